@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace NEngine {
+
+enum class ArchiveCompression : uint32_t
+{
+    None,
+    // Independent LZ4 blocks of ARCHIVE_CHUNK_SIZE bytes each.
+    LZ4,
+};
+
+// Uncompressed size of every chunk of a compressed entry but the last.
+inline constexpr uint32_t ARCHIVE_CHUNK_SIZE = 64 * 1024;
+// Entries start on page boundaries, so uncompressed ones can be mapped and
+// handed out as they are.
+inline constexpr uint64_t ARCHIVE_ALIGNMENT = 4096;
+
+// One record of the table of contents, sorted by pathHash.
+struct ArchiveEntry
+{
+    uint64_t pathHash;
+    uint64_t offset;
+    uint64_t storedSize;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    ArchiveCompression compression;
+    // Compressed entries start with chunkCount + 1 offsets of their chunks
+    // from the start of the entry; a chunk whose stored size equals its
+    // uncompressed size did not compress and is stored as is.
+    uint32_t chunkCount;
+};
+
+struct ArchiveSource
+{
+    // Path the entry is looked up by, with forward slashes.
+    std::string name;
+    std::string path;
+    ArchiveCompression compression = ArchiveCompression::None;
+};
+
+// Packs `sources` into one archive file. Entries that compression would not
+// shrink are stored uncompressed.
+void write_asset_archive(const std::string &path,
+                         std::span<const ArchiveSource> sources);
+
+// Read-only view of an archive. The whole file is mapped, so opening an
+// entry costs a table of contents lookup instead of a system call.
+class AssetArchive
+{
+public:
+    explicit AssetArchive(const std::string &path);
+    AssetArchive(const AssetArchive &) = delete;
+    AssetArchive &operator=(const AssetArchive &) = delete;
+
+    [[nodiscard]] const ArchiveEntry *Find(std::string_view name) const;
+    [[nodiscard]] std::span<const ArchiveEntry> GetEntries() const;
+    [[nodiscard]] std::string_view GetName(const ArchiveEntry &entry) const;
+    // Contents of an uncompressed entry inside the mapping, empty for
+    // compressed ones.
+    [[nodiscard]] std::span<const uint8_t> GetMappedData(
+        const ArchiveEntry &entry) const;
+    // Copies bytes [offset, offset + out.size()) of the entry's contents
+    // into `out`. Only the chunks overlapping the range are decompressed,
+    // and those it covers completely are decompressed straight into `out`.
+    void Read(const ArchiveEntry &entry,
+              uint64_t offset,
+              std::span<uint8_t> out) const;
+    // Contents of an entry from its stored bytes, such as those read
+    // asynchronously from GetPath() at entry.offset.
+    [[nodiscard]] static std::vector<uint8_t> Decode(
+        const ArchiveEntry &entry,
+        std::span<const uint8_t> stored);
+    [[nodiscard]] const std::string &GetPath() const;
+
+private:
+    std::string m_path;
+    MappedFile m_file;
+    std::span<const ArchiveEntry> m_entries;
+    std::string_view m_names;
+};
+}  // namespace NEngine
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace NEngine {
+
+// 64 bit hash of `data`. Not cryptographic, but every input bit affects
+// every output bit, which is all a cache key needs.
+uint64_t hash_bytes(std::span<const uint8_t> data, uint64_t seed = 0);
+
+// Key of an asset cooked from the file at `sourcePath`. It changes whenever
+// the contents of the file, the version of the code that cooks it or the
+// settings it is cooked with change; the path itself is not part of it.
+uint64_t get_asset_key(const std::string &sourcePath,
+                       uint32_t cookerVersion,
+                       std::string_view settings);
+
+struct AssetCacheStats
+{
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    uint32_t entryCount = 0;
+    uint64_t bytesUsed = 0;
+    uint64_t bytesLimit = 0;
+};
+
+// Derived data cache: cooked assets stored in a directory under the key of
+// their source, so that later runs skip the importers entirely. Entries are
+// evicted least recently used first once their total size passes the limit;
+// the last use is kept in the file's modification time, so the order
+// survives restarts. Thread-safe; cooks run without holding the lock, so
+// different assets cook concurrently.
+class AssetCache
+{
+public:
+    // Writes the cooked asset to the file at the given path.
+    using CookFunction = std::function<void(const std::string &path)>;
+
+    static constexpr uint64_t DEFAULT_MAX_BYTES = 1ull << 30;
+
+    explicit AssetCache(const std::string &directory,
+                        uint64_t maxBytes = DEFAULT_MAX_BYTES);
+    AssetCache(const AssetCache &) = delete;
+    AssetCache &operator=(const AssetCache &) = delete;
+
+    // Path of the entry for `key`. On a miss `cook` is called to create it;
+    // it writes to a temporary file that is only moved into place when it
+    // returns, so an interrupted cook never leaves a broken entry behind.
+    std::string Get(uint64_t key,
+                    std::string_view extension,
+                    const CookFunction &cook);
+    [[nodiscard]] AssetCacheStats GetStats() const;
+
+private:
+    struct Entry
+    {
+        uint64_t size = 0;
+        std::filesystem::file_time_type lastUse;
+    };
+
+    // Removes least recently used entries other than `keep` until the cache
+    // fits its limit. Call with m_mutex held.
+    void Evict(const std::string &keep);
+
+    std::filesystem::path m_directory;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    AssetCacheStats m_stats;
+    // Numbers temporary files, so that concurrent cooks of one key do not
+    // write to the same file.
+    uint64_t m_nextTemporary = 0;
+};
+}  // namespace NEngine
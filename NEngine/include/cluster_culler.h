@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+#include "gpu_allocator.h"
+#include "mesh_file.h"
+#include "upload_service.h"
+
+namespace NEngine {
+
+// Culls the meshlets of one mesh with a compute shader and draws the
+// survivors with a single vkCmdDrawIndexedIndirectCount, one draw command
+// per visible meshlet. Needs no mesh shaders, only the drawIndirectCount and
+// multiDrawIndirect features.
+class ClusterCuller
+{
+public:
+    ClusterCuller(VkDevice device,
+                  GpuAllocator &allocator,
+                  const std::vector<char> &shaderCode,
+                  uint32_t meshletCount);
+    ClusterCuller(const ClusterCuller &) = delete;
+    ClusterCuller &operator=(const ClusterCuller &) = delete;
+    ~ClusterCuller();
+    // The GPU must no longer use the culler.
+    void Cleanup();
+
+    // Copies the meshlet table on `transferUploads` and hands it over to
+    // `graphicsUploads`, which must also run the culling pass.
+    void Upload(UploadService &transferUploads,
+                UploadService &graphicsUploads,
+                std::span<const Meshlet> meshlets);
+
+    // Records the culling dispatch for `meshletCount` meshlets starting at
+    // `firstMeshlet`, e.g. those of one level of detail, of a mesh drawn
+    // with `model`, `view` and `proj`. Must be recorded outside of a render
+    // pass; the draw commands are visible to indirect draws afterwards.
+    void Record(VkCommandBuffer cb,
+                uint32_t firstMeshlet,
+                uint32_t meshletCount,
+                const glm::mat4 &model,
+                const glm::mat4 &view,
+                const glm::mat4 &proj,
+                bool coneCulling) const;
+    // Draws the meshlets that survived the last Record with the bound
+    // graphics pipeline, vertex buffers and index buffer.
+    void Draw(VkCommandBuffer cb) const;
+
+    [[nodiscard]] uint32_t GetMeshletCount() const;
+
+private:
+    void CreateBuffer(VkDeviceSize size,
+                      VkBufferUsageFlags usage,
+                      VkBuffer &buffer,
+                      GpuAllocation &memory) const;
+
+    VkDevice m_device{};
+    GpuAllocator *m_allocator{};
+    uint32_t m_meshletCount = 0;
+    VkDescriptorSetLayout m_descriptorSetLayout{};
+    VkPipelineLayout m_pipelineLayout{};
+    VkPipeline m_pipeline{};
+    VkDescriptorPool m_descriptorPool{};
+    VkDescriptorSet m_descriptorSet{};
+    VkBuffer m_meshletBuffer{};
+    GpuAllocation m_meshletMemory{};
+    VkBuffer m_drawBuffer{};
+    GpuAllocation m_drawMemory{};
+    VkBuffer m_countBuffer{};
+    GpuAllocation m_countMemory{};
+};
+}  // namespace NEngine
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "gpu_allocator.h"
+#include "image.h"
+#include "render_graph.h"
+#include "upload_service.h"
+
+namespace NEngine {
+
+// Hierarchical depth buffer for occlusion culling. Level 0 is the largest
+// power of two size that fits the depth buffer and every texel of a level
+// holds the farthest depth of the pixels it covers, so a box whose nearest
+// depth lies behind the texels its screen rectangle touches is hidden. Built
+// by a compute shader that reads every sample of the multisampled depth
+// buffer, one dispatch per level, in a pass of the frame's render graph.
+class DepthPyramid
+{
+public:
+    DepthPyramid(VkDevice device,
+                 GpuAllocator &allocator,
+                 const std::vector<char> &shaderCode);
+    DepthPyramid(const DepthPyramid &) = delete;
+    DepthPyramid &operator=(const DepthPyramid &) = delete;
+    ~DepthPyramid();
+    // The GPU must no longer use the pyramid.
+    void Cleanup();
+
+    // Recreates the pyramid for a multisampled depth buffer of `extent`
+    // and records moving its levels to GENERAL, where they stay, into the
+    // batch of `uploads`. The GPU must no longer use the previous pyramid.
+    void Resize(UploadService &uploads,
+                VkExtent2D extent,
+                VkSampleCountFlagBits samples);
+
+    // Adds the pass building the pyramid from `depth` to `graph` and
+    // returns the pyramid, for the passes that read it to declare.
+    RenderGraphImage AddPass(RenderGraph &graph, RenderGraphImage depth);
+
+    // View of every level, for texelFetch with an explicit level.
+    [[nodiscard]] VkImageView GetView() const;
+    [[nodiscard]] VkSampler GetSampler() const;
+
+private:
+    void DestroyImage();
+    // Points the dispatch of level 0 at the depth buffer.
+    void WriteDepthView(VkImageView depthView) const;
+    void Record(VkCommandBuffer cb) const;
+
+    VkDevice m_device{};
+    GpuAllocator *m_allocator{};
+    VkDescriptorSetLayout m_descriptorSetLayout{};
+    VkPipelineLayout m_pipelineLayout{};
+    VkPipeline m_pipeline{};
+    VkSampler m_sampler{};
+
+    std::unique_ptr<Image> m_image;
+    // One per level, written by the dispatch that builds it.
+    std::vector<VkImageView> m_levelViews;
+    VkDescriptorPool m_descriptorPool{};
+    std::vector<VkDescriptorSet> m_descriptorSets;
+    VkExtent2D m_depthExtent{};
+    uint32_t m_sampleCount = 1;
+    // Version of the render graph whose depth buffer level 0 reads, 0 when
+    // it reads none yet.
+    uint64_t m_graphVersion = 0;
+};
+}  // namespace NEngine
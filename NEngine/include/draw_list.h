@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace NEngine {
+
+// Data of one instance as the vertex shader reads it, laid out as std430.
+struct InstanceData
+{
+    glm::mat4 model{1.0f};
+    uint32_t material = 0;
+    uint32_t padding[3] = {};
+};
+static_assert(sizeof(InstanceData) == 80, "Must match phong_vs.vert");
+
+// Instances that share a mesh, level of detail and material, which are
+// drawn together with one instanced draw per submesh. Their data is the
+// range [firstInstance, firstInstance + instanceCount) of the list's
+// instances, which the vertex shader indexes with gl_InstanceIndex.
+struct DrawGroup
+{
+    uint32_t mesh = 0;
+    uint32_t lod = 0;
+    uint32_t material = 0;
+    uint32_t firstInstance = 0;
+    uint32_t instanceCount = 0;
+};
+
+// The instances drawn in a frame, sorted into groups so that every group's
+// instance data is contiguous. Buffers are kept between frames.
+class DrawList
+{
+public:
+    void Clear();
+    void Add(uint32_t mesh,
+             uint32_t lod,
+             uint32_t material,
+             const glm::mat4 &model);
+    // Sorts the instances added since Clear into groups, ordered by mesh,
+    // level of detail and material, and instances within a group in the
+    // order they were added.
+    void Build();
+
+    [[nodiscard]] std::span<const InstanceData> GetInstances() const;
+    [[nodiscard]] std::span<const DrawGroup> GetGroups() const;
+
+private:
+    struct Entry
+    {
+        uint64_t key = 0;
+        uint32_t index = 0;
+    };
+
+    std::vector<Entry> m_entries;
+    std::vector<InstanceData> m_added;
+    std::vector<InstanceData> m_instances;
+    std::vector<DrawGroup> m_groups;
+};
+}  // namespace NEngine
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <imgui.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace NEngine {
+
+struct CameraState
+{
+    glm::mat4 view{1.0f};
+    glm::vec3 position{0.0f};
+};
+
+// An object of the scene, drawn with the mesh and material of the given
+// indices.
+struct DrawItem
+{
+    glm::mat4 model{1.0f};
+    uint32_t mesh = 0;
+    uint32_t material = 0;
+};
+
+// Copy of the draw data ImGui produced for a frame, which stays valid while
+// the game thread builds the next one. ImGui counts its allocations in the
+// context without locking, so copies are made and freed on the thread that
+// runs ImGui.
+class UiDrawData
+{
+public:
+    UiDrawData() = default;
+    UiDrawData(const UiDrawData &) = delete;
+    UiDrawData &operator=(const UiDrawData &) = delete;
+    ~UiDrawData();
+
+    void Capture(const ImDrawData &drawData);
+    // The Vulkan backend takes a non-const pointer but only reads it.
+    [[nodiscard]] ImDrawData *Get() const;
+
+private:
+    void Clear();
+
+    mutable ImDrawData m_drawData;
+    std::vector<ImDrawList *> m_drawLists;
+};
+
+// Everything the render thread needs to draw a frame, written by the game
+// thread and not changed while it is rendered.
+struct FramePacket
+{
+    CameraState camera;
+    // Shared by the packets until the game thread changes the scene, so
+    // that the renderer only has to look at the items when they change.
+    // Never null.
+    std::shared_ptr<const std::vector<DrawItem>> drawList;
+    UiDrawData ui;
+    // Set when the window was resized since the previous packet.
+    bool windowResized = false;
+};
+
+// Packets handed from the game thread to the render thread in order. While
+// one packet is rendered the next can be queued and a third written, so the
+// game thread simulates a frame ahead of the one being submitted and only
+// blocks when it gets further ahead than that.
+class FramePacketQueue
+{
+public:
+    static constexpr uint32_t PACKET_COUNT = 3;
+
+    FramePacketQueue() = default;
+    FramePacketQueue(const FramePacketQueue &) = delete;
+    FramePacketQueue &operator=(const FramePacketQueue &) = delete;
+
+    // Game thread. Blocks until a packet is free and returns it for writing,
+    // or null once the queue is closed. Its previous contents are left in
+    // place, so buffers are reused.
+    [[nodiscard]] FramePacket *BeginWrite();
+    // Queues the packet returned by the last BeginWrite.
+    void Publish();
+
+    // Render thread. Blocks until a packet is queued and returns the oldest,
+    // or null once the queue is closed.
+    [[nodiscard]] const FramePacket *Acquire();
+    // Frees the packet returned by the last Acquire for writing.
+    void Release();
+
+    // Wakes both threads and makes every later call return null.
+    void Close();
+
+private:
+    std::array<FramePacket, PACKET_COUNT> m_packets;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    // Packets ever published, acquired and released. Packet n lives in slot
+    // n % PACKET_COUNT.
+    uint64_t m_published = 0;
+    uint64_t m_acquired = 0;
+    uint64_t m_released = 0;
+    bool m_closed = false;
+};
+}  // namespace NEngine
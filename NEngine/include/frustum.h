@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+// Gribb-Hartmann plane extraction for Vulkan's 0..1 depth range. Planes of
+// the combined matrix come out in the space the matrix starts from, facing
+// inwards.
+void extract_frustum_planes(const glm::mat4 &m, glm::vec4 (&planes)[6]);
+
+// Whether `bounds` is not entirely behind one of the planes. Boxes near a
+// corner of the frustum may pass without touching it.
+bool is_box_visible(const glm::vec4 (&planes)[6], const MeshBounds &bounds);
+
+// Smallest box that contains `bounds` transformed by the affine matrix `m`.
+MeshBounds transform_bounds(const glm::mat4 &m, const MeshBounds &bounds);
+}  // namespace NEngine
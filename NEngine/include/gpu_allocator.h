@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <vector>
+
+namespace NEngine {
+
+struct GpuAllocation
+{
+    VkDeviceMemory memory{};
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryType = 0;
+    uint32_t blockId = 0;
+    // Non-null when the allocation lives in host visible memory. Blocks are
+    // persistently mapped, so callers must not call vkMapMemory on them.
+    void *mapped = nullptr;
+};
+
+struct GpuAllocatorStats
+{
+    uint32_t blockCount = 0;
+    uint32_t dedicatedBlockCount = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeRangeCount = 0;
+    VkDeviceSize bytesReserved = 0;
+    VkDeviceSize bytesUsed = 0;
+    VkDeviceSize largestFreeRange = 0;
+
+    // 0 when all free space is one contiguous range, approaching 1 when free
+    // space is scattered across many small holes.
+    [[nodiscard]] float
+    Fragmentation() const
+    {
+        const VkDeviceSize bytes_free = bytesReserved - bytesUsed;
+        if (bytes_free == 0) {
+            return 0.0f;
+        }
+        return 1.0f - static_cast<float>(largestFreeRange) /
+                          static_cast<float>(bytes_free);
+    }
+};
+
+// Reserves large VkDeviceMemory blocks per memory type and hands out aligned
+// sub-ranges of them, so buffers and images do not each cost a
+// vkAllocateMemory call.
+class GpuAllocator
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    GpuAllocator(VkDevice device,
+                 VkPhysicalDevice physicalDevice,
+                 VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+    GpuAllocator(const GpuAllocator &) = delete;
+    GpuAllocator &operator=(const GpuAllocator &) = delete;
+    ~GpuAllocator();
+    void Cleanup();
+
+    [[nodiscard]] GpuAllocation Allocate(
+        const VkMemoryRequirements &requirements,
+        VkMemoryPropertyFlags properties);
+    void Free(const GpuAllocation &allocation);
+
+    [[nodiscard]] GpuAllocatorStats GetStats() const;
+    [[nodiscard]] const VkPhysicalDeviceMemoryProperties &
+    GetMemoryProperties() const;
+
+private:
+    struct Range
+    {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    struct Block
+    {
+        VkDeviceMemory memory{};
+        VkDeviceSize size = 0;
+        VkDeviceSize used = 0;
+        void *mapped = nullptr;
+        uint32_t id = 0;
+        uint32_t allocationCount = 0;
+        bool dedicated = false;
+        // Sorted by offset so neighbours can be merged on free.
+        std::vector<Range> freeRanges;
+    };
+
+    Block &CreateBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated);
+    void DestroyBlock(Block &block) const;
+    static bool TryAllocateFromBlock(Block &block,
+                                     VkDeviceSize size,
+                                     VkDeviceSize alignment,
+                                     VkDeviceSize &offset);
+
+    VkDevice m_device{};
+    VkDeviceSize m_blockSize = 0;
+    VkDeviceSize m_bufferImageGranularity = 1;
+    uint32_t m_nextBlockId = 0;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+    std::array<std::vector<Block>, VK_MAX_MEMORY_TYPES> m_blocks;
+};
+}  // namespace NEngine
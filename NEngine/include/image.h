@@ -2,6 +2,8 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include "gpu_allocator.h"
+
 namespace NEngine {
 
 struct ImageCreateInfo
@@ -14,6 +16,7 @@ struct ImageCreateInfo
     VkImageTiling tiling;
     VkImageUsageFlags usage;
     VkMemoryPropertyFlags properties;
+    VkImageCreateFlags flags;
 };
 
 class Image
@@ -21,7 +24,7 @@ class Image
 public:
     Image(const ImageCreateInfo &createInfo,
           VkDevice device,
-          VkPhysicalDevice physicalDevice);
+          GpuAllocator &allocator);
     ~Image();
     void Cleanup();
 
@@ -29,12 +32,23 @@ public:
 
     VkImage GetImage() const;
     VkImageView GetImageView() const;
+    VkFormat GetFormat() const;
+    VkImageUsageFlags GetUsage() const;
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+    uint32_t GetMipLevels() const;
 
 private:
     VkImage m_image{};
-    VkDeviceMemory m_imageMemory{};
+    GpuAllocation m_imageMemory{};
+    GpuAllocator *m_allocator{};
     VkImageView m_imageView{};
     VkDevice m_device{};
     VkFormat m_format;
+    VkImageUsageFlags m_usage = 0;
+    VkImageCreateFlags m_flags = 0;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_mipLevels = 1;
 };
 }  // namespace NEngine
\ No newline at end of file
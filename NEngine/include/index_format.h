@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+// Number of vertices a submesh can address with 16 bit indices relative to
+// its vertex offset.
+static constexpr uint32_t MAX_16BIT_VERTICES = 65536;
+
+// Index buffer contents as uploaded to the GPU, together with the submeshes
+// rebased onto it.
+struct IndexBufferData
+{
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t indexCount = 0;
+    std::vector<uint8_t> indices;
+    // Same ranges as the mesh's submeshes and meshlets, with `vertexOffset`
+    // set.
+    std::vector<Submesh> submeshes;
+    std::vector<Meshlet> meshlets;
+};
+
+uint32_t get_index_size(VkIndexType indexType);
+
+// Picks 16 bit indices when every submesh references fewer than 65,536
+// consecutive vertices. Indices are then stored relative to the first
+// vertex the submesh uses, which becomes its vertex offset.
+IndexBufferData encode_index_buffer(const MeshData &mesh);
+
+// Splits submeshes that reference more vertices than 16 bit indices can
+// address, duplicating the vertices shared between the pieces. Vertices are
+// reordered so that every piece uses a consecutive range. Meshlets are kept
+// whole, and levels of detail cover the pieces of their submeshes.
+void split_for_16bit_indices(MeshData &mesh);
+}  // namespace NEngine
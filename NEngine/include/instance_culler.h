@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "depth_pyramid.h"
+#include "draw_list.h"
+#include "gpu_allocator.h"
+#include "image.h"
+#include "mesh_file.h"
+#include "upload_service.h"
+
+namespace NEngine {
+
+// Two phases of culling in a frame. Early draws the objects that were
+// visible in the previous frame; Late, recorded after the depth pyramid was
+// built from what Early drew, draws the objects that became visible.
+// Without a depth pyramid only Early is recorded, and it draws every object
+// in the frustum.
+enum class CullPhase : uint32_t
+{
+    Early,
+    Late,
+};
+
+// Draws every object of a scene with one mesh without the CPU touching the
+// objects per frame. Their instance data and bounds are uploaded once; every
+// frame a compute shader culls them against the frustum and, if there is
+// one, the depth pyramid, picks their levels of detail and writes one draw
+// command per submesh of every survivor, which a single
+// vkCmdDrawIndexedIndirectCount per phase draws. Needs the
+// drawIndirectCount and multiDrawIndirect features.
+class InstanceCuller
+{
+public:
+    InstanceCuller(VkDevice device,
+                   GpuAllocator &allocator,
+                   const std::vector<char> &shaderCode,
+                   const DepthPyramid *depthPyramid);
+    InstanceCuller(const InstanceCuller &) = delete;
+    InstanceCuller &operator=(const InstanceCuller &) = delete;
+    ~InstanceCuller();
+    // The GPU must no longer use the culler.
+    void Cleanup();
+
+    // Uploads the levels of detail of the mesh the objects are drawn with,
+    // and without a depth pyramid the image that stands in for it. Called
+    // once, before SetObjects.
+    void SetMesh(UploadService &uploads,
+                 std::span<const MeshLod> lods,
+                 std::span<const Submesh> submeshes,
+                 const MeshBounds &bounds);
+    // Replaces the objects, which start out as hidden. The GPU must no
+    // longer use the previous ones, and the buffer GetInstanceBuffer returns
+    // changes.
+    void SetObjects(UploadService &uploads,
+                    std::span<const InstanceData> objects);
+    // Points the culler at the depth pyramid's image after it was resized.
+    // The GPU must no longer use the culler.
+    void UpdateDepthPyramid();
+
+    // Records the culling dispatch of `phase` for the camera given by
+    // `view` and `proj`. Must be recorded outside of a render pass, Early
+    // before Late in every frame; the draw commands are visible to indirect
+    // draws afterwards.
+    void Record(VkCommandBuffer cb,
+                CullPhase phase,
+                const glm::mat4 &view,
+                const glm::mat4 &proj,
+                float viewportHeight) const;
+    // Draws the objects that the Record of `phase` let through with the
+    // bound graphics pipeline, vertex buffers and index buffer.
+    void Draw(VkCommandBuffer cb, CullPhase phase) const;
+
+    // Instance data of the objects, indexed by gl_InstanceIndex.
+    [[nodiscard]] VkBuffer GetInstanceBuffer() const;
+    [[nodiscard]] uint32_t GetObjectCount() const;
+
+private:
+    void CreateBuffer(VkDeviceSize size,
+                      VkBufferUsageFlags usage,
+                      VkBuffer &buffer,
+                      GpuAllocation &memory) const;
+    void CreateStandInPyramid(UploadService &uploads);
+    void DestroyObjectBuffers();
+    void WriteDescriptorSet() const;
+
+    [[nodiscard]] uint32_t GetMaxDrawCount() const;
+
+    VkDevice m_device{};
+    GpuAllocator *m_allocator{};
+    // Null when culling against the frustum only, in which case the shader
+    // never reads the 1x1 stand-in bound in the pyramid's place.
+    const DepthPyramid *m_depthPyramid{};
+    std::unique_ptr<Image> m_standInPyramid;
+    VkSampler m_standInSampler{};
+    VkDescriptorSetLayout m_descriptorSetLayout{};
+    VkPipelineLayout m_pipelineLayout{};
+    VkPipeline m_pipeline{};
+    VkDescriptorPool m_descriptorPool{};
+    VkDescriptorSet m_descriptorSet{};
+
+    uint32_t m_lodCount = 0;
+    // Most submeshes of any level, hence draw commands of any object.
+    uint32_t m_maxCommandsPerObject = 0;
+    // Bounding sphere of the mesh, in mesh units.
+    glm::vec3 m_meshCenter{0.0f};
+    float m_meshRadius = 0.0f;
+    VkBuffer m_lodBuffer{};
+    GpuAllocation m_lodMemory{};
+    VkBuffer m_templateBuffer{};
+    GpuAllocation m_templateMemory{};
+
+    uint32_t m_objectCount = 0;
+    VkBuffer m_instanceBuffer{};
+    GpuAllocation m_instanceMemory{};
+    VkBuffer m_boundsBuffer{};
+    GpuAllocation m_boundsMemory{};
+    VkBuffer m_visibilityBuffer{};
+    GpuAllocation m_visibilityMemory{};
+    // Commands of the early phase, then those of the late one.
+    VkBuffer m_drawBuffer{};
+    GpuAllocation m_drawMemory{};
+    // One count per phase.
+    VkBuffer m_countBuffer{};
+    GpuAllocation m_countMemory{};
+};
+}  // namespace NEngine
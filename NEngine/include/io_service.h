@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NEngine {
+
+// Size of a read that runs to the end of the file.
+inline constexpr uint64_t READ_TO_END = UINT64_MAX;
+
+struct IoRequest
+{
+    std::string path;
+    uint64_t offset = 0;
+    // Reads are cut short at the end of the file.
+    uint64_t size = READ_TO_END;
+    // Called once with the bytes read, or with the error that failed the
+    // read and no bytes. Must not throw.
+    std::function<void(std::vector<uint8_t> data, std::exception_ptr error)>
+        onComplete;
+};
+
+class IoBackend;
+
+// Asynchronous file reads, so that loading many files overlaps their disk
+// latencies instead of adding them up. On Linux the reads of a batch are
+// queued on an io_uring and submitted with one system call; elsewhere, or
+// when the kernel refuses io_uring, a pool of threads issues blocking reads.
+//
+// Completion callbacks run on an I/O thread and should hand expensive work
+// off rather than stall the reads queued behind them. Files that fail to
+// open and empty reads complete before Submit returns.
+class IoService
+{
+public:
+    static constexpr uint32_t DEFAULT_QUEUE_DEPTH = 64;
+
+    explicit IoService(uint32_t queueDepth = DEFAULT_QUEUE_DEPTH);
+    IoService(const IoService &) = delete;
+    IoService &operator=(const IoService &) = delete;
+    // Waits for the reads in flight.
+    ~IoService();
+
+    // Queues a batch of reads. Reads beyond the queue depth wait for earlier
+    // ones to complete; Submit itself does not.
+    void Submit(std::vector<IoRequest> requests);
+    [[nodiscard]] std::future<std::vector<uint8_t>> Read(
+        const std::string &path,
+        uint64_t offset = 0,
+        uint64_t size = READ_TO_END);
+    // Blocks until every submitted read has completed.
+    void WaitIdle();
+
+    [[nodiscard]] bool UsesIoUring() const;
+
+private:
+    std::unique_ptr<IoBackend> m_backend;
+};
+}  // namespace NEngine
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace NEngine {
+
+struct Job;
+
+// Number of jobs that have not finished yet. Jobs are added to a counter
+// when they are submitted, and other jobs can be held back until it drops to
+// zero. Reuse a counter only after waiting for it.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    [[nodiscard]] bool IsDone() const;
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> m_pending{0};
+    std::mutex m_mutex;
+    // Jobs submitted with this counter as their dependency.
+    std::vector<Job *> m_dependents;
+    // First exception thrown by one of the jobs.
+    std::exception_ptr m_error;
+};
+
+// Runs jobs on a fixed set of worker threads. Every worker owns a Chase-Lev
+// deque: it pushes and pops jobs it submits at the bottom without locking,
+// and idle workers steal from the top of the others'. Jobs submitted by
+// other threads go through a shared queue.
+//
+// Threads that wait for a counter run jobs until it drops to zero, so jobs
+// can submit and wait for jobs of their own.
+class JobSystem
+{
+public:
+    // One less than there are hardware threads, since a waiting thread
+    // takes part.
+    static uint32_t GetDefaultWorkerCount();
+
+    explicit JobSystem(uint32_t workerCount = GetDefaultWorkerCount());
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+    // Runs the jobs still queued and stops the workers.
+    ~JobSystem();
+
+    // Queues `job`. It is added to `counter` when one is given, and when
+    // `dependency` is given it only starts once that counter drops to zero.
+    void Run(std::function<void()> job,
+             JobCounter *counter = nullptr,
+             JobCounter *dependency = nullptr);
+    // Runs queued jobs until `counter` drops to zero, then rethrows the first
+    // exception that one of its jobs threw.
+    void Wait(JobCounter &counter);
+    // Workers plus the thread that waits.
+    [[nodiscard]] uint32_t GetThreadCount() const;
+
+private:
+    struct Worker;
+
+    [[nodiscard]] Worker *GetCurrentWorker();
+    void Push(Job *job);
+    [[nodiscard]] Job *FindJob();
+    void Execute(Job *job);
+    void RunWorker(uint32_t index);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::mutex m_queueMutex;
+    std::deque<Job *> m_queue;
+    // Jobs pushed and not yet taken, which idle workers sleep without.
+    std::atomic<uint32_t> m_queuedJobs{0};
+    std::atomic<uint32_t> m_sleepingWorkers{0};
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+};
+
+// The engine's job system, started on first use.
+JobSystem &get_job_system();
+
+// Ranges parallel_for splits work into per thread, so that threads whose
+// ranges happen to be cheap steal the rest.
+inline constexpr size_t JOBS_PER_THREAD = 4;
+
+// Number of parts to split `count` items into so that each gets at least
+// `minPerJob`, at most one per thread of the job system.
+inline size_t
+get_job_count(size_t count, size_t minPerJob)
+{
+    return std::clamp<size_t>(count / std::max<size_t>(minPerJob, 1),
+                              1,
+                              get_job_system().GetThreadCount());
+}
+
+// Runs `task(i)` for every i in [0, count) as a job, waits for them and
+// rethrows the first exception.
+template <typename Task>
+void
+run_parallel(size_t count, const Task &task)
+{
+    if (count == 1) {
+        task(0);
+        return;
+    }
+    JobSystem &jobs = get_job_system();
+    JobCounter counter;
+    for (size_t i = 0; i < count; ++i) {
+        jobs.Run([&task, i] { task(i); }, &counter);
+    }
+    jobs.Wait(counter);
+}
+
+// Runs `body(begin, end)` on consecutive ranges of [0, count) as jobs, with
+// at least `minPerJob` items in every range but the last, and waits for
+// them.
+template <typename Body>
+void
+parallel_for(size_t count, size_t minPerJob, const Body &body)
+{
+    if (count == 0) {
+        return;
+    }
+    const size_t job_count = std::clamp<size_t>(
+        count / std::max<size_t>(minPerJob, 1),
+        1,
+        get_job_system().GetThreadCount() * JOBS_PER_THREAD);
+    const size_t per_job = (count + job_count - 1) / job_count;
+    run_parallel((count + per_job - 1) / per_job, [&](size_t i) {
+        const size_t begin = i * per_job;
+        body(begin, std::min(begin + per_job, count));
+    });
+}
+}  // namespace NEngine
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace NEngine {
+
+// Compresses `data` into one block of the LZ4 block format, readable by any
+// LZ4 decoder. Uses a single greedy pass over a hash table of 4 byte
+// sequences, trading ratio for speed like LZ4's default level.
+std::vector<uint8_t> lz4_compress(std::span<const uint8_t> data);
+
+// Decompresses one LZ4 block into `out`, which must be exactly the size of
+// the original data. Throws when the block is malformed or does not fill
+// `out`, so corrupt input never writes outside it.
+void lz4_decompress(std::span<const uint8_t> block, std::span<uint8_t> out);
+}  // namespace NEngine
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace NEngine {
+
+// Read-only view of a whole file mapped into the address space. Pages are
+// faulted in by the OS on first access, so nothing is read up front.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path);
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    [[nodiscard]] const uint8_t *GetData() const;
+    [[nodiscard]] size_t GetSize() const;
+
+private:
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
+
+// Contents of a file, valid for as long as this object. They are either
+// mapped by it, owned by it, such as decompressed data, or borrowed from a
+// mapping that outlives it, such as an archive's.
+class FileData
+{
+public:
+    FileData() = default;
+
+    static FileData Map(const std::string &path);
+    static FileData Own(std::vector<uint8_t> bytes);
+    static FileData Borrow(std::span<const uint8_t> data);
+
+    [[nodiscard]] std::span<const uint8_t> GetData() const;
+
+private:
+    std::unique_ptr<MappedFile> m_file;
+    std::vector<uint8_t> m_bytes;
+    std::span<const uint8_t> m_data;
+};
+}  // namespace NEngine
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "vertex.h"
+#include "vertex_format.h"
+
+namespace NEngine {
+
+struct MeshBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// A range of the index buffer drawn with one material. Its indices are
+// relative to `vertexOffset`, which lets 16 bit indices address submeshes of
+// meshes with more than 65,536 vertices.
+struct Submesh
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t vertexOffset;
+    MeshBounds bounds;
+};
+
+// A cluster of at most 64 vertices and 124 triangles that is culled as a
+// whole, by its bounding sphere against the frustum and by its normal cone
+// against the view direction. Its triangles are a range of the index buffer
+// inside one submesh. Laid out as the culling shader reads it.
+struct Meshlet
+{
+    glm::vec3 center;
+    float radius;
+    // All triangles face away from a camera at `p` when
+    // dot(normalize(coneApex - p), coneAxis) >= coneCutoff. The cutoff is
+    // above 1 when they face too many directions to be culled this way.
+    glm::vec3 coneApex;
+    float coneCutoff;
+    glm::vec3 coneAxis;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Copied from the submesh that contains the meshlet.
+    uint32_t vertexOffset;
+    uint32_t reserved[2];
+};
+
+// One level of detail: a range of submeshes that together draw the whole
+// mesh, and the meshlets that cover them. Level 0 is the imported mesh.
+struct MeshLod
+{
+    uint32_t firstSubmesh;
+    uint32_t submeshCount;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    // Distance between this level's surface and level 0's, in mesh units,
+    // as estimated by the simplifier's quadrics. Never decreases from one
+    // level to the next.
+    float error;
+};
+
+// A mesh as imported: welded full precision vertices, a triangle list and
+// the submeshes that partition it. The indices are absolute, so every
+// vertex offset is zero until the index buffer is encoded.
+struct MeshData
+{
+    std::vector<vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Submesh> submeshes;
+    // Empty until build_meshlets runs.
+    std::vector<Meshlet> meshlets;
+    // Empty until generate_lods runs, which means a single level made of
+    // all submeshes.
+    std::vector<MeshLod> lods;
+    MeshBounds bounds{};
+};
+
+MeshBounds compute_bounds(std::span<const vertex> vertices,
+                          std::span<const uint32_t> indices);
+
+// Encodes the vertices of `mesh` with `layout` and writes them, the indices,
+// the submeshes, the meshlets and the levels of detail in the binary mesh
+// format read by MeshFile.
+// Indices are stored as 16 bit values whenever the submeshes allow it.
+void write_mesh_file(const std::string &path,
+                     const MeshData &mesh,
+                     const VertexLayout &layout);
+
+// A cooked mesh mapped from disk or from an archive. The vertex streams and
+// indices point straight into the file's contents and are laid out exactly
+// as the GPU buffers expect, so loading only validates the header and the
+// table offsets.
+class MeshFile
+{
+public:
+    // Bumped whenever the header, the submesh table or a vertex stream
+    // encoding changes.
+    static constexpr uint32_t VERSION = 6;
+
+    explicit MeshFile(const std::string &path);
+    // `name` is only used in error messages.
+    MeshFile(FileData data, const std::string &name);
+
+    [[nodiscard]] VertexStreamsView GetVertexStreams() const;
+    [[nodiscard]] VkIndexType GetIndexType() const;
+    [[nodiscard]] uint32_t GetIndexCount() const;
+    [[nodiscard]] std::span<const uint8_t> GetIndexData() const;
+    [[nodiscard]] std::span<const Submesh> GetSubmeshes() const;
+    [[nodiscard]] std::span<const Meshlet> GetMeshlets() const;
+    // At least one level.
+    [[nodiscard]] std::span<const MeshLod> GetLods() const;
+    [[nodiscard]] const MeshBounds &GetBounds() const;
+
+private:
+    FileData m_file;
+    VkIndexType m_indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t m_indexCount = 0;
+    std::span<const uint8_t> m_indexData;
+    std::span<const Submesh> m_submeshes;
+    std::span<const Meshlet> m_meshlets;
+    std::span<const MeshLod> m_lods;
+    MeshBounds m_bounds{};
+    VertexStreamsView m_vertexStreams;
+};
+}  // namespace NEngine
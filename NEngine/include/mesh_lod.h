@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+static constexpr uint32_t MAX_MESH_LODS = 8;
+
+struct SimplifiedLevel
+{
+    std::vector<uint32_t> indices;
+    // Largest quadric error of any collapse so far, an estimate of the
+    // distance between the simplified and the original surface in mesh
+    // units.
+    float error = 0.0f;
+};
+
+// Collapses edges of the triangle list `indices` in order of their quadric
+// error and saves a level whenever the index count drops to the next of
+// `targetIndexCounts`, which must be descending. Levels reference the
+// original vertices. Vertices that share a position but differ in their
+// other attributes only collapse along their seam, and open borders only
+// along themselves, so UV and normal seams and silhouettes keep their shape.
+// Levels the simplifier cannot reach repeat the last one it reached.
+std::vector<SimplifiedLevel> simplify_mesh(
+    std::span<const uint32_t> indices,
+    std::span<const vertex> vertices,
+    std::span<const size_t> targetIndexCounts);
+
+// Appends up to MAX_MESH_LODS - 1 levels to `mesh`, each with about half the
+// triangles of the one before, as new submeshes and fills `mesh.lods`.
+// Stops early once simplification no longer pays off.
+void generate_lods(MeshData &mesh);
+
+// Picks the coarsest level whose error, projected at the closest point of
+// `bounds`, stays below `pixelThreshold` pixels on a viewport
+// `viewportHeight` pixels high.
+uint32_t select_lod(std::span<const MeshLod> lods,
+                    const MeshBounds &bounds,
+                    const glm::mat4 &modelView,
+                    const glm::mat4 &proj,
+                    float viewportHeight,
+                    float pixelThreshold = 1.0f);
+}  // namespace NEngine
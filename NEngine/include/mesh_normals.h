@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+// Sets every vertex normal to the area weighted average of the normals of
+// the triangles around it. With more than one job, the triangle normals
+// are computed four at a time from positions stored as separate x, y and z
+// arrays, and the triangle corners are sorted by vertex range, so that
+// each job sums and normalizes the vertices of one range on its own.
+// Otherwise a single loop does it in place. Vertices without triangles of
+// non-zero area get a zero normal.
+void generate_normals(std::span<vertex> vertices,
+                      std::span<const uint32_t> indices);
+
+// Fills the vertex tangents with MikkTSpace, from the positions, normals and
+// texture coordinates. Corners of one vertex that end up with different
+// tangents, e.g. where the texture is mirrored, get copies of the vertex.
+// Submeshes are processed by separate jobs; tangents are never averaged
+// across submeshes.
+void generate_tangents(MeshData &mesh);
+}  // namespace NEngine
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+struct VertexCacheStats
+{
+    // Average cache miss ratio: vertex shader invocations per triangle.
+    float acmr = 0.0f;
+    // Average transformed vertex ratio: invocations per referenced vertex.
+    float atvr = 0.0f;
+};
+
+// Simulates a FIFO post-transform cache of `cacheSize` entries.
+VertexCacheStats analyze_vertex_cache(std::span<const uint32_t> indices,
+                                      uint32_t vertexCount,
+                                      uint32_t cacheSize = 16);
+
+// Reorders triangles for post-transform cache hits with Tipsify, which
+// targets FIFO caches of 16 or more entries. The input order is kept when it
+// is already better.
+void optimize_vertex_cache(std::span<uint32_t> indices, uint32_t vertexCount);
+
+// Splits cache optimized triangles into clusters and orders the clusters
+// so that outward facing ones relative to the center of `bounds` come first,
+// which reduces overdraw. Clusters are only cut where the ACMR stays within
+// `threshold` times the original, so most of the cache gain is kept.
+void optimize_overdraw(std::span<uint32_t> indices,
+                       std::span<const vertex> vertices,
+                       const MeshBounds &bounds,
+                       float threshold = 1.05f);
+
+// Reorders vertices by first use and drops unreferenced ones, so vertex
+// fetches walk memory linearly.
+void optimize_vertex_fetch(MeshData &mesh);
+
+// Runs all of the above on every submesh, generates the levels of detail
+// and splits everything into meshlets before the vertex fetch pass.
+void optimize_mesh(MeshData &mesh);
+}  // namespace NEngine
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+// Small enough for the culling bounds to be tight, large enough that the
+// per-meshlet draw commands stay cheap.
+static constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+static constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Reorders the triangles of every submesh into meshlets and fills
+// `mesh.meshlets` and the meshlet ranges of `mesh.lods`. A meshlet grows
+// through triangles that share its vertices and starts from the next
+// triangle in index order once it runs dry, so cache optimized input stays
+// mostly cache friendly.
+void build_meshlets(MeshData &mesh,
+                    uint32_t maxVertices = MESHLET_MAX_VERTICES,
+                    uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// Fills the bounding sphere and the normal cone of `meshlet` from the
+// triangles in `indices`.
+void compute_meshlet_bounds(Meshlet &meshlet,
+                            std::span<const vertex> vertices,
+                            std::span<const uint32_t> indices);
+}  // namespace NEngine
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <vector>
+
+#include "image.h"
+#include "upload_service.h"
+
+namespace NEngine {
+
+// Builds mip chains with a compute shader that produces six levels per
+// dispatch, so a 4K texture costs two dispatches and one barrier instead of a
+// blit and two barriers per level. Only needs sampled and storage support for
+// the format, not linear filtering, and therefore also covers formats the
+// blit path rejects. Requires the shaderStorageImageWriteWithoutFormat
+// feature to be enabled on the device.
+class MipGenerator
+{
+public:
+    // Images passed to Record must be created with these usage bits and with
+    // GetImageFlags(format).
+    static constexpr VkImageUsageFlags IMAGE_USAGE =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+
+    MipGenerator(VkDevice device,
+                 VkPhysicalDevice physicalDevice,
+                 const std::vector<char> &shaderCode);
+    MipGenerator(const MipGenerator &) = delete;
+    MipGenerator &operator=(const MipGenerator &) = delete;
+    ~MipGenerator();
+    // The GPU must no longer use any chain recorded by this generator.
+    void Cleanup();
+
+    [[nodiscard]] bool Supports(VkFormat format) const;
+    [[nodiscard]] static VkImageCreateFlags GetImageFlags(VkFormat format);
+
+    // Records the mip chains of `images` into the batch of `uploads`, which
+    // must run on a queue with compute support. Every level must be in
+    // TRANSFER_DST_OPTIMAL with level 0 written by a transfer command; all
+    // levels end up in SHADER_READ_ONLY_OPTIMAL, visible to fragment shaders.
+    void Record(UploadService &uploads, const std::vector<const Image *> &images);
+    // Releases the level views and descriptors of the chains whose batches
+    // have completed. Images must not be destroyed while views of theirs
+    // remain, so call it after waiting for a batch and before freeing its
+    // images.
+    void ReleaseCompleted();
+
+private:
+    static constexpr uint32_t LEVELS_PER_DISPATCH = 6;
+
+    // Views and descriptors of one Record call, released once the batch
+    // they were recorded into has completed.
+    struct Pending
+    {
+        const UploadService *uploads;
+        uint64_t value;
+        VkDescriptorPool descriptorPool;
+        std::vector<VkImageView> views;
+    };
+
+    VkImageView CreateView(const Image &image,
+                           VkFormat format,
+                           VkImageUsageFlags usage,
+                           uint32_t mipLevel,
+                           std::vector<VkImageView> &views) const;
+    void Release(const Pending &pending) const;
+
+    VkDevice m_device{};
+    VkPhysicalDevice m_physicalDevice{};
+    VkDescriptorSetLayout m_descriptorSetLayout{};
+    VkPipelineLayout m_pipelineLayout{};
+    VkPipeline m_pipeline{};
+    VkSampler m_sampler{};
+    std::vector<Pending> m_pending;
+};
+}  // namespace NEngine
@@ -19,13 +19,10 @@ vk_result(const VkResult &result, const char *filename, int line)
 }
 
 inline uint32_t
-find_memory_type(VkPhysicalDevice physical_device,
+find_memory_type(const VkPhysicalDeviceMemoryProperties &memory_properties,
                  uint32_t type_filter,
                  VkMemoryPropertyFlags properties)
 {
-    VkPhysicalDeviceMemoryProperties memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
-
     for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
         if (type_filter & (1 << i) &&
             (memory_properties.memoryTypes[i].propertyFlags & properties) ==
@@ -37,6 +34,17 @@ find_memory_type(VkPhysicalDevice physical_device,
     throw std::runtime_error("Failed to find suitable memory type");
 }
 
+inline uint32_t
+find_memory_type(VkPhysicalDevice physical_device,
+                 uint32_t type_filter,
+                 VkMemoryPropertyFlags properties)
+{
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    return find_memory_type(memory_properties, type_filter, properties);
+}
+
 #if _NDEBUG
 #define ASSERT(...)
 #define VKRESULT(...)
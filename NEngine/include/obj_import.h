@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+// Loads a Wavefront OBJ file and welds identical vertices. Every shape of
+// the file becomes one submesh. Normals are generated when the file has
+// none.
+MeshData import_obj(const std::string &path);
+}  // namespace NEngine
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "gpu_allocator.h"
+
+namespace NEngine {
+
+// Ways a pass can use an image. Each implies the layout the image must be in
+// and the stages and accesses the graph synchronizes with other passes.
+enum class RenderGraphAccess : uint32_t
+{
+    // Color attachment of a graphics pass, loaded unless the pass is the
+    // first to write the image in the frame.
+    ColorAttachment,
+    // Depth attachment of a graphics pass, tested and written.
+    DepthAttachment,
+    // Resolve target of a graphics pass's color attachment of the same
+    // index. Overwritten entirely, so what was there before is not kept.
+    ResolveAttachment,
+    // Sampled by compute shaders while in DEPTH_STENCIL_READ_ONLY_OPTIMAL.
+    DepthRead,
+    // Sampled by compute shaders while in GENERAL.
+    ComputeRead,
+    // Read and written as a storage image by compute shaders, in GENERAL.
+    ComputeWrite,
+    // Sampled by fragment shaders while in SHADER_READ_ONLY_OPTIMAL.
+    FragmentRead,
+};
+
+// An image declared to the graph for the current frame.
+struct RenderGraphImage
+{
+    uint32_t index = UINT32_MAX;
+};
+
+struct RenderGraphImageDesc
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent{};
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // Whether the first pass that writes the image as an attachment clears
+    // it to clearValue, rather than leaving it undefined.
+    bool clear = false;
+    VkClearValue clearValue{};
+};
+
+// An image the graph does not own, such as a swap chain image.
+struct RenderGraphImport
+{
+    VkImage image{};
+    VkImageView view{};
+    // Layout at the start of the frame. UNDEFINED discards the contents,
+    // and the first pass using the image then only waits at its own stages,
+    // which is where a semaphore handing the image over must be waited on.
+    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Layout the image is left in at the end of the frame.
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Whether the image is a result of the frame. Passes are only kept
+    // when what they write reaches a result.
+    bool output = false;
+};
+
+struct RenderGraphUse
+{
+    RenderGraphImage image;
+    RenderGraphAccess access;
+};
+
+using RenderGraphRecord = std::function<void(VkCommandBuffer cb)>;
+
+// Records a frame from passes that declare which images they use and how.
+// The passes are declared anew every frame, in execution order, and
+// compiled when they or the images differ from the last compiled frame,
+// which happens when the swap chain or the set of passes changes:
+//
+// - Passes whose writes no result of the frame depends on are culled.
+//   Passes that declare no writes are assumed to write something the graph
+//   does not track and are always kept.
+// - Consecutive graphics passes with the same attachments are merged into
+//   one render pass instance.
+// - Every pass gets a single pipeline barrier with the layout transitions
+//   and memory dependencies its uses need, and none where reads follow
+//   reads in the same layout. The first use of an image in a frame waits
+//   for its last use in the previous one.
+// - Images the graph owns only live from their first to their last use,
+//   and images whose lifetimes do not overlap share memory.
+class RenderGraph
+{
+public:
+    RenderGraph(VkDevice device, GpuAllocator &allocator);
+    RenderGraph(const RenderGraph &) = delete;
+    RenderGraph &operator=(const RenderGraph &) = delete;
+    ~RenderGraph();
+    // The GPU must no longer use the graph.
+    void Cleanup();
+
+    // Drops the passes and images declared for the previous frame.
+    void Reset();
+    // Declares an image the graph creates, with undefined contents at the
+    // start of every frame.
+    RenderGraphImage CreateImage(const RenderGraphImageDesc &desc);
+    RenderGraphImage ImportImage(const RenderGraphImageDesc &desc,
+                                 const RenderGraphImport &import);
+    // Adds a pass recorded inside a render pass over its attachment uses,
+    // which must be in the order color, depth, resolve.
+    void AddGraphicsPass(std::span<const RenderGraphUse> uses,
+                         RenderGraphRecord record);
+    // Adds a pass recorded outside of render passes.
+    void AddComputePass(std::span<const RenderGraphUse> uses,
+                        RenderGraphRecord record);
+
+    // Records the passes declared since Reset into `cb`, compiling them
+    // first if they changed. Compiling waits for the GPU to be idle, as it
+    // destroys the objects of the previous compilation.
+    void Execute(VkCommandBuffer cb);
+    // Forgets the compiled frame, for when imported images were destroyed.
+    // The GPU must no longer use the graph.
+    void Invalidate();
+
+    // Only valid while Execute records the passes.
+    [[nodiscard]] VkImageView GetImageView(RenderGraphImage image) const;
+    // Changes every time Execute compiles, which recreates the images the
+    // graph owns.
+    [[nodiscard]] uint64_t GetVersion() const;
+
+private:
+    enum class PassType : uint32_t
+    {
+        Graphics,
+        Compute,
+    };
+
+    struct Resource
+    {
+        RenderGraphImageDesc desc;
+        bool imported = false;
+        RenderGraphImport import;
+    };
+
+    struct Pass
+    {
+        PassType type = PassType::Compute;
+        uint32_t firstUse = 0;
+        uint32_t useCount = 0;
+        RenderGraphRecord record;
+    };
+
+    // Where an image's contents stand while the frame is simulated.
+    struct ImageState
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // Stages and accesses of the last write or layout transition.
+        VkPipelineStageFlags writeStages = 0;
+        VkAccessFlags writeAccess = 0;
+        // Stages that read since then, which the next write must wait for.
+        VkPipelineStageFlags readStages = 0;
+        // Stages and accesses the last write is already visible to.
+        VkPipelineStageFlags visibleStages = 0;
+        VkAccessFlags visibleAccess = 0;
+    };
+
+    struct ImageBarrier
+    {
+        uint32_t resource = 0;
+        VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkAccessFlags srcAccess = 0;
+        VkAccessFlags dstAccess = 0;
+    };
+
+    struct Barrier
+    {
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        VkAccessFlags srcAccess = 0;
+        VkAccessFlags dstAccess = 0;
+        std::vector<ImageBarrier> images;
+    };
+
+    struct Framebuffer
+    {
+        std::vector<VkImageView> views;
+        VkFramebuffer framebuffer{};
+    };
+
+    // One or more passes recorded together: a compute pass, or graphics
+    // passes merged into one render pass instance.
+    struct Step
+    {
+        std::vector<uint32_t> passes;
+        // Uses of all the passes, each image once.
+        std::vector<RenderGraphUse> uses;
+        Barrier barrier;
+        VkRenderPass renderPass{};
+        // Resources of the attachments, in the render pass's order.
+        std::vector<uint32_t> attachments;
+        std::vector<VkClearValue> clearValues;
+        VkExtent2D extent{};
+        // Keyed by the views of the attachments, as imported images can
+        // change every frame.
+        std::vector<Framebuffer> framebuffers;
+    };
+
+    // Steps an image is used in, UINT32_MAX when none is.
+    struct Lifetime
+    {
+        uint32_t firstStep = UINT32_MAX;
+        uint32_t lastStep = 0;
+        VkPipelineStageFlags firstStages = 0;
+    };
+
+    // Memory shared by owned images whose lifetimes do not overlap.
+    struct MemorySlot
+    {
+        VkMemoryRequirements requirements{};
+        GpuAllocation allocation{};
+        // Resources of the images, in the order they use the memory.
+        std::vector<uint32_t> resources;
+    };
+
+    void AddPass(PassType type,
+                 std::span<const RenderGraphUse> uses,
+                 RenderGraphRecord record);
+    void BuildKey(std::vector<uint32_t> &key) const;
+    void Compile();
+    void DestroyCompiled();
+    // Returns the passes to keep, in order.
+    [[nodiscard]] std::vector<uint32_t> CullPasses() const;
+    void BuildSteps(const std::vector<uint32_t> &passes);
+    void ComputeLifetimes();
+    void CreateImages();
+    // Replays the frame's uses from `initial`, filling the steps' barriers
+    // and the final barrier when `record` is set, and returns the state
+    // every image is left in.
+    std::vector<ImageState> Simulate(const std::vector<ImageState> &initial,
+                                     bool record);
+    void CreateRenderPass(Step &step) const;
+    VkFramebuffer GetFramebuffer(Step &step);
+    void RecordBarrier(VkCommandBuffer cb, const Barrier &barrier);
+    [[nodiscard]] VkImage GetImage(uint32_t resource) const;
+    [[nodiscard]] VkImageView GetView(uint32_t resource) const;
+    [[nodiscard]] std::span<const RenderGraphUse> GetUses(
+        const Pass &pass) const;
+
+    VkDevice m_device{};
+    GpuAllocator *m_allocator{};
+
+    // Declared for the current frame.
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<RenderGraphUse> m_uses;
+
+    // Compiled from the passes and resources that produced m_key.
+    std::vector<uint32_t> m_key;
+    std::vector<uint32_t> m_scratchKey;
+    uint64_t m_version = 0;
+    bool m_compiled = false;
+    std::vector<Step> m_steps;
+    Barrier m_finalBarrier;
+    std::vector<Lifetime> m_lifetimes;
+    // Per resource, null for imported images and unused ones.
+    std::vector<VkImage> m_images;
+    std::vector<VkImageView> m_views;
+    std::vector<MemorySlot> m_slots;
+    std::vector<VkImageMemoryBarrier> m_scratchBarriers;
+};
+}  // namespace NEngine
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+// Bounding volume hierarchy over the world space boxes of a scene's
+// objects, for culling them against the view frustum on the CPU. Every node
+// has up to four children whose boxes are stored as separate arrays per
+// axis, so that one SSE plane test covers all of them, and the objects under
+// a child are a contiguous range of the build order. Subtrees inside the
+// frustum are taken whole without testing their boxes.
+class SceneBvh
+{
+public:
+    // Builds the hierarchy over `boxes`, whose indices are the objects'.
+    void Build(std::span<const MeshBounds> boxes);
+
+    // Replaces `visible` with the objects whose boxes are not entirely
+    // behind one of `planes`, as extract_frustum_planes makes them for the
+    // world. Subtrees are split between the threads of the job system once
+    // there are enough objects. The order is the hierarchy's, not the
+    // objects'.
+    void Cull(const glm::vec4 (&planes)[6],
+              std::vector<uint32_t> &visible) const;
+
+    [[nodiscard]] size_t GetObjectCount() const;
+
+private:
+    static constexpr uint32_t WIDTH = 4;
+
+    struct Node
+    {
+        // Boxes of the children.
+        alignas(16) float minX[WIDTH];
+        alignas(16) float minY[WIDTH];
+        alignas(16) float minZ[WIDTH];
+        alignas(16) float maxX[WIDTH];
+        alignas(16) float maxY[WIDTH];
+        alignas(16) float maxZ[WIDTH];
+        // Objects under each child are [first, first + count) of m_order. A
+        // child with one object is that object, any other is the node
+        // `child`.
+        uint32_t first[WIDTH];
+        uint32_t count[WIDTH];
+        uint32_t child[WIDTH];
+        uint32_t childCount;
+    };
+
+    // A node still to be tested, with the planes its box is not yet known
+    // to be inside of.
+    struct Task
+    {
+        uint32_t node;
+        uint32_t planeMask;
+    };
+
+    // Builds the node over the objects [first, first + count) of m_order,
+    // reordering them, and returns its index and the box around them.
+    uint32_t BuildNode(std::span<const MeshBounds> boxes,
+                       std::span<const uint32_t> codes,
+                       uint32_t first,
+                       uint32_t count,
+                       MeshBounds &bounds);
+    // Culls the subtree of `root` depth first.
+    void CullSubtree(const glm::vec4 (&planes)[6],
+                     Task root,
+                     std::vector<uint32_t> &visible) const;
+    // Tests the children of `task.node`, appends the objects of those that
+    // are visible and have nothing left to test to `visible` and queues the
+    // rest in `pending`.
+    void CullNode(const glm::vec4 (&planes)[6],
+                  Task task,
+                  std::vector<uint32_t> &visible,
+                  std::vector<Task> &pending) const;
+    void AppendObjects(uint32_t first,
+                       uint32_t count,
+                       std::vector<uint32_t> &visible) const;
+
+    std::vector<Node> m_nodes;
+    // Objects in the order of the hierarchy's leaves.
+    std::vector<uint32_t> m_order;
+};
+}  // namespace NEngine
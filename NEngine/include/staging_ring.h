@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <deque>
+#include <vector>
+
+#include "gpu_allocator.h"
+
+namespace NEngine {
+
+struct StagingRegion
+{
+    VkBuffer buffer{};
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *data = nullptr;
+};
+
+// Persistently mapped host visible buffer that uploads are written through.
+// Regions handed out by Acquire are recycled once the fence returned by the
+// Submit that followed them is signaled. Submit hands every region acquired
+// since the previous one to a single fence, so a ring must only be used by
+// one submitter.
+class StagingRing
+{
+public:
+    StagingRing(VkDevice device,
+                GpuAllocator &allocator,
+                VkBuffer buffer,
+                const GpuAllocation &memory,
+                VkDeviceSize capacity);
+    StagingRing(const StagingRing &) = delete;
+    StagingRing &operator=(const StagingRing &) = delete;
+    ~StagingRing();
+    void Cleanup();
+
+    // Returns a region of at most `size` bytes whose offset is a multiple of
+    // `alignment` and whose size is a multiple of `granularity` (unless it
+    // covers the whole request). Requests larger than the free space are
+    // split, so callers loop until everything is written. Blocks on the
+    // oldest in-flight submission when the ring is full.
+    [[nodiscard]] StagingRegion Acquire(VkDeviceSize size,
+                                        VkDeviceSize alignment = 16,
+                                        VkDeviceSize granularity = 1);
+    // Non-blocking variant of Acquire. Returns false instead of waiting when
+    // no space is free, so a caller can submit its own pending batch first.
+    [[nodiscard]] bool TryAcquire(VkDeviceSize size,
+                                  VkDeviceSize alignment,
+                                  VkDeviceSize granularity,
+                                  StagingRegion &region);
+    // Returns the fence the caller must pass to vkQueueSubmit for the
+    // commands that read the regions acquired since the previous Submit.
+    [[nodiscard]] VkFence Submit();
+    // Releases the regions of every submission that has completed.
+    void Reclaim();
+
+    [[nodiscard]] VkDeviceSize GetCapacity() const;
+
+private:
+    struct Submission
+    {
+        VkFence fence;
+        VkDeviceSize end;
+    };
+
+    void WaitOldest();
+
+    VkDevice m_device{};
+    GpuAllocator *m_allocator{};
+    VkBuffer m_buffer{};
+    GpuAllocation m_memory{};
+    VkDeviceSize m_capacity = 0;
+    VkDeviceSize m_head = 0;
+    VkDeviceSize m_tail = 0;
+    bool m_hasPending = false;
+    std::deque<Submission> m_inFlight;
+    std::vector<VkFence> m_freeFences;
+};
+}  // namespace NEngine
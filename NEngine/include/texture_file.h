@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace NEngine {
+
+// A cooked texture as stored on disk: a KTX2 container without
+// supercompression holding a single 2D image and its full mip chain, ready
+// to be copied into an image of `format`.
+struct TextureFile
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Tightly packed data of every mip level, level 0 first.
+    std::vector<std::vector<uint8_t>> levels;
+};
+
+// Where the levels of a cooked texture are stored in its file.
+struct TextureFileLayout
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    struct Level
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+    // Level 0 first.
+    std::vector<Level> levels;
+};
+
+// Fills `out` with the bytes of a file that start at `offset`.
+using FileReader =
+    std::function<void(uint64_t offset, std::span<uint8_t> out)>;
+
+struct TextureBlockInfo
+{
+    // Bytes per block, or per texel for uncompressed formats.
+    uint32_t size;
+    // Width and height of a block in texels, 1 for uncompressed formats.
+    uint32_t extent;
+};
+
+// Formats the cooker produces and the loader accepts. Throws for others.
+TextureBlockInfo get_texture_block_info(VkFormat format);
+
+TextureFile read_texture_file(const std::string &path);
+// Reads only the header and level index of a texture file of `fileSize`
+// bytes, so that the levels can be streamed from wherever it is stored.
+// `name` is only used in error messages.
+TextureFileLayout read_texture_layout(const FileReader &read,
+                                      uint64_t fileSize,
+                                      const std::string &name);
+void write_texture_file(const std::string &path, const TextureFile &texture);
+}  // namespace NEngine
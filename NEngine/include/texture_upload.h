@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <vector>
+
+#include "image.h"
+#include "mip_generator.h"
+#include "upload_service.h"
+
+namespace NEngine {
+
+struct TextureUpload
+{
+    Image *image;
+    // Writers of the tightly packed texels of the leading mip levels, level 0
+    // first. Levels past the end are generated on the GPU.
+    std::vector<StagingWriter> levels;
+    // Size of one texel, or of one block for block-compressed formats.
+    uint32_t texelSize;
+    // Width and height of a block in texels, 1 for uncompressed formats.
+    uint32_t blockExtent = 1;
+};
+
+// Records the layout transitions, copies and mip chains of every texture
+// into the current batch of `uploads`, which must run on a graphics queue.
+// Barriers for the same mip level of all textures are issued together, so a
+// whole material set costs a single submission. Texels are copied into the
+// staging ring before this returns, so the sources the writers read may be
+// freed afterwards.
+//
+// Missing mips are built by `mipGenerator` for textures it supports and that
+// were created with its usage and flags, and by blits otherwise. Textures
+// whose whole chain is provided, such as cooked block-compressed ones, are
+// only copied and transitioned.
+void record_texture_uploads(UploadService &uploads,
+                            const std::vector<TextureUpload> &textures,
+                            VkPhysicalDevice physical_device,
+                            MipGenerator *mipGenerator = nullptr);
+
+// Builds mip chains with one linear blit per level. Every level must be in
+// TRANSFER_DST_OPTIMAL with level 0 written; all levels end up in
+// SHADER_READ_ONLY_OPTIMAL, visible to fragment shaders.
+void record_blit_mips(VkCommandBuffer cb,
+                      const std::vector<const Image *> &images);
+}  // namespace NEngine
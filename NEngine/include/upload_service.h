@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <deque>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "staging_ring.h"
+
+namespace NEngine {
+
+// Fills `out` with the bytes of an upload's source that start at `offset`.
+// Lets sources such as compressed archive entries be decoded straight into
+// staging memory.
+using StagingWriter =
+    std::function<void(VkDeviceSize offset, std::span<uint8_t> out)>;
+
+// Writer that copies from `data`.
+StagingWriter copy_from(const void *data);
+
+// Records upload work for one queue into a single command buffer and submits
+// it on Flush without waiting for the GPU. Every flush signals the next value
+// of a timeline semaphore; consumers wait on that value only when they first
+// need the uploaded resources.
+class UploadService
+{
+public:
+    // `stagingRing` must not be shared with another service.
+    UploadService(VkDevice device,
+                  VkQueue queue,
+                  uint32_t queueFamily,
+                  StagingRing &stagingRing);
+    UploadService(const UploadService &) = delete;
+    UploadService &operator=(const UploadService &) = delete;
+    ~UploadService();
+    void Cleanup();
+
+    // Command buffer of the batch being recorded. Valid until the next Flush.
+    [[nodiscard]] VkCommandBuffer GetCommandBuffer();
+
+    void CopyToBuffer(VkBuffer dst,
+                      const void *data,
+                      VkDeviceSize size,
+                      VkDeviceSize dstOffset = 0);
+    void CopyToBuffer(VkBuffer dst,
+                      const StagingWriter &write,
+                      VkDeviceSize size,
+                      VkDeviceSize dstOffset = 0);
+    // Copies tightly packed texels into `mipLevel` of `image`, which must
+    // already be in TRANSFER_DST_OPTIMAL layout. `width` and `height` are the
+    // extent of that level. For block-compressed formats `texelSize` is the
+    // size of one block and `blockExtent` its width and height in texels.
+    void CopyToImage(VkImage image,
+                     const void *texels,
+                     uint32_t width,
+                     uint32_t height,
+                     uint32_t texelSize,
+                     uint32_t mipLevel = 0,
+                     uint32_t blockExtent = 1);
+    void CopyToImage(VkImage image,
+                     const StagingWriter &write,
+                     uint32_t width,
+                     uint32_t height,
+                     uint32_t texelSize,
+                     uint32_t mipLevel = 0,
+                     uint32_t blockExtent = 1);
+
+    // Records a queue family ownership release of `buffer` into this batch
+    // and the matching acquire into the batch of `dst`. `dst` must wait for
+    // this service's flush (see WaitFor) before its batch is submitted. A
+    // no-op when both services run on the same queue family.
+    void TransferOwnership(UploadService &dst,
+                           VkBuffer buffer,
+                           VkAccessFlags dstAccess,
+                           VkPipelineStageFlags dstStage);
+
+    // Makes the next submitted batch wait until `other` reaches `value`.
+    void WaitFor(const UploadService &other, uint64_t value);
+
+    // Submits the recorded batch and returns the timeline value it signals.
+    // Returns the last submitted value when nothing was recorded.
+    uint64_t Flush();
+
+    [[nodiscard]] VkSemaphore GetSemaphore() const;
+    [[nodiscard]] uint64_t GetLastSubmittedValue() const;
+    // Value the batch being recorded will signal once flushed.
+    [[nodiscard]] uint64_t GetRecordingValue() const;
+    [[nodiscard]] bool IsComplete(uint64_t value) const;
+    void Wait(uint64_t value) const;
+
+private:
+    struct Batch
+    {
+        VkCommandBuffer commandBuffer;
+        uint64_t value;
+    };
+
+    struct SemaphoreWait
+    {
+        VkSemaphore semaphore;
+        uint64_t value;
+    };
+
+    void RecycleCompletedBatches();
+    StagingRegion AcquireStaging(VkDeviceSize size,
+                                 VkDeviceSize alignment,
+                                 VkDeviceSize granularity);
+
+    VkDevice m_device{};
+    VkQueue m_queue{};
+    uint32_t m_queueFamily = 0;
+    StagingRing *m_stagingRing{};
+    VkCommandPool m_commandPool{};
+    VkSemaphore m_timeline{};
+    uint64_t m_lastSubmittedValue = 0;
+    VkCommandBuffer m_recording{};
+    bool m_usesStaging = false;
+    std::vector<SemaphoreWait> m_waits;
+    std::deque<Batch> m_inFlight;
+    std::vector<VkCommandBuffer> m_freeCommandBuffers;
+};
+}  // namespace NEngine
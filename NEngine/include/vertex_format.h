@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+#include "vertex.h"
+
+namespace NEngine {
+
+struct MeshBounds;
+
+// GPU vertices are split into streams with one binding each:
+//   0: positions, the only stream depth-only passes need,
+//   1: texture coordinates, normals and tangents,
+//   2: colours, or a single white texel read with a zero stride.
+enum class PositionFormat : uint32_t
+{
+    // 12 bytes, positions as imported.
+    Float32,
+    // 8 bytes, half floats normalized to the mesh bounds.
+    Float16,
+    // 8 bytes, 16 bit signed normalized values relative to the mesh bounds.
+    Snorm16,
+};
+
+enum class AttributeFormat : uint32_t
+{
+    // 36 bytes, float texture coordinates, normal and tangent with the
+    // bitangent sign in w.
+    Float32,
+    // 12 bytes, half float texture coordinates, an octahedral normal in two
+    // 16 bit signed normalized values and an octahedral tangent in two 8 bit
+    // ones, followed by a zero byte and the bitangent sign.
+    Packed,
+};
+
+struct VertexLayout
+{
+    PositionFormat positions = PositionFormat::Snorm16;
+    AttributeFormat attributes = AttributeFormat::Packed;
+    // Imported colours are always white, so the stream is off by default.
+    bool colors = false;
+};
+
+enum VertexBinding : uint32_t
+{
+    POSITION_BINDING = 0,
+    ATTRIBUTE_BINDING = 1,
+    COLOR_BINDING = 2,
+    VERTEX_BINDING_COUNT = 3,
+};
+
+// Size of one colour in the colour stream, and of the constant white colour
+// bound when a mesh has none.
+static constexpr uint32_t COLOR_STRIDE = 4;
+
+uint32_t get_position_stride(PositionFormat format);
+uint32_t get_attribute_stride(AttributeFormat format);
+
+struct VertexStreams
+{
+    VertexLayout layout;
+    uint32_t vertexCount = 0;
+    // Maps stored positions back to mesh space: pos * scale + offset.
+    glm::vec3 positionScale{1.0f};
+    glm::vec3 positionOffset{0.0f};
+    std::vector<uint8_t> positions;
+    std::vector<uint8_t> attributes;
+    // Empty unless the layout has colours.
+    std::vector<uint8_t> colors;
+};
+
+// Non-owning counterpart of VertexStreams, e.g. into a mapped mesh file.
+struct VertexStreamsView
+{
+    VertexLayout layout;
+    uint32_t vertexCount = 0;
+    glm::vec3 positionScale{1.0f};
+    glm::vec3 positionOffset{0.0f};
+    std::span<const uint8_t> positions;
+    std::span<const uint8_t> attributes;
+    std::span<const uint8_t> colors;
+};
+
+VertexStreams encode_vertex_streams(std::span<const vertex> vertices,
+                                    const MeshBounds &bounds,
+                                    const VertexLayout &layout);
+VertexStreamsView view_vertex_streams(const VertexStreams &streams);
+
+// Vertex input state matching phong_vs.vert, whose specialization constant
+// OCTAHEDRAL_NORMALS must be set for packed attributes.
+std::vector<VkVertexInputBindingDescription> get_binding_descriptions(
+    const VertexLayout &layout);
+std::vector<VkVertexInputAttributeDescription> get_attribute_descriptions(
+    const VertexLayout &layout);
+
+// Position stream only, for depth-only and shadow passes.
+VkVertexInputBindingDescription get_position_binding_description(
+    const VertexLayout &layout);
+VkVertexInputAttributeDescription get_position_attribute_description(
+    const VertexLayout &layout);
+}  // namespace NEngine
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "asset_archive.h"
+#include "io_service.h"
+#include "mapped_file.h"
+
+namespace NEngine {
+
+// A file opened through a VirtualFileSystem, either an archive entry or a
+// loose file on disk, which is mapped when opened, or contents that were
+// already read.
+class VirtualFile
+{
+public:
+    // Opens the loose file at `path` on disk.
+    explicit VirtualFile(const std::string &path);
+    explicit VirtualFile(FileData data);
+    VirtualFile(const AssetArchive &archive, const ArchiveEntry &entry);
+
+    [[nodiscard]] uint64_t GetSize() const;
+    // Copies bytes [offset, offset + out.size()) of the contents into `out`,
+    // decompressing compressed archive entries on the way.
+    void Read(uint64_t offset, std::span<uint8_t> out) const;
+    // Whole contents, borrowed from the mapping when they can be used in
+    // place and decompressed otherwise. Loose files keep their own mapping,
+    // so this consumes the file.
+    [[nodiscard]] FileData ReadAll() &&;
+
+private:
+    const AssetArchive *m_archive = nullptr;
+    const ArchiveEntry *m_entry = nullptr;
+    FileData m_loose;
+};
+
+// Resolves resource paths such as "shaders/phong_vs.spv" against mounted
+// archives and directories, the most recently mounted first. Mount
+// everything before looking files up; lookups are thread-safe.
+class VirtualFileSystem
+{
+public:
+    // Entries are found under the names they were packed with.
+    void MountArchive(const std::string &path);
+    // Files below `directory` are found as "<prefix>/<relative path>".
+    void MountDirectory(const std::string &directory,
+                        const std::string &prefix);
+
+    [[nodiscard]] bool Exists(const std::string &path) const;
+    // Throws when no mount has the file.
+    [[nodiscard]] VirtualFile Open(const std::string &path) const;
+    [[nodiscard]] FileData Read(const std::string &path) const;
+    // Reads the files at `paths` as one batch on `io`, decompressing
+    // archive entries on its completion thread. Missing files fail their
+    // futures. The file system must outlive the reads.
+    [[nodiscard]] std::vector<std::future<FileData>> ReadAsync(
+        std::span<const std::string> paths,
+        IoService &io) const;
+
+private:
+    struct Mount
+    {
+        std::unique_ptr<AssetArchive> archive;
+        std::filesystem::path directory;
+        std::string prefix;
+    };
+
+    // Where a file's contents are on disk: an entry of an archive or a
+    // loose file.
+    struct Location
+    {
+        const AssetArchive *archive = nullptr;
+        const ArchiveEntry *entry = nullptr;
+        std::filesystem::path file;
+    };
+
+    [[nodiscard]] std::optional<Location> Find(const std::string &path) const;
+
+    std::vector<Mount> m_mounts;
+};
+}  // namespace NEngine
@@ -3,29 +3,78 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <array>
+#include <future>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
 
-#include "camera.h"
+#include "asset_cache.h"
+#include "cluster_culler.h"
+#include "depth_pyramid.h"
+#include "draw_list.h"
+#include "frame_packet.h"
+#include "gpu_allocator.h"
 #include "image.h"
+#include "instance_culler.h"
+#include "index_format.h"
+#include "io_service.h"
+#include "mesh_file.h"
+#include "vertex_format.h"
+#include "mip_generator.h"
+#include "render_graph.h"
+#include "scene_bvh.h"
+#include "staging_ring.h"
+#include "texture_file.h"
+#include "upload_service.h"
+#include "virtual_file_system.h"
 
 
 namespace NEngine {
 struct vertex;
 
+struct MipBenchmarkResult
+{
+    uint32_t mipLevels = 0;
+    double blitMs = 0.0;
+    // Empty when the device cannot run the compute path.
+    std::optional<double> computeMs;
+};
+
 class VulkanApplication
 {
 public:
+    // Materials draw items can use. Must match phong_fs.frag.
+    static constexpr uint32_t MATERIAL_COUNT = 4;
+
     VulkanApplication(VulkanApplication &&) = delete;
     VulkanApplication(const VulkanApplication &) = delete;
     explicit VulkanApplication(SDL_Window *window);
-    void DrawFrame();
-    void OnWindowResized();
+    // Renders `frame` and presents it. The packet is only read, so the game
+    // thread can write the next one meanwhile.
+    void DrawFrame(const FramePacket &frame);
     ~VulkanApplication();
     void LoadModel(const std::string &path);
-    void OnMouseMove(uint32_t mouse_state, int x, int y);
+    [[nodiscard]] GpuAllocatorStats GetMemoryStats() const;
+    [[nodiscard]] AssetCacheStats GetAssetCacheStats() const;
+    // Average GPU time of building a full mip chain for a width x height
+    // RGBA8 texture with blits and with the compute shader.
+    MipBenchmarkResult BenchmarkMipGeneration(uint32_t width,
+                                              uint32_t height,
+                                              uint32_t iterations);
 
 private:
     void CreateCommandPool();
+    void CreateFileSystem();
+    // Starts reading the shaders and cooked assets that initialization
+    // loads, so that their reads overlap each other and device creation.
+    void PrefetchFiles();
+    // Takes the prefetched contents of a file if there are any and opens
+    // it through the file system otherwise.
+    [[nodiscard]] VirtualFile OpenFile(const std::string &path);
+    [[nodiscard]] std::vector<char> ReadShader(const char *name);
     void InitVulkan();
     void Cleanup() const;
     void SetupDebugMessenger();
@@ -42,9 +91,13 @@ private:
     [[nodiscard]] VkShaderModule CreateShaderModule(
         const std::vector<char> &code) const;
     void CreateRenderPass();
-    void CreateFramebuffers();
     void CreateCommandBuffers();
-    void RecordCommandBuffer(VkCommandBuffer cb, uint32_t image_idx) const;
+    void RecordCommandBuffer(VkCommandBuffer cb,
+                             uint32_t image_idx,
+                             const FramePacket &frame) const;
+    // Binds the pipeline, buffers and descriptor sets that draws use, which
+    // a render pass does not keep.
+    void BindDrawState(VkCommandBuffer cb) const;
     void CreateSyncObjects();
     void RecreateSwapChain();
     void CleanupSwapChain() const;
@@ -53,35 +106,44 @@ private:
                        VkBufferUsageFlags usage,
                        VkMemoryPropertyFlags properties,
                        VkBuffer &buffer,
-                       VkDeviceMemory &buffer_memory) const;
-    void CopyBuffer(VkBuffer src_buffer,
-                     VkBuffer dst_buffer,
-                     VkDeviceSize size);
+                       GpuAllocation &buffer_memory) const;
+    [[nodiscard]] std::unique_ptr<StagingRing> CreateStagingRing(
+        VkDeviceSize size) const;
+    void CreateUploadServices();
+    void FlushUploads();
     void CreateIndexBuffer();
+    void CreateClusterCuller();
+    void CreateInstanceCuller();
     void CreateDescriptorSetLayout();
     void CreateUniformBuffers();
-    void UpdateUniformBuffer() const;
+    // Culls the items of `frame` against scene_bvh_, rebuilding it when they
+    // changed, picks their levels of detail and sorts them into draw_list_.
+    // Only used without the instance culler.
+    void BuildDrawList(const FramePacket &frame);
+    // Hands the items of `frame` to the instance culler if they changed.
+    void UpdateScene(const FramePacket &frame);
+    void UpdateUniformBuffer(const FramePacket &frame) const;
+    // Copies the instances of draw_list_ to the current frame's instance
+    // buffer, growing it when they do not fit.
+    void UpdateInstanceBuffer();
+    void CreateInstanceBuffer(uint32_t frame, uint32_t capacity);
+    // Points the descriptor set of `frame` at the buffer the vertex shader
+    // reads instances from.
+    void WriteInstanceDescriptor(uint32_t frame) const;
     void CreateDescriptorPool();
     void CreateDescriptorSets();
-    void CreateTextureImage(const std::string &texture_path);
-    void CreateImage(uint32_t width,
-                      uint32_t height,
-                      VkFormat format,
-                      uint32_t mip_levels,
-                      VkSampleCountFlagBits num_samples,
-                      VkImageTiling tiling,
-                      VkImageUsageFlags usage,
-                      VkMemoryPropertyFlags properties,
-                      VkImage &image,
-                      VkDeviceMemory &image_memory) const;
+    void CreateTextureImage(const VirtualFile &file, const std::string &name);
+    void CreateTextureImage(const uint8_t *pixels,
+                            uint32_t width,
+                            uint32_t height);
+    void CreateCookedTextureImage(const VirtualFile &file,
+                                  const TextureFileLayout &layout);
     void CreateTextureImageView();
     VkImageView CreateImageView(VkImage image,
                                   VkFormat format,
                                   VkImageAspectFlags aspect_flags,
                                   uint32_t mip_levels) const;
     void CreateTextureSampler();
-    void CreateDepthResources();
-    void CreateColorResources();
     void InitImGui();
     void DestroyImGui() const;
 
@@ -100,9 +162,10 @@ private:
     std::vector<VkImageView> swap_chain_image_views_;
     VkDescriptorSetLayout descriptor_set_layout_{};
     VkPipelineLayout pipeline_layout_{};
+    // Pipelines and the UI are created against it. Frames are recorded in
+    // the render graph's render passes, which are compatible with it.
     VkRenderPass render_pass_{};
     VkPipeline graphics_pipeline_{};
-    std::vector<VkFramebuffer> swap_chain_framebuffers_;
     VkCommandPool command_pool_{};
     std::vector<VkCommandBuffer> command_buffers_;
     std::vector<VkSemaphore> image_available_semaphores_;
@@ -111,37 +174,78 @@ private:
     uint32_t current_frame_ = 0;
     bool is_framebuffer_resized = false;
     VkBuffer vertex_buffer_{};
-    VkDeviceMemory vertex_buffer_memory_{};
+    GpuAllocation vertex_buffer_memory_{};
     VkQueue transfer_queue_{};
-    VkCommandPool transfer_command_pool_{};
     VkBuffer index_buffer_{};
-    VkDeviceMemory index_buffer_memory_{};
+    GpuAllocation index_buffer_memory_{};
     std::vector<VkBuffer> uniform_buffers_;
-    std::vector<VkDeviceMemory> uniform_buffers_memory_;
+    std::vector<GpuAllocation> uniform_buffers_memory_;
     std::vector<void *> uniform_buffers_mapped_;
     std::vector<VkBuffer> uniform_buffers_ps_;
-    std::vector<VkDeviceMemory> uniform_buffers_memory_ps_;
+    std::vector<GpuAllocation> uniform_buffers_memory_ps_;
     std::vector<void *> uniform_buffers_mapped_ps_;
+    std::vector<VkBuffer> instance_buffers_;
+    std::vector<GpuAllocation> instance_buffers_memory_;
+    // In instances.
+    std::vector<uint32_t> instance_buffer_capacities_;
+    DrawList draw_list_;
+    SceneBvh scene_bvh_;
+    // Items of the current frame that scene_bvh_ found visible.
+    std::vector<uint32_t> visible_items_;
     VkDescriptorPool descriptor_pool_{};
     std::vector<VkDescriptorSet> descriptor_sets_;
     uint32_t mip_levels_ = 0;
     VkSampler texture_sampler_{};
     VkSampleCountFlagBits msaa_samples_ = VK_SAMPLE_COUNT_1_BIT;
-    VkImage color_image_{};
-    VkDeviceMemory color_image_memory_{};
-    VkImageView color_image_view_{};
+    VkFormat depth_format_ = VK_FORMAT_UNDEFINED;
     VkDescriptorPool imgui_pool_{};
 
-    std::vector<vertex> vertices_;
-    std::vector<uint32_t> indices_;
+    // Point into mesh_file_.
+    VertexStreamsView vertex_streams_;
+    VkIndexType index_type_ = VK_INDEX_TYPE_UINT32;
+    std::span<const uint8_t> index_data_;
+    std::span<const Submesh> submeshes_;
+    std::span<const Meshlet> meshlets_;
+    std::span<const MeshLod> lods_;
+    MeshBounds mesh_bounds_{};
+    std::unique_ptr<MeshFile> mesh_file_;
+    std::unique_ptr<AssetCache> asset_cache_;
+    std::unique_ptr<VirtualFileSystem> file_system_;
+    // Declared after the file system, so that reads still in flight finish
+    // before the archives they decode against are unmapped.
+    std::unique_ptr<IoService> io_service_;
+    std::unordered_map<std::string, std::future<FileData>> prefetched_files_;
+    std::array<VkDeviceSize, VERTEX_BINDING_COUNT> vertex_stream_offsets_{};
 
     const std::vector<const char *> validation_layers = {
         "VK_LAYER_KHRONOS_validation"};
     const std::vector<const char *> device_extensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
-    std::unique_ptr<Camera> camera_;
-    std::unique_ptr<Image> m_depthImage;
+    std::unique_ptr<GpuAllocator> allocator_;
+    // One per upload service.
+    std::unique_ptr<StagingRing> transfer_staging_ring_;
+    std::unique_ptr<StagingRing> graphics_staging_ring_;
+    std::unique_ptr<UploadService> transfer_uploads_;
+    std::unique_ptr<UploadService> graphics_uploads_;
+    std::unique_ptr<MipGenerator> mip_generator_;
+    // Creates the multisampled color and depth buffers of every frame.
+    std::unique_ptr<RenderGraph> render_graph_;
+    std::unique_ptr<ClusterCuller> cluster_culler_;
+    // Declared before instance_culler_, which reads it. Only created for
+    // occlusion culling.
+    std::unique_ptr<DepthPyramid> depth_pyramid_;
+    std::unique_ptr<InstanceCuller> instance_culler_;
+    // The draw list last handed to instance_culler_, or that scene_bvh_ was
+    // built over.
+    std::shared_ptr<const std::vector<DrawItem>> scene_;
+    bool storage_write_without_format_ = false;
+    bool texture_compression_bc_ = false;
+    bool draw_indirect_count_ = false;
+    // Indirect count draws and a multisampled depth buffer compute shaders
+    // can sample, which the depth pyramid needs. Without the latter the
+    // instance culler tests the frustum only.
+    bool occlusion_culling_ = false;
     std::unique_ptr<Image> m_textureImage;
 };
 
@@ -4,14 +4,20 @@ layout(location = 0) in vec3 frag_color;
 layout(location = 1) in vec2 tex_coords;
 layout(location = 2) in vec3 normal;
 layout(location = 3) in vec3 frag_world_pos;
+layout(location = 5) flat in uint material;
 
 layout(location = 0) out vec4 out_color;
 
 layout(binding = 1) uniform sampler2D tex_sampler;
 
+// Must match MATERIAL_COUNT in vulkan_application.h.
+const uint MATERIAL_COUNT = 4;
+
 layout(binding = 2) uniform uniform_buffer_object {
     vec3 light_pos;
 	vec3 cam_pos;
+    // Multiplies the texture of every material.
+    vec4 material_colors[MATERIAL_COUNT];
 } ubo;
 
 
@@ -22,7 +28,9 @@ void main() {
 	vec3 l = normalize(ubo.light_pos - frag_world_pos);
 	vec3 h = normalize(v + l);
 
-    vec4 color = vec4(texture(tex_sampler, tex_coords).rgb * frag_color, 1.0);
+    vec4 color = vec4(texture(tex_sampler, tex_coords).rgb * frag_color *
+                      ubo.material_colors[material].rgb,
+                      1.0);
 
 	float kD = max(dot(n, l), 0.0);
 	vec3 diffuse = kD * color.rgb;
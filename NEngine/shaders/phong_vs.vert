@@ -1,25 +1,65 @@
 #version 450
 
+// Set for meshes with packed attributes, whose normals and tangents arrive
+// as two octahedral components.
+layout(constant_id = 0) const bool OCTAHEDRAL_NORMALS = false;
+
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_color;
 layout(location = 2) in vec2 in_tex_coords;
 layout(location = 3) in vec3 in_normal;
+// MikkTSpace tangent, bitangent sign in w.
+layout(location = 4) in vec4 in_tangent;
 
 layout(location = 0) out vec3 frag_color;
 layout(location = 1) out vec2 tex_coords;
 layout(location = 2) out vec3 normal;
 layout(location = 3) out vec3 frag_world_pos;
+// World space tangent frame for normal mapping, with the bitangent sign in
+// w: bitangent = cross(normal, tangent.xyz) * tangent.w.
+layout(location = 4) out vec4 tangent;
+layout(location = 5) flat out uint material;
 
 layout(binding = 0) uniform uniform_buffer_object {
-    mat4 model;
     mat4 view;
     mat4 proj;
+    // Maps quantized positions back to mesh space.
+    vec4 position_scale;
+    vec4 position_offset;
 } ubo;
 
+struct instance_data {
+    mat4 model;
+    uint material;
+};
+
+// The instances of all draw groups, each group's in a contiguous range.
+// gl_InstanceIndex includes the first instance of the draw.
+layout(std430, binding = 3) readonly buffer instance_buffer {
+    instance_data instances[];
+};
+
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(in_position, 1.0);
+    vec3 position =
+        in_position * ubo.position_scale.xyz + ubo.position_offset.xyz;
+    vec3 in_n =
+        OCTAHEDRAL_NORMALS ? decode_octahedral(in_normal.xy) : in_normal;
+    vec3 in_t = OCTAHEDRAL_NORMALS ? decode_octahedral(in_tangent.xy)
+                                   : in_tangent.xyz;
+
+    const instance_data instance = instances[gl_InstanceIndex];
+    gl_Position = ubo.proj * ubo.view * instance.model * vec4(position, 1.0);
     frag_color = in_color;
     tex_coords = in_tex_coords;
-    normal = (ubo.model * vec4(in_normal, 0.0)).xyz;
-    frag_world_pos = (ubo.model * vec4(in_position, 1.0)).xyz;
-}
\ No newline at end of file
+    normal = (instance.model * vec4(in_n, 0.0)).xyz;
+    tangent = vec4((instance.model * vec4(in_t, 0.0)).xyz, in_tangent.w);
+    frag_world_pos = (instance.model * vec4(position, 1.0)).xyz;
+    material = instance.material;
+}
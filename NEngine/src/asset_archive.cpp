@@ -0,0 +1,340 @@
+#include "asset_archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "lz4_block.h"
+
+namespace NEngine {
+
+// "NPAK" read as a little-endian integer.
+static constexpr uint32_t ARCHIVE_MAGIC = 0x4B41504E;
+static constexpr uint32_t ARCHIVE_VERSION = 1;
+
+// The header fills the first page, followed by the entries, the table of
+// contents and the names. All values are little-endian; offsets are from
+// the start of the file.
+struct ArchiveHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t chunkSize;
+    uint64_t tocOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+static_assert(sizeof(ArchiveEntry) == 48);
+static_assert(sizeof(ArchiveHeader) == 40);
+
+// 64 bit FNV-1a.
+static uint64_t
+hash_path(std::string_view name)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (const char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static void
+pad_to(std::ofstream &file, uint64_t &size, uint64_t alignment)
+{
+    static constexpr char ZEROS[ARCHIVE_ALIGNMENT] = {};
+    const uint64_t padding = (alignment - size % alignment) % alignment;
+    file.write(ZEROS, static_cast<std::streamsize>(padding));
+    size += padding;
+}
+
+// Compressed form of `data`: the chunk offsets followed by the chunks.
+static std::vector<uint8_t>
+compress_chunks(std::span<const uint8_t> data, uint32_t &chunkCount)
+{
+    chunkCount = static_cast<uint32_t>(
+        (data.size() + ARCHIVE_CHUNK_SIZE - 1) / ARCHIVE_CHUNK_SIZE);
+    std::vector<uint64_t> offsets(chunkCount + 1);
+    std::vector<uint8_t> chunks;
+    const uint64_t table_size = offsets.size() * sizeof(uint64_t);
+    for (uint32_t chunk = 0; chunk < chunkCount; ++chunk) {
+        offsets[chunk] = table_size + chunks.size();
+        const std::span<const uint8_t> source = data.subspan(
+            size_t{chunk} * ARCHIVE_CHUNK_SIZE,
+            std::min<size_t>(ARCHIVE_CHUNK_SIZE,
+                             data.size() - size_t{chunk} * ARCHIVE_CHUNK_SIZE));
+        const std::vector<uint8_t> compressed = lz4_compress(source);
+        if (compressed.size() < source.size()) {
+            chunks.insert(chunks.end(), compressed.begin(), compressed.end());
+        }
+        else {
+            chunks.insert(chunks.end(), source.begin(), source.end());
+        }
+    }
+    offsets[chunkCount] = table_size + chunks.size();
+
+    std::vector<uint8_t> out(table_size);
+    memcpy(out.data(), offsets.data(), table_size);
+    out.insert(out.end(), chunks.begin(), chunks.end());
+    return out;
+}
+
+// Copies bytes [offset, offset + out.size()) of the contents of an entry
+// stored at `stored` into `out`.
+static void
+read_entry(const ArchiveEntry &entry,
+           const uint8_t *stored,
+           uint64_t offset,
+           std::span<uint8_t> out)
+{
+    if (entry.compression == ArchiveCompression::None) {
+        memcpy(out.data(), stored + offset, out.size());
+        return;
+    }
+
+    std::vector<uint8_t> scratch;
+    const uint64_t end = offset + out.size();
+    for (uint64_t chunk = offset / ARCHIVE_CHUNK_SIZE;
+         chunk * ARCHIVE_CHUNK_SIZE < end;
+         ++chunk) {
+        uint64_t chunk_offsets[2];
+        memcpy(chunk_offsets,
+               stored + chunk * sizeof(uint64_t),
+               sizeof(chunk_offsets));
+        if (chunk_offsets[0] > chunk_offsets[1] ||
+            chunk_offsets[1] > entry.storedSize) {
+            throw std::runtime_error("Archive chunk is out of bounds");
+        }
+        const std::span<const uint8_t> block(
+            stored + chunk_offsets[0], chunk_offsets[1] - chunk_offsets[0]);
+
+        const uint64_t chunk_begin = chunk * ARCHIVE_CHUNK_SIZE;
+        const uint64_t chunk_size =
+            std::min<uint64_t>(ARCHIVE_CHUNK_SIZE, entry.size - chunk_begin);
+        const uint64_t first = std::max(offset, chunk_begin);
+        const uint64_t last = std::min(end, chunk_begin + chunk_size);
+        const std::span<uint8_t> dst =
+            out.subspan(first - offset, last - first);
+
+        if (block.size() == chunk_size) {
+            memcpy(dst.data(),
+                   block.data() + (first - chunk_begin),
+                   dst.size());
+        }
+        else if (dst.size() == chunk_size) {
+            lz4_decompress(block, dst);
+        }
+        else {
+            scratch.resize(chunk_size);
+            lz4_decompress(block, scratch);
+            memcpy(dst.data(),
+                   scratch.data() + (first - chunk_begin),
+                   dst.size());
+        }
+    }
+}
+
+void
+write_asset_archive(const std::string &path,
+                    std::span<const ArchiveSource> sources)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to create archive " + path);
+    }
+
+    ArchiveHeader header{};
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.entryCount = static_cast<uint32_t>(sources.size());
+    header.chunkSize = ARCHIVE_CHUNK_SIZE;
+    uint64_t size = sizeof(header);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<ArchiveEntry> entries;
+    std::string names;
+    for (const ArchiveSource &source : sources) {
+        const MappedFile data(source.path);
+        const std::span<const uint8_t> bytes(data.GetData(), data.GetSize());
+
+        ArchiveEntry entry{};
+        entry.pathHash = hash_path(source.name);
+        entry.size = bytes.size();
+        entry.nameOffset = static_cast<uint32_t>(names.size());
+        entry.nameLength = static_cast<uint32_t>(source.name.size());
+        names += source.name;
+
+        std::vector<uint8_t> compressed;
+        if (source.compression == ArchiveCompression::LZ4) {
+            compressed = compress_chunks(bytes, entry.chunkCount);
+        }
+        std::span<const uint8_t> stored = bytes;
+        if (!compressed.empty() && compressed.size() < bytes.size()) {
+            entry.compression = ArchiveCompression::LZ4;
+            stored = compressed;
+        }
+        else {
+            entry.chunkCount = 0;
+        }
+
+        pad_to(file, size, ARCHIVE_ALIGNMENT);
+        entry.offset = size;
+        entry.storedSize = stored.size();
+        file.write(reinterpret_cast<const char *>(stored.data()),
+                   static_cast<std::streamsize>(stored.size()));
+        size += stored.size();
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(),
+              entries.end(),
+              [](const ArchiveEntry &a, const ArchiveEntry &b) {
+                  return a.pathHash < b.pathHash;
+              });
+    for (size_t i = 1; i < entries.size(); ++i) {
+        if (entries[i].pathHash == entries[i - 1].pathHash) {
+            throw std::runtime_error("Archive entry names collide in " + path);
+        }
+    }
+
+    pad_to(file, size, alignof(ArchiveEntry));
+    header.tocOffset = size;
+    file.write(reinterpret_cast<const char *>(entries.data()),
+               static_cast<std::streamsize>(entries.size() *
+                                            sizeof(ArchiveEntry)));
+    size += entries.size() * sizeof(ArchiveEntry);
+    header.namesOffset = size;
+    header.namesSize = names.size();
+    file.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (!file) {
+        throw std::runtime_error("Failed to write archive " + path);
+    }
+}
+
+AssetArchive::AssetArchive(const std::string &path)
+    : m_path(path), m_file(path)
+{
+    const uint64_t file_size = m_file.GetSize();
+    if (file_size < sizeof(ArchiveHeader)) {
+        throw std::runtime_error("Archive is truncated: " + path);
+    }
+
+    ArchiveHeader header;
+    memcpy(&header, m_file.GetData(), sizeof(header));
+    if (header.magic != ARCHIVE_MAGIC) {
+        throw std::runtime_error("Not an asset archive: " + path);
+    }
+    if (header.version != ARCHIVE_VERSION ||
+        header.chunkSize != ARCHIVE_CHUNK_SIZE) {
+        throw std::runtime_error("Archive has an outdated version: " + path);
+    }
+    if (header.tocOffset % alignof(ArchiveEntry) != 0 ||
+        header.tocOffset > file_size ||
+        (file_size - header.tocOffset) / sizeof(ArchiveEntry) <
+            header.entryCount ||
+        header.namesOffset > file_size ||
+        file_size - header.namesOffset < header.namesSize) {
+        throw std::runtime_error("Archive table of contents is out of bounds");
+    }
+
+    m_entries = {reinterpret_cast<const ArchiveEntry *>(m_file.GetData() +
+                                                        header.tocOffset),
+                 header.entryCount};
+    m_names = {reinterpret_cast<const char *>(m_file.GetData() +
+                                              header.namesOffset),
+               header.namesSize};
+
+    for (const ArchiveEntry &entry : m_entries) {
+        const bool compressed = entry.compression == ArchiveCompression::LZ4;
+        if (entry.offset > file_size ||
+            file_size - entry.offset < entry.storedSize ||
+            entry.nameOffset > m_names.size() ||
+            m_names.size() - entry.nameOffset < entry.nameLength ||
+            (!compressed && (entry.compression != ArchiveCompression::None ||
+                             entry.storedSize != entry.size)) ||
+            (compressed && entry.chunkCount !=
+                               (entry.size + ARCHIVE_CHUNK_SIZE - 1) /
+                                   ARCHIVE_CHUNK_SIZE) ||
+            (compressed && (entry.offset % alignof(uint64_t) != 0 ||
+                            entry.storedSize / sizeof(uint64_t) <=
+                                entry.chunkCount))) {
+            throw std::runtime_error("Archive entry is out of bounds");
+        }
+    }
+}
+
+const ArchiveEntry *
+AssetArchive::Find(std::string_view name) const
+{
+    const uint64_t hash = hash_path(name);
+    const auto it = std::lower_bound(
+        m_entries.begin(),
+        m_entries.end(),
+        hash,
+        [](const ArchiveEntry &entry, uint64_t value) {
+            return entry.pathHash < value;
+        });
+    if (it == m_entries.end() || it->pathHash != hash ||
+        GetName(*it) != name) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+std::span<const ArchiveEntry>
+AssetArchive::GetEntries() const
+{
+    return m_entries;
+}
+
+std::string_view
+AssetArchive::GetName(const ArchiveEntry &entry) const
+{
+    return m_names.substr(entry.nameOffset, entry.nameLength);
+}
+
+std::span<const uint8_t>
+AssetArchive::GetMappedData(const ArchiveEntry &entry) const
+{
+    if (entry.compression != ArchiveCompression::None) {
+        return {};
+    }
+    return {m_file.GetData() + entry.offset, entry.size};
+}
+
+void
+AssetArchive::Read(const ArchiveEntry &entry,
+                   uint64_t offset,
+                   std::span<uint8_t> out) const
+{
+    if (offset > entry.size || entry.size - offset < out.size()) {
+        throw std::runtime_error("Read past the end of archive entry " +
+                                 std::string(GetName(entry)));
+    }
+    read_entry(entry, m_file.GetData() + entry.offset, offset, out);
+}
+
+std::vector<uint8_t>
+AssetArchive::Decode(const ArchiveEntry &entry,
+                     std::span<const uint8_t> stored)
+{
+    if (stored.size() != entry.storedSize) {
+        throw std::runtime_error("Archive entry was read incompletely");
+    }
+    std::vector<uint8_t> bytes(entry.size);
+    read_entry(entry, stored.data(), 0, bytes);
+    return bytes;
+}
+
+const std::string &
+AssetArchive::GetPath() const
+{
+    return m_path;
+}
+}  // namespace NEngine
@@ -0,0 +1,179 @@
+#include "asset_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace NEngine {
+
+// Multipliers and finalizer of xxHash64, applied to one 8 byte lane at a
+// time.
+static constexpr uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t HASH_PRIME_3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t HASH_PRIME_5 = 0x27D4EB2F165667C5ull;
+
+// Suffix of entries that are still being cooked.
+static constexpr const char *TEMPORARY_EXTENSION = ".tmp";
+
+static uint64_t
+rotate_left(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t
+hash_bytes(std::span<const uint8_t> data, uint64_t seed)
+{
+    uint64_t hash = seed + HASH_PRIME_5 + data.size();
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        uint64_t lane;
+        memcpy(&lane, data.data() + i, sizeof(lane));
+        hash ^= rotate_left(lane * HASH_PRIME_2, 31) * HASH_PRIME_1;
+        hash = rotate_left(hash, 27) * HASH_PRIME_1 + HASH_PRIME_3;
+    }
+    for (; i < data.size(); ++i) {
+        hash ^= data[i] * HASH_PRIME_5;
+        hash = rotate_left(hash, 11) * HASH_PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t
+get_asset_key(const std::string &sourcePath,
+              uint32_t cookerVersion,
+              std::string_view settings)
+{
+    const MappedFile source(sourcePath);
+    const uint64_t settings_hash = hash_bytes(
+        {reinterpret_cast<const uint8_t *>(settings.data()), settings.size()},
+        cookerVersion);
+    return hash_bytes({source.GetData(), source.GetSize()}, settings_hash);
+}
+
+AssetCache::AssetCache(const std::string &directory, uint64_t maxBytes)
+    : m_directory(directory)
+{
+    m_stats.bytesLimit = maxBytes;
+    std::filesystem::create_directories(m_directory);
+
+    for (const auto &file : std::filesystem::directory_iterator(m_directory)) {
+        if (!file.is_regular_file()) {
+            continue;
+        }
+        // Left behind by a cook that did not finish.
+        if (file.path().extension() == TEMPORARY_EXTENSION) {
+            std::error_code error;
+            std::filesystem::remove(file.path(), error);
+            continue;
+        }
+        const Entry entry{file.file_size(), file.last_write_time()};
+        m_entries[file.path().filename().string()] = entry;
+        m_stats.bytesUsed += entry.size;
+    }
+    Evict({});
+}
+
+std::string
+AssetCache::Get(uint64_t key,
+                std::string_view extension,
+                const CookFunction &cook)
+{
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+    const std::string name = hex + std::string(extension);
+    const std::filesystem::path path = m_directory / name;
+    const auto now = std::filesystem::file_time_type::clock::now();
+
+    std::filesystem::path temporary = path;
+    {
+        std::lock_guard lock(m_mutex);
+        auto it = m_entries.find(name);
+        if (it != m_entries.end()) {
+            std::error_code error;
+            std::filesystem::last_write_time(path, now, error);
+            if (!error) {
+                it->second.lastUse = now;
+                ++m_stats.hits;
+                return path.string();
+            }
+            // Deleted behind the cache's back.
+            m_stats.bytesUsed -= it->second.size;
+            m_entries.erase(it);
+        }
+
+        ++m_stats.misses;
+        temporary += "." + std::to_string(m_nextTemporary++);
+        temporary += TEMPORARY_EXTENSION;
+    }
+
+    try {
+        cook(temporary.string());
+        std::filesystem::rename(temporary, path);
+    }
+    catch (...) {
+        std::error_code error;
+        std::filesystem::remove(temporary, error);
+        throw;
+    }
+
+    std::lock_guard lock(m_mutex);
+    const Entry entry{std::filesystem::file_size(path), now};
+    const auto it = m_entries.find(name);
+    if (it != m_entries.end()) {
+        // Cooked concurrently by another thread, which added it first.
+        m_stats.bytesUsed -= it->second.size;
+    }
+    m_entries[name] = entry;
+    m_stats.bytesUsed += entry.size;
+    Evict(name);
+    return path.string();
+}
+
+AssetCacheStats
+AssetCache::GetStats() const
+{
+    std::lock_guard lock(m_mutex);
+    AssetCacheStats stats = m_stats;
+    stats.entryCount = static_cast<uint32_t>(m_entries.size());
+    return stats;
+}
+
+void
+AssetCache::Evict(const std::string &keep)
+{
+    if (m_stats.bytesUsed <= m_stats.bytesLimit) {
+        return;
+    }
+
+    std::vector<std::pair<std::filesystem::file_time_type, std::string>>
+        by_last_use;
+    for (const auto &[name, entry] : m_entries) {
+        if (name != keep) {
+            by_last_use.emplace_back(entry.lastUse, name);
+        }
+    }
+    std::sort(by_last_use.begin(), by_last_use.end());
+
+    for (const auto &[last_use, name] : by_last_use) {
+        if (m_stats.bytesUsed <= m_stats.bytesLimit) {
+            break;
+        }
+        std::error_code error;
+        std::filesystem::remove(m_directory / name, error);
+        m_stats.bytesUsed -= m_entries[name].size;
+        m_entries.erase(name);
+        ++m_stats.evictions;
+    }
+}
+}  // namespace NEngine
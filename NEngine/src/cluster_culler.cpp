@@ -0,0 +1,304 @@
+#include "cluster_culler.h"
+
+#include <array>
+
+#include "frustum.h"
+#include "misc.h"
+
+namespace NEngine {
+
+static constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+struct ClusterCullParams
+{
+    glm::vec4 frustum[6];
+    glm::vec3 cameraPosition;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t coneCulling;
+};
+
+static_assert(sizeof(ClusterCullParams) <= 128,
+              "Push constants must fit the guaranteed minimum size");
+
+ClusterCuller::ClusterCuller(VkDevice device,
+                             GpuAllocator &allocator,
+                             const std::vector<char> &shaderCode,
+                             uint32_t meshletCount)
+    : m_device(device),
+      m_allocator(&allocator),
+      m_meshletCount(meshletCount)
+{
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+    VKRESULT(vkCreateDescriptorSetLayout(
+        device, &layout_info, nullptr, &m_descriptorSetLayout));
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(ClusterCullParams);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &m_descriptorSetLayout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    VKRESULT(vkCreatePipelineLayout(
+        device, &pipeline_layout_info, nullptr, &m_pipelineLayout));
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shaderCode.size();
+    module_info.pCode = reinterpret_cast<const uint32_t *>(shaderCode.data());
+    VkShaderModule shader_module{};
+    VKRESULT(
+        vkCreateShaderModule(device, &module_info, nullptr, &shader_module));
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = m_pipelineLayout;
+    VKRESULT(vkCreateComputePipelines(
+        device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_pipeline));
+    vkDestroyShaderModule(device, shader_module, nullptr);
+
+    // The count is reset with vkCmdFillBuffer before every dispatch.
+    CreateBuffer(sizeof(Meshlet) * meshletCount,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 m_meshletBuffer,
+                 m_meshletMemory);
+    CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * meshletCount,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                 m_drawBuffer,
+                 m_drawMemory);
+    CreateBuffer(sizeof(uint32_t),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 m_countBuffer,
+                 m_countMemory);
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = static_cast<uint32_t>(bindings.size());
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    VKRESULT(vkCreateDescriptorPool(
+        device, &pool_info, nullptr, &m_descriptorPool));
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = m_descriptorPool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &m_descriptorSetLayout;
+    VKRESULT(vkAllocateDescriptorSets(device, &alloc_info, &m_descriptorSet));
+
+    const std::array<VkDescriptorBufferInfo, 3> buffer_infos = {{
+        {m_meshletBuffer, 0, VK_WHOLE_SIZE},
+        {m_drawBuffer, 0, VK_WHOLE_SIZE},
+        {m_countBuffer, 0, VK_WHOLE_SIZE},
+    }};
+    std::array<VkWriteDescriptorSet, 3> writes{};
+    for (uint32_t i = 0; i < writes.size(); ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = m_descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &buffer_infos[i];
+    }
+    vkUpdateDescriptorSets(device,
+                           static_cast<uint32_t>(writes.size()),
+                           writes.data(),
+                           0,
+                           nullptr);
+}
+
+ClusterCuller::~ClusterCuller()
+{
+    Cleanup();
+}
+
+void
+ClusterCuller::Cleanup()
+{
+    if (!m_pipeline) {
+        return;
+    }
+
+    vkDestroyBuffer(m_device, m_meshletBuffer, nullptr);
+    m_allocator->Free(m_meshletMemory);
+    vkDestroyBuffer(m_device, m_drawBuffer, nullptr);
+    m_allocator->Free(m_drawMemory);
+    vkDestroyBuffer(m_device, m_countBuffer, nullptr);
+    m_allocator->Free(m_countMemory);
+
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+    m_descriptorPool = nullptr;
+    m_pipeline = nullptr;
+    m_pipelineLayout = nullptr;
+    m_descriptorSetLayout = nullptr;
+}
+
+void
+ClusterCuller::CreateBuffer(VkDeviceSize size,
+                            VkBufferUsageFlags usage,
+                            VkBuffer &buffer,
+                            GpuAllocation &memory) const
+{
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = size;
+    info.usage = usage;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VKRESULT(vkCreateBuffer(m_device, &info, nullptr, &buffer));
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(m_device, buffer, &memory_requirements);
+    memory = m_allocator->Allocate(memory_requirements,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VKRESULT(
+        vkBindBufferMemory(m_device, buffer, memory.memory, memory.offset));
+}
+
+void
+ClusterCuller::Upload(UploadService &transferUploads,
+                      UploadService &graphicsUploads,
+                      std::span<const Meshlet> meshlets)
+{
+    ASSERT(meshlets.size() == m_meshletCount, "Meshlet count changed");
+    transferUploads.CopyToBuffer(
+        m_meshletBuffer, meshlets.data(), meshlets.size_bytes());
+    transferUploads.TransferOwnership(graphicsUploads,
+                                      m_meshletBuffer,
+                                      VK_ACCESS_SHADER_READ_BIT,
+                                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+void
+ClusterCuller::Record(VkCommandBuffer cb,
+                      uint32_t firstMeshlet,
+                      uint32_t meshletCount,
+                      const glm::mat4 &model,
+                      const glm::mat4 &view,
+                      const glm::mat4 &proj,
+                      bool coneCulling) const
+{
+    ClusterCullParams params{};
+    extract_frustum_planes(proj * view * model, params.frustum);
+    params.cameraPosition = glm::inverse(view * model)[3];
+    ASSERT(firstMeshlet <= m_meshletCount &&
+               m_meshletCount - firstMeshlet >= meshletCount,
+           "Meshlet range is out of bounds");
+    params.firstMeshlet = firstMeshlet;
+    params.meshletCount = meshletCount;
+    params.coneCulling = coneCulling ? 1 : 0;
+
+    // The previous frame's indirect draw must be done reading the buffers
+    // before they are overwritten.
+    vkCmdPipelineBarrier(cb,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT |
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+
+    vkCmdFillBuffer(cb, m_countBuffer, 0, sizeof(uint32_t), 0);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                            VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cb,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         1,
+                         &barrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(cb,
+                            VK_PIPELINE_BIND_POINT_COMPUTE,
+                            m_pipelineLayout,
+                            0,
+                            1,
+                            &m_descriptorSet,
+                            0,
+                            nullptr);
+    vkCmdPushConstants(cb,
+                       m_pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT,
+                       0,
+                       sizeof(params),
+                       &params);
+    vkCmdDispatch(
+        cb, (meshletCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(cb,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         0,
+                         1,
+                         &barrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+}
+
+void
+ClusterCuller::Draw(VkCommandBuffer cb) const
+{
+    vkCmdDrawIndexedIndirectCount(cb,
+                                  m_drawBuffer,
+                                  0,
+                                  m_countBuffer,
+                                  0,
+                                  m_meshletCount,
+                                  sizeof(VkDrawIndexedIndirectCommand));
+}
+
+uint32_t
+ClusterCuller::GetMeshletCount() const
+{
+    return m_meshletCount;
+}
+}  // namespace NEngine
@@ -0,0 +1,397 @@
+#include "depth_pyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include "misc.h"
+
+namespace NEngine {
+
+static constexpr VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+static constexpr uint32_t PYRAMID_GROUP_SIZE = 8;
+static constexpr uint32_t BINDING_COUNT = 3;
+
+struct DepthPyramidParams
+{
+    int32_t srcWidth;
+    int32_t srcHeight;
+    int32_t dstWidth;
+    int32_t dstHeight;
+    // Non-zero for level 0, which reads the depth buffer instead of the
+    // level above.
+    uint32_t fromDepth;
+    uint32_t sampleCount;
+};
+
+static uint32_t
+level_extent(uint32_t extent, uint32_t level)
+{
+    return std::max(extent >> level, 1u);
+}
+
+DepthPyramid::DepthPyramid(VkDevice device,
+                           GpuAllocator &allocator,
+                           const std::vector<char> &shaderCode)
+    : m_device(device),
+      m_allocator(&allocator)
+{
+    // The multisampled depth buffer, the level above and the level built.
+    std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+    VKRESULT(vkCreateDescriptorSetLayout(
+        device, &layout_info, nullptr, &m_descriptorSetLayout));
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(DepthPyramidParams);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &m_descriptorSetLayout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    VKRESULT(vkCreatePipelineLayout(
+        device, &pipeline_layout_info, nullptr, &m_pipelineLayout));
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shaderCode.size();
+    module_info.pCode = reinterpret_cast<const uint32_t *>(shaderCode.data());
+    VkShaderModule shader_module{};
+    VKRESULT(
+        vkCreateShaderModule(device, &module_info, nullptr, &shader_module));
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = m_pipelineLayout;
+    VKRESULT(vkCreateComputePipelines(
+        device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_pipeline));
+    vkDestroyShaderModule(device, shader_module, nullptr);
+
+    // Only used with texelFetch, filtering never happens.
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+    VKRESULT(vkCreateSampler(device, &sampler_info, nullptr, &m_sampler));
+}
+
+DepthPyramid::~DepthPyramid()
+{
+    Cleanup();
+}
+
+void
+DepthPyramid::Cleanup()
+{
+    if (!m_pipeline) {
+        return;
+    }
+
+    DestroyImage();
+    vkDestroySampler(m_device, m_sampler, nullptr);
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+    m_sampler = nullptr;
+    m_pipeline = nullptr;
+    m_pipelineLayout = nullptr;
+    m_descriptorSetLayout = nullptr;
+}
+
+void
+DepthPyramid::DestroyImage()
+{
+    if (!m_image) {
+        return;
+    }
+
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    m_descriptorPool = nullptr;
+    m_descriptorSets.clear();
+    for (const VkImageView view : m_levelViews) {
+        vkDestroyImageView(m_device, view, nullptr);
+    }
+    m_levelViews.clear();
+    m_image.reset();
+}
+
+void
+DepthPyramid::Resize(UploadService &uploads,
+                     VkExtent2D extent,
+                     VkSampleCountFlagBits samples)
+{
+    DestroyImage();
+    m_depthExtent = extent;
+    m_sampleCount = static_cast<uint32_t>(samples);
+    m_graphVersion = 0;
+
+    // Halving a power of two keeps every texel of a level covering exactly
+    // four of the level above, so only level 0 has to handle texels that
+    // straddle pixels.
+    const uint32_t width = std::bit_floor(std::max(extent.width, 1u));
+    const uint32_t height = std::bit_floor(std::max(extent.height, 1u));
+    const uint32_t level_count =
+        static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+
+    ImageCreateInfo create_info{};
+    create_info.width = width;
+    create_info.height = height;
+    create_info.format = PYRAMID_FORMAT;
+    create_info.mipLevels = level_count;
+    create_info.numSamples = VK_SAMPLE_COUNT_1_BIT;
+    create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    create_info.usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    create_info.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    m_image = std::make_unique<Image>(create_info, m_device, *m_allocator);
+    m_image->CreateImageView(VK_IMAGE_ASPECT_COLOR_BIT, level_count);
+
+    for (uint32_t level = 0; level < level_count; ++level) {
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = m_image->GetImage();
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = PYRAMID_FORMAT;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = level;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+        VkImageView view{};
+        VKRESULT(vkCreateImageView(m_device, &view_info, nullptr, &view));
+        m_levelViews.push_back(view);
+    }
+
+    const std::array<VkDescriptorPoolSize, 2> pool_sizes = {{
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * level_count},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, level_count},
+    }};
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = level_count;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    VKRESULT(vkCreateDescriptorPool(
+        m_device, &pool_info, nullptr, &m_descriptorPool));
+
+    const std::vector<VkDescriptorSetLayout> layouts(level_count,
+                                                     m_descriptorSetLayout);
+    m_descriptorSets.resize(level_count);
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = m_descriptorPool;
+    alloc_info.descriptorSetCount = level_count;
+    alloc_info.pSetLayouts = layouts.data();
+    VKRESULT(vkAllocateDescriptorSets(
+        m_device, &alloc_info, m_descriptorSets.data()));
+
+    // Every dispatch binds all three images. The depth buffer is written
+    // by WriteDepthView once the render graph has created it. Level 0 does
+    // not read the level above, so its own view stands in for it.
+    for (uint32_t level = 0; level < level_count; ++level) {
+        const std::array<VkDescriptorImageInfo, 2> image_infos = {{
+            {m_sampler,
+             m_levelViews[level == 0 ? 0 : level - 1],
+             VK_IMAGE_LAYOUT_GENERAL},
+            {nullptr, m_levelViews[level], VK_IMAGE_LAYOUT_GENERAL},
+        }};
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        for (uint32_t i = 0; i < writes.size(); ++i) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = m_descriptorSets[level];
+            writes[i].dstBinding = i + 1;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType =
+                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[i].pImageInfo = &image_infos[i];
+        }
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        vkUpdateDescriptorSets(m_device,
+                               static_cast<uint32_t>(writes.size()),
+                               writes.data(),
+                               0,
+                               nullptr);
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = m_image->GetImage();
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = level_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(uploads.GetCommandBuffer(),
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr,
+                         1,
+                         &barrier);
+}
+
+RenderGraphImage
+DepthPyramid::AddPass(RenderGraph &graph, RenderGraphImage depth)
+{
+    ASSERT(m_image, "Resize must come first");
+
+    RenderGraphImageDesc desc{};
+    desc.format = PYRAMID_FORMAT;
+    desc.extent = {m_image->GetWidth(), m_image->GetHeight()};
+    RenderGraphImport import{};
+    import.image = m_image->GetImage();
+    import.view = m_image->GetImageView();
+    import.initialLayout = VK_IMAGE_LAYOUT_GENERAL;
+    import.finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+    const RenderGraphImage pyramid = graph.ImportImage(desc, import);
+
+    const std::array<RenderGraphUse, 2> uses = {{
+        {depth, RenderGraphAccess::DepthRead},
+        {pyramid, RenderGraphAccess::ComputeWrite},
+    }};
+    // The graph recreates the depth buffer when it compiles, and does so
+    // after waiting for the GPU to be idle, so the descriptors can be
+    // rewritten while the pass records.
+    graph.AddComputePass(uses, [this, &graph, depth](VkCommandBuffer cb) {
+        if (m_graphVersion != graph.GetVersion()) {
+            WriteDepthView(graph.GetImageView(depth));
+            m_graphVersion = graph.GetVersion();
+        }
+        Record(cb);
+    });
+    return pyramid;
+}
+
+void
+DepthPyramid::WriteDepthView(VkImageView depthView) const
+{
+    const VkDescriptorImageInfo image_info = {
+        m_sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    std::vector<VkWriteDescriptorSet> writes(m_descriptorSets.size());
+    for (size_t level = 0; level < writes.size(); ++level) {
+        writes[level].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[level].dstSet = m_descriptorSets[level];
+        writes[level].dstBinding = 0;
+        writes[level].descriptorCount = 1;
+        writes[level].descriptorType =
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[level].pImageInfo = &image_info;
+    }
+    vkUpdateDescriptorSets(m_device,
+                           static_cast<uint32_t>(writes.size()),
+                           writes.data(),
+                           0,
+                           nullptr);
+}
+
+void
+DepthPyramid::Record(VkCommandBuffer cb) const
+{
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    const uint32_t width = m_image->GetWidth();
+    const uint32_t height = m_image->GetHeight();
+    for (uint32_t level = 0; level < m_levelViews.size(); ++level) {
+        DepthPyramidParams params{};
+        params.srcWidth = static_cast<int32_t>(
+            level == 0 ? m_depthExtent.width : level_extent(width, level - 1));
+        params.srcHeight = static_cast<int32_t>(
+            level == 0 ? m_depthExtent.height
+                       : level_extent(height, level - 1));
+        params.dstWidth = static_cast<int32_t>(level_extent(width, level));
+        params.dstHeight = static_cast<int32_t>(level_extent(height, level));
+        params.fromDepth = level == 0;
+        params.sampleCount = m_sampleCount;
+
+        vkCmdBindDescriptorSets(cb,
+                                VK_PIPELINE_BIND_POINT_COMPUTE,
+                                m_pipelineLayout,
+                                0,
+                                1,
+                                &m_descriptorSets[level],
+                                0,
+                                nullptr);
+        vkCmdPushConstants(cb,
+                           m_pipelineLayout,
+                           VK_SHADER_STAGE_COMPUTE_BIT,
+                           0,
+                           sizeof(params),
+                           &params);
+        vkCmdDispatch(cb,
+                      (params.dstWidth + PYRAMID_GROUP_SIZE - 1) /
+                          PYRAMID_GROUP_SIZE,
+                      (params.dstHeight + PYRAMID_GROUP_SIZE - 1) /
+                          PYRAMID_GROUP_SIZE,
+                      1);
+
+        // Makes the level visible to the next dispatch. The render graph
+        // orders the pass against the culling around it.
+        if (level + 1 == m_levelViews.size()) {
+            break;
+        }
+        vkCmdPipelineBarrier(cb,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0,
+                             1,
+                             &barrier,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr);
+    }
+}
+
+VkImageView
+DepthPyramid::GetView() const
+{
+    return m_image->GetImageView();
+}
+
+VkSampler
+DepthPyramid::GetSampler() const
+{
+    return m_sampler;
+}
+}  // namespace NEngine
@@ -0,0 +1,79 @@
+#include "draw_list.h"
+
+#include <algorithm>
+
+#include "misc.h"
+
+namespace NEngine {
+
+static constexpr uint32_t MESH_BITS = 24;
+static constexpr uint32_t LOD_BITS = 8;
+
+static uint64_t
+get_group_key(uint32_t mesh, uint32_t lod, uint32_t material)
+{
+    return static_cast<uint64_t>(mesh) << (LOD_BITS + 32) |
+           static_cast<uint64_t>(lod) << 32 | material;
+}
+
+void
+DrawList::Clear()
+{
+    m_entries.clear();
+    m_added.clear();
+    m_instances.clear();
+    m_groups.clear();
+}
+
+void
+DrawList::Add(uint32_t mesh,
+              uint32_t lod,
+              uint32_t material,
+              const glm::mat4 &model)
+{
+    ASSERT(mesh < (1u << MESH_BITS) && lod < (1u << LOD_BITS),
+           "Mesh or level of detail out of range");
+    m_entries.push_back({get_group_key(mesh, lod, material),
+                         static_cast<uint32_t>(m_added.size())});
+    m_added.push_back({model, material});
+}
+
+void
+DrawList::Build()
+{
+    std::sort(m_entries.begin(),
+              m_entries.end(),
+              [](const Entry &a, const Entry &b) {
+                  return a.key != b.key ? a.key < b.key : a.index < b.index;
+              });
+
+    m_instances.clear();
+    m_groups.clear();
+    m_instances.reserve(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (i == 0 || m_entries[i].key != m_entries[i - 1].key) {
+            const uint64_t key = m_entries[i].key;
+            m_groups.push_back(
+                {static_cast<uint32_t>(key >> (LOD_BITS + 32)),
+                 static_cast<uint32_t>(key >> 32) & ((1u << LOD_BITS) - 1),
+                 static_cast<uint32_t>(key),
+                 static_cast<uint32_t>(i),
+                 0});
+        }
+        ++m_groups.back().instanceCount;
+        m_instances.push_back(m_added[m_entries[i].index]);
+    }
+}
+
+std::span<const InstanceData>
+DrawList::GetInstances() const
+{
+    return m_instances;
+}
+
+std::span<const DrawGroup>
+DrawList::GetGroups() const
+{
+    return m_groups;
+}
+}  // namespace NEngine
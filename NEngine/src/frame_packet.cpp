@@ -0,0 +1,86 @@
+#include "frame_packet.h"
+
+namespace NEngine {
+
+UiDrawData::~UiDrawData()
+{
+    Clear();
+}
+
+void
+UiDrawData::Capture(const ImDrawData &drawData)
+{
+    Clear();
+    m_drawData = drawData;
+    m_drawLists.reserve(drawData.CmdListsCount);
+    for (int i = 0; i < drawData.CmdListsCount; ++i) {
+        m_drawLists.push_back(drawData.CmdLists[i]->CloneOutput());
+    }
+    m_drawData.CmdLists = m_drawLists.data();
+}
+
+ImDrawData *
+UiDrawData::Get() const
+{
+    return m_drawData.Valid ? &m_drawData : nullptr;
+}
+
+void
+UiDrawData::Clear()
+{
+    for (ImDrawList *draw_list : m_drawLists) {
+        IM_DELETE(draw_list);
+    }
+    m_drawLists.clear();
+    m_drawData.Clear();
+}
+
+FramePacket *
+FramePacketQueue::BeginWrite()
+{
+    std::unique_lock lock(m_mutex);
+    m_changed.wait(lock, [this] {
+        return m_closed || m_published - m_released < PACKET_COUNT;
+    });
+    return m_closed ? nullptr : &m_packets[m_published % PACKET_COUNT];
+}
+
+void
+FramePacketQueue::Publish()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        ++m_published;
+    }
+    m_changed.notify_all();
+}
+
+const FramePacket *
+FramePacketQueue::Acquire()
+{
+    std::unique_lock lock(m_mutex);
+    m_changed.wait(lock,
+                   [this] { return m_closed || m_acquired < m_published; });
+    return m_closed ? nullptr : &m_packets[m_acquired++ % PACKET_COUNT];
+}
+
+void
+FramePacketQueue::Release()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        ++m_released;
+    }
+    m_changed.notify_all();
+}
+
+void
+FramePacketQueue::Close()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_closed = true;
+    }
+    m_changed.notify_all();
+}
+}  // namespace NEngine
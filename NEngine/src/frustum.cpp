@@ -0,0 +1,52 @@
+#include "frustum.h"
+
+namespace NEngine {
+
+void
+extract_frustum_planes(const glm::mat4 &m, glm::vec4 (&planes)[6])
+{
+    const auto row = [&](int i) {
+        return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    };
+    planes[0] = row(3) + row(0);
+    planes[1] = row(3) - row(0);
+    planes[2] = row(3) + row(1);
+    planes[3] = row(3) - row(1);
+    planes[4] = row(2);
+    planes[5] = row(3) - row(2);
+    for (glm::vec4 &plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+bool
+is_box_visible(const glm::vec4 (&planes)[6], const MeshBounds &bounds)
+{
+    // The corner furthest along the plane's normal is the last to leave it.
+    for (const glm::vec4 &plane : planes) {
+        const glm::vec3 corner(plane.x >= 0.0f ? bounds.max.x : bounds.min.x,
+                               plane.y >= 0.0f ? bounds.max.y : bounds.min.y,
+                               plane.z >= 0.0f ? bounds.max.z : bounds.min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+MeshBounds
+transform_bounds(const glm::mat4 &m, const MeshBounds &bounds)
+{
+    // Arvo's method: each column of the matrix scaled by the box's smallest
+    // and largest coordinate on that axis, the smaller of the two added to
+    // the minimum and the larger to the maximum.
+    MeshBounds result{glm::vec3(m[3]), glm::vec3(m[3])};
+    for (int column = 0; column < 3; ++column) {
+        const glm::vec3 a = glm::vec3(m[column]) * bounds.min[column];
+        const glm::vec3 b = glm::vec3(m[column]) * bounds.max[column];
+        result.min += glm::min(a, b);
+        result.max += glm::max(a, b);
+    }
+    return result;
+}
+}  // namespace NEngine
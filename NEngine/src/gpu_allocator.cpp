@@ -0,0 +1,265 @@
+#include "gpu_allocator.h"
+
+#include <algorithm>
+
+#include "misc.h"
+
+namespace NEngine {
+
+static VkDeviceSize
+align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+GpuAllocator::GpuAllocator(VkDevice device,
+                           VkPhysicalDevice physicalDevice,
+                           VkDeviceSize blockSize)
+    : m_device(device),
+      m_blockSize(blockSize)
+{
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_bufferImageGranularity =
+        std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+}
+
+GpuAllocator::~GpuAllocator()
+{
+    Cleanup();
+}
+
+void
+GpuAllocator::Cleanup()
+{
+    for (auto &blocks : m_blocks) {
+        for (Block &block : blocks) {
+            DestroyBlock(block);
+        }
+        blocks.clear();
+    }
+}
+
+GpuAllocation
+GpuAllocator::Allocate(const VkMemoryRequirements &requirements,
+                       VkMemoryPropertyFlags properties)
+{
+    const uint32_t memory_type = find_memory_type(
+        m_memoryProperties, requirements.memoryTypeBits, properties);
+
+    // Linear and optimal resources may end up next to each other inside a
+    // block, so every sub-range is padded to bufferImageGranularity.
+    const VkDeviceSize alignment =
+        std::max(requirements.alignment, m_bufferImageGranularity);
+    const VkDeviceSize size = align_up(requirements.size, alignment);
+
+    GpuAllocation allocation{};
+    allocation.memoryType = memory_type;
+    allocation.size = size;
+
+    std::vector<Block> &blocks = m_blocks[memory_type];
+
+    Block *target = nullptr;
+    // Anything bigger than half a block would waste most of a shared block, so
+    // it gets memory of its own.
+    if (size > m_blockSize / 2) {
+        target = &CreateBlock(memory_type, size, true);
+        target->freeRanges.clear();
+        allocation.offset = 0;
+    }
+    else {
+        for (Block &block : blocks) {
+            if (!block.dedicated &&
+                TryAllocateFromBlock(block, size, alignment, allocation.offset))
+            {
+                target = &block;
+                break;
+            }
+        }
+        if (!target) {
+            target = &CreateBlock(memory_type, m_blockSize, false);
+            const bool ok = TryAllocateFromBlock(
+                *target, size, alignment, allocation.offset);
+            ASSERT(ok, "Fresh block must fit the allocation");
+        }
+    }
+
+    ++target->allocationCount;
+    target->used += size;
+
+    allocation.memory = target->memory;
+    allocation.blockId = target->id;
+    if (target->mapped) {
+        allocation.mapped =
+            static_cast<char *>(target->mapped) + allocation.offset;
+    }
+
+    return allocation;
+}
+
+void
+GpuAllocator::Free(const GpuAllocation &allocation)
+{
+    if (!allocation.memory) {
+        return;
+    }
+
+    std::vector<Block> &blocks = m_blocks[allocation.memoryType];
+    const auto it = std::find_if(
+        blocks.begin(), blocks.end(), [&allocation](const Block &block) {
+            return block.id == allocation.blockId;
+        });
+    ASSERT(it != blocks.end(), "Allocation does not belong to this allocator");
+
+    Block &block = *it;
+    --block.allocationCount;
+    block.used -= allocation.size;
+
+    // Keep one empty shared block per memory type around so that a
+    // load/unload cycle does not bounce memory back and forth with the driver.
+    const bool keep_block =
+        !block.dedicated &&
+        std::count_if(blocks.begin(), blocks.end(), [](const Block &b) {
+            return !b.dedicated;
+        }) == 1;
+
+    if (block.allocationCount == 0 && !keep_block) {
+        DestroyBlock(block);
+        blocks.erase(it);
+    }
+    else if (!block.dedicated) {
+        auto &ranges = block.freeRanges;
+        const Range freed = {allocation.offset, allocation.size};
+        auto next = std::lower_bound(
+            ranges.begin(),
+            ranges.end(),
+            freed,
+            [](const Range &a, const Range &b) { return a.offset < b.offset; });
+        next = ranges.insert(next, freed);
+
+        // Coalesce with the following and preceding free ranges.
+        if (next + 1 != ranges.end() &&
+            next->offset + next->size == (next + 1)->offset) {
+            next->size += (next + 1)->size;
+            ranges.erase(next + 1);
+        }
+        if (next != ranges.begin() &&
+            (next - 1)->offset + (next - 1)->size == next->offset) {
+            (next - 1)->size += next->size;
+            ranges.erase(next);
+        }
+    }
+}
+
+GpuAllocatorStats
+GpuAllocator::GetStats() const
+{
+    GpuAllocatorStats stats{};
+    for (const auto &blocks : m_blocks) {
+        for (const Block &block : blocks) {
+            ++stats.blockCount;
+            if (block.dedicated) {
+                ++stats.dedicatedBlockCount;
+            }
+            stats.allocationCount += block.allocationCount;
+            stats.bytesReserved += block.size;
+            stats.bytesUsed += block.used;
+            for (const Range &range : block.freeRanges) {
+                ++stats.freeRangeCount;
+                stats.largestFreeRange =
+                    std::max(stats.largestFreeRange, range.size);
+            }
+        }
+    }
+    return stats;
+}
+
+const VkPhysicalDeviceMemoryProperties &
+GpuAllocator::GetMemoryProperties() const
+{
+    return m_memoryProperties;
+}
+
+GpuAllocator::Block &
+GpuAllocator::CreateBlock(uint32_t memoryType,
+                          VkDeviceSize size,
+                          bool dedicated)
+{
+    Block block{};
+    block.size = size;
+    block.dedicated = dedicated;
+    block.id = m_nextBlockId++;
+    block.freeRanges.push_back({0, size});
+
+    VkMemoryAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = size;
+    allocate_info.memoryTypeIndex = memoryType;
+
+    VKRESULT(vkAllocateMemory(m_device, &allocate_info, nullptr, &block.memory));
+
+    if (m_memoryProperties.memoryTypes[memoryType].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        VKRESULT(vkMapMemory(
+            m_device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped));
+    }
+
+    m_blocks[memoryType].push_back(std::move(block));
+    return m_blocks[memoryType].back();
+}
+
+void
+GpuAllocator::DestroyBlock(Block &block) const
+{
+    if (block.mapped) {
+        vkUnmapMemory(m_device, block.memory);
+        block.mapped = nullptr;
+    }
+    if (block.memory) {
+        vkFreeMemory(m_device, block.memory, nullptr);
+        block.memory = nullptr;
+    }
+}
+
+bool
+GpuAllocator::TryAllocateFromBlock(Block &block,
+                                   VkDeviceSize size,
+                                   VkDeviceSize alignment,
+                                   VkDeviceSize &offset)
+{
+    // Best fit: the smallest free range that still holds the aligned request.
+    auto best = block.freeRanges.end();
+    for (auto it = block.freeRanges.begin(); it != block.freeRanges.end();
+         ++it) {
+        const VkDeviceSize aligned = align_up(it->offset, alignment);
+        const VkDeviceSize padding = aligned - it->offset;
+        if (it->size < size + padding) {
+            continue;
+        }
+        if (best == block.freeRanges.end() || it->size < best->size) {
+            best = it;
+        }
+    }
+
+    if (best == block.freeRanges.end()) {
+        return false;
+    }
+
+    const Range range = *best;
+    offset = align_up(range.offset, alignment);
+    const VkDeviceSize padding = offset - range.offset;
+    const VkDeviceSize tail = range.size - padding - size;
+
+    best = block.freeRanges.erase(best);
+    if (tail > 0) {
+        best = block.freeRanges.insert(best, {offset + size, tail});
+    }
+    if (padding > 0) {
+        block.freeRanges.insert(best, {range.offset, padding});
+    }
+
+    return true;
+}
+}  // namespace NEngine
@@ -5,12 +5,19 @@
 namespace NEngine {
 Image::Image(const ImageCreateInfo &createInfo,
              VkDevice device,
-             VkPhysicalDevice physicalDevice)
-    : m_device(device),
-      m_format(createInfo.format)
+             GpuAllocator &allocator)
+    : m_allocator(&allocator),
+      m_device(device),
+      m_format(createInfo.format),
+      m_usage(createInfo.usage),
+      m_flags(createInfo.flags),
+      m_width(createInfo.width),
+      m_height(createInfo.height),
+      m_mipLevels(createInfo.mipLevels)
 {
     VkImageCreateInfo image_info{};
     image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.flags = createInfo.flags;
     image_info.imageType = VK_IMAGE_TYPE_2D;
     image_info.extent.width = createInfo.width;
     image_info.extent.height = createInfo.height;
@@ -29,17 +36,11 @@ Image::Image(const ImageCreateInfo &createInfo,
     VkMemoryRequirements memory_requirements;
     vkGetImageMemoryRequirements(device, m_image, &memory_requirements);
 
-    VkMemoryAllocateInfo allocate_info{};
-    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocate_info.allocationSize = memory_requirements.size;
-    allocate_info.memoryTypeIndex =
-        find_memory_type(physicalDevice,
-                         memory_requirements.memoryTypeBits,
-                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_imageMemory =
+        allocator.Allocate(memory_requirements, createInfo.properties);
 
-    VKRESULT(vkAllocateMemory(device, &allocate_info, nullptr, &m_imageMemory));
-
-    VKRESULT(vkBindImageMemory(device, m_image, m_imageMemory, 0));
+    VKRESULT(vkBindImageMemory(
+        device, m_image, m_imageMemory.memory, m_imageMemory.offset));
 }
 Image::~Image()
 {
@@ -56,16 +57,25 @@ Image::Cleanup()
         vkDestroyImage(m_device, m_image, nullptr);
         m_image = nullptr;
     }
-    if (m_imageMemory) {
-        vkFreeMemory(m_device, m_imageMemory, nullptr);
-        m_imageMemory = nullptr;
+    if (m_imageMemory.memory) {
+        m_allocator->Free(m_imageMemory);
+        m_imageMemory = {};
     }
 }
 void
 Image::CreateImageView(VkImageAspectFlags aspectFlags, uint32_t mipLevels)
 {
+    // Usage the image format itself does not support, such as storage on an
+    // sRGB image, must be excluded from views of that format.
+    VkImageViewUsageCreateInfo usage_info{};
+    usage_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    usage_info.usage = m_usage & ~VK_IMAGE_USAGE_STORAGE_BIT;
+
     VkImageViewCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    if (m_flags & VK_IMAGE_CREATE_EXTENDED_USAGE_BIT) {
+        create_info.pNext = &usage_info;
+    }
     create_info.image = m_image;
     create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
     create_info.format = m_format;
@@ -92,4 +102,29 @@ Image::GetImageView() const
 {
     return m_imageView;
 }
+VkFormat
+Image::GetFormat() const
+{
+    return m_format;
+}
+VkImageUsageFlags
+Image::GetUsage() const
+{
+    return m_usage;
+}
+uint32_t
+Image::GetWidth() const
+{
+    return m_width;
+}
+uint32_t
+Image::GetHeight() const
+{
+    return m_height;
+}
+uint32_t
+Image::GetMipLevels() const
+{
+    return m_mipLevels;
+}
 }  // namespace NEngine
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "index_format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace NEngine {
+
+uint32_t
+get_index_size(VkIndexType indexType)
+{
+    switch (indexType) {
+        case VK_INDEX_TYPE_UINT16:
+            return 2;
+        case VK_INDEX_TYPE_UINT32:
+            return 4;
+        default:
+            throw std::runtime_error("Unsupported index type");
+    }
+}
+
+IndexBufferData
+encode_index_buffer(const MeshData &mesh)
+{
+    IndexBufferData data;
+    data.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    data.submeshes = mesh.submeshes;
+
+    // The lowest vertex of every submesh becomes its vertex offset, so only
+    // the span of vertices it uses has to fit into 16 bits.
+    bool fits_16bit = true;
+    for (Submesh &submesh : data.submeshes) {
+        const auto [min, max] = std::minmax_element(
+            mesh.indices.begin() + submesh.firstIndex,
+            mesh.indices.begin() + submesh.firstIndex + submesh.indexCount);
+        if (submesh.indexCount == 0) {
+            submesh.vertexOffset = 0;
+            continue;
+        }
+        submesh.vertexOffset = *min;
+        fits_16bit = fits_16bit && *max - *min < MAX_16BIT_VERTICES;
+    }
+
+    if (fits_16bit) {
+        data.indexType = VK_INDEX_TYPE_UINT16;
+        data.indices.resize(mesh.indices.size() * sizeof(uint16_t));
+        auto *indices = reinterpret_cast<uint16_t *>(data.indices.data());
+        for (const Submesh &submesh : data.submeshes) {
+            for (uint32_t i = submesh.firstIndex;
+                 i < submesh.firstIndex + submesh.indexCount;
+                 ++i) {
+                indices[i] = static_cast<uint16_t>(mesh.indices[i] -
+                                                   submesh.vertexOffset);
+            }
+        }
+    }
+    else {
+        data.indexType = VK_INDEX_TYPE_UINT32;
+        data.indices.resize(mesh.indices.size() * sizeof(uint32_t));
+        memcpy(data.indices.data(), mesh.indices.data(), data.indices.size());
+        for (Submesh &submesh : data.submeshes) {
+            submesh.vertexOffset = 0;
+        }
+    }
+
+    // Meshlets never straddle submeshes and share their vertex offset.
+    data.meshlets = mesh.meshlets;
+    for (Meshlet &meshlet : data.meshlets) {
+        const auto submesh = std::find_if(
+            data.submeshes.begin(),
+            data.submeshes.end(),
+            [&](const Submesh &s) {
+                return meshlet.firstIndex >= s.firstIndex &&
+                       meshlet.firstIndex < s.firstIndex + s.indexCount;
+            });
+        if (submesh == data.submeshes.end()) {
+            throw std::runtime_error("Meshlet lies outside of all submeshes");
+        }
+        meshlet.vertexOffset = submesh->vertexOffset;
+    }
+
+    return data;
+}
+
+void
+split_for_16bit_indices(MeshData &mesh)
+{
+    static constexpr uint32_t UNMAPPED = UINT32_MAX;
+    static constexpr uint32_t PENDING = UINT32_MAX - 1;
+
+    // Pieces are cut between meshlets when the mesh has them and between
+    // triangles otherwise. Units are indexed by their first triangle.
+    std::vector<uint32_t> unit_sizes(mesh.indices.size() / 3, 3);
+    for (const Meshlet &meshlet : mesh.meshlets) {
+        unit_sizes[meshlet.firstIndex / 3] = meshlet.indexCount;
+    }
+
+    std::vector<vertex> vertices;
+    std::vector<Submesh> submeshes;
+    vertices.reserve(mesh.vertices.size());
+
+    // Every piece gets its own copy of the vertices it uses, in first use
+    // order, so the vertex fetch order of the input is kept.
+    std::vector<uint32_t> remap(mesh.vertices.size(), UNMAPPED);
+    std::vector<uint32_t> piece_vertices;
+    std::vector<uint32_t> unit_vertices;
+    // Pieces of every input submesh, as offsets into `submeshes`.
+    std::vector<uint32_t> first_pieces;
+    first_pieces.reserve(mesh.submeshes.size() + 1);
+    for (const Submesh &submesh : mesh.submeshes) {
+        first_pieces.push_back(static_cast<uint32_t>(submeshes.size()));
+        uint32_t unit = submesh.firstIndex;
+        const uint32_t end = submesh.firstIndex + submesh.indexCount;
+        while (unit < end) {
+            Submesh piece{};
+            piece.firstIndex = unit;
+            const size_t base = vertices.size();
+
+            for (; unit < end; unit += unit_sizes[unit / 3]) {
+                const std::span<uint32_t> indices =
+                    std::span(mesh.indices).subspan(unit, unit_sizes[unit / 3]);
+                for (const uint32_t index : indices) {
+                    if (remap[index] == UNMAPPED) {
+                        remap[index] = PENDING;
+                        unit_vertices.push_back(index);
+                    }
+                }
+                if (vertices.size() - base + unit_vertices.size() >
+                    MAX_16BIT_VERTICES) {
+                    for (const uint32_t v : unit_vertices) {
+                        remap[v] = UNMAPPED;
+                    }
+                    unit_vertices.clear();
+                    break;
+                }
+                for (uint32_t &index : indices) {
+                    if (remap[index] == PENDING) {
+                        remap[index] = static_cast<uint32_t>(vertices.size());
+                        piece_vertices.push_back(index);
+                        vertices.push_back(mesh.vertices[index]);
+                    }
+                    index = remap[index];
+                }
+                unit_vertices.clear();
+            }
+
+            piece.indexCount = unit - piece.firstIndex;
+            piece.bounds = compute_bounds(
+                vertices,
+                std::span(mesh.indices)
+                    .subspan(piece.firstIndex, piece.indexCount));
+            submeshes.push_back(piece);
+
+            // Vertices shared with the next piece are duplicated.
+            for (const uint32_t v : piece_vertices) {
+                remap[v] = UNMAPPED;
+            }
+            piece_vertices.clear();
+        }
+    }
+
+    first_pieces.push_back(static_cast<uint32_t>(submeshes.size()));
+
+    for (MeshLod &lod : mesh.lods) {
+        const uint32_t first = first_pieces[lod.firstSubmesh];
+        lod.submeshCount =
+            first_pieces[lod.firstSubmesh + lod.submeshCount] - first;
+        lod.firstSubmesh = first;
+    }
+
+    mesh.vertices = std::move(vertices);
+    mesh.submeshes = std::move(submeshes);
+}
+}  // namespace NEngine
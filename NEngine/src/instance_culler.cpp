@@ -0,0 +1,574 @@
+#include "instance_culler.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "misc.h"
+
+namespace NEngine {
+
+static constexpr uint32_t CULL_GROUP_SIZE = 64;
+static constexpr uint32_t BUFFER_BINDING_COUNT = 6;
+static constexpr uint32_t BINDING_COUNT = BUFFER_BINDING_COUNT + 1;
+static constexpr uint32_t PHASE_COUNT = 2;
+
+struct InstanceCullParams
+{
+    glm::mat4 viewProj;
+    glm::vec3 cameraPosition;
+    float pixelsPerUnit;
+    uint32_t objectCount;
+    uint32_t lodCount;
+    float meshRadius;
+    uint32_t phase;
+    uint32_t firstDraw;
+    // Non-zero when the late phase tests the depth pyramid.
+    uint32_t occlusion;
+};
+
+static_assert(sizeof(InstanceCullParams) <= 128,
+              "Push constants must fit the guaranteed minimum size");
+
+// Layouts of instance_cull_cs.comp.
+struct GpuLod
+{
+    uint32_t firstCommand;
+    uint32_t commandCount;
+    float error;
+};
+
+struct ObjectBounds
+{
+    glm::vec3 center;
+    float radius;
+};
+
+InstanceCuller::InstanceCuller(VkDevice device,
+                               GpuAllocator &allocator,
+                               const std::vector<char> &shaderCode,
+                               const DepthPyramid *depthPyramid)
+    : m_device(device),
+      m_allocator(&allocator),
+      m_depthPyramid(depthPyramid)
+{
+    // Buffers, then the depth pyramid.
+    std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[BUFFER_BINDING_COUNT].descriptorType =
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+    VKRESULT(vkCreateDescriptorSetLayout(
+        device, &layout_info, nullptr, &m_descriptorSetLayout));
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(InstanceCullParams);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &m_descriptorSetLayout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    VKRESULT(vkCreatePipelineLayout(
+        device, &pipeline_layout_info, nullptr, &m_pipelineLayout));
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shaderCode.size();
+    module_info.pCode = reinterpret_cast<const uint32_t *>(shaderCode.data());
+    VkShaderModule shader_module{};
+    VKRESULT(
+        vkCreateShaderModule(device, &module_info, nullptr, &shader_module));
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = m_pipelineLayout;
+    VKRESULT(vkCreateComputePipelines(
+        device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_pipeline));
+    vkDestroyShaderModule(device, shader_module, nullptr);
+
+    // The counts are reset with vkCmdFillBuffer before the early phase.
+    CreateBuffer(sizeof(uint32_t) * PHASE_COUNT,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 m_countBuffer,
+                 m_countMemory);
+
+    const std::array<VkDescriptorPoolSize, 2> pool_sizes = {{
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BUFFER_BINDING_COUNT},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+    }};
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    VKRESULT(vkCreateDescriptorPool(
+        device, &pool_info, nullptr, &m_descriptorPool));
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = m_descriptorPool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &m_descriptorSetLayout;
+    VKRESULT(vkAllocateDescriptorSets(device, &alloc_info, &m_descriptorSet));
+}
+
+InstanceCuller::~InstanceCuller()
+{
+    Cleanup();
+}
+
+void
+InstanceCuller::Cleanup()
+{
+    if (!m_pipeline) {
+        return;
+    }
+
+    DestroyObjectBuffers();
+    if (m_lodBuffer) {
+        vkDestroyBuffer(m_device, m_lodBuffer, nullptr);
+        m_allocator->Free(m_lodMemory);
+        vkDestroyBuffer(m_device, m_templateBuffer, nullptr);
+        m_allocator->Free(m_templateMemory);
+    }
+    if (m_standInPyramid) {
+        vkDestroySampler(m_device, m_standInSampler, nullptr);
+        m_standInPyramid.reset();
+        m_standInSampler = nullptr;
+    }
+    vkDestroyBuffer(m_device, m_countBuffer, nullptr);
+    m_allocator->Free(m_countMemory);
+
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+    m_descriptorPool = nullptr;
+    m_pipeline = nullptr;
+    m_pipelineLayout = nullptr;
+    m_descriptorSetLayout = nullptr;
+}
+
+void
+InstanceCuller::CreateBuffer(VkDeviceSize size,
+                             VkBufferUsageFlags usage,
+                             VkBuffer &buffer,
+                             GpuAllocation &memory) const
+{
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = size;
+    info.usage = usage;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VKRESULT(vkCreateBuffer(m_device, &info, nullptr, &buffer));
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(m_device, buffer, &memory_requirements);
+    memory = m_allocator->Allocate(memory_requirements,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VKRESULT(
+        vkBindBufferMemory(m_device, buffer, memory.memory, memory.offset));
+}
+
+void
+InstanceCuller::CreateStandInPyramid(UploadService &uploads)
+{
+    ImageCreateInfo create_info{};
+    create_info.width = 1;
+    create_info.height = 1;
+    create_info.format = VK_FORMAT_R32_SFLOAT;
+    create_info.mipLevels = 1;
+    create_info.numSamples = VK_SAMPLE_COUNT_1_BIT;
+    create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    create_info.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    m_standInPyramid =
+        std::make_unique<Image>(create_info, m_device, *m_allocator);
+    m_standInPyramid->CreateImageView(VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    VKRESULT(
+        vkCreateSampler(m_device, &sampler_info, nullptr, &m_standInSampler));
+
+    // Moved to the layout the pyramid's descriptor names; never written.
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = m_standInPyramid->GetImage();
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = 0;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(uploads.GetCommandBuffer(),
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr,
+                         1,
+                         &barrier);
+}
+
+void
+InstanceCuller::DestroyObjectBuffers()
+{
+    if (!m_instanceBuffer) {
+        return;
+    }
+
+    vkDestroyBuffer(m_device, m_instanceBuffer, nullptr);
+    m_allocator->Free(m_instanceMemory);
+    vkDestroyBuffer(m_device, m_boundsBuffer, nullptr);
+    m_allocator->Free(m_boundsMemory);
+    vkDestroyBuffer(m_device, m_visibilityBuffer, nullptr);
+    m_allocator->Free(m_visibilityMemory);
+    vkDestroyBuffer(m_device, m_drawBuffer, nullptr);
+    m_allocator->Free(m_drawMemory);
+    m_instanceBuffer = nullptr;
+    m_boundsBuffer = nullptr;
+    m_visibilityBuffer = nullptr;
+    m_drawBuffer = nullptr;
+}
+
+void
+InstanceCuller::SetMesh(UploadService &uploads,
+                        std::span<const MeshLod> lods,
+                        std::span<const Submesh> submeshes,
+                        const MeshBounds &bounds)
+{
+    ASSERT(!m_lodBuffer, "The mesh is set once");
+    ASSERT(!lods.empty(), "Mesh must have a level of detail");
+    if (!m_depthPyramid) {
+        CreateStandInPyramid(uploads);
+    }
+
+    // One draw command per submesh, which objects copy and point at
+    // themselves.
+    std::vector<GpuLod> gpu_lods;
+    std::vector<VkDrawIndexedIndirectCommand> templates;
+    for (const MeshLod &lod : lods) {
+        gpu_lods.push_back({static_cast<uint32_t>(templates.size()),
+                            lod.submeshCount,
+                            lod.error});
+        for (const Submesh &submesh :
+             submeshes.subspan(lod.firstSubmesh, lod.submeshCount)) {
+            templates.push_back(
+                {submesh.indexCount,
+                 1,
+                 submesh.firstIndex,
+                 static_cast<int32_t>(submesh.vertexOffset),
+                 0});
+        }
+        m_maxCommandsPerObject =
+            std::max(m_maxCommandsPerObject, lod.submeshCount);
+    }
+    m_lodCount = static_cast<uint32_t>(lods.size());
+    m_meshCenter = (bounds.min + bounds.max) * 0.5f;
+    m_meshRadius = glm::length(bounds.max - bounds.min) * 0.5f;
+
+    const VkDeviceSize lod_size = sizeof(GpuLod) * gpu_lods.size();
+    const VkDeviceSize template_size =
+        sizeof(VkDrawIndexedIndirectCommand) *
+        std::max<size_t>(templates.size(), 1);
+    CreateBuffer(lod_size,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 m_lodBuffer,
+                 m_lodMemory);
+    CreateBuffer(template_size,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 m_templateBuffer,
+                 m_templateMemory);
+    uploads.CopyToBuffer(m_lodBuffer, gpu_lods.data(), lod_size);
+    uploads.CopyToBuffer(m_templateBuffer,
+                         templates.data(),
+                         sizeof(VkDrawIndexedIndirectCommand) *
+                             templates.size());
+}
+
+void
+InstanceCuller::SetObjects(UploadService &uploads,
+                           std::span<const InstanceData> objects)
+{
+    ASSERT(m_lodBuffer, "SetMesh must come first");
+    DestroyObjectBuffers();
+    m_objectCount = static_cast<uint32_t>(objects.size());
+
+    // The mesh's bounding sphere moved into world space, scaled by the
+    // model matrix's largest axis scale.
+    std::vector<ObjectBounds> bounds(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const glm::mat4 &model = objects[i].model;
+        const float scale = std::max({glm::length(glm::vec3(model[0])),
+                                      glm::length(glm::vec3(model[1])),
+                                      glm::length(glm::vec3(model[2]))});
+        bounds[i].center = model * glm::vec4(m_meshCenter, 1.0f);
+        bounds[i].radius = m_meshRadius * scale;
+    }
+
+    // Buffers are never empty, so that the descriptors stay valid.
+    const VkDeviceSize object_count = std::max<size_t>(objects.size(), 1);
+    CreateBuffer(sizeof(InstanceData) * object_count,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 m_instanceBuffer,
+                 m_instanceMemory);
+    CreateBuffer(sizeof(ObjectBounds) * object_count,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 m_boundsBuffer,
+                 m_boundsMemory);
+    CreateBuffer(sizeof(uint32_t) * object_count,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 m_visibilityBuffer,
+                 m_visibilityMemory);
+    CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * PHASE_COUNT *
+                     std::max<VkDeviceSize>(GetMaxDrawCount(), 1),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                 m_drawBuffer,
+                 m_drawMemory);
+    uploads.CopyToBuffer(
+        m_instanceBuffer, objects.data(), objects.size_bytes());
+    uploads.CopyToBuffer(m_boundsBuffer,
+                         bounds.data(),
+                         sizeof(ObjectBounds) * bounds.size());
+    // The first frame's early phase draws nothing, and the late one every
+    // object that is not hidden by the cleared depth.
+    const std::vector<uint32_t> visibility(objects.size(), 0);
+    uploads.CopyToBuffer(m_visibilityBuffer,
+                         visibility.data(),
+                         sizeof(uint32_t) * visibility.size());
+    WriteDescriptorSet();
+}
+
+void
+InstanceCuller::UpdateDepthPyramid()
+{
+    if (m_instanceBuffer) {
+        WriteDescriptorSet();
+    }
+}
+
+void
+InstanceCuller::WriteDescriptorSet() const
+{
+    const std::array<VkDescriptorBufferInfo, BUFFER_BINDING_COUNT>
+        buffer_infos = {{
+            {m_boundsBuffer, 0, VK_WHOLE_SIZE},
+            {m_lodBuffer, 0, VK_WHOLE_SIZE},
+            {m_templateBuffer, 0, VK_WHOLE_SIZE},
+            {m_drawBuffer, 0, VK_WHOLE_SIZE},
+            {m_countBuffer, 0, VK_WHOLE_SIZE},
+            {m_visibilityBuffer, 0, VK_WHOLE_SIZE},
+        }};
+    const VkDescriptorImageInfo image_info =
+        m_depthPyramid ? VkDescriptorImageInfo{m_depthPyramid->GetSampler(),
+                                               m_depthPyramid->GetView(),
+                                               VK_IMAGE_LAYOUT_GENERAL}
+                       : VkDescriptorImageInfo{
+                             m_standInSampler,
+                             m_standInPyramid->GetImageView(),
+                             VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+    for (uint32_t i = 0; i < writes.size(); ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = m_descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        if (i < BUFFER_BINDING_COUNT) {
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &buffer_infos[i];
+        }
+        else {
+            writes[i].descriptorType =
+                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[i].pImageInfo = &image_info;
+        }
+    }
+    vkUpdateDescriptorSets(m_device,
+                           static_cast<uint32_t>(writes.size()),
+                           writes.data(),
+                           0,
+                           nullptr);
+}
+
+void
+InstanceCuller::Record(VkCommandBuffer cb,
+                       CullPhase phase,
+                       const glm::mat4 &view,
+                       const glm::mat4 &proj,
+                       float viewportHeight) const
+{
+    ASSERT(m_instanceBuffer, "SetObjects must come first");
+    ASSERT(m_depthPyramid || phase == CullPhase::Early,
+           "Without a depth pyramid there is no late phase");
+    InstanceCullParams params{};
+    params.viewProj = proj * view;
+    params.cameraPosition = glm::inverse(view)[3];
+    params.pixelsPerUnit = std::abs(proj[1][1]) * viewportHeight * 0.5f;
+    params.objectCount = m_objectCount;
+    params.lodCount = m_lodCount;
+    params.meshRadius =
+        std::max(m_meshRadius, std::numeric_limits<float>::min());
+    params.phase = static_cast<uint32_t>(phase);
+    params.firstDraw = params.phase * GetMaxDrawCount();
+    params.occlusion = m_depthPyramid != nullptr;
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    if (phase == CullPhase::Early) {
+        // The previous frame's indirect draws must be done reading the
+        // buffers before they are overwritten, and its late phase's
+        // visibility visible.
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cb,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0,
+                             1,
+                             &barrier,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr);
+
+        vkCmdFillBuffer(
+            cb, m_countBuffer, 0, sizeof(uint32_t) * PHASE_COUNT, 0);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                                VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cb,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0,
+                             1,
+                             &barrier,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr);
+    }
+    else {
+        // The early phase must be done reading the visibility before the
+        // late one overwrites it.
+        vkCmdPipelineBarrier(cb,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr);
+    }
+
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(cb,
+                            VK_PIPELINE_BIND_POINT_COMPUTE,
+                            m_pipelineLayout,
+                            0,
+                            1,
+                            &m_descriptorSet,
+                            0,
+                            nullptr);
+    vkCmdPushConstants(cb,
+                       m_pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT,
+                       0,
+                       sizeof(params),
+                       &params);
+    vkCmdDispatch(
+        cb, (m_objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(cb,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         0,
+                         1,
+                         &barrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+}
+
+void
+InstanceCuller::Draw(VkCommandBuffer cb, CullPhase phase) const
+{
+    const uint32_t index = static_cast<uint32_t>(phase);
+    vkCmdDrawIndexedIndirectCount(
+        cb,
+        m_drawBuffer,
+        sizeof(VkDrawIndexedIndirectCommand) * index * GetMaxDrawCount(),
+        m_countBuffer,
+        sizeof(uint32_t) * index,
+        GetMaxDrawCount(),
+        sizeof(VkDrawIndexedIndirectCommand));
+}
+
+VkBuffer
+InstanceCuller::GetInstanceBuffer() const
+{
+    return m_instanceBuffer;
+}
+
+uint32_t
+InstanceCuller::GetObjectCount() const
+{
+    return m_objectCount;
+}
+
+// Draw commands one phase may write.
+uint32_t
+InstanceCuller::GetMaxDrawCount() const
+{
+    return m_objectCount * m_maxCommandsPerObject;
+}
+}  // namespace NEngine
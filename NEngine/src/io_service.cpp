@@ -0,0 +1,627 @@
+#include "io_service.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define NENGINE_IO_URING 1
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#endif
+
+namespace NEngine {
+
+// Threads of the fallback backend; blocking reads overlap only as far as
+// there are threads to wait in them.
+static constexpr uint32_t FALLBACK_THREAD_COUNT = 4;
+
+class IoBackend
+{
+public:
+    virtual ~IoBackend() = default;
+
+    virtual void Submit(std::vector<IoRequest> requests) = 0;
+    virtual void WaitIdle() = 0;
+    [[nodiscard]] virtual bool UsesIoUring() const = 0;
+};
+
+static void
+complete(IoRequest &request,
+         std::vector<uint8_t> data,
+         std::exception_ptr error)
+{
+    if (request.onComplete) {
+        request.onComplete(std::move(data), std::move(error));
+    }
+}
+
+// Bytes of the file that a read of `size` at `offset` covers.
+static uint64_t
+clamp_read_size(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+    return offset >= fileSize ? 0 : std::min(size, fileSize - offset);
+}
+
+// Blocking reads on a pool of threads.
+class ThreadIoBackend final : public IoBackend
+{
+public:
+    explicit ThreadIoBackend(uint32_t threadCount)
+    {
+        for (uint32_t i = 0; i < threadCount; ++i) {
+            m_threads.emplace_back([this] { Run(); });
+        }
+    }
+
+    ~ThreadIoBackend() override
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_work.notify_all();
+        for (std::thread &thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    void
+    Submit(std::vector<IoRequest> requests) override
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            for (IoRequest &request : requests) {
+                m_queue.push_back(std::move(request));
+            }
+        }
+        m_work.notify_all();
+    }
+
+    void
+    WaitIdle() override
+    {
+        std::unique_lock lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_queue.empty() && m_active == 0; });
+    }
+
+    [[nodiscard]] bool
+    UsesIoUring() const override
+    {
+        return false;
+    }
+
+private:
+    void
+    Run()
+    {
+        for (;;) {
+            IoRequest request;
+            {
+                std::unique_lock lock(m_mutex);
+                m_work.wait(lock,
+                            [this] { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty()) {
+                    return;
+                }
+                request = std::move(m_queue.front());
+                m_queue.pop_front();
+                ++m_active;
+            }
+
+            Read(request);
+
+            std::lock_guard lock(m_mutex);
+            if (--m_active == 0 && m_queue.empty()) {
+                m_idle.notify_all();
+            }
+        }
+    }
+
+    static void
+    Read(IoRequest &request)
+    {
+        std::vector<uint8_t> data;
+        std::exception_ptr error;
+        try {
+            std::ifstream file(request.path, std::ios::binary | std::ios::ate);
+            if (!file.is_open()) {
+                throw std::runtime_error("Failed to open " + request.path);
+            }
+            const auto file_size = static_cast<uint64_t>(file.tellg());
+            data.resize(
+                clamp_read_size(request.offset, request.size, file_size));
+            file.seekg(static_cast<std::streamoff>(request.offset));
+            file.read(reinterpret_cast<char *>(data.data()),
+                      static_cast<std::streamsize>(data.size()));
+            if (!file) {
+                throw std::runtime_error("Failed to read " + request.path);
+            }
+        }
+        catch (...) {
+            data.clear();
+            error = std::current_exception();
+        }
+        complete(request, std::move(data), std::move(error));
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_idle;
+    std::deque<IoRequest> m_queue;
+    uint32_t m_active = 0;
+    bool m_stopping = false;
+};
+
+#ifdef NENGINE_IO_URING
+// Linux caps a single read a little below 2 GiB.
+static constexpr uint64_t MAX_READ_SIZE = 1ull << 30;
+
+static std::exception_ptr
+make_io_error(const char *what, const std::string &path, int error)
+{
+    return std::make_exception_ptr(std::runtime_error(
+        std::string(what) + " " + path + ": " +
+        std::generic_category().message(error)));
+}
+
+static int
+io_uring_enter(int ring,
+               uint32_t toSubmit,
+               uint32_t minComplete,
+               uint32_t flags)
+{
+    for (;;) {
+        const long result = syscall(__NR_io_uring_enter,
+                                    ring,
+                                    toSubmit,
+                                    minComplete,
+                                    flags,
+                                    nullptr,
+                                    0);
+        if (result >= 0 || errno != EINTR) {
+            return static_cast<int>(result);
+        }
+    }
+}
+
+// Reads through an io_uring, set up with raw system calls. Submitting
+// threads open the files and queue the reads; a completion thread reaps
+// them, queues the rest of short reads again and hands results out.
+class UringIoBackend final : public IoBackend
+{
+public:
+    explicit UringIoBackend(uint32_t queueDepth)
+    {
+        io_uring_params params{};
+        m_ring = static_cast<int>(
+            syscall(__NR_io_uring_setup, queueDepth, &params));
+        if (m_ring < 0) {
+            throw std::runtime_error("Failed to set up an io_uring");
+        }
+        // IORING_OP_READ came with the current position feature.
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+            !(params.features & IORING_FEAT_RW_CUR_POS)) {
+            Release();
+            throw std::runtime_error("The kernel's io_uring is too old");
+        }
+
+        m_ringSize = std::max(
+            params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        m_ringMemory = mmap(nullptr,
+                            m_ringSize,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE,
+                            m_ring,
+                            IORING_OFF_SQ_RING);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr,
+                          m_sqesSize,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE,
+                          m_ring,
+                          IORING_OFF_SQES);
+        if (m_ringMemory == MAP_FAILED || sqes == MAP_FAILED) {
+            if (m_ringMemory == MAP_FAILED) {
+                m_ringMemory = nullptr;
+            }
+            if (sqes != MAP_FAILED) {
+                munmap(sqes, m_sqesSize);
+            }
+            Release();
+            throw std::runtime_error("Failed to map the io_uring");
+        }
+
+        uint8_t *ring = static_cast<uint8_t *>(m_ringMemory);
+        m_sqes = static_cast<io_uring_sqe *>(sqes);
+        m_sqEntries = params.sq_entries;
+        m_sqMask =
+            *reinterpret_cast<uint32_t *>(ring + params.sq_off.ring_mask);
+        m_sqTail = reinterpret_cast<uint32_t *>(ring + params.sq_off.tail);
+        m_sqArray = reinterpret_cast<uint32_t *>(ring + params.sq_off.array);
+        m_cqMask =
+            *reinterpret_cast<uint32_t *>(ring + params.cq_off.ring_mask);
+        m_cqHead = reinterpret_cast<uint32_t *>(ring + params.cq_off.head);
+        m_cqTail = reinterpret_cast<uint32_t *>(ring + params.cq_off.tail);
+        m_cqes = reinterpret_cast<io_uring_cqe *>(ring + params.cq_off.cqes);
+
+        m_thread = std::thread([this] { Run(); });
+    }
+
+    ~UringIoBackend() override
+    {
+        WaitIdle();
+        {
+            // A no-op without a read wakes the completion thread to exit.
+            // Should the ring refuse it, the thread is polling already.
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+            io_uring_sqe sqe{};
+            sqe.opcode = IORING_OP_NOP;
+            PushEntry(sqe);
+            std::vector<std::unique_ptr<Read>> failed;
+            Enter(failed);
+        }
+        m_thread.join();
+        Release();
+    }
+
+    void
+    Submit(std::vector<IoRequest> requests) override
+    {
+        std::vector<std::unique_ptr<Read>> reads;
+        for (IoRequest &request : requests) {
+            auto read = std::make_unique<Read>();
+            read->request = std::move(request);
+            const std::string &path = read->request.path;
+            read->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat status{};
+            if (read->fd < 0 || fstat(read->fd, &status) != 0) {
+                const int error = errno;
+                if (read->fd >= 0) {
+                    close(read->fd);
+                }
+                complete(read->request,
+                         {},
+                         make_io_error("Failed to open", path, error));
+                continue;
+            }
+
+            const uint64_t size =
+                clamp_read_size(read->request.offset,
+                                read->request.size,
+                                static_cast<uint64_t>(status.st_size));
+            if (size == 0) {
+                close(read->fd);
+                complete(read->request, {}, nullptr);
+                continue;
+            }
+            read->data.resize(size);
+            reads.push_back(std::move(read));
+        }
+
+        std::vector<std::unique_ptr<Read>> failed;
+        {
+            std::lock_guard lock(m_mutex);
+            m_pending += reads.size();
+            for (std::unique_ptr<Read> &read : reads) {
+                m_queued.push_back(std::move(read));
+            }
+            SubmitQueued(failed);
+        }
+        Finish(failed);
+    }
+
+    void
+    WaitIdle() override
+    {
+        std::unique_lock lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_pending == 0; });
+    }
+
+    [[nodiscard]] bool
+    UsesIoUring() const override
+    {
+        return true;
+    }
+
+private:
+    struct Read
+    {
+        IoRequest request;
+        int fd = -1;
+        std::vector<uint8_t> data;
+        uint64_t done = 0;
+        std::exception_ptr error;
+    };
+
+    // Copies `entry` into the submission queue. Call with m_mutex held and
+    // fewer than m_sqEntries entries in flight.
+    void
+    PushEntry(const io_uring_sqe &entry)
+    {
+        const uint32_t tail = *m_sqTail;
+        const uint32_t index = tail & m_sqMask;
+        m_sqes[index] = entry;
+        m_sqArray[index] = index;
+        std::atomic_ref(*m_sqTail).store(tail + 1, std::memory_order_release);
+        ++m_inFlight;
+        ++m_unsubmitted;
+    }
+
+    // Hands the pushed entries to the kernel. Entries it cannot take for
+    // now are left for the completion thread to hand over after reaping,
+    // which is what a full completion queue needs; when nothing is in
+    // flight to reap, this retries instead. On other errors the kernel
+    // took none of them, so they are taken back out of the queue and their
+    // reads moved to `failed`. Call with m_mutex held.
+    void
+    Enter(std::vector<std::unique_ptr<Read>> &failed)
+    {
+        while (m_unsubmitted > 0) {
+            const int result = io_uring_enter(m_ring, m_unsubmitted, 0, 0);
+            if (result > 0) {
+                m_unsubmitted -= static_cast<uint32_t>(result);
+                continue;
+            }
+            const int error = result == 0 ? EAGAIN : errno;
+            if (error == EAGAIN || error == EBUSY) {
+                if (m_inFlight > m_unsubmitted) {
+                    return;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+
+            const uint32_t tail = *m_sqTail;
+            for (uint32_t i = tail - m_unsubmitted; i != tail; ++i) {
+                const io_uring_sqe &sqe = m_sqes[i & m_sqMask];
+                --m_inFlight;
+                if (sqe.user_data == 0) {
+                    continue;
+                }
+                std::unique_ptr<Read> read(
+                    reinterpret_cast<Read *>(sqe.user_data));
+                read->error = make_io_error(
+                    "Failed to submit a read of", read->request.path, error);
+                failed.push_back(std::move(read));
+            }
+            std::atomic_ref(*m_sqTail).store(tail - m_unsubmitted,
+                                             std::memory_order_release);
+            m_unsubmitted = 0;
+        }
+    }
+
+    // Moves queued reads into the submission queue while it has room, which
+    // also keeps the twice as large completion queue from overflowing.
+    // Reads that cannot be submitted are moved to `failed`. Call with
+    // m_mutex held.
+    void
+    SubmitQueued(std::vector<std::unique_ptr<Read>> &failed)
+    {
+        while (!m_queued.empty() && m_inFlight < m_sqEntries) {
+            Read *read = m_queued.front().release();
+            m_queued.pop_front();
+
+            io_uring_sqe sqe{};
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = read->fd;
+            sqe.off = read->request.offset + read->done;
+            sqe.addr = reinterpret_cast<uint64_t>(read->data.data() +
+                                                  read->done);
+            sqe.len = static_cast<uint32_t>(
+                std::min(read->data.size() - read->done, MAX_READ_SIZE));
+            sqe.user_data = reinterpret_cast<uint64_t>(read);
+            PushEntry(sqe);
+        }
+        Enter(failed);
+    }
+
+    // Hands finished reads to their callbacks and drops them from
+    // m_pending. Call without m_mutex held.
+    void
+    Finish(std::vector<std::unique_ptr<Read>> &finished)
+    {
+        if (finished.empty()) {
+            return;
+        }
+
+        for (std::unique_ptr<Read> &read : finished) {
+            close(read->fd);
+            if (read->error) {
+                read->data.clear();
+            }
+            complete(read->request, std::move(read->data), read->error);
+        }
+
+        std::lock_guard lock(m_mutex);
+        m_pending -= finished.size();
+        if (m_pending == 0) {
+            m_idle.notify_all();
+        }
+    }
+
+    // Runs on the completion thread, which must not throw: an exception
+    // leaving it would terminate the process.
+    void
+    Run()
+    {
+        for (bool stopping = false; !stopping;) {
+            if (io_uring_enter(m_ring, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+                errno != EAGAIN && errno != EBUSY) {
+                // Reads already submitted complete without anyone waiting,
+                // so the completion queue is polled instead.
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            std::vector<std::unique_ptr<Read>> finished;
+            {
+                std::lock_guard lock(m_mutex);
+                uint32_t head = *m_cqHead;
+                const uint32_t tail =
+                    std::atomic_ref(*m_cqTail).load(std::memory_order_acquire);
+                for (; head != tail; ++head) {
+                    const io_uring_cqe &cqe = m_cqes[head & m_cqMask];
+                    --m_inFlight;
+                    if (cqe.user_data == 0) {
+                        stopping = true;
+                        continue;
+                    }
+
+                    std::unique_ptr<Read> read(
+                        reinterpret_cast<Read *>(cqe.user_data));
+                    if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                        m_queued.push_front(std::move(read));
+                        continue;
+                    }
+                    if (cqe.res < 0) {
+                        read->error = make_io_error(
+                            "Failed to read", read->request.path, -cqe.res);
+                    }
+                    else if (cqe.res == 0) {
+                        // The file shrank since it was opened.
+                        read->error = make_io_error(
+                            "Failed to read", read->request.path, EIO);
+                    }
+                    else {
+                        read->done += static_cast<uint64_t>(cqe.res);
+                        if (read->done < read->data.size()) {
+                            m_queued.push_front(std::move(read));
+                            continue;
+                        }
+                    }
+                    finished.push_back(std::move(read));
+                }
+                std::atomic_ref(*m_cqHead).store(head,
+                                                 std::memory_order_release);
+                SubmitQueued(finished);
+                // The wake-up no-op was refused, and nothing is left that
+                // could still complete.
+                if (m_stopping && m_inFlight == 0) {
+                    stopping = true;
+                }
+            }
+            Finish(finished);
+        }
+    }
+
+    void
+    Release()
+    {
+        if (m_sqes) {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if (m_ringMemory) {
+            munmap(m_ringMemory, m_ringSize);
+        }
+        if (m_ring >= 0) {
+            close(m_ring);
+        }
+    }
+
+    int m_ring = -1;
+    void *m_ringMemory = nullptr;
+    size_t m_ringSize = 0;
+    io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+    uint32_t m_sqEntries = 0;
+    uint32_t m_sqMask = 0;
+    uint32_t *m_sqTail = nullptr;
+    uint32_t *m_sqArray = nullptr;
+    uint32_t m_cqMask = 0;
+    uint32_t *m_cqHead = nullptr;
+    uint32_t *m_cqTail = nullptr;
+    io_uring_cqe *m_cqes = nullptr;
+
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    // Reads waiting for room in the submission queue, including the rest
+    // of short reads.
+    std::deque<std::unique_ptr<Read>> m_queued;
+    // Submission queue entries not yet completed.
+    uint32_t m_inFlight = 0;
+    // Entries pushed that the kernel has not taken yet, the last ones of
+    // the submission queue.
+    uint32_t m_unsubmitted = 0;
+    // Set once the destructor asked the completion thread to exit.
+    bool m_stopping = false;
+    // Reads submitted and not yet completed, queued or in flight.
+    size_t m_pending = 0;
+    std::thread m_thread;
+};
+#endif
+
+IoService::IoService(uint32_t queueDepth)
+{
+    queueDepth = std::max(queueDepth, 1u);
+#ifdef NENGINE_IO_URING
+    try {
+        m_backend = std::make_unique<UringIoBackend>(queueDepth);
+        return;
+    }
+    catch (const std::exception &) {
+        // Old kernels and seccomp filters refuse io_uring.
+    }
+#endif
+    m_backend = std::make_unique<ThreadIoBackend>(
+        std::min(queueDepth, FALLBACK_THREAD_COUNT));
+}
+
+IoService::~IoService() = default;
+
+void
+IoService::Submit(std::vector<IoRequest> requests)
+{
+    m_backend->Submit(std::move(requests));
+}
+
+std::future<std::vector<uint8_t>>
+IoService::Read(const std::string &path, uint64_t offset, uint64_t size)
+{
+    auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    std::future<std::vector<uint8_t>> result = promise->get_future();
+
+    std::vector<IoRequest> requests(1);
+    requests[0].path = path;
+    requests[0].offset = offset;
+    requests[0].size = size;
+    requests[0].onComplete = [promise](std::vector<uint8_t> data,
+                                       std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(std::move(error));
+        }
+        else {
+            promise->set_value(std::move(data));
+        }
+    };
+    Submit(std::move(requests));
+    return result;
+}
+
+void
+IoService::WaitIdle()
+{
+    m_backend->WaitIdle();
+}
+
+bool
+IoService::UsesIoUring() const
+{
+    return m_backend->UsesIoUring();
+}
+}  // namespace NEngine
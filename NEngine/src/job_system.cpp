@@ -0,0 +1,365 @@
+#include "job_system.h"
+
+#include <thread>
+#include <utility>
+
+namespace NEngine {
+
+struct Job
+{
+    std::function<void()> function;
+    JobCounter *counter = nullptr;
+};
+
+// Chase-Lev work-stealing deque, in the formulation of Lê et al. for the
+// C11 memory model. The owning worker pushes and pops at the bottom; other
+// threads steal from the top, and only contend with the owner over the
+// last job.
+class WorkStealingDeque
+{
+public:
+    static constexpr int64_t INITIAL_CAPACITY = 256;
+
+    WorkStealingDeque() : m_array(new Array(INITIAL_CAPACITY)) {}
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+    ~WorkStealingDeque() { delete m_array.load(std::memory_order_relaxed); }
+
+    // Owner only.
+    void
+    Push(Job *job)
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_acquire);
+        Array *array = m_array.load(std::memory_order_relaxed);
+        if (bottom - top >= array->capacity) {
+            array = Grow(array, top, bottom);
+        }
+        array->Put(bottom, job);
+        m_bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // Owner only. Takes the most recently pushed job.
+    Job *
+    Pop()
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array *array = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(bottom, std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_seq_cst);
+        if (top > bottom) {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job *job = array->Get(bottom);
+        if (top == bottom) {
+            // The last job; whoever moves the top first gets it.
+            if (!m_top.compare_exchange_strong(top,
+                                               top + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed)) {
+                job = nullptr;
+            }
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // Any thread. Takes the least recently pushed job, or nothing when the
+    // deque is empty or another thread took the job first.
+    Job *
+    Steal()
+    {
+        int64_t top = m_top.load(std::memory_order_seq_cst);
+        const int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+        if (top >= bottom) {
+            return nullptr;
+        }
+
+        Job *job = m_array.load(std::memory_order_acquire)->Get(top);
+        if (!m_top.compare_exchange_strong(top,
+                                           top + 1,
+                                           std::memory_order_seq_cst,
+                                           std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return job;
+    }
+
+private:
+    struct Array
+    {
+        explicit Array(int64_t capacity)
+            : capacity(capacity),
+              slots(std::make_unique<std::atomic<Job *>[]>(capacity))
+        {
+        }
+
+        [[nodiscard]] Job *
+        Get(int64_t index) const
+        {
+            return slots[index & (capacity - 1)].load(
+                std::memory_order_relaxed);
+        }
+
+        void
+        Put(int64_t index, Job *job)
+        {
+            slots[index & (capacity - 1)].store(job,
+                                                std::memory_order_relaxed);
+        }
+
+        int64_t capacity;
+        std::unique_ptr<std::atomic<Job *>[]> slots;
+    };
+
+    // Replaces `array` by one twice as large. Thieves may still read the
+    // old one, so it is only freed with the deque.
+    Array *
+    Grow(Array *array, int64_t top, int64_t bottom)
+    {
+        auto grown = std::make_unique<Array>(array->capacity * 2);
+        for (int64_t i = top; i < bottom; ++i) {
+            grown->Put(i, array->Get(i));
+        }
+        m_retired.emplace_back(array);
+        m_array.store(grown.get(), std::memory_order_release);
+        return grown.release();
+    }
+
+    std::atomic<int64_t> m_top{0};
+    std::atomic<int64_t> m_bottom{0};
+    std::atomic<Array *> m_array;
+    std::vector<std::unique_ptr<Array>> m_retired;
+};
+
+struct JobSystem::Worker
+{
+    WorkStealingDeque deque;
+    std::thread thread;
+};
+
+// The job system whose worker the current thread is, if any.
+static thread_local const JobSystem *t_job_system = nullptr;
+static thread_local uint32_t t_worker_index = 0;
+
+// Picks the first victim to steal from, so that thieves spread out.
+static uint32_t
+next_random()
+{
+    static thread_local uint32_t state = static_cast<uint32_t>(
+        std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1);
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+bool
+JobCounter::IsDone() const
+{
+    return m_pending.load(std::memory_order_acquire) == 0;
+}
+
+uint32_t
+JobSystem::GetDefaultWorkerCount()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+}
+
+JobSystem::JobSystem(uint32_t workerCount)
+{
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        m_workers[i]->thread = std::thread([this, i] { RunWorker(i); });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (const std::unique_ptr<Worker> &worker : m_workers) {
+        worker->thread.join();
+    }
+    // Without workers the jobs nobody waited for are still queued.
+    while (Job *job = FindJob()) {
+        Execute(job);
+    }
+}
+
+void
+JobSystem::Run(std::function<void()> job,
+               JobCounter *counter,
+               JobCounter *dependency)
+{
+    auto *queued = new Job{std::move(job), counter};
+    if (counter) {
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (dependency) {
+        std::lock_guard lock(dependency->m_mutex);
+        if (dependency->m_pending.load(std::memory_order_relaxed) > 0) {
+            dependency->m_dependents.push_back(queued);
+            return;
+        }
+    }
+    Push(queued);
+}
+
+void
+JobSystem::Wait(JobCounter &counter)
+{
+    while (!counter.IsDone()) {
+        if (Job *job = FindJob()) {
+            Execute(job);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+
+    // The job that finished last may still hold the lock.
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(counter.m_mutex);
+        error = std::exchange(counter.m_error, nullptr);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+uint32_t
+JobSystem::GetThreadCount() const
+{
+    return static_cast<uint32_t>(m_workers.size()) + 1;
+}
+
+JobSystem::Worker *
+JobSystem::GetCurrentWorker()
+{
+    return t_job_system == this ? m_workers[t_worker_index].get() : nullptr;
+}
+
+void
+JobSystem::Push(Job *job)
+{
+    // Counted before it can be taken, so that the count never wraps.
+    m_queuedJobs.fetch_add(1);
+    if (Worker *worker = GetCurrentWorker()) {
+        worker->deque.Push(job);
+    }
+    else {
+        std::lock_guard lock(m_queueMutex);
+        m_queue.push_back(job);
+    }
+
+    // Pairs with the sleeping count going up before the queued count is
+    // checked, so that one of the two threads sees the other's change.
+    if (m_sleepingWorkers.load() > 0) {
+        std::lock_guard lock(m_sleepMutex);
+        m_wake.notify_one();
+    }
+}
+
+Job *
+JobSystem::FindJob()
+{
+    Job *job = nullptr;
+    Worker *current = GetCurrentWorker();
+    if (current) {
+        job = current->deque.Pop();
+    }
+    if (!job) {
+        std::lock_guard lock(m_queueMutex);
+        if (!m_queue.empty()) {
+            job = m_queue.front();
+            m_queue.pop_front();
+        }
+    }
+    const size_t worker_count = m_workers.size();
+    const size_t first = worker_count > 0 ? next_random() % worker_count : 0;
+    for (size_t i = 0; !job && i < worker_count; ++i) {
+        Worker &victim = *m_workers[(first + i) % worker_count];
+        if (&victim != current) {
+            job = victim.deque.Steal();
+        }
+    }
+
+    if (job) {
+        m_queuedJobs.fetch_sub(1);
+    }
+    return job;
+}
+
+void
+JobSystem::Execute(Job *job)
+{
+    JobCounter *counter = job->counter;
+    try {
+        job->function();
+    }
+    catch (...) {
+        if (counter) {
+            std::lock_guard lock(counter->m_mutex);
+            if (!counter->m_error) {
+                counter->m_error = std::current_exception();
+            }
+        }
+    }
+    delete job;
+    if (!counter) {
+        return;
+    }
+
+    // Waiters return as soon as the count drops to zero, so the counter is
+    // not touched after its lock is released.
+    std::vector<Job *> ready;
+    {
+        std::lock_guard lock(counter->m_mutex);
+        if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ready.swap(counter->m_dependents);
+        }
+    }
+    for (Job *dependent : ready) {
+        Push(dependent);
+    }
+}
+
+void
+JobSystem::RunWorker(uint32_t index)
+{
+    t_job_system = this;
+    t_worker_index = index;
+    for (;;) {
+        if (Job *job = FindJob()) {
+            Execute(job);
+            continue;
+        }
+
+        std::unique_lock lock(m_sleepMutex);
+        m_sleepingWorkers.fetch_add(1);
+        m_wake.wait(lock, [this] {
+            return m_stopping || m_queuedJobs.load() > 0;
+        });
+        m_sleepingWorkers.fetch_sub(1);
+        if (m_stopping && m_queuedJobs.load() == 0) {
+            return;
+        }
+    }
+}
+
+JobSystem &
+get_job_system()
+{
+    static JobSystem job_system;
+    return job_system;
+}
+}  // namespace NEngine
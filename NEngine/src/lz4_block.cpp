@@ -0,0 +1,185 @@
+#include "lz4_block.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace NEngine {
+
+static constexpr uint32_t HASH_BITS = 16;
+static constexpr size_t MIN_MATCH = 4;
+// The format requires the last match to start at least 12 bytes before the
+// end of the block and the last 5 bytes to be literals.
+static constexpr size_t MATCH_START_LIMIT = 12;
+static constexpr size_t LAST_LITERALS = 5;
+static constexpr size_t MAX_OFFSET = 65535;
+// Lengths that do not fit the 4 bits of the token continue in extra bytes.
+static constexpr uint32_t TOKEN_LENGTH_MAX = 15;
+
+static uint32_t
+read32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t
+hash_sequence(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void
+put_length(std::vector<uint8_t> &out, size_t length)
+{
+    for (; length >= 255; length -= 255) {
+        out.push_back(255);
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+// Writes `literals` followed by a match of `matchLength` bytes at `offset`
+// back, or only the literals for the last sequence of the block.
+static void
+put_sequence(std::vector<uint8_t> &out,
+             std::span<const uint8_t> literals,
+             size_t offset,
+             size_t matchLength)
+{
+    const size_t literal_length = literals.size();
+    const size_t match_code = offset ? matchLength - MIN_MATCH : 0;
+    out.push_back(static_cast<uint8_t>(
+        (std::min<size_t>(literal_length, TOKEN_LENGTH_MAX) << 4) |
+        std::min<size_t>(match_code, TOKEN_LENGTH_MAX)));
+    if (literal_length >= TOKEN_LENGTH_MAX) {
+        put_length(out, literal_length - TOKEN_LENGTH_MAX);
+    }
+    out.insert(out.end(), literals.begin(), literals.end());
+
+    if (offset) {
+        out.push_back(static_cast<uint8_t>(offset));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (match_code >= TOKEN_LENGTH_MAX) {
+            put_length(out, match_code - TOKEN_LENGTH_MAX);
+        }
+    }
+}
+
+std::vector<uint8_t>
+lz4_compress(std::span<const uint8_t> data)
+{
+    std::vector<uint8_t> out;
+    out.reserve(data.size() + data.size() / 255 + 16);
+
+    // Position + 1 of the last sequence with each hash, 0 when there is none.
+    std::vector<uint32_t> table(size_t{1} << HASH_BITS, 0);
+    const uint8_t *bytes = data.data();
+    const size_t size = data.size();
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MATCH_START_LIMIT <= size) {
+        const uint32_t sequence = read32(bytes + i);
+        uint32_t &slot = table[hash_sequence(sequence)];
+        const size_t candidate = slot;
+        slot = static_cast<uint32_t>(i + 1);
+
+        if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET ||
+            read32(bytes + candidate - 1) != sequence) {
+            ++i;
+            continue;
+        }
+
+        const size_t match = candidate - 1;
+        size_t length = MIN_MATCH;
+        while (i + length < size - LAST_LITERALS &&
+               bytes[match + length] == bytes[i + length]) {
+            ++length;
+        }
+        put_sequence(out, data.subspan(anchor, i - anchor), i - match, length);
+        i += length;
+        anchor = i;
+    }
+    put_sequence(out, data.subspan(anchor), 0, 0);
+
+    return out;
+}
+
+// Reads the extra bytes of a length whose token nibble was 15.
+static size_t
+get_length(std::span<const uint8_t> block, size_t &in)
+{
+    size_t length = 0;
+    uint8_t byte;
+    do {
+        if (in >= block.size()) {
+            throw std::runtime_error("Truncated LZ4 block");
+        }
+        byte = block[in++];
+        length += byte;
+    } while (byte == 255);
+    return length;
+}
+
+void
+lz4_decompress(std::span<const uint8_t> block, std::span<uint8_t> out)
+{
+    size_t in = 0;
+    size_t written = 0;
+    for (;;) {
+        if (in >= block.size()) {
+            throw std::runtime_error("Truncated LZ4 block");
+        }
+        const uint8_t token = block[in++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == TOKEN_LENGTH_MAX) {
+            literal_length += get_length(block, in);
+        }
+        if (literal_length > block.size() - in ||
+            literal_length > out.size() - written) {
+            throw std::runtime_error("LZ4 literals run past the block");
+        }
+        memcpy(out.data() + written, block.data() + in, literal_length);
+        in += literal_length;
+        written += literal_length;
+
+        // The last sequence has no match.
+        if (in == block.size()) {
+            break;
+        }
+
+        if (block.size() - in < 2) {
+            throw std::runtime_error("Truncated LZ4 block");
+        }
+        const size_t offset = block[in] | (size_t{block[in + 1]} << 8);
+        in += 2;
+        size_t match_length = token & TOKEN_LENGTH_MAX;
+        if (match_length == TOKEN_LENGTH_MAX) {
+            match_length += get_length(block, in);
+        }
+        match_length += MIN_MATCH;
+        if (offset == 0 || offset > written ||
+            match_length > out.size() - written) {
+            throw std::runtime_error("LZ4 match runs past the block");
+        }
+
+        // Matches may overlap the bytes they produce, which repeats them.
+        const uint8_t *match = out.data() + written - offset;
+        uint8_t *dst = out.data() + written;
+        if (offset >= match_length) {
+            memcpy(dst, match, match_length);
+        }
+        else {
+            for (size_t j = 0; j < match_length; ++j) {
+                dst[j] = match[j];
+            }
+        }
+        written += match_length;
+    }
+
+    if (written != out.size()) {
+        throw std::runtime_error("LZ4 block is shorter than expected");
+    }
+}
+}  // namespace NEngine
@@ -3,15 +3,43 @@
 #include <imgui_impl_sdl2.h>
 #include <imgui_impl_vulkan.h>
 
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
 
+#include "camera.h"
+#include "frame_packet.h"
 #include "vulkan_application.h"
 
 SDL_Window *window = nullptr;
+// Owned by the render thread while it runs.
 NEngine::VulkanApplication *app = nullptr;
+// Owned by the game thread.
+NEngine::Camera *camera = nullptr;
 bool is_window_visible = true;
+bool is_window_resized = false;
 bool running = true;
+// Copies of the model laid out in a square grid, edited in the Scene window.
+int object_count = 1;
+// Rebuilt when the object count changes and shared by the packets otherwise.
+std::shared_ptr<const std::vector<NEngine::DrawItem>> scene;
+
+// Copied by the render thread after every frame, for the windows that show
+// them.
+static struct RenderStats
+{
+    std::mutex mutex;
+    NEngine::GpuAllocatorStats memory;
+    NEngine::AssetCacheStats assetCache;
+} s_render_stats;
 
 bool
 does_imgui_wants_capture_io()
@@ -32,7 +60,7 @@ poll_events()
         if (e.type == SDL_WINDOWEVENT) {
             switch (e.window.event) {
                 case SDL_WINDOWEVENT_RESIZED:
-                    app->OnWindowResized();
+                    is_window_resized = true;
                     break;
                 case SDL_WINDOWEVENT_SHOWN:
                 case SDL_WINDOWEVENT_RESTORED:
@@ -57,7 +85,8 @@ poll_events()
         }
         else if (e.type == SDL_MOUSEMOTION) {
             if (!does_imgui_wants_capture_io()) {
-                app->OnMouseMove(e.motion.state, e.motion.x, e.motion.y);
+                camera->UpdateMousePos(e.motion.state,
+                                       glm::vec2(e.motion.x, e.motion.y));
             }
         }
     }
@@ -91,6 +120,7 @@ destroy_sdl2_context()
     SDL_DestroyWindow(window);
     SDL_Quit();
     delete app;
+    delete camera;
 }
 
 static struct FPSCounter
@@ -130,6 +160,143 @@ void update_title_fps(float elapsed)
     }
 }
 
+void
+show_memory_stats()
+{
+    NEngine::GpuAllocatorStats stats;
+    {
+        std::lock_guard lock(s_render_stats.mutex);
+        stats = s_render_stats.memory;
+    }
+    constexpr float MB = 1024.0f * 1024.0f;
+
+    ImGui::Begin("GPU Memory");
+    ImGui::Text("Blocks: %u (%u dedicated)",
+                stats.blockCount,
+                stats.dedicatedBlockCount);
+    ImGui::Text("Allocations: %u", stats.allocationCount);
+    ImGui::Text("Used: %.2f / %.2f MB",
+                stats.bytesUsed / MB,
+                stats.bytesReserved / MB);
+    ImGui::Text("Free ranges: %u, largest %.2f MB",
+                stats.freeRangeCount,
+                stats.largestFreeRange / MB);
+    ImGui::Text("Fragmentation: %.1f%%", stats.Fragmentation() * 100.0f);
+    ImGui::End();
+}
+
+void
+show_asset_cache_stats()
+{
+    NEngine::AssetCacheStats stats;
+    {
+        std::lock_guard lock(s_render_stats.mutex);
+        stats = s_render_stats.assetCache;
+    }
+    constexpr float MB = 1024.0f * 1024.0f;
+
+    ImGui::Begin("Asset Cache");
+    ImGui::Text("Hits: %u, misses: %u", stats.hits, stats.misses);
+    ImGui::Text("Entries: %u, evicted %u", stats.entryCount, stats.evictions);
+    ImGui::Text("Size: %.2f / %.2f MB",
+                stats.bytesUsed / MB,
+                stats.bytesLimit / MB);
+    ImGui::End();
+}
+
+void
+show_scene_settings()
+{
+    constexpr int MAX_OBJECTS = 1000000;
+
+    ImGui::Begin("Scene");
+    ImGui::SliderInt("Objects",
+                     &object_count,
+                     1,
+                     MAX_OBJECTS,
+                     "%d",
+                     ImGuiSliderFlags_Logarithmic);
+    ImGui::End();
+}
+
+void
+run_mip_benchmark()
+{
+    constexpr uint32_t ITERATIONS = 50;
+    for (const uint32_t size : {512u, 1024u, 2048u, 4096u}) {
+        const NEngine::MipBenchmarkResult result =
+            app->BenchmarkMipGeneration(size, size, ITERATIONS);
+        std::cout << size << "x" << size << " (" << result.mipLevels
+                  << " levels): blit " << result.blitMs << " ms";
+        if (result.computeMs) {
+            std::cout << ", compute " << *result.computeMs << " ms";
+        }
+        else {
+            std::cout << ", compute unsupported";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Draws the packets the game thread publishes until the queue is closed.
+void
+run_render_thread(NEngine::FramePacketQueue &frame_packets,
+                  std::exception_ptr &error)
+{
+    try {
+        while (const NEngine::FramePacket *frame = frame_packets.Acquire()) {
+            app->DrawFrame(*frame);
+            frame_packets.Release();
+
+            std::lock_guard lock(s_render_stats.mutex);
+            s_render_stats.memory = app->GetMemoryStats();
+            s_render_stats.assetCache = app->GetAssetCacheStats();
+        }
+    }
+    catch (...) {
+        error = std::current_exception();
+        // Stops the game thread waiting for packets that are never drawn.
+        frame_packets.Close();
+    }
+}
+
+// Lays out `count` copies of the model in a square grid.
+std::shared_ptr<const std::vector<NEngine::DrawItem>>
+build_scene(int count)
+{
+    // Rows are centered on the origin, so a single object stays where it
+    // was.
+    constexpr float SPACING = 2.5f;
+    const int columns =
+        static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+    const float offset = (columns - 1) * SPACING * 0.5f;
+    auto items = std::make_shared<std::vector<NEngine::DrawItem>>(count);
+    for (int i = 0; i < count; ++i) {
+        const glm::vec3 position((i % columns) * SPACING - offset,
+                                 0.0f,
+                                 (i / columns) * SPACING - offset);
+        NEngine::DrawItem &item = (*items)[i];
+        item.model = glm::translate(glm::mat4(1.0f), position);
+        item.material = i % NEngine::VulkanApplication::MATERIAL_COUNT;
+    }
+    return items;
+}
+
+// Writes the state of the frame the game thread just simulated.
+void
+write_frame_packet(NEngine::FramePacket &frame)
+{
+    camera->Update();
+    frame.camera.view = camera->view;
+    frame.camera.position = camera->cam_pos;
+    if (!scene || scene->size() != static_cast<size_t>(object_count)) {
+        scene = build_scene(object_count);
+    }
+    frame.drawList = scene;
+    frame.ui.Capture(*ImGui::GetDrawData());
+    frame.windowResized = std::exchange(is_window_resized, false);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -139,19 +306,53 @@ main(int argc, char **argv)
 
     app = new NEngine::VulkanApplication(window);
 
+    if (argc > 1 && std::string(argv[1]) == "--bench-mips") {
+        run_mip_benchmark();
+        destroy_sdl2_context();
+        return 0;
+    }
+
+    int width = 0;
+    int height = 0;
+    SDL_GetWindowSize(window, &width, &height);
+    camera = new NEngine::Camera(width, height, 10);
+
+    s_render_stats.memory = app->GetMemoryStats();
+    s_render_stats.assetCache = app->GetAssetCacheStats();
+
+    // Events, ImGui and the camera stay on this thread, the game thread; the
+    // render thread owns the application from here on and draws the packets
+    // it is handed, so that simulating a frame overlaps submitting the
+    // previous one.
+    NEngine::FramePacketQueue frame_packets;
+    std::exception_ptr render_error;
+    std::thread render_thread(run_render_thread,
+                              std::ref(frame_packets),
+                              std::ref(render_error));
+
     while (running) {
         const uint64_t start = SDL_GetPerformanceCounter();
 
         poll_events();
 
         if (is_window_visible) {
+            NEngine::FramePacket *frame = frame_packets.BeginWrite();
+            if (!frame) {
+                break;
+            }
+
             ImGui_ImplVulkan_NewFrame();
             ImGui_ImplSDL2_NewFrame(window);
             ImGui::NewFrame();
 
             ImGui::ShowDemoWindow();
+            show_memory_stats();
+            show_asset_cache_stats();
+            show_scene_settings();
 
-            app->DrawFrame();
+            ImGui::Render();
+            write_frame_packet(*frame);
+            frame_packets.Publish();
         }
 
         const uint64_t end = SDL_GetPerformanceCounter();
@@ -160,5 +361,10 @@ main(int argc, char **argv)
 	    update_title_fps(elapsed);
     }
 
+    frame_packets.Close();
+    render_thread.join();
     destroy_sdl2_context();
+    if (render_error) {
+        std::rethrow_exception(render_error);
+    }
 }
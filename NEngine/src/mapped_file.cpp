@@ -0,0 +1,149 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace NEngine {
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string &path)
+{
+    m_file = CreateFileA(path.c_str(),
+                         GENERIC_READ,
+                         FILE_SHARE_READ,
+                         nullptr,
+                         OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                         nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        m_file = nullptr;
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(m_file, &size)) {
+        CloseHandle(m_file);
+        throw std::runtime_error("Failed to query size of " + path);
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0) {
+        return;
+    }
+
+    m_mapping =
+        CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        CloseHandle(m_file);
+        throw std::runtime_error("Failed to map " + path);
+    }
+    m_data = static_cast<const uint8_t *>(
+        MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        throw std::runtime_error("Failed to map " + path);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+}
+#else
+MappedFile::MappedFile(const std::string &path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    struct stat info = {};
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to query size of " + path);
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    if (m_size == 0) {
+        close(fd);
+        return;
+    }
+
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Failed to map " + path);
+    }
+    // Mapped files are mostly streamed front to back into staging memory.
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const uint8_t *>(data);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) {
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+    }
+}
+#endif
+
+const uint8_t *
+MappedFile::GetData() const
+{
+    return m_data;
+}
+size_t
+MappedFile::GetSize() const
+{
+    return m_size;
+}
+
+FileData
+FileData::Map(const std::string &path)
+{
+    FileData file;
+    file.m_file = std::make_unique<MappedFile>(path);
+    file.m_data = {file.m_file->GetData(), file.m_file->GetSize()};
+    return file;
+}
+
+FileData
+FileData::Own(std::vector<uint8_t> bytes)
+{
+    FileData file;
+    file.m_bytes = std::move(bytes);
+    file.m_data = file.m_bytes;
+    return file;
+}
+
+FileData
+FileData::Borrow(std::span<const uint8_t> data)
+{
+    FileData file;
+    file.m_data = data;
+    return file;
+}
+
+std::span<const uint8_t>
+FileData::GetData() const
+{
+    return m_data;
+}
+}  // namespace NEngine
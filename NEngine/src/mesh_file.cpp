@@ -0,0 +1,293 @@
+#include "mesh_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include "index_format.h"
+
+namespace NEngine {
+
+// "NMSH" read as a little-endian integer.
+static constexpr uint32_t MESH_FILE_MAGIC = 0x48534D4E;
+// Every array starts on a 16 byte boundary of the file.
+static constexpr size_t MESH_FILE_ALIGNMENT = 16;
+
+// The file is the header followed by the position, attribute and colour
+// streams, the indices, the submesh, meshlet and level of detail tables. All
+// values are little-endian; offsets are from the start of the file.
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t submeshCount;
+    uint32_t positionFormat;
+    uint32_t attributeFormat;
+    uint32_t colors;
+    // 2 or 4 bytes per index.
+    uint32_t indexSize;
+    uint32_t meshletCount;
+    uint32_t lodCount;
+    uint32_t reserved;
+    MeshBounds bounds;
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+    uint64_t positionDataOffset;
+    uint64_t attributeDataOffset;
+    uint64_t colorDataOffset;
+    uint64_t indexDataOffset;
+    uint64_t submeshDataOffset;
+    uint64_t meshletDataOffset;
+    uint64_t lodDataOffset;
+};
+
+static_assert(sizeof(MeshBounds) == 24);
+static_assert(sizeof(Submesh) == 36);
+static_assert(sizeof(Meshlet) == 64);
+static_assert(sizeof(MeshLod) == 20);
+static_assert(sizeof(MeshFileHeader) == 152);
+
+MeshBounds
+compute_bounds(std::span<const vertex> vertices,
+               std::span<const uint32_t> indices)
+{
+    MeshBounds bounds{glm::vec3(std::numeric_limits<float>::max()),
+                      glm::vec3(std::numeric_limits<float>::lowest())};
+    for (const uint32_t index : indices) {
+        bounds.min = glm::min(bounds.min, vertices[index].pos);
+        bounds.max = glm::max(bounds.max, vertices[index].pos);
+    }
+    if (indices.empty()) {
+        bounds = {glm::vec3(0.0f), glm::vec3(0.0f)};
+    }
+    return bounds;
+}
+
+static size_t
+append(std::vector<uint8_t> &out, const void *data, size_t size)
+{
+    out.resize((out.size() + MESH_FILE_ALIGNMENT - 1) &
+               ~(MESH_FILE_ALIGNMENT - 1));
+    const size_t offset = out.size();
+    out.resize(offset + size);
+    if (size > 0) {
+        memcpy(out.data() + offset, data, size);
+    }
+    return offset;
+}
+
+void
+write_mesh_file(const std::string &path,
+                const MeshData &mesh,
+                const VertexLayout &layout)
+{
+    const VertexStreams streams =
+        encode_vertex_streams(mesh.vertices, mesh.bounds, layout);
+    const IndexBufferData index_buffer = encode_index_buffer(mesh);
+    std::vector<MeshLod> lods = mesh.lods;
+    if (lods.empty()) {
+        lods.push_back({0,
+                        static_cast<uint32_t>(mesh.submeshes.size()),
+                        0,
+                        static_cast<uint32_t>(mesh.meshlets.size()),
+                        0.0f});
+    }
+
+    MeshFileHeader header{};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MeshFile::VERSION;
+    header.vertexCount = streams.vertexCount;
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.submeshCount = static_cast<uint32_t>(mesh.submeshes.size());
+    header.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+    header.lodCount = static_cast<uint32_t>(lods.size());
+    header.positionFormat = static_cast<uint32_t>(layout.positions);
+    header.attributeFormat = static_cast<uint32_t>(layout.attributes);
+    header.colors = layout.colors ? 1 : 0;
+    header.indexSize = get_index_size(index_buffer.indexType);
+    header.bounds = mesh.bounds;
+    header.positionScale = streams.positionScale;
+    header.positionOffset = streams.positionOffset;
+
+    std::vector<uint8_t> out(sizeof(header));
+    header.positionDataOffset =
+        append(out, streams.positions.data(), streams.positions.size());
+    header.attributeDataOffset =
+        append(out, streams.attributes.data(), streams.attributes.size());
+    header.colorDataOffset =
+        append(out, streams.colors.data(), streams.colors.size());
+    header.indexDataOffset = append(
+        out, index_buffer.indices.data(), index_buffer.indices.size());
+    header.submeshDataOffset =
+        append(out,
+               index_buffer.submeshes.data(),
+               index_buffer.submeshes.size() * sizeof(Submesh));
+    header.meshletDataOffset =
+        append(out,
+               index_buffer.meshlets.data(),
+               index_buffer.meshlets.size() * sizeof(Meshlet));
+    header.lodDataOffset =
+        append(out, lods.data(), lods.size() * sizeof(MeshLod));
+    memcpy(out.data(), &header, sizeof(header));
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    file.write(reinterpret_cast<const char *>(out.data()),
+               static_cast<std::streamsize>(out.size()));
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+template <typename T>
+static std::span<const T>
+get_array(std::span<const uint8_t> file, uint64_t offset, size_t count)
+{
+    if (offset % alignof(T) != 0 || offset > file.size() ||
+        (file.size() - offset) / sizeof(T) < count) {
+        throw std::runtime_error("Mesh file array is out of bounds");
+    }
+    return {reinterpret_cast<const T *>(file.data() + offset), count};
+}
+
+MeshFile::MeshFile(const std::string &path)
+    : MeshFile(FileData::Map(path), path)
+{
+}
+
+MeshFile::MeshFile(FileData data, const std::string &name)
+    : m_file(std::move(data))
+{
+    const std::span<const uint8_t> file = m_file.GetData();
+    if (file.size() < sizeof(MeshFileHeader)) {
+        throw std::runtime_error("Mesh file is truncated: " + name);
+    }
+
+    MeshFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != MESH_FILE_MAGIC) {
+        throw std::runtime_error("Not a mesh file: " + name);
+    }
+    if (header.version != VERSION) {
+        throw std::runtime_error("Mesh file has an outdated version: " + name);
+    }
+    if (header.positionFormat >
+            static_cast<uint32_t>(PositionFormat::Snorm16) ||
+        header.attributeFormat >
+            static_cast<uint32_t>(AttributeFormat::Packed)) {
+        throw std::runtime_error("Mesh file has an unknown vertex layout");
+    }
+    if (header.indexSize != 2 && header.indexSize != 4) {
+        throw std::runtime_error("Mesh file has an unknown index size");
+    }
+
+    VertexLayout &layout = m_vertexStreams.layout;
+    layout.positions = static_cast<PositionFormat>(header.positionFormat);
+    layout.attributes = static_cast<AttributeFormat>(header.attributeFormat);
+    layout.colors = header.colors != 0;
+
+    m_vertexStreams.vertexCount = header.vertexCount;
+    m_vertexStreams.positionScale = header.positionScale;
+    m_vertexStreams.positionOffset = header.positionOffset;
+    m_vertexStreams.positions = get_array<uint8_t>(
+        file,
+        header.positionDataOffset,
+        size_t{header.vertexCount} * get_position_stride(layout.positions));
+    m_vertexStreams.attributes = get_array<uint8_t>(
+        file,
+        header.attributeDataOffset,
+        size_t{header.vertexCount} * get_attribute_stride(layout.attributes));
+    const size_t color_size =
+        layout.colors ? size_t{header.vertexCount} * COLOR_STRIDE : 0;
+    m_vertexStreams.colors =
+        get_array<uint8_t>(file, header.colorDataOffset, color_size);
+    m_indexType = header.indexSize == 2 ? VK_INDEX_TYPE_UINT16
+                                        : VK_INDEX_TYPE_UINT32;
+    m_indexCount = header.indexCount;
+    m_indexData =
+        get_array<uint8_t>(file,
+                           header.indexDataOffset,
+                           size_t{header.indexCount} * header.indexSize);
+    m_submeshes = get_array<Submesh>(
+        file, header.submeshDataOffset, header.submeshCount);
+    m_meshlets = get_array<Meshlet>(
+        file, header.meshletDataOffset, header.meshletCount);
+    m_lods =
+        get_array<MeshLod>(file, header.lodDataOffset, header.lodCount);
+    m_bounds = header.bounds;
+
+    for (const Submesh &submesh : m_submeshes) {
+        if (submesh.firstIndex > header.indexCount ||
+            header.indexCount - submesh.firstIndex < submesh.indexCount ||
+            submesh.vertexOffset > header.vertexCount) {
+            throw std::runtime_error("Mesh file submesh is out of bounds");
+        }
+    }
+    for (const Meshlet &meshlet : m_meshlets) {
+        if (meshlet.firstIndex > header.indexCount ||
+            header.indexCount - meshlet.firstIndex < meshlet.indexCount ||
+            meshlet.vertexOffset > header.vertexCount) {
+            throw std::runtime_error("Mesh file meshlet is out of bounds");
+        }
+    }
+    if (m_lods.empty()) {
+        throw std::runtime_error("Mesh file has no levels of detail");
+    }
+    for (const MeshLod &lod : m_lods) {
+        if (lod.firstSubmesh > header.submeshCount ||
+            header.submeshCount - lod.firstSubmesh < lod.submeshCount ||
+            lod.firstMeshlet > header.meshletCount ||
+            header.meshletCount - lod.firstMeshlet < lod.meshletCount) {
+            throw std::runtime_error("Mesh file level of detail is out of "
+                                     "bounds");
+        }
+    }
+}
+
+VertexStreamsView
+MeshFile::GetVertexStreams() const
+{
+    return m_vertexStreams;
+}
+VkIndexType
+MeshFile::GetIndexType() const
+{
+    return m_indexType;
+}
+uint32_t
+MeshFile::GetIndexCount() const
+{
+    return m_indexCount;
+}
+std::span<const uint8_t>
+MeshFile::GetIndexData() const
+{
+    return m_indexData;
+}
+std::span<const Submesh>
+MeshFile::GetSubmeshes() const
+{
+    return m_submeshes;
+}
+std::span<const Meshlet>
+MeshFile::GetMeshlets() const
+{
+    return m_meshlets;
+}
+std::span<const MeshLod>
+MeshFile::GetLods() const
+{
+    return m_lods;
+}
+const MeshBounds &
+MeshFile::GetBounds() const
+{
+    return m_bounds;
+}
+}  // namespace NEngine
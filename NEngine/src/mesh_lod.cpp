@@ -0,0 +1,642 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+#include "mesh_optimizer.h"
+
+namespace NEngine {
+
+static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+// Border and seam planes are weighted like a triangle this many times as
+// large as the square of the edge, so sliding along them is cheap and
+// moving away from them is not.
+static constexpr double BOUNDARY_WEIGHT = 10.0;
+// A collapse is rejected when it turns a triangle by more than about 87
+// degrees; flipped triangles leave holes and spikes behind.
+static constexpr float MIN_NORMAL_COSINE = 0.05f;
+// A level is only kept when it has at most this fraction of the triangles
+// of the level before; anything closer is not worth its memory.
+static constexpr float MAX_LOD_TRIANGLE_RATIO = 0.8f;
+// Submeshes are not simplified below this many triangles, so small parts
+// keep their rough shape instead of collapsing into nothing.
+static constexpr size_t MIN_LOD_TRIANGLES = 8;
+
+// Symmetric 4x4 error quadric of Garland and Heckbert. Squared distances to
+// all accumulated planes, weighted by area.
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    double c = 0;
+    double weight = 0;
+
+    void
+    AddPlane(const glm::dvec3 &n, double d, double w)
+    {
+        a00 += w * n.x * n.x;
+        a01 += w * n.x * n.y;
+        a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y;
+        a12 += w * n.y * n.z;
+        a22 += w * n.z * n.z;
+        b0 += w * n.x * d;
+        b1 += w * n.y * d;
+        b2 += w * n.z * d;
+        c += w * d * d;
+    }
+
+    Quadric &
+    operator+=(const Quadric &q)
+    {
+        a00 += q.a00;
+        a01 += q.a01;
+        a02 += q.a02;
+        a11 += q.a11;
+        a12 += q.a12;
+        a22 += q.a22;
+        b0 += q.b0;
+        b1 += q.b1;
+        b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+        return *this;
+    }
+
+    [[nodiscard]] double
+    Evaluate(const glm::dvec3 &p) const
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        const double value = a00 * x * x + a11 * y * y + a22 * z * z +
+                             2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                             2 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(value, 0.0);
+    }
+};
+
+enum class EdgeKind : uint8_t
+{
+    Manifold,
+    // Used by one triangle only.
+    Border,
+    // Shared by two triangles that use different vertices on one of its
+    // ends, e.g. across a UV or normal discontinuity.
+    Seam,
+    // Anything else: non-manifold or inconsistently wound.
+    Complex,
+};
+
+enum class PositionKind : uint8_t
+{
+    Manifold,
+    Border,
+    Seam,
+    // Corners, seams meeting borders and other places that must not move.
+    Locked,
+};
+
+// One directed edge of a triangle, keyed by the positions it connects so
+// that all triangles sharing a geometric edge sort next to each other.
+struct EdgeEntry
+{
+    uint64_t key;
+    uint32_t triangle;
+    uint32_t corner;
+};
+
+struct Collapse
+{
+    double cost;
+    uint32_t from;
+    uint32_t to;
+};
+
+// Vertices with equal positions are wedges of one position, stored as one
+// array with offsets.
+struct Positions
+{
+    std::vector<uint32_t> ofVertex;
+    std::vector<glm::dvec3> points;
+    std::vector<uint32_t> wedgeOffsets;
+    std::vector<uint32_t> wedges;
+};
+
+static Positions
+weld_positions(std::span<const uint32_t> indices,
+               std::span<const vertex> vertices)
+{
+    std::vector<uint32_t> used(indices.begin(), indices.end());
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+    std::stable_sort(used.begin(), used.end(), [&](uint32_t a, uint32_t b) {
+        const glm::vec3 &pa = vertices[a].pos;
+        const glm::vec3 &pb = vertices[b].pos;
+        return std::tie(pa.x, pa.y, pa.z) < std::tie(pb.x, pb.y, pb.z);
+    });
+
+    Positions positions;
+    positions.ofVertex.assign(vertices.size(), NO_VERTEX);
+    positions.wedges = used;
+    for (size_t i = 0; i < used.size(); ++i) {
+        if (i == 0 || vertices[used[i]].pos != vertices[used[i - 1]].pos) {
+            positions.wedgeOffsets.push_back(static_cast<uint32_t>(i));
+            positions.points.emplace_back(vertices[used[i]].pos);
+        }
+        positions.ofVertex[used[i]] =
+            static_cast<uint32_t>(positions.points.size() - 1);
+    }
+    positions.wedgeOffsets.push_back(static_cast<uint32_t>(used.size()));
+    return positions;
+}
+
+static uint64_t
+edge_key(uint32_t a, uint32_t b)
+{
+    return (uint64_t{std::min(a, b)} << 32) | std::max(a, b);
+}
+
+// Sorts the edges of `triangles` by position pair and returns them together
+// with the kind of every run of equal keys, stored at the run's first entry.
+static void
+classify_edges(std::span<const uint32_t> triangles,
+               const Positions &positions,
+               std::vector<EdgeEntry> &edges,
+               std::vector<EdgeKind> &kinds)
+{
+    const auto &of = positions.ofVertex;
+    edges.resize(triangles.size());
+    for (uint32_t i = 0; i < triangles.size(); ++i) {
+        const uint32_t t = i / 3;
+        const uint32_t next = 3 * t + (i + 1) % 3;
+        edges[i] = {edge_key(of[triangles[i]], of[triangles[next]]), t, i % 3};
+    }
+    std::sort(edges.begin(), edges.end(), [](const auto &a, const auto &b) {
+        return a.key < b.key;
+    });
+
+    kinds.assign(edges.size(), EdgeKind::Complex);
+    const auto from = [&](const EdgeEntry &e) {
+        return triangles[3 * e.triangle + e.corner];
+    };
+    const auto to = [&](const EdgeEntry &e) {
+        return triangles[3 * e.triangle + (e.corner + 1) % 3];
+    };
+    for (size_t begin = 0, end = 0; begin < edges.size(); begin = end) {
+        while (end < edges.size() && edges[end].key == edges[begin].key) {
+            ++end;
+        }
+        if (end - begin == 1) {
+            kinds[begin] = EdgeKind::Border;
+        }
+        else if (end - begin == 2) {
+            const EdgeEntry &e0 = edges[begin];
+            const EdgeEntry &e1 = edges[begin + 1];
+            if (of[from(e0)] != of[to(e1)]) {
+                kinds[begin] = EdgeKind::Complex;
+            }
+            else if (from(e0) == to(e1) && to(e0) == from(e1)) {
+                kinds[begin] = EdgeKind::Manifold;
+            }
+            else {
+                kinds[begin] = EdgeKind::Seam;
+            }
+        }
+    }
+}
+
+std::vector<SimplifiedLevel>
+simplify_mesh(std::span<const uint32_t> indices,
+              std::span<const vertex> vertices,
+              std::span<const size_t> targetIndexCounts)
+{
+    const Positions positions = weld_positions(indices, vertices);
+    const auto &of = positions.ofVertex;
+    const auto &points = positions.points;
+    const size_t position_count = points.size();
+
+    std::vector<uint32_t> triangles(indices.begin(), indices.end());
+    std::vector<EdgeEntry> edges;
+    std::vector<EdgeKind> edge_kinds;
+
+    const auto triangle_normal = [&](uint32_t t) {
+        const glm::dvec3 &p0 = points[of[triangles[3 * t]]];
+        const glm::dvec3 &p1 = points[of[triangles[3 * t + 1]]];
+        const glm::dvec3 &p2 = points[of[triangles[3 * t + 2]]];
+        return glm::cross(p1 - p0, p2 - p0);
+    };
+
+    // Every position starts with the planes of its triangles, and of the
+    // borders and seams it lies on.
+    std::vector<Quadric> quadrics(position_count);
+    for (uint32_t t = 0; t < triangles.size() / 3; ++t) {
+        const glm::dvec3 n = triangle_normal(t);
+        const double length = glm::length(n);
+        if (length == 0.0) {
+            continue;
+        }
+        const glm::dvec3 unit = n / length;
+        const double d = -glm::dot(unit, points[of[triangles[3 * t]]]);
+        for (int k = 0; k < 3; ++k) {
+            Quadric &q = quadrics[of[triangles[3 * t + k]]];
+            q.AddPlane(unit, d, length * 0.5);
+            q.weight += length * 0.5;
+        }
+    }
+    classify_edges(triangles, positions, edges, edge_kinds);
+    for (size_t begin = 0, end = 0; begin < edges.size(); begin = end) {
+        while (end < edges.size() && edges[end].key == edges[begin].key) {
+            ++end;
+        }
+        if (edge_kinds[begin] != EdgeKind::Border &&
+            edge_kinds[begin] != EdgeKind::Seam) {
+            continue;
+        }
+        // Seams get a plane from each side.
+        for (size_t e = begin; e < end; ++e) {
+            const uint32_t t = edges[e].triangle;
+            const uint32_t p0 = of[triangles[3 * t + edges[e].corner]];
+            const uint32_t p1 =
+                of[triangles[3 * t + (edges[e].corner + 1) % 3]];
+            const glm::dvec3 edge = points[p1] - points[p0];
+            const glm::dvec3 n = glm::cross(edge, triangle_normal(t));
+            const double length = glm::length(n);
+            if (length == 0.0) {
+                continue;
+            }
+            const glm::dvec3 unit = n / length;
+            const double d = -glm::dot(unit, points[p0]);
+            const double w = BOUNDARY_WEIGHT * glm::dot(edge, edge);
+            for (const uint32_t p : {p0, p1}) {
+                quadrics[p].AddPlane(unit, d, w);
+                quadrics[p].weight += w;
+            }
+        }
+    }
+
+    std::vector<uint32_t> adjacency_offsets(position_count + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint8_t> border_edges(position_count);
+    std::vector<uint8_t> seam_edges(position_count);
+    std::vector<PositionKind> position_kinds(position_count);
+    std::vector<Collapse> collapses;
+    std::vector<bool> locked(position_count);
+    std::vector<uint32_t> remap(vertices.size());
+    std::iota(remap.begin(), remap.end(), 0u);
+    float error = 0.0f;
+
+    // Collapses as many independent edges as it can, cheapest first, until
+    // `target` indices are left. Returns false when nothing could collapse.
+    const auto collapse_pass = [&](size_t target) {
+        const uint32_t triangle_count =
+            static_cast<uint32_t>(triangles.size() / 3);
+
+        std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+        for (const uint32_t index : triangles) {
+            ++adjacency_offsets[of[index] + 1];
+        }
+        std::partial_sum(adjacency_offsets.begin(),
+                         adjacency_offsets.end(),
+                         adjacency_offsets.begin());
+        adjacency.resize(triangles.size());
+        {
+            std::vector<uint32_t> fill(adjacency_offsets.begin(),
+                                       adjacency_offsets.end() - 1);
+            for (size_t i = 0; i < triangles.size(); ++i) {
+                adjacency[fill[of[triangles[i]]]++] =
+                    static_cast<uint32_t>(i / 3);
+            }
+        }
+        const auto around = [&](uint32_t p) {
+            return std::span<const uint32_t>(adjacency)
+                .subspan(adjacency_offsets[p],
+                         adjacency_offsets[p + 1] - adjacency_offsets[p]);
+        };
+
+        classify_edges(triangles, positions, edges, edge_kinds);
+        std::fill(border_edges.begin(), border_edges.end(), 0);
+        std::fill(seam_edges.begin(), seam_edges.end(), 0);
+        std::fill(position_kinds.begin(),
+                  position_kinds.end(),
+                  PositionKind::Manifold);
+        for (size_t begin = 0, end = 0; begin < edges.size(); begin = end) {
+            while (end < edges.size() && edges[end].key == edges[begin].key) {
+                ++end;
+            }
+            const uint32_t p0 = static_cast<uint32_t>(edges[begin].key >> 32);
+            const uint32_t p1 = static_cast<uint32_t>(edges[begin].key);
+            for (const uint32_t p : {p0, p1}) {
+                switch (edge_kinds[begin]) {
+                    case EdgeKind::Border:
+                        border_edges[p] = std::min(border_edges[p] + 1, 3);
+                        break;
+                    case EdgeKind::Seam:
+                        seam_edges[p] = std::min(seam_edges[p] + 1, 3);
+                        break;
+                    case EdgeKind::Complex:
+                        position_kinds[p] = PositionKind::Locked;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        for (uint32_t p = 0; p < position_count; ++p) {
+            const uint32_t wedge_count =
+                positions.wedgeOffsets[p + 1] - positions.wedgeOffsets[p];
+            if (position_kinds[p] == PositionKind::Locked) {
+                continue;
+            }
+            if (border_edges[p] == 0 && seam_edges[p] == 0 &&
+                wedge_count == 1) {
+                position_kinds[p] = PositionKind::Manifold;
+            }
+            else if (border_edges[p] == 2 && seam_edges[p] == 0 &&
+                     wedge_count == 1) {
+                position_kinds[p] = PositionKind::Border;
+            }
+            else if (border_edges[p] == 0 && seam_edges[p] == 2 &&
+                     wedge_count == 2) {
+                position_kinds[p] = PositionKind::Seam;
+            }
+            else {
+                position_kinds[p] = PositionKind::Locked;
+            }
+        }
+
+        // Border and seam positions only slide along their own kind of
+        // edge, which keeps the outline and the attribute layout intact.
+        const auto can_collapse = [&](uint32_t from, EdgeKind kind) {
+            switch (position_kinds[from]) {
+                case PositionKind::Manifold:
+                    return kind == EdgeKind::Manifold;
+                case PositionKind::Border:
+                    return kind == EdgeKind::Border;
+                case PositionKind::Seam:
+                    return kind == EdgeKind::Seam;
+                default:
+                    return false;
+            }
+        };
+        collapses.clear();
+        for (size_t begin = 0, end = 0; begin < edges.size(); begin = end) {
+            while (end < edges.size() && edges[end].key == edges[begin].key) {
+                ++end;
+            }
+            const uint32_t p0 = static_cast<uint32_t>(edges[begin].key >> 32);
+            const uint32_t p1 = static_cast<uint32_t>(edges[begin].key);
+            Collapse best{std::numeric_limits<double>::max(), 0, 0};
+            for (const auto &[from, to] : {std::pair(p0, p1), {p1, p0}}) {
+                if (!can_collapse(from, edge_kinds[begin])) {
+                    continue;
+                }
+                Quadric q = quadrics[from];
+                q += quadrics[to];
+                const double cost = q.Evaluate(points[to]);
+                if (cost < best.cost) {
+                    best = {cost, from, to};
+                }
+            }
+            if (best.cost != std::numeric_limits<double>::max()) {
+                collapses.push_back(best);
+            }
+        }
+        std::sort(collapses.begin(),
+                  collapses.end(),
+                  [](const Collapse &a, const Collapse &b) {
+                      return a.cost < b.cost;
+                  });
+
+        std::fill(locked.begin(), locked.end(), false);
+        size_t index_count = triangles.size();
+        uint32_t applied = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> wedge_targets;
+        for (const Collapse &collapse : collapses) {
+            if (index_count <= target) {
+                break;
+            }
+            if (locked[collapse.from] || locked[collapse.to]) {
+                continue;
+            }
+
+            // Every wedge moves to the wedge of `to` it shares a triangle
+            // with; more than one choice would tear the seam apart.
+            wedge_targets.clear();
+            bool valid = true;
+            uint32_t removed = 0;
+            for (const uint32_t t : around(collapse.from)) {
+                uint32_t wedge = NO_VERTEX;
+                uint32_t target_wedge = NO_VERTEX;
+                for (int k = 0; k < 3; ++k) {
+                    const uint32_t v = triangles[3 * t + k];
+                    if (of[v] == collapse.from) {
+                        wedge = v;
+                    }
+                    else if (of[v] == collapse.to) {
+                        target_wedge = v;
+                    }
+                }
+                if (target_wedge != NO_VERTEX) {
+                    ++removed;
+                    const auto known = std::find_if(
+                        wedge_targets.begin(),
+                        wedge_targets.end(),
+                        [&](const auto &w) { return w.first == wedge; });
+                    if (known == wedge_targets.end()) {
+                        wedge_targets.emplace_back(wedge, target_wedge);
+                    }
+                    else if (known->second != target_wedge) {
+                        valid = false;
+                    }
+                    continue;
+                }
+
+                // Triangles that survive must not flip.
+                const glm::dvec3 before = triangle_normal(t);
+                glm::dvec3 corners[3];
+                for (int k = 0; k < 3; ++k) {
+                    const uint32_t p = of[triangles[3 * t + k]];
+                    corners[k] = points[p == collapse.from ? collapse.to : p];
+                }
+                const glm::dvec3 after = glm::cross(corners[1] - corners[0],
+                                                    corners[2] - corners[0]);
+                if (glm::dot(before, after) <=
+                    MIN_NORMAL_COSINE * glm::length(before) *
+                        glm::length(after)) {
+                    valid = false;
+                }
+            }
+            for (uint32_t w = positions.wedgeOffsets[collapse.from];
+                 valid && w < positions.wedgeOffsets[collapse.from + 1];
+                 ++w) {
+                const uint32_t wedge = positions.wedges[w];
+                const bool mapped = std::any_of(
+                    wedge_targets.begin(),
+                    wedge_targets.end(),
+                    [&](const auto &target) { return target.first == wedge; });
+                const bool used = std::any_of(
+                    around(collapse.from).begin(),
+                    around(collapse.from).end(),
+                    [&](uint32_t t) {
+                        return triangles[3 * t] == wedge ||
+                               triangles[3 * t + 1] == wedge ||
+                               triangles[3 * t + 2] == wedge;
+                    });
+                valid = mapped || !used;
+            }
+            if (!valid) {
+                continue;
+            }
+
+            for (const auto &[wedge, target_wedge] : wedge_targets) {
+                remap[wedge] = target_wedge;
+            }
+            Quadric &q = quadrics[collapse.to];
+            q += quadrics[collapse.from];
+            error = std::max(
+                error,
+                static_cast<float>(std::sqrt(
+                    collapse.cost / std::max(q.weight, 1e-30))));
+
+            // Positions whose triangles changed wait for the next pass, so
+            // the checks above stay valid for every collapse in this one.
+            for (const uint32_t t : around(collapse.from)) {
+                for (int k = 0; k < 3; ++k) {
+                    locked[of[triangles[3 * t + k]]] = true;
+                }
+            }
+            index_count -= 3 * removed;
+            ++applied;
+        }
+
+        size_t write = 0;
+        for (uint32_t t = 0; t < triangle_count; ++t) {
+            const uint32_t v0 = remap[triangles[3 * t]];
+            const uint32_t v1 = remap[triangles[3 * t + 1]];
+            const uint32_t v2 = remap[triangles[3 * t + 2]];
+            if (of[v0] == of[v1] || of[v1] == of[v2] || of[v0] == of[v2]) {
+                continue;
+            }
+            triangles[write++] = v0;
+            triangles[write++] = v1;
+            triangles[write++] = v2;
+        }
+        triangles.resize(write);
+        return applied > 0;
+    };
+
+    std::vector<SimplifiedLevel> levels;
+    levels.reserve(targetIndexCounts.size());
+    bool stalled = false;
+    for (const size_t target : targetIndexCounts) {
+        while (!stalled && triangles.size() > target) {
+            stalled = !collapse_pass(target);
+        }
+        levels.push_back({triangles, error});
+    }
+    return levels;
+}
+
+void
+generate_lods(MeshData &mesh)
+{
+    const uint32_t submesh_count = static_cast<uint32_t>(mesh.submeshes.size());
+    mesh.lods.assign(1, MeshLod{0, submesh_count, 0, 0, 0.0f});
+
+    // Every level is simplified from the previous one in a single run per
+    // submesh, so the quadrics keep the whole history of the surface.
+    std::vector<std::vector<SimplifiedLevel>> levels(submesh_count);
+    for (uint32_t s = 0; s < submesh_count; ++s) {
+        const Submesh &submesh = mesh.submeshes[s];
+        std::vector<size_t> targets;
+        for (uint32_t lod = 1; lod < MAX_MESH_LODS; ++lod) {
+            const size_t triangles = submesh.indexCount / 3 >> lod;
+            targets.push_back(std::max(triangles, MIN_LOD_TRIANGLES) * 3);
+        }
+        levels[s] = simplify_mesh(
+            std::span(mesh.indices)
+                .subspan(submesh.firstIndex, submesh.indexCount),
+            mesh.vertices,
+            targets);
+    }
+
+    size_t previous_count = mesh.indices.size();
+    float error = 0.0f;
+    for (uint32_t lod = 1; lod < MAX_MESH_LODS; ++lod) {
+        size_t index_count = 0;
+        for (const auto &submesh_levels : levels) {
+            index_count += submesh_levels[lod - 1].indices.size();
+        }
+        if (index_count == 0 ||
+            static_cast<float>(index_count) >
+                static_cast<float>(previous_count) * MAX_LOD_TRIANGLE_RATIO) {
+            break;
+        }
+        previous_count = index_count;
+
+        MeshLod level{static_cast<uint32_t>(mesh.submeshes.size()),
+                      submesh_count,
+                      0,
+                      0,
+                      0.0f};
+        for (uint32_t s = 0; s < submesh_count; ++s) {
+            const SimplifiedLevel &simplified = levels[s][lod - 1];
+            Submesh submesh{};
+            submesh.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+            submesh.indexCount =
+                static_cast<uint32_t>(simplified.indices.size());
+            mesh.indices.insert(mesh.indices.end(),
+                                simplified.indices.begin(),
+                                simplified.indices.end());
+            const std::span<uint32_t> indices =
+                std::span(mesh.indices)
+                    .subspan(submesh.firstIndex, submesh.indexCount);
+            optimize_vertex_cache(
+                indices, static_cast<uint32_t>(mesh.vertices.size()));
+            submesh.bounds = compute_bounds(mesh.vertices, indices);
+            mesh.submeshes.push_back(submesh);
+            error = std::max(error, simplified.error);
+        }
+        level.error = error;
+        mesh.lods.push_back(level);
+    }
+}
+
+uint32_t
+select_lod(std::span<const MeshLod> lods,
+           const MeshBounds &bounds,
+           const glm::mat4 &modelView,
+           const glm::mat4 &proj,
+           float viewportHeight,
+           float pixelThreshold)
+{
+    // Errors are in mesh units; the largest axis scale converts them
+    // conservatively.
+    const float scale = std::max({glm::length(glm::vec3(modelView[0])),
+                                  glm::length(glm::vec3(modelView[1])),
+                                  glm::length(glm::vec3(modelView[2]))});
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const float radius = glm::length(bounds.max - bounds.min) * 0.5f * scale;
+    const float distance =
+        glm::length(glm::vec3(modelView * glm::vec4(center, 1.0f))) - radius;
+    if (distance <= 0.0f) {
+        return 0;
+    }
+
+    // Pixels covered by one unit at `distance`, from the vertical field of
+    // view the projection encodes.
+    const float pixels_per_unit =
+        std::abs(proj[1][1]) * viewportHeight * 0.5f / distance;
+    uint32_t selected = 0;
+    for (uint32_t lod = 1; lod < lods.size(); ++lod) {
+        if (lods[lod].error * scale * pixels_per_unit > pixelThreshold) {
+            break;
+        }
+        selected = lod;
+    }
+    return selected;
+}
+}  // namespace NEngine
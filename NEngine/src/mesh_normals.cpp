@@ -0,0 +1,405 @@
+#include "mesh_normals.h"
+
+#include <mikktspace/mikktspace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "job_system.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define NENGINE_MESH_SSE 1
+#endif
+
+namespace NEngine {
+
+static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+// Below these counts a pass runs on the calling thread only; queuing jobs
+// would cost more than the work.
+static constexpr size_t MIN_TRIANGLES_PER_JOB = 1 << 15;
+static constexpr size_t MIN_VERTICES_PER_JOB = 1 << 15;
+
+// Three arrays of x, y and z values, so that four consecutive vectors load
+// into one register per axis.
+struct SoaVectors
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    void
+    Assign(size_t count)
+    {
+        x.assign(count, 0.0f);
+        y.assign(count, 0.0f);
+        z.assign(count, 0.0f);
+    }
+};
+
+// Checks that triangles [begin, end) only use existing vertices.
+static void
+check_indices(std::span<const uint32_t> indices,
+              size_t begin,
+              size_t end,
+              size_t vertexCount)
+{
+    if (begin < end && *std::max_element(indices.begin() + 3 * begin,
+                                         indices.begin() + 3 * end) >=
+                           vertexCount) {
+        throw std::runtime_error("Vertex index is out of range");
+    }
+}
+
+// Writes the normals of triangles [begin, end) to `faces`, four triangles
+// at a time. A normal's length is twice the triangle's area, so sums of
+// them are area weighted.
+static void
+compute_face_normals(const SoaVectors &positions,
+                     std::span<const uint32_t> indices,
+                     size_t begin,
+                     size_t end,
+                     SoaVectors &faces)
+{
+    const float *px = positions.x.data();
+    const float *py = positions.y.data();
+    const float *pz = positions.z.data();
+    size_t t = begin;
+#ifdef NENGINE_MESH_SSE
+    for (; t + 4 <= end; t += 4) {
+        // Corner `k` of each of the four triangles.
+        const uint32_t *c = indices.data() + 3 * t;
+        const auto gather = [c](const float *p, size_t k) {
+            return _mm_setr_ps(p[c[k]], p[c[3 + k]], p[c[6 + k]], p[c[9 + k]]);
+        };
+        const __m128 x0 = gather(px, 0);
+        const __m128 y0 = gather(py, 0);
+        const __m128 z0 = gather(pz, 0);
+        const __m128 ax = _mm_sub_ps(gather(px, 1), x0);
+        const __m128 ay = _mm_sub_ps(gather(py, 1), y0);
+        const __m128 az = _mm_sub_ps(gather(pz, 1), z0);
+        const __m128 bx = _mm_sub_ps(gather(px, 2), x0);
+        const __m128 by = _mm_sub_ps(gather(py, 2), y0);
+        const __m128 bz = _mm_sub_ps(gather(pz, 2), z0);
+        _mm_storeu_ps(faces.x.data() + t,
+                      _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+        _mm_storeu_ps(faces.y.data() + t,
+                      _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+        _mm_storeu_ps(faces.z.data() + t,
+                      _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+    }
+#endif
+    for (; t < end; ++t) {
+        const uint32_t i0 = indices[3 * t];
+        const uint32_t i1 = indices[3 * t + 1];
+        const uint32_t i2 = indices[3 * t + 2];
+        const float ax = px[i1] - px[i0];
+        const float ay = py[i1] - py[i0];
+        const float az = pz[i1] - pz[i0];
+        const float bx = px[i2] - px[i0];
+        const float by = py[i2] - py[i0];
+        const float bz = pz[i2] - pz[i0];
+        faces.x[t] = ay * bz - az * by;
+        faces.y[t] = az * bx - ax * bz;
+        faces.z[t] = ax * by - ay * bx;
+    }
+}
+
+// Scales the first `count` vectors to unit length; zero vectors stay zero.
+static void
+normalize_vectors(float *x, float *y, float *z, size_t count)
+{
+    size_t i = 0;
+#ifdef NENGINE_MESH_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4) {
+        const __m128 vx = _mm_loadu_ps(x + i);
+        const __m128 vy = _mm_loadu_ps(y + i);
+        const __m128 vz = _mm_loadu_ps(z + i);
+        const __m128 length_squared =
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                       _mm_mul_ps(vz, vz));
+        const __m128 scale =
+            _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(length_squared)),
+                       _mm_cmpgt_ps(length_squared, zero));
+        _mm_storeu_ps(x + i, _mm_mul_ps(vx, scale));
+        _mm_storeu_ps(y + i, _mm_mul_ps(vy, scale));
+        _mm_storeu_ps(z + i, _mm_mul_ps(vz, scale));
+    }
+#endif
+    for (; i < count; ++i) {
+        const float length = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+        const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        x[i] *= scale;
+        y[i] *= scale;
+        z[i] *= scale;
+    }
+}
+
+// Single threaded generate_normals, which skips the copies the parallel
+// passes need and sums the normals in place.
+static void
+generate_normals_serial(std::span<vertex> vertices,
+                        std::span<const uint32_t> indices)
+{
+    for (vertex &v : vertices) {
+        v.normal = glm::vec3(0.0f);
+    }
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const uint32_t i0 = indices[i];
+        const uint32_t i1 = indices[i + 1];
+        const uint32_t i2 = indices[i + 2];
+        if (std::max({i0, i1, i2}) >= vertices.size()) {
+            throw std::runtime_error("Vertex index is out of range");
+        }
+        const glm::vec3 &p0 = vertices[i0].pos;
+        const glm::vec3 n =
+            glm::cross(vertices[i1].pos - p0, vertices[i2].pos - p0);
+        vertices[i0].normal += n;
+        vertices[i1].normal += n;
+        vertices[i2].normal += n;
+    }
+    for (vertex &v : vertices) {
+        const float length = glm::length(v.normal);
+        if (length > 0.0f) {
+            v.normal /= length;
+        }
+    }
+}
+
+void
+generate_normals(std::span<vertex> vertices, std::span<const uint32_t> indices)
+{
+    const size_t vertex_count = vertices.size();
+    const size_t triangle_count = indices.size() / 3;
+    const size_t job_count =
+        get_job_count(triangle_count, MIN_TRIANGLES_PER_JOB);
+    if (job_count == 1 || vertex_count == 0) {
+        generate_normals_serial(vertices, indices);
+        return;
+    }
+
+    SoaVectors positions;
+    positions.Assign(vertex_count);
+    parallel_for(
+        vertex_count, MIN_VERTICES_PER_JOB, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) {
+                positions.x[v] = vertices[v].pos.x;
+                positions.y[v] = vertices[v].pos.y;
+                positions.z[v] = vertices[v].pos.z;
+            }
+        });
+
+    // Vertices are split into ranges of a power of two size, at most one
+    // per job, so that finding a vertex's range is a shift.
+    const size_t per_job = (triangle_count + job_count - 1) / job_count;
+    const uint32_t range_shift = static_cast<uint32_t>(
+        std::bit_width((vertex_count + job_count - 1) / job_count - 1));
+    const size_t range_count = ((vertex_count - 1) >> range_shift) + 1;
+
+    // Job i computes the normals of the i-th share of the triangles and
+    // counts the corners it has in every vertex range.
+    SoaVectors faces;
+    faces.Assign(triangle_count);
+    std::vector<size_t> offsets(job_count * range_count);
+    run_parallel(job_count, [&](size_t i) {
+        const size_t begin = std::min(i * per_job, triangle_count);
+        const size_t end = std::min(begin + per_job, triangle_count);
+        check_indices(indices, begin, end, vertex_count);
+        compute_face_normals(positions, indices, begin, end, faces);
+        size_t *counts = offsets.data() + i * range_count;
+        for (size_t c = 3 * begin; c < 3 * end; ++c) {
+            ++counts[indices[c] >> range_shift];
+        }
+    });
+
+    // Buckets the corners by vertex range, and within one by triangle, so
+    // that every vertex adds up its triangles in index order whatever the
+    // job count. Memory grows with the corners rather than with the
+    // vertex ranges the jobs' triangles happen to span.
+    std::vector<size_t> bucket_begins(range_count + 1);
+    size_t total = 0;
+    for (size_t j = 0; j < range_count; ++j) {
+        bucket_begins[j] = total;
+        for (size_t i = 0; i < job_count; ++i) {
+            const size_t count = offsets[i * range_count + j];
+            offsets[i * range_count + j] = total;
+            total += count;
+        }
+    }
+    bucket_begins[range_count] = total;
+
+    std::vector<uint32_t> corners(total);
+    run_parallel(job_count, [&](size_t i) {
+        const size_t begin = std::min(i * per_job, triangle_count);
+        const size_t end = std::min(begin + per_job, triangle_count);
+        size_t *next = offsets.data() + i * range_count;
+        for (size_t c = 3 * begin; c < 3 * end; ++c) {
+            corners[next[indices[c] >> range_shift]++] =
+                static_cast<uint32_t>(c);
+        }
+    });
+
+    // Job j sums the normals of the vertices of range j, which no other
+    // job touches, and normalizes them four at a time.
+    SoaVectors sums;
+    sums.Assign(vertex_count);
+    run_parallel(range_count, [&](size_t j) {
+        for (size_t k = bucket_begins[j]; k < bucket_begins[j + 1]; ++k) {
+            const uint32_t c = corners[k];
+            const uint32_t v = indices[c];
+            sums.x[v] += faces.x[c / 3];
+            sums.y[v] += faces.y[c / 3];
+            sums.z[v] += faces.z[c / 3];
+        }
+
+        const size_t begin = j << range_shift;
+        const size_t end = std::min(begin + (size_t{1} << range_shift),
+                                    vertex_count);
+        normalize_vectors(sums.x.data() + begin,
+                          sums.y.data() + begin,
+                          sums.z.data() + begin,
+                          end - begin);
+        for (size_t v = begin; v < end; ++v) {
+            vertices[v].normal = {sums.x[v], sums.y[v], sums.z[v]};
+        }
+    });
+}
+
+// One submesh as seen by MikkTSpace, which asks for every corner of every
+// face and reports a tangent per corner.
+struct TangentSpaceMesh
+{
+    std::span<const vertex> vertices;
+    std::span<const uint32_t> indices;
+    std::span<glm::vec4> tangents;
+};
+
+static const vertex &
+corner_vertex(const SMikkTSpaceContext *context, int face, int corner)
+{
+    const auto *mesh = static_cast<const TangentSpaceMesh *>(
+        context->m_pUserData);
+    return mesh->vertices[mesh->indices[3 * face + corner]];
+}
+
+static void
+generate_submesh_tangents(TangentSpaceMesh &mesh)
+{
+    SMikkTSpaceInterface callbacks{};
+    callbacks.m_getNumFaces = [](const SMikkTSpaceContext *context) {
+        return static_cast<int>(
+            static_cast<const TangentSpaceMesh *>(context->m_pUserData)
+                ->indices.size() /
+            3);
+    };
+    callbacks.m_getNumVerticesOfFace = [](const SMikkTSpaceContext *, int) {
+        return 3;
+    };
+    callbacks.m_getPosition = [](const SMikkTSpaceContext *context,
+                                 float out[],
+                                 int face,
+                                 int corner) {
+        const glm::vec3 &p = corner_vertex(context, face, corner).pos;
+        out[0] = p.x;
+        out[1] = p.y;
+        out[2] = p.z;
+    };
+    callbacks.m_getNormal = [](const SMikkTSpaceContext *context,
+                               float out[],
+                               int face,
+                               int corner) {
+        const glm::vec3 &n = corner_vertex(context, face, corner).normal;
+        out[0] = n.x;
+        out[1] = n.y;
+        out[2] = n.z;
+    };
+    callbacks.m_getTexCoord = [](const SMikkTSpaceContext *context,
+                                 float out[],
+                                 int face,
+                                 int corner) {
+        const glm::vec2 &uv = corner_vertex(context, face, corner).tex_coord;
+        out[0] = uv.x;
+        out[1] = uv.y;
+    };
+    callbacks.m_setTSpaceBasic = [](const SMikkTSpaceContext *context,
+                                    const float tangent[],
+                                    float sign,
+                                    int face,
+                                    int corner) {
+        auto *mesh = static_cast<TangentSpaceMesh *>(context->m_pUserData);
+        mesh->tangents[3 * face + corner] =
+            glm::vec4(tangent[0], tangent[1], tangent[2], sign);
+    };
+
+    SMikkTSpaceContext context{};
+    context.m_pInterface = &callbacks;
+    context.m_pUserData = &mesh;
+    if (!genTangSpaceDefault(&context)) {
+        throw std::runtime_error("Failed to generate tangents");
+    }
+}
+
+void
+generate_tangents(MeshData &mesh)
+{
+    std::vector<Submesh> ranges = mesh.submeshes;
+    if (ranges.empty()) {
+        ranges.push_back(
+            {0, static_cast<uint32_t>(mesh.indices.size()), 0, mesh.bounds});
+    }
+
+    // Submeshes differ a lot in size, so jobs take the next one from a
+    // shared counter instead of a fixed share. Largest first keeps one big
+    // submesh from starting last.
+    std::sort(ranges.begin(), ranges.end(), [](const auto &a, const auto &b) {
+        return a.indexCount > b.indexCount;
+    });
+    std::vector<glm::vec4> corner_tangents(mesh.indices.size());
+    std::atomic<size_t> next_range{0};
+    run_parallel(get_job_count(ranges.size(), 1), [&](size_t) {
+        for (size_t r = next_range++; r < ranges.size(); r = next_range++) {
+            TangentSpaceMesh submesh{
+                mesh.vertices,
+                std::span(mesh.indices)
+                    .subspan(ranges[r].firstIndex, ranges[r].indexCount),
+                std::span(corner_tangents)
+                    .subspan(ranges[r].firstIndex, ranges[r].indexCount)};
+            generate_submesh_tangents(submesh);
+        }
+    });
+
+    // The first corner of a vertex decides its tangent. Corners with another
+    // one use a copy of the vertex, found again through a chain of copies.
+    std::vector<uint32_t> next_copy(mesh.vertices.size(), NO_VERTEX);
+    std::vector<bool> assigned(mesh.vertices.size(), false);
+    for (size_t i = 0; i < mesh.indices.size(); ++i) {
+        uint32_t v = mesh.indices[i];
+        const glm::vec4 &tangent = corner_tangents[i];
+        if (!assigned[v]) {
+            assigned[v] = true;
+            mesh.vertices[v].tangent = tangent;
+            continue;
+        }
+        while (mesh.vertices[v].tangent != tangent &&
+               next_copy[v] != NO_VERTEX) {
+            v = next_copy[v];
+        }
+        if (mesh.vertices[v].tangent != tangent) {
+            vertex copy = mesh.vertices[v];
+            copy.tangent = tangent;
+            next_copy[v] = static_cast<uint32_t>(mesh.vertices.size());
+            next_copy.push_back(NO_VERTEX);
+            mesh.vertices.push_back(copy);
+            v = next_copy[v];
+        }
+        mesh.indices[i] = v;
+    }
+}
+}  // namespace NEngine
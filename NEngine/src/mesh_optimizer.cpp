@@ -0,0 +1,321 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "mesh_lod.h"
+#include "meshlet.h"
+
+namespace NEngine {
+
+static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+// FIFO size that Tipsify optimizes for. Real caches are at least this big,
+// and a larger setting degrades quickly on smaller caches.
+static constexpr uint32_t TIPSIFY_CACHE_SIZE = 16;
+
+// FIFO size used to find cluster boundaries for overdraw ordering.
+static constexpr uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+VertexCacheStats
+analyze_vertex_cache(std::span<const uint32_t> indices,
+                     uint32_t vertexCount,
+                     uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    if (indices.empty()) {
+        return stats;
+    }
+
+    // A vertex is cached while fewer than `cacheSize` misses happened since
+    // it was last loaded, which models a FIFO without storing it.
+    std::vector<uint32_t> load_time(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t time = cacheSize + 1;
+    uint32_t misses = 0;
+    uint32_t unique = 0;
+    for (const uint32_t index : indices) {
+        if (time - load_time[index] > cacheSize) {
+            load_time[index] = time++;
+            ++misses;
+        }
+        if (!referenced[index]) {
+            referenced[index] = true;
+            ++unique;
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) /
+                 static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(unique);
+    return stats;
+}
+
+// Picks the next fanning vertex: the candidate that will still be in the
+// cache after its remaining triangles are emitted and was loaded earliest.
+static uint32_t
+next_fanning_vertex(const std::vector<uint32_t> &candidates,
+                    const std::vector<uint32_t> &live_triangles,
+                    const std::vector<uint32_t> &load_time,
+                    uint32_t time,
+                    std::vector<uint32_t> &dead_ends,
+                    uint32_t &cursor)
+{
+    uint32_t best = NO_VERTEX;
+    uint32_t best_priority = 0;
+    for (const uint32_t v : candidates) {
+        if (live_triangles[v] == 0) {
+            continue;
+        }
+        uint32_t priority = 0;
+        const uint32_t age = time - load_time[v];
+        if (age + 2 * live_triangles[v] <= TIPSIFY_CACHE_SIZE) {
+            priority = age;
+        }
+        if (best == NO_VERTEX || priority > best_priority) {
+            best = v;
+            best_priority = priority;
+        }
+    }
+    if (best != NO_VERTEX) {
+        return best;
+    }
+
+    // Dead end: fall back to recently used vertices, then to the first
+    // vertex in input order that has triangles left.
+    while (!dead_ends.empty()) {
+        const uint32_t v = dead_ends.back();
+        dead_ends.pop_back();
+        if (live_triangles[v] > 0) {
+            return v;
+        }
+    }
+    while (cursor < live_triangles.size()) {
+        if (live_triangles[cursor] > 0) {
+            return cursor;
+        }
+        ++cursor;
+    }
+    return NO_VERTEX;
+}
+
+void
+optimize_vertex_cache(std::span<uint32_t> indices, uint32_t vertexCount)
+{
+    const uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Triangles of every vertex, in input order.
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (const uint32_t index : indices) {
+        ++offsets[index + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> live_triangles(vertexCount, 0);
+    std::vector<uint32_t> adjacency(indices.size());
+    for (uint32_t i = 0; i < indices.size(); ++i) {
+        const uint32_t v = indices[i];
+        adjacency[offsets[v] + live_triangles[v]++] = i / 3;
+    }
+
+    // Tipsify, from Sander et al., "Fast Triangle Reordering for Vertex
+    // Locality and Reduced Overdraw": emit all remaining triangles around a
+    // fanning vertex, then move on to a neighbour that is still cached.
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> load_time(vertexCount, 0);
+    uint32_t time = TIPSIFY_CACHE_SIZE + 1;
+    std::vector<uint32_t> dead_ends;
+    std::vector<uint32_t> candidates;
+    uint32_t cursor = 0;
+
+    uint32_t fanning = indices[0];
+    while (fanning != NO_VERTEX) {
+        candidates.clear();
+        for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+            const uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = true;
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t v = indices[3 * t + k];
+                output.push_back(v);
+                dead_ends.push_back(v);
+                candidates.push_back(v);
+                --live_triangles[v];
+                if (time - load_time[v] > TIPSIFY_CACHE_SIZE) {
+                    load_time[v] = time++;
+                }
+            }
+        }
+        fanning = next_fanning_vertex(candidates,
+                                      live_triangles,
+                                      load_time,
+                                      time,
+                                      dead_ends,
+                                      cursor);
+    }
+
+    // Exporters sometimes already write a good order, e.g. strips; keep it
+    // when Tipsify cannot beat it.
+    if (analyze_vertex_cache(output, vertexCount, TIPSIFY_CACHE_SIZE).acmr <
+        analyze_vertex_cache(indices, vertexCount, TIPSIFY_CACHE_SIZE).acmr) {
+        std::copy(output.begin(), output.end(), indices.begin());
+    }
+}
+
+void
+optimize_overdraw(std::span<uint32_t> indices,
+                  std::span<const vertex> vertices,
+                  const MeshBounds &bounds,
+                  float threshold)
+{
+    const uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+    if (triangle_count < 2) {
+        return;
+    }
+
+    // Advancing the clock past the cache size evicts everything, which
+    // simulates each piece starting with an empty cache after reordering.
+    std::vector<uint32_t> load_time(vertices.size(), 0);
+    uint32_t time = OVERDRAW_CACHE_SIZE + 1;
+    const auto flush = [&] { time += OVERDRAW_CACHE_SIZE + 1; };
+    const auto triangle_misses = [&](uint32_t t) {
+        uint32_t misses = 0;
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t v = indices[3 * t + k];
+            if (time - load_time[v] > OVERDRAW_CACHE_SIZE) {
+                load_time[v] = time++;
+                ++misses;
+            }
+        }
+        return misses;
+    };
+
+    // Hard boundaries sit where the cache optimized order starts over and a
+    // triangle misses on all of its vertices; moving those clusters around
+    // costs nothing.
+    std::vector<uint32_t> hard_starts;
+    for (uint32_t t = 0; t < triangle_count; ++t) {
+        if (triangle_misses(t) == 3) {
+            hard_starts.push_back(t);
+        }
+    }
+    if (hard_starts.empty() || hard_starts[0] != 0) {
+        hard_starts.insert(hard_starts.begin(), 0);
+    }
+    hard_starts.push_back(triangle_count);
+
+    // Soft boundaries split hard clusters further wherever the running ACMR
+    // of the piece is already within `threshold` of the whole cluster's.
+    std::vector<uint32_t> cluster_starts;
+    for (size_t c = 0; c + 1 < hard_starts.size(); ++c) {
+        const uint32_t begin = hard_starts[c];
+        const uint32_t end = hard_starts[c + 1];
+
+        flush();
+        uint32_t cluster_misses = 0;
+        for (uint32_t t = begin; t < end; ++t) {
+            cluster_misses += triangle_misses(t);
+        }
+        const float cluster_acmr = static_cast<float>(cluster_misses) /
+                                   static_cast<float>(end - begin);
+
+        flush();
+        uint32_t start = begin;
+        uint32_t misses = 0;
+        cluster_starts.push_back(begin);
+        for (uint32_t t = begin; t < end; ++t) {
+            misses += triangle_misses(t);
+            const float acmr =
+                static_cast<float>(misses) / static_cast<float>(t + 1 - start);
+            if (t + 1 < end && acmr <= cluster_acmr * threshold) {
+                start = t + 1;
+                misses = 0;
+                cluster_starts.push_back(start);
+                flush();
+            }
+        }
+    }
+    cluster_starts.push_back(triangle_count);
+
+    // Draw the clusters facing away from the center first: on closed,
+    // roughly convex meshes they are the ones most likely to occlude the
+    // rest.
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const size_t cluster_count = cluster_starts.size() - 1;
+    std::vector<float> sort_keys(cluster_count, 0.0f);
+    for (size_t c = 0; c < cluster_count; ++c) {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (uint32_t t = cluster_starts[c]; t < cluster_starts[c + 1]; ++t) {
+            const glm::vec3 &p0 = vertices[indices[3 * t]].pos;
+            const glm::vec3 &p1 = vertices[indices[3 * t + 1]].pos;
+            const glm::vec3 &p2 = vertices[indices[3 * t + 2]].pos;
+            const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            const float a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        if (area > 0.0f && glm::length(normal) > 0.0f) {
+            sort_keys[c] =
+                glm::dot(centroid / area - center, glm::normalize(normal));
+        }
+    }
+
+    std::vector<uint32_t> order(cluster_count);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return sort_keys[a] > sort_keys[b];
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (const uint32_t c : order) {
+        output.insert(output.end(),
+                      indices.begin() + 3 * cluster_starts[c],
+                      indices.begin() + 3 * cluster_starts[c + 1]);
+    }
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void
+optimize_vertex_fetch(MeshData &mesh)
+{
+    std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+    std::vector<vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (uint32_t &index : mesh.indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices = std::move(vertices);
+}
+
+void
+optimize_mesh(MeshData &mesh)
+{
+    const uint32_t vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+    for (const Submesh &submesh : mesh.submeshes) {
+        const std::span<uint32_t> indices =
+            std::span(mesh.indices)
+                .subspan(submesh.firstIndex, submesh.indexCount);
+        optimize_vertex_cache(indices, vertex_count);
+        optimize_overdraw(indices, mesh.vertices, submesh.bounds);
+    }
+    generate_lods(mesh);
+    build_meshlets(mesh);
+    optimize_vertex_fetch(mesh);
+}
+}  // namespace NEngine
@@ -0,0 +1,298 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "mesh_optimizer.h"
+
+namespace NEngine {
+
+static constexpr uint32_t NO_TRIANGLE = UINT32_MAX;
+static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+// Cones whose normals spread further than this are not worth testing; the
+// cutoff would reject almost no view directions.
+static constexpr float MIN_CONE_SPREAD = 0.1f;
+// Never reached by the cosine the culling shader compares against.
+static constexpr float NO_CONE_CUTOFF = 2.0f;
+
+void
+compute_meshlet_bounds(Meshlet &meshlet,
+                       std::span<const vertex> vertices,
+                       std::span<const uint32_t> indices)
+{
+    if (indices.empty()) {
+        meshlet.center = glm::vec3(0.0f);
+        meshlet.radius = 0.0f;
+        meshlet.coneApex = glm::vec3(0.0f);
+        meshlet.coneAxis = glm::vec3(0.0f);
+        meshlet.coneCutoff = NO_CONE_CUTOFF;
+        return;
+    }
+
+    // Ritter's sphere: start from two distant points, then grow the sphere
+    // to cover the rest.
+    const auto farthest_from = [&](const glm::vec3 &p) {
+        glm::vec3 result = p;
+        float max_distance = -1.0f;
+        for (const uint32_t index : indices) {
+            const float distance = glm::length(vertices[index].pos - p);
+            if (distance > max_distance) {
+                max_distance = distance;
+                result = vertices[index].pos;
+            }
+        }
+        return result;
+    };
+    const glm::vec3 a = farthest_from(vertices[indices[0]].pos);
+    const glm::vec3 b = farthest_from(a);
+    glm::vec3 center = (a + b) * 0.5f;
+    float radius = glm::length(b - a) * 0.5f;
+    for (const uint32_t index : indices) {
+        const glm::vec3 &p = vertices[index].pos;
+        const float distance = glm::length(p - center);
+        if (distance > radius) {
+            const float new_radius = (radius + distance) * 0.5f;
+            center += (p - center) * ((distance - new_radius) / distance);
+            radius = new_radius;
+        }
+    }
+    meshlet.center = center;
+    meshlet.radius = radius;
+
+    // The cone axis is the average facing direction, its spread the largest
+    // angle between the axis and a triangle normal. The apex is moved back
+    // along the axis until it lies behind every triangle plane, so the view
+    // direction test is conservative for the whole meshlet.
+    glm::vec3 axis(0.0f);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3 &p0 = vertices[indices[i]].pos;
+        const glm::vec3 n = glm::cross(vertices[indices[i + 1]].pos - p0,
+                                       vertices[indices[i + 2]].pos - p0);
+        const float length = glm::length(n);
+        if (length > 0.0f) {
+            axis += n / length;
+        }
+    }
+
+    meshlet.coneApex = center;
+    meshlet.coneAxis = glm::vec3(0.0f);
+    meshlet.coneCutoff = NO_CONE_CUTOFF;
+    if (glm::length(axis) == 0.0f) {
+        return;
+    }
+    axis = glm::normalize(axis);
+
+    float min_dot = 1.0f;
+    float max_t = 0.0f;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3 &p0 = vertices[indices[i]].pos;
+        const glm::vec3 n = glm::cross(vertices[indices[i + 1]].pos - p0,
+                                       vertices[indices[i + 2]].pos - p0);
+        const float length = glm::length(n);
+        if (length == 0.0f) {
+            continue;
+        }
+        const float d = glm::dot(axis, n / length);
+        min_dot = std::min(min_dot, d);
+        if (d > 0.0f) {
+            max_t = std::max(max_t, glm::dot(center - p0, n / length) / d);
+        }
+    }
+
+    meshlet.coneAxis = axis;
+    if (min_dot <= MIN_CONE_SPREAD) {
+        return;
+    }
+    meshlet.coneApex = center - axis * max_t;
+    meshlet.coneCutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+void
+build_meshlets(MeshData &mesh, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    const size_t vertex_count = mesh.vertices.size();
+    const std::span<const uint32_t> indices = mesh.indices;
+
+    // Triangles around every vertex, stored as one array with offsets.
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for (const uint32_t index : indices) {
+        ++adjacency_offsets[index + 1];
+    }
+    for (size_t v = 0; v < vertex_count; ++v) {
+        adjacency_offsets[v + 1] += adjacency_offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(adjacency_offsets.begin(),
+                                   adjacency_offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<uint32_t> output(indices.size());
+    std::vector<bool> emitted(indices.size() / 3, false);
+    std::vector<uint32_t> local_vertices(vertex_count, NO_VERTEX);
+    std::vector<uint32_t> meshlet_vertices;
+    meshlet_vertices.reserve(maxVertices);
+    mesh.meshlets.clear();
+
+    // Meshlets of every submesh, as offsets into the meshlet table.
+    std::vector<uint32_t> submesh_meshlets;
+    submesh_meshlets.reserve(mesh.submeshes.size() + 1);
+    for (const Submesh &submesh : mesh.submeshes) {
+        submesh_meshlets.push_back(
+            static_cast<uint32_t>(mesh.meshlets.size()));
+        const uint32_t first_triangle = submesh.firstIndex / 3;
+        const uint32_t end_triangle =
+            first_triangle + submesh.indexCount / 3;
+        uint32_t write = submesh.firstIndex;
+        uint32_t meshlet_start = write;
+        uint32_t meshlet_triangles = 0;
+        uint32_t scan = first_triangle;
+        uint32_t last = NO_TRIANGLE;
+
+        glm::vec3 centroid_sum(0.0f);
+        const auto triangle_centroid = [&](uint32_t t) {
+            return (mesh.vertices[indices[3 * t]].pos +
+                    mesh.vertices[indices[3 * t + 1]].pos +
+                    mesh.vertices[indices[3 * t + 2]].pos) /
+                   3.0f;
+        };
+
+        const auto new_vertices = [&](uint32_t t) {
+            uint32_t count = 0;
+            for (uint32_t k = 0; k < 3; ++k) {
+                count += local_vertices[indices[3 * t + k]] == NO_VERTEX;
+            }
+            return count;
+        };
+
+        // Prefers triangles that add the fewest vertices, then those closest
+        // to the meshlet's centroid, which keeps meshlets round and their
+        // bounding spheres small.
+        const auto best_neighbour = [&](std::span<const uint32_t> around) {
+            uint32_t best = NO_TRIANGLE;
+            uint32_t best_new = 4;
+            float best_distance = std::numeric_limits<float>::max();
+            for (const uint32_t v : around) {
+                for (uint32_t a = adjacency_offsets[v];
+                     a < adjacency_offsets[v + 1];
+                     ++a) {
+                    const uint32_t t = adjacency[a];
+                    if (emitted[t] || t < first_triangle ||
+                        t >= end_triangle) {
+                        continue;
+                    }
+                    const uint32_t added = new_vertices(t);
+                    if (added > best_new) {
+                        continue;
+                    }
+                    const float distance = glm::length(
+                        triangle_centroid(t) -
+                        centroid_sum / static_cast<float>(meshlet_triangles));
+                    if (added < best_new || distance < best_distance) {
+                        best = t;
+                        best_new = added;
+                        best_distance = distance;
+                    }
+                }
+            }
+            return best;
+        };
+
+        const auto flush = [&]() {
+            if (meshlet_triangles == 0) {
+                return;
+            }
+            Meshlet meshlet{};
+            meshlet.firstIndex = meshlet_start;
+            meshlet.indexCount = meshlet_triangles * 3;
+
+            // Growing by adjacency loses the input's cache order, so the
+            // triangles are reordered again within the meshlet, on local
+            // vertex numbers to keep the optimizer's tables small.
+            const std::span<uint32_t> meshlet_indices =
+                std::span(output).subspan(meshlet.firstIndex,
+                                          meshlet.indexCount);
+            for (uint32_t &index : meshlet_indices) {
+                index = local_vertices[index];
+            }
+            optimize_vertex_cache(
+                meshlet_indices,
+                static_cast<uint32_t>(meshlet_vertices.size()));
+            for (uint32_t &index : meshlet_indices) {
+                index = meshlet_vertices[index];
+            }
+
+            compute_meshlet_bounds(
+                meshlet,
+                mesh.vertices,
+                std::span<const uint32_t>(output).subspan(
+                    meshlet.firstIndex, meshlet.indexCount));
+            mesh.meshlets.push_back(meshlet);
+
+            for (const uint32_t v : meshlet_vertices) {
+                local_vertices[v] = NO_VERTEX;
+            }
+            meshlet_vertices.clear();
+            meshlet_start = write;
+            meshlet_triangles = 0;
+            centroid_sum = glm::vec3(0.0f);
+            last = NO_TRIANGLE;
+        };
+
+        while (true) {
+            uint32_t next = NO_TRIANGLE;
+            if (last != NO_TRIANGLE) {
+                next = best_neighbour(indices.subspan(3 * last, 3));
+                if (next == NO_TRIANGLE) {
+                    next = best_neighbour(meshlet_vertices);
+                }
+            }
+            if (next == NO_TRIANGLE) {
+                while (scan < end_triangle && emitted[scan]) {
+                    ++scan;
+                }
+                if (scan == end_triangle) {
+                    break;
+                }
+                next = scan;
+            }
+
+            if (meshlet_vertices.size() + new_vertices(next) > maxVertices ||
+                meshlet_triangles == maxTriangles) {
+                flush();
+            }
+
+            for (uint32_t k = 0; k < 3; ++k) {
+                const uint32_t v = indices[3 * next + k];
+                if (local_vertices[v] == NO_VERTEX) {
+                    local_vertices[v] =
+                        static_cast<uint32_t>(meshlet_vertices.size());
+                    meshlet_vertices.push_back(v);
+                }
+                output[write++] = v;
+            }
+            emitted[next] = true;
+            centroid_sum += triangle_centroid(next);
+            ++meshlet_triangles;
+            last = next;
+        }
+        flush();
+    }
+    submesh_meshlets.push_back(static_cast<uint32_t>(mesh.meshlets.size()));
+
+    for (MeshLod &lod : mesh.lods) {
+        lod.firstMeshlet = submesh_meshlets[lod.firstSubmesh];
+        lod.meshletCount =
+            submesh_meshlets[lod.firstSubmesh + lod.submeshCount] -
+            lod.firstMeshlet;
+    }
+
+    mesh.indices = std::move(output);
+}
+}  // namespace NEngine
@@ -0,0 +1,454 @@
+#include "mip_generator.h"
+
+#include <algorithm>
+#include <array>
+
+#include "misc.h"
+
+namespace NEngine {
+
+struct DownsampleParams
+{
+    int32_t srcWidth;
+    int32_t srcHeight;
+    uint32_t mipCount;
+    uint32_t srgb;
+};
+
+// sRGB formats cannot be used for storage images. The shader writes through a
+// UNORM view and encodes the colors itself.
+static VkFormat
+get_storage_format(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return VK_FORMAT_R8G8B8A8_UNORM;
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return VK_FORMAT_B8G8R8A8_UNORM;
+        case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+            return VK_FORMAT_A8B8G8R8_UNORM_PACK32;
+        default:
+            return format;
+    }
+}
+
+static uint32_t
+mip_extent(uint32_t extent, uint32_t level)
+{
+    return std::max(extent >> level, 1u);
+}
+
+static VkImageMemoryBarrier
+make_barrier(const Image &image,
+             uint32_t base_mip_level,
+             uint32_t level_count,
+             VkImageLayout old_layout,
+             VkImageLayout new_layout,
+             VkAccessFlags src_access,
+             VkAccessFlags dst_access)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = image.GetImage();
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = base_mip_level;
+    barrier.subresourceRange.levelCount = level_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+static void
+pipeline_barrier(VkCommandBuffer cb,
+                 VkPipelineStageFlags src_stage,
+                 VkPipelineStageFlags dst_stage,
+                 const std::vector<VkImageMemoryBarrier> &barriers)
+{
+    if (barriers.empty()) {
+        return;
+    }
+    vkCmdPipelineBarrier(cb,
+                         src_stage,
+                         dst_stage,
+                         0,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr,
+                         static_cast<uint32_t>(barriers.size()),
+                         barriers.data());
+}
+
+MipGenerator::MipGenerator(VkDevice device,
+                           VkPhysicalDevice physicalDevice,
+                           const std::vector<char> &shaderCode)
+    : m_device(device),
+      m_physicalDevice(physicalDevice)
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = LEVELS_PER_DISPATCH;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+    VKRESULT(vkCreateDescriptorSetLayout(
+        device, &layout_info, nullptr, &m_descriptorSetLayout));
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(DownsampleParams);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &m_descriptorSetLayout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    VKRESULT(vkCreatePipelineLayout(
+        device, &pipeline_layout_info, nullptr, &m_pipelineLayout));
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shaderCode.size();
+    module_info.pCode = reinterpret_cast<const uint32_t *>(shaderCode.data());
+    VkShaderModule shader_module{};
+    VKRESULT(
+        vkCreateShaderModule(device, &module_info, nullptr, &shader_module));
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = m_pipelineLayout;
+    VKRESULT(vkCreateComputePipelines(
+        device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_pipeline));
+    vkDestroyShaderModule(device, shader_module, nullptr);
+
+    // Only used with texelFetch, filtering never happens.
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    VKRESULT(vkCreateSampler(device, &sampler_info, nullptr, &m_sampler));
+}
+
+MipGenerator::~MipGenerator()
+{
+    Cleanup();
+}
+
+void
+MipGenerator::Cleanup()
+{
+    if (!m_pipeline) {
+        return;
+    }
+
+    for (const Pending &pending : m_pending) {
+        Release(pending);
+    }
+    m_pending.clear();
+
+    vkDestroySampler(m_device, m_sampler, nullptr);
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+    m_sampler = nullptr;
+    m_pipeline = nullptr;
+    m_pipelineLayout = nullptr;
+    m_descriptorSetLayout = nullptr;
+}
+
+bool
+MipGenerator::Supports(VkFormat format) const
+{
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &props);
+    if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+        return false;
+    }
+
+    vkGetPhysicalDeviceFormatProperties(
+        m_physicalDevice, get_storage_format(format), &props);
+    return props.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+}
+
+VkImageCreateFlags
+MipGenerator::GetImageFlags(VkFormat format)
+{
+    // The storage usage is only valid for the UNORM alias of sRGB formats.
+    return get_storage_format(format) != format
+               ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT |
+                     VK_IMAGE_CREATE_EXTENDED_USAGE_BIT
+               : 0;
+}
+
+void
+MipGenerator::Record(UploadService &uploads,
+                     const std::vector<const Image *> &images)
+{
+    ReleaseCompleted();
+    if (images.empty()) {
+        return;
+    }
+
+    const VkCommandBuffer cb = uploads.GetCommandBuffer();
+    Pending pending{&uploads, uploads.GetRecordingValue(), {}, {}};
+
+    uint32_t dispatch_count = 0;
+    for (const Image *image : images) {
+        dispatch_count += (image->GetMipLevels() - 1 + LEVELS_PER_DISPATCH - 1) /
+                          LEVELS_PER_DISPATCH;
+    }
+
+    if (dispatch_count > 0) {
+        std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_sizes[0].descriptorCount = dispatch_count;
+        pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        pool_sizes[1].descriptorCount = dispatch_count * LEVELS_PER_DISPATCH;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.maxSets = dispatch_count;
+        pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_info.pPoolSizes = pool_sizes.data();
+        VKRESULT(vkCreateDescriptorPool(
+            m_device, &pool_info, nullptr, &pending.descriptorPool));
+    }
+
+    // Level 0 was written by a transfer, the remaining levels only need the
+    // layout change.
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (const Image *image : images) {
+        barriers.push_back(
+            make_barrier(*image,
+                         0,
+                         image->GetMipLevels(),
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_GENERAL,
+                         VK_ACCESS_TRANSFER_WRITE_BIT,
+                         VK_ACCESS_SHADER_READ_BIT |
+                             VK_ACCESS_SHADER_WRITE_BIT));
+    }
+    pipeline_barrier(cb,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                     barriers);
+
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+    // Every round builds the next six levels of all images. Only the last
+    // level written by the previous round has to be made visible.
+    for (uint32_t base = 0;; base += LEVELS_PER_DISPATCH) {
+        barriers.clear();
+        bool has_work = false;
+        for (const Image *image : images) {
+            if (base + 1 >= image->GetMipLevels()) {
+                continue;
+            }
+            has_work = true;
+            if (base > 0) {
+                barriers.push_back(make_barrier(*image,
+                                                base,
+                                                1,
+                                                VK_IMAGE_LAYOUT_GENERAL,
+                                                VK_IMAGE_LAYOUT_GENERAL,
+                                                VK_ACCESS_SHADER_WRITE_BIT,
+                                                VK_ACCESS_SHADER_READ_BIT));
+            }
+        }
+        if (!has_work) {
+            break;
+        }
+        pipeline_barrier(cb,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         barriers);
+
+        for (const Image *image : images) {
+            if (base + 1 >= image->GetMipLevels()) {
+                continue;
+            }
+            const uint32_t mip_count = std::min(
+                image->GetMipLevels() - 1 - base, LEVELS_PER_DISPATCH);
+
+            VkDescriptorSetAllocateInfo alloc_info{};
+            alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            alloc_info.descriptorPool = pending.descriptorPool;
+            alloc_info.descriptorSetCount = 1;
+            alloc_info.pSetLayouts = &m_descriptorSetLayout;
+            VkDescriptorSet descriptor_set{};
+            VKRESULT(
+                vkAllocateDescriptorSets(m_device, &alloc_info, &descriptor_set));
+
+            VkDescriptorImageInfo src_info{};
+            src_info.sampler = m_sampler;
+            src_info.imageView = CreateView(*image,
+                                            image->GetFormat(),
+                                            VK_IMAGE_USAGE_SAMPLED_BIT,
+                                            base,
+                                            pending.views);
+            src_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            // Unused array slots repeat the last level, the shader does not
+            // write past mip_count.
+            std::array<VkDescriptorImageInfo, LEVELS_PER_DISPATCH> dst_infos{};
+            const VkFormat storage_format =
+                get_storage_format(image->GetFormat());
+            for (uint32_t i = 0; i < LEVELS_PER_DISPATCH; ++i) {
+                dst_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                dst_infos[i].imageView =
+                    i < mip_count ? CreateView(*image,
+                                               storage_format,
+                                               VK_IMAGE_USAGE_STORAGE_BIT,
+                                               base + 1 + i,
+                                               pending.views)
+                                  : dst_infos[mip_count - 1].imageView;
+            }
+
+            std::array<VkWriteDescriptorSet, 2> writes{};
+            writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[0].dstSet = descriptor_set;
+            writes[0].dstBinding = 0;
+            writes[0].descriptorType =
+                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[0].descriptorCount = 1;
+            writes[0].pImageInfo = &src_info;
+            writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[1].dstSet = descriptor_set;
+            writes[1].dstBinding = 1;
+            writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[1].descriptorCount = LEVELS_PER_DISPATCH;
+            writes[1].pImageInfo = dst_infos.data();
+            vkUpdateDescriptorSets(m_device,
+                                   static_cast<uint32_t>(writes.size()),
+                                   writes.data(),
+                                   0,
+                                   nullptr);
+
+            const uint32_t src_width = mip_extent(image->GetWidth(), base);
+            const uint32_t src_height = mip_extent(image->GetHeight(), base);
+            const DownsampleParams params = {
+                static_cast<int32_t>(src_width),
+                static_cast<int32_t>(src_height),
+                mip_count,
+                storage_format != image->GetFormat()};
+
+            vkCmdBindDescriptorSets(cb,
+                                    VK_PIPELINE_BIND_POINT_COMPUTE,
+                                    m_pipelineLayout,
+                                    0,
+                                    1,
+                                    &descriptor_set,
+                                    0,
+                                    nullptr);
+            vkCmdPushConstants(cb,
+                               m_pipelineLayout,
+                               VK_SHADER_STAGE_COMPUTE_BIT,
+                               0,
+                               sizeof(params),
+                               &params);
+            // Each workgroup covers 32x32 texels of the first level written.
+            vkCmdDispatch(cb,
+                          (mip_extent(src_width, 1) + 31) / 32,
+                          (mip_extent(src_height, 1) + 31) / 32,
+                          1);
+        }
+    }
+
+    barriers.clear();
+    for (const Image *image : images) {
+        barriers.push_back(
+            make_barrier(*image,
+                         0,
+                         image->GetMipLevels(),
+                         VK_IMAGE_LAYOUT_GENERAL,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_ACCESS_SHADER_READ_BIT));
+    }
+    pipeline_barrier(cb,
+                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                     barriers);
+
+    m_pending.push_back(std::move(pending));
+}
+
+VkImageView
+MipGenerator::CreateView(const Image &image,
+                         VkFormat format,
+                         VkImageUsageFlags usage,
+                         uint32_t mipLevel,
+                         std::vector<VkImageView> &views) const
+{
+    VkImageViewUsageCreateInfo usage_info{};
+    usage_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    usage_info.usage = usage;
+
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.pNext = &usage_info;
+    view_info.image = image.GetImage();
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = mipLevel;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+
+    VkImageView view{};
+    VKRESULT(vkCreateImageView(m_device, &view_info, nullptr, &view));
+    views.push_back(view);
+
+    return view;
+}
+
+void
+MipGenerator::ReleaseCompleted()
+{
+    std::erase_if(m_pending, [this](const Pending &pending) {
+        if (!pending.uploads->IsComplete(pending.value)) {
+            return false;
+        }
+        Release(pending);
+        return true;
+    });
+}
+
+void
+MipGenerator::Release(const Pending &pending) const
+{
+    for (VkImageView view : pending.views) {
+        vkDestroyImageView(m_device, view, nullptr);
+    }
+    if (pending.descriptorPool) {
+        vkDestroyDescriptorPool(m_device, pending.descriptorPool, nullptr);
+    }
+}
+}  // namespace NEngine
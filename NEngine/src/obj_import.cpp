@@ -0,0 +1,360 @@
+#include "obj_import.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#include "job_system.h"
+#include "mapped_file.h"
+#include "mesh_normals.h"
+
+namespace NEngine {
+
+// Below this size a file is tokenized on the calling thread only.
+static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+static constexpr int32_t MISSING_INDEX = INT32_MIN;
+static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+// Attribute indices of one triangle corner. Non-negative values are 0-based
+// indices into the whole file. Relative (negative) OBJ indices are resolved
+// against the chunk while tokenizing and stored bitwise negated, because the
+// number of attributes in earlier chunks is not known yet.
+struct ObjCorner
+{
+    int32_t position;
+    int32_t texcoord;
+    int32_t normal;
+};
+
+struct ObjChunk
+{
+    const char *begin;
+    const char *end;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+    // Three corners per triangle; polygons are triangulated as fans.
+    std::vector<ObjCorner> corners;
+    // Local triangle indices at which an `o` or `g` statement starts a new
+    // submesh.
+    std::vector<uint32_t> groupStarts;
+    // Attributes and corners in all preceding chunks.
+    uint32_t positionBase = 0;
+    uint32_t texcoordBase = 0;
+    uint32_t normalBase = 0;
+    uint32_t cornerBase = 0;
+};
+
+static const char *
+skip_spaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    return p;
+}
+
+static const char *
+skip_line(const char *p, const char *end)
+{
+    const void *newline = memchr(p, '\n', static_cast<size_t>(end - p));
+    return newline ? static_cast<const char *>(newline) + 1 : end;
+}
+
+static const char *
+parse_floats(const char *p, const char *end, float *values, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        p = skip_spaces(p, end);
+        const std::from_chars_result result =
+            std::from_chars(p, end, values[i]);
+        if (result.ec != std::errc()) {
+            throw std::runtime_error("Malformed number in OBJ file");
+        }
+        p = result.ptr;
+    }
+    return p;
+}
+
+static int32_t
+resolve_index(int32_t index, size_t local_count)
+{
+    if (index > 0) {
+        return index - 1;
+    }
+    if (index < 0 && static_cast<size_t>(-static_cast<int64_t>(index)) <=
+                         local_count) {
+        return ~static_cast<int32_t>(static_cast<int64_t>(local_count) + index);
+    }
+    // Zero, or relative to an attribute in an earlier chunk. The latter is
+    // legal OBJ but no exporter writes it.
+    throw std::runtime_error("Unsupported index in OBJ file");
+}
+
+// Parses one `v`, `v/t`, `v//n` or `v/t/n` face token.
+static const char *
+parse_corner(const char *p, const char *end, ObjChunk &chunk, ObjCorner &corner)
+{
+    int32_t values[3] = {0, 0, 0};
+    for (int i = 0; i < 3; ++i) {
+        if (i > 0) {
+            if (p == end || *p != '/') {
+                break;
+            }
+            ++p;
+        }
+        const std::from_chars_result result =
+            std::from_chars(p, end, values[i]);
+        if (result.ec != std::errc()) {
+            if (i == 1 && p < end && *p == '/') {
+                continue;
+            }
+            throw std::runtime_error("Malformed face in OBJ file");
+        }
+        p = result.ptr;
+    }
+
+    corner.position = resolve_index(values[0], chunk.positions.size());
+    corner.texcoord = values[1]
+                          ? resolve_index(values[1], chunk.texcoords.size())
+                          : MISSING_INDEX;
+    corner.normal = values[2]
+                        ? resolve_index(values[2], chunk.normals.size())
+                        : MISSING_INDEX;
+    return p;
+}
+
+static void
+tokenize(ObjChunk &chunk)
+{
+    // Rough guesses that avoid most reallocations for typical files.
+    const size_t size = static_cast<size_t>(chunk.end - chunk.begin);
+    chunk.positions.reserve(size / 96);
+    chunk.texcoords.reserve(size / 96);
+    chunk.normals.reserve(size / 96);
+    chunk.corners.reserve(size / 24);
+
+    std::vector<ObjCorner> polygon;
+    const char *p = chunk.begin;
+    const char *end = chunk.end;
+    while (p < end) {
+        p = skip_spaces(p, end);
+        if (p + 1 >= end) {
+            break;
+        }
+
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            glm::vec3 &position = chunk.positions.emplace_back();
+            p = parse_floats(p + 2, end, &position.x, 3);
+        }
+        else if (p[0] == 'v' && p[1] == 't') {
+            glm::vec2 &texcoord = chunk.texcoords.emplace_back();
+            p = parse_floats(p + 2, end, &texcoord.x, 2);
+        }
+        else if (p[0] == 'v' && p[1] == 'n') {
+            glm::vec3 &normal = chunk.normals.emplace_back();
+            p = parse_floats(p + 2, end, &normal.x, 3);
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            polygon.clear();
+            p += 2;
+            while (true) {
+                p = skip_spaces(p, end);
+                if (p == end || *p == '\r' || *p == '\n' || *p == '#') {
+                    break;
+                }
+                p = parse_corner(p, end, chunk, polygon.emplace_back());
+            }
+            if (polygon.size() < 3) {
+                throw std::runtime_error("Degenerate face in OBJ file");
+            }
+            for (size_t i = 2; i < polygon.size(); ++i) {
+                chunk.corners.push_back(polygon[0]);
+                chunk.corners.push_back(polygon[i - 1]);
+                chunk.corners.push_back(polygon[i]);
+            }
+        }
+        else if ((p[0] == 'o' || p[0] == 'g') &&
+                 (p[1] == ' ' || p[1] == '\t' || p[1] == '\r' ||
+                  p[1] == '\n')) {
+            chunk.groupStarts.push_back(
+                static_cast<uint32_t>(chunk.corners.size() / 3));
+        }
+
+        p = skip_line(p, end);
+    }
+}
+
+static int32_t
+to_global(int32_t index, uint32_t base)
+{
+    return index >= 0 || index == MISSING_INDEX
+               ? index
+               : static_cast<int32_t>(base) + ~index;
+}
+
+template <typename T>
+static const T *
+fetch(const std::vector<T> &all, int32_t index)
+{
+    if (index == MISSING_INDEX) {
+        return nullptr;
+    }
+    if (index < 0 || static_cast<size_t>(index) >= all.size()) {
+        throw std::runtime_error("OBJ face index is out of range");
+    }
+    return &all[static_cast<size_t>(index)];
+}
+
+static uint32_t
+hash_vertex(const vertex &v)
+{
+    uint32_t words[sizeof(vertex) / sizeof(uint32_t)];
+    memcpy(words, &v, sizeof(vertex));
+
+    uint32_t hash = 2166136261u;
+    for (const uint32_t word : words) {
+        hash = (hash ^ word) * 0x9E3779B1u;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+MeshData
+import_obj(const std::string &path)
+{
+    const MappedFile file(path);
+    const char *begin = reinterpret_cast<const char *>(file.GetData());
+    const char *end = begin + file.GetSize();
+
+    // Split the file at line boundaries into one chunk per thread of the job
+    // system.
+    const size_t chunk_count = get_job_count(file.GetSize(), MIN_CHUNK_SIZE);
+    std::vector<ObjChunk> chunks(chunk_count);
+    const char *chunk_begin = begin;
+    for (size_t i = 0; i < chunk_count; ++i) {
+        const char *chunk_end =
+            i + 1 == chunk_count
+                ? end
+                : skip_line(std::max(chunk_begin,
+                                     begin + file.GetSize() * (i + 1) /
+                                                 chunk_count),
+                            end);
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+
+    run_parallel(chunk_count, [&](size_t i) { tokenize(chunks[i]); });
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> group_starts = {0};
+    uint32_t corner_count = 0;
+    for (ObjChunk &chunk : chunks) {
+        chunk.positionBase = static_cast<uint32_t>(positions.size());
+        chunk.texcoordBase = static_cast<uint32_t>(texcoords.size());
+        chunk.normalBase = static_cast<uint32_t>(normals.size());
+        chunk.cornerBase = corner_count;
+        positions.insert(
+            positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texcoords.insert(
+            texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+        normals.insert(
+            normals.end(), chunk.normals.begin(), chunk.normals.end());
+        for (const uint32_t start : chunk.groupStarts) {
+            group_starts.push_back(chunk.cornerBase / 3 + start);
+        }
+        corner_count += static_cast<uint32_t>(chunk.corners.size());
+    }
+
+    // Build the vertex of every corner and its hash in parallel, then weld
+    // them in file order so that the result does not depend on the number
+    // of threads.
+    std::vector<vertex> corner_vertices(corner_count);
+    std::vector<uint32_t> corner_hashes(corner_count);
+    run_parallel(chunk_count, [&](size_t i) {
+        const ObjChunk &chunk = chunks[i];
+        for (size_t c = 0; c < chunk.corners.size(); ++c) {
+            const ObjCorner &corner = chunk.corners[c];
+            const glm::vec3 *position = fetch(
+                positions, to_global(corner.position, chunk.positionBase));
+            const glm::vec2 *texcoord = fetch(
+                texcoords, to_global(corner.texcoord, chunk.texcoordBase));
+            const glm::vec3 *normal = fetch(
+                normals, to_global(corner.normal, chunk.normalBase));
+
+            vertex &v = corner_vertices[chunk.cornerBase + c];
+            v = {};
+            v.pos = *position;
+            if (texcoord) {
+                v.tex_coord = {texcoord->x, 1.0f - texcoord->y};
+            }
+            if (normal) {
+                v.normal = *normal;
+            }
+            v.color = {1.0f, 1.0f, 1.0f};
+            corner_hashes[chunk.cornerBase + c] = hash_vertex(v);
+        }
+    });
+    chunks.clear();
+
+    MeshData mesh;
+    mesh.vertices.reserve(positions.size());
+    mesh.indices.resize(corner_count);
+
+    // Open addressing with linear probing over (hash, vertex index) slots.
+    // Comparing the stored hash first keeps most probes off the vertex data.
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t index;
+    };
+    const size_t capacity =
+        std::bit_ceil(std::max<size_t>(corner_count, 8) * 2);
+    const size_t mask = capacity - 1;
+    std::vector<Slot> table(capacity, Slot{0, EMPTY_SLOT});
+    for (uint32_t i = 0; i < corner_count; ++i) {
+        const vertex &v = corner_vertices[i];
+        const uint32_t hash = corner_hashes[i];
+        size_t slot = hash & mask;
+        while (table[slot].index != EMPTY_SLOT &&
+               (table[slot].hash != hash ||
+                memcmp(&mesh.vertices[table[slot].index], &v, sizeof(vertex)) !=
+                    0)) {
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot].index == EMPTY_SLOT) {
+            table[slot] = {hash, static_cast<uint32_t>(mesh.vertices.size())};
+            mesh.vertices.push_back(v);
+        }
+        mesh.indices[i] = table[slot].index;
+    }
+
+    if (normals.empty()) {
+        generate_normals(mesh.vertices, mesh.indices);
+    }
+
+    // Every `o` and `g` starts a submesh; ones without faces are dropped.
+    group_starts.push_back(corner_count / 3);
+    for (size_t i = 0; i + 1 < group_starts.size(); ++i) {
+        if (group_starts[i] == group_starts[i + 1]) {
+            continue;
+        }
+        Submesh submesh{};
+        submesh.firstIndex = group_starts[i] * 3;
+        submesh.indexCount = (group_starts[i + 1] - group_starts[i]) * 3;
+        submesh.bounds = compute_bounds(
+            mesh.vertices,
+            std::span(mesh.indices)
+                .subspan(submesh.firstIndex, submesh.indexCount));
+        mesh.submeshes.push_back(submesh);
+    }
+    mesh.bounds = compute_bounds(mesh.vertices, mesh.indices);
+
+    return mesh;
+}
+}  // namespace NEngine
@@ -0,0 +1,898 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "misc.h"
+
+namespace NEngine {
+
+// What a RenderGraphAccess implies.
+struct AccessInfo
+{
+    VkImageLayout layout;
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageUsageFlags usage;
+    bool reads;
+    bool writes;
+    bool attachment;
+};
+
+static constexpr VkAccessFlags WRITE_ACCESS =
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+static constexpr VkImageUsageFlags ATTACHMENT_USAGE =
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+// Indexed by RenderGraphAccess.
+static constexpr AccessInfo ACCESS_INFOS[] = {
+    {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+     VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+     true,
+     true,
+     true},
+    {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+     VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+     true,
+     true,
+     true},
+    {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+     VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+     false,
+     true,
+     true},
+    {VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+     VK_ACCESS_SHADER_READ_BIT,
+     VK_IMAGE_USAGE_SAMPLED_BIT,
+     true,
+     false,
+     false},
+    {VK_IMAGE_LAYOUT_GENERAL,
+     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+     VK_ACCESS_SHADER_READ_BIT,
+     VK_IMAGE_USAGE_SAMPLED_BIT,
+     true,
+     false,
+     false},
+    {VK_IMAGE_LAYOUT_GENERAL,
+     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+     VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+     VK_IMAGE_USAGE_STORAGE_BIT,
+     true,
+     true,
+     false},
+    {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+     VK_ACCESS_SHADER_READ_BIT,
+     VK_IMAGE_USAGE_SAMPLED_BIT,
+     true,
+     false,
+     false},
+};
+static_assert(std::size(ACCESS_INFOS) ==
+                  static_cast<size_t>(RenderGraphAccess::FragmentRead) + 1,
+              "Must cover every RenderGraphAccess");
+
+static const AccessInfo &
+get_access_info(RenderGraphAccess access)
+{
+    return ACCESS_INFOS[static_cast<uint32_t>(access)];
+}
+
+static bool
+is_depth_format(VkFormat format)
+{
+    return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT ||
+           format == VK_FORMAT_D16_UNORM_S8_UINT ||
+           format == VK_FORMAT_D24_UNORM_S8_UINT ||
+           format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+// Aspects that layout transitions of an image of `format` must name.
+static VkImageAspectFlags
+get_barrier_aspect(VkFormat format)
+{
+    if (!is_depth_format(format)) {
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+    if (format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT) {
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    }
+    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+}
+
+template <typename T>
+static void
+append_key(std::vector<uint32_t> &key, const T &value)
+{
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0);
+    uint32_t words[sizeof(T) / sizeof(uint32_t)];
+    std::memcpy(words, &value, sizeof(T));
+    key.insert(key.end(), std::begin(words), std::end(words));
+}
+
+RenderGraph::RenderGraph(VkDevice device, GpuAllocator &allocator)
+    : m_device(device),
+      m_allocator(&allocator)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    Cleanup();
+}
+
+void
+RenderGraph::Cleanup()
+{
+    DestroyCompiled();
+    m_compiled = false;
+}
+
+void
+RenderGraph::Reset()
+{
+    m_resources.clear();
+    m_passes.clear();
+    m_uses.clear();
+}
+
+RenderGraphImage
+RenderGraph::CreateImage(const RenderGraphImageDesc &desc)
+{
+    Resource &resource = m_resources.emplace_back();
+    resource.desc = desc;
+    return {static_cast<uint32_t>(m_resources.size() - 1)};
+}
+
+RenderGraphImage
+RenderGraph::ImportImage(const RenderGraphImageDesc &desc,
+                         const RenderGraphImport &import)
+{
+    Resource &resource = m_resources.emplace_back();
+    resource.desc = desc;
+    resource.imported = true;
+    resource.import = import;
+    return {static_cast<uint32_t>(m_resources.size() - 1)};
+}
+
+void
+RenderGraph::AddGraphicsPass(std::span<const RenderGraphUse> uses,
+                             RenderGraphRecord record)
+{
+    AddPass(PassType::Graphics, uses, std::move(record));
+}
+
+void
+RenderGraph::AddComputePass(std::span<const RenderGraphUse> uses,
+                            RenderGraphRecord record)
+{
+    AddPass(PassType::Compute, uses, std::move(record));
+}
+
+void
+RenderGraph::AddPass(PassType type,
+                     std::span<const RenderGraphUse> uses,
+                     RenderGraphRecord record)
+{
+    for ([[maybe_unused]] const RenderGraphUse &use : uses) {
+        ASSERT(use.image.index < m_resources.size(), "Unknown image");
+        ASSERT(type == PassType::Graphics ||
+                   !get_access_info(use.access).attachment,
+               "Compute passes cannot use attachments");
+    }
+
+    Pass &pass = m_passes.emplace_back();
+    pass.type = type;
+    pass.firstUse = static_cast<uint32_t>(m_uses.size());
+    pass.useCount = static_cast<uint32_t>(uses.size());
+    pass.record = std::move(record);
+    m_uses.insert(m_uses.end(), uses.begin(), uses.end());
+}
+
+void
+RenderGraph::Execute(VkCommandBuffer cb)
+{
+    BuildKey(m_scratchKey);
+    if (!m_compiled || m_scratchKey != m_key) {
+        // The set of passes changes rarely, so rather than keeping the old
+        // images and render passes alive until the frames in flight are
+        // done with them, the GPU is drained.
+        if (m_compiled) {
+            VKRESULT(vkDeviceWaitIdle(m_device));
+        }
+        DestroyCompiled();
+        m_key.swap(m_scratchKey);
+        Compile();
+    }
+
+    for (Step &step : m_steps) {
+        RecordBarrier(cb, step.barrier);
+        if (!step.renderPass) {
+            for (uint32_t pass : step.passes) {
+                m_passes[pass].record(cb);
+            }
+            continue;
+        }
+
+        VkRenderPassBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        begin_info.renderPass = step.renderPass;
+        begin_info.framebuffer = GetFramebuffer(step);
+        begin_info.renderArea.offset = {0, 0};
+        begin_info.renderArea.extent = step.extent;
+        begin_info.clearValueCount =
+            static_cast<uint32_t>(step.clearValues.size());
+        begin_info.pClearValues = step.clearValues.data();
+        vkCmdBeginRenderPass(cb, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+        for (uint32_t pass : step.passes) {
+            m_passes[pass].record(cb);
+        }
+        vkCmdEndRenderPass(cb);
+    }
+    RecordBarrier(cb, m_finalBarrier);
+}
+
+void
+RenderGraph::Invalidate()
+{
+    DestroyCompiled();
+    m_compiled = false;
+}
+
+VkImageView
+RenderGraph::GetImageView(RenderGraphImage image) const
+{
+    return GetView(image.index);
+}
+
+uint64_t
+RenderGraph::GetVersion() const
+{
+    return m_version;
+}
+
+// Everything compiling depends on, which leaves out the imported images'
+// handles.
+void
+RenderGraph::BuildKey(std::vector<uint32_t> &key) const
+{
+    key.clear();
+    key.push_back(static_cast<uint32_t>(m_resources.size()));
+    for (const Resource &resource : m_resources) {
+        key.push_back(resource.desc.format);
+        key.push_back(resource.desc.extent.width);
+        key.push_back(resource.desc.extent.height);
+        key.push_back(resource.desc.samples);
+        key.push_back(resource.desc.clear);
+        append_key(key, resource.desc.clearValue);
+        key.push_back(resource.imported);
+        if (resource.imported) {
+            key.push_back(resource.import.initialLayout);
+            key.push_back(resource.import.finalLayout);
+            key.push_back(resource.import.output);
+        }
+    }
+    key.push_back(static_cast<uint32_t>(m_passes.size()));
+    for (const Pass &pass : m_passes) {
+        key.push_back(static_cast<uint32_t>(pass.type));
+        key.push_back(pass.useCount);
+        for (const RenderGraphUse &use : GetUses(pass)) {
+            key.push_back(use.image.index);
+            key.push_back(static_cast<uint32_t>(use.access));
+        }
+    }
+}
+
+void
+RenderGraph::Compile()
+{
+    BuildSteps(CullPasses());
+    ComputeLifetimes();
+    CreateImages();
+
+    // Replaying the frame once gives the state every image is left in,
+    // which is where the next frame finds it.
+    std::vector<ImageState> initial(m_resources.size());
+    for (uint32_t i = 0; i < m_resources.size(); ++i) {
+        if (m_resources[i].imported) {
+            initial[i].layout = m_resources[i].import.initialLayout;
+        }
+    }
+    const std::vector<ImageState> end = Simulate(initial, false);
+
+    for (uint32_t i = 0; i < m_resources.size(); ++i) {
+        const Resource &resource = m_resources[i];
+        if (resource.imported) {
+            if (resource.import.initialLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
+                initial[i] = {};
+                initial[i].writeStages = m_lifetimes[i].firstStages;
+            }
+            else {
+                initial[i] = end[i];
+                initial[i].layout = resource.import.initialLayout;
+            }
+        }
+    }
+    // An owned image takes its memory over from the image that used it
+    // before, which is the slot's last image for the first one.
+    for (const MemorySlot &slot : m_slots) {
+        for (size_t i = 0; i < slot.resources.size(); ++i) {
+            const uint32_t previous =
+                slot.resources[(i + slot.resources.size() - 1) %
+                               slot.resources.size()];
+            initial[slot.resources[i]] = end[previous];
+            initial[slot.resources[i]].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+    }
+    Simulate(initial, true);
+
+    for (Step &step : m_steps) {
+        if (m_passes[step.passes.front()].type == PassType::Graphics) {
+            CreateRenderPass(step);
+        }
+    }
+    ++m_version;
+    m_compiled = true;
+}
+
+void
+RenderGraph::DestroyCompiled()
+{
+    for (Step &step : m_steps) {
+        for (const Framebuffer &framebuffer : step.framebuffers) {
+            vkDestroyFramebuffer(m_device, framebuffer.framebuffer, nullptr);
+        }
+        vkDestroyRenderPass(m_device, step.renderPass, nullptr);
+    }
+    for (size_t i = 0; i < m_images.size(); ++i) {
+        if (m_images[i]) {
+            vkDestroyImageView(m_device, m_views[i], nullptr);
+            vkDestroyImage(m_device, m_images[i], nullptr);
+        }
+    }
+    for (const MemorySlot &slot : m_slots) {
+        m_allocator->Free(slot.allocation);
+    }
+    m_steps.clear();
+    m_finalBarrier = {};
+    m_lifetimes.clear();
+    m_images.clear();
+    m_views.clear();
+    m_slots.clear();
+}
+
+std::vector<uint32_t>
+RenderGraph::CullPasses() const
+{
+    // Walking backwards, an image is needed while a kept pass after the
+    // current one reads what it holds.
+    std::vector<bool> needed(m_resources.size());
+    for (uint32_t i = 0; i < m_resources.size(); ++i) {
+        needed[i] = m_resources[i].imported && m_resources[i].import.output;
+    }
+
+    std::vector<uint32_t> kept;
+    for (uint32_t pass = static_cast<uint32_t>(m_passes.size()); pass-- > 0;) {
+        const std::span<const RenderGraphUse> uses = GetUses(m_passes[pass]);
+        bool writes = false;
+        bool keep = false;
+        for (const RenderGraphUse &use : uses) {
+            if (get_access_info(use.access).writes) {
+                writes = true;
+                keep = keep || needed[use.image.index];
+            }
+        }
+        if (writes && !keep) {
+            continue;
+        }
+
+        for (const RenderGraphUse &use : uses) {
+            const AccessInfo &info = get_access_info(use.access);
+            if (info.writes && !info.reads) {
+                needed[use.image.index] = false;
+            }
+        }
+        for (const RenderGraphUse &use : uses) {
+            if (get_access_info(use.access).reads) {
+                needed[use.image.index] = true;
+            }
+        }
+        kept.push_back(pass);
+    }
+    std::reverse(kept.begin(), kept.end());
+    return kept;
+}
+
+static bool
+same_attachments(std::span<const RenderGraphUse> a,
+                 std::span<const RenderGraphUse> b)
+{
+    auto a_it = a.begin();
+    auto b_it = b.begin();
+    while (true) {
+        while (a_it != a.end() && !get_access_info(a_it->access).attachment) {
+            ++a_it;
+        }
+        while (b_it != b.end() && !get_access_info(b_it->access).attachment) {
+            ++b_it;
+        }
+        if (a_it == a.end() || b_it == b.end()) {
+            return a_it == a.end() && b_it == b.end();
+        }
+        if (a_it->image.index != b_it->image.index ||
+            a_it->access != b_it->access) {
+            return false;
+        }
+        ++a_it;
+        ++b_it;
+    }
+}
+
+void
+RenderGraph::BuildSteps(const std::vector<uint32_t> &passes)
+{
+    for (uint32_t pass : passes) {
+        const std::span<const RenderGraphUse> uses = GetUses(m_passes[pass]);
+        // A pass that follows one with the same attachments continues its
+        // render pass. What else it reads was not written by the one
+        // before, so its barrier can move ahead of both.
+        if (m_passes[pass].type == PassType::Graphics && !m_steps.empty()) {
+            Step &last = m_steps.back();
+            const Pass &previous = m_passes[last.passes.back()];
+            if (previous.type == PassType::Graphics &&
+                same_attachments(GetUses(previous), uses)) {
+                last.passes.push_back(pass);
+                for (const RenderGraphUse &use : uses) {
+                    const auto it = std::find_if(
+                        last.uses.begin(),
+                        last.uses.end(),
+                        [&](const RenderGraphUse &other) {
+                            return other.image.index == use.image.index;
+                        });
+                    ASSERT(it == last.uses.end() || it->access == use.access,
+                           "Merged passes use an image in different ways");
+                    if (it == last.uses.end()) {
+                        last.uses.push_back(use);
+                    }
+                }
+                continue;
+            }
+        }
+
+        Step &step = m_steps.emplace_back();
+        step.passes.push_back(pass);
+        step.uses.assign(uses.begin(), uses.end());
+        if (m_passes[pass].type == PassType::Graphics) {
+            for (const RenderGraphUse &use : uses) {
+                if (get_access_info(use.access).attachment) {
+                    step.attachments.push_back(use.image.index);
+                }
+            }
+        }
+    }
+}
+
+void
+RenderGraph::ComputeLifetimes()
+{
+    m_lifetimes.assign(m_resources.size(), {});
+    for (uint32_t s = 0; s < m_steps.size(); ++s) {
+        for (const RenderGraphUse &use : m_steps[s].uses) {
+            Lifetime &lifetime = m_lifetimes[use.image.index];
+            if (lifetime.firstStep == UINT32_MAX) {
+                lifetime.firstStep = s;
+                lifetime.firstStages = get_access_info(use.access).stages;
+            }
+            lifetime.lastStep = s;
+        }
+    }
+}
+
+void
+RenderGraph::CreateImages()
+{
+    m_images.assign(m_resources.size(), nullptr);
+    m_views.assign(m_resources.size(), nullptr);
+
+    std::vector<VkImageUsageFlags> usage(m_resources.size(), 0);
+    for (const Step &step : m_steps) {
+        for (const RenderGraphUse &use : step.uses) {
+            usage[use.image.index] |= get_access_info(use.access).usage;
+        }
+    }
+
+    // Owned images in the order they start being used, so that each can
+    // take the memory of one whose last use came before its first.
+    std::vector<uint32_t> owned;
+    for (uint32_t i = 0; i < m_resources.size(); ++i) {
+        if (!m_resources[i].imported &&
+            m_lifetimes[i].firstStep != UINT32_MAX) {
+            owned.push_back(i);
+        }
+    }
+    std::stable_sort(owned.begin(), owned.end(), [&](uint32_t a, uint32_t b) {
+        return m_lifetimes[a].firstStep < m_lifetimes[b].firstStep;
+    });
+
+    for (uint32_t i : owned) {
+        const RenderGraphImageDesc &desc = m_resources[i].desc;
+        // Images that are only ever attachments need no memory of their own
+        // on tilers.
+        if ((usage[i] & ~ATTACHMENT_USAGE) == 0) {
+            usage[i] |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = desc.format;
+        image_info.extent = {desc.extent.width, desc.extent.height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = desc.samples;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = usage[i];
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VKRESULT(vkCreateImage(m_device, &image_info, nullptr, &m_images[i]));
+
+        VkMemoryRequirements requirements{};
+        vkGetImageMemoryRequirements(m_device, m_images[i], &requirements);
+        const auto slot = std::find_if(
+            m_slots.begin(), m_slots.end(), [&](const MemorySlot &other) {
+                return m_lifetimes[other.resources.back()].lastStep <
+                           m_lifetimes[i].firstStep &&
+                       (other.requirements.memoryTypeBits &
+                        requirements.memoryTypeBits);
+            });
+        if (slot == m_slots.end()) {
+            MemorySlot &added = m_slots.emplace_back();
+            added.requirements = requirements;
+            added.resources.push_back(i);
+            continue;
+        }
+        slot->requirements.size =
+            std::max(slot->requirements.size, requirements.size);
+        slot->requirements.alignment =
+            std::max(slot->requirements.alignment, requirements.alignment);
+        slot->requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        slot->resources.push_back(i);
+    }
+
+    for (MemorySlot &slot : m_slots) {
+        slot.allocation = m_allocator->Allocate(
+            slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        for (uint32_t i : slot.resources) {
+            VKRESULT(vkBindImageMemory(m_device,
+                                       m_images[i],
+                                       slot.allocation.memory,
+                                       slot.allocation.offset));
+
+            const VkFormat format = m_resources[i].desc.format;
+            VkImageViewCreateInfo view_info{};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.image = m_images[i];
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = format;
+            view_info.subresourceRange.aspectMask =
+                is_depth_format(format) ? VK_IMAGE_ASPECT_DEPTH_BIT
+                                        : VK_IMAGE_ASPECT_COLOR_BIT;
+            view_info.subresourceRange.baseMipLevel = 0;
+            view_info.subresourceRange.levelCount = 1;
+            view_info.subresourceRange.baseArrayLayer = 0;
+            view_info.subresourceRange.layerCount = 1;
+            VKRESULT(
+                vkCreateImageView(m_device, &view_info, nullptr, &m_views[i]));
+        }
+    }
+}
+
+std::vector<RenderGraph::ImageState>
+RenderGraph::Simulate(const std::vector<ImageState> &initial, bool record)
+{
+    std::vector<ImageState> states = initial;
+    for (Step &step : m_steps) {
+        Barrier barrier;
+        for (const RenderGraphUse &use : step.uses) {
+            const AccessInfo &info = get_access_info(use.access);
+            ImageState &state = states[use.image.index];
+            const bool transition = state.layout != info.layout;
+            if (transition || info.writes) {
+                // Waits for the last write and every read since.
+                const VkPipelineStageFlags src_stages =
+                    state.writeStages | state.readStages;
+                if (transition) {
+                    barrier.images.push_back({use.image.index,
+                                              state.layout,
+                                              info.layout,
+                                              state.writeAccess,
+                                              info.access});
+                }
+                else if (src_stages) {
+                    barrier.srcAccess |= state.writeAccess;
+                    barrier.dstAccess |= info.access;
+                }
+                if (transition || src_stages) {
+                    barrier.srcStages |= src_stages;
+                    barrier.dstStages |= info.stages;
+                }
+
+                state.layout = info.layout;
+                state.writeStages = info.stages;
+                state.writeAccess = info.access & WRITE_ACCESS;
+                if (info.writes) {
+                    state.readStages = 0;
+                    state.visibleStages = 0;
+                    state.visibleAccess = 0;
+                }
+                else {
+                    state.readStages = info.stages;
+                    state.visibleStages = info.stages;
+                    state.visibleAccess = info.access;
+                }
+                continue;
+            }
+
+            // Reads in the same layout only wait for a write they do not
+            // see yet.
+            if (state.writeStages &&
+                ((info.stages & ~state.visibleStages) ||
+                 (info.access & ~state.visibleAccess))) {
+                barrier.srcStages |= state.writeStages;
+                barrier.dstStages |= info.stages;
+                barrier.srcAccess |= state.writeAccess;
+                barrier.dstAccess |= info.access;
+                state.visibleStages |= info.stages;
+                state.visibleAccess |= info.access;
+            }
+            state.readStages |= info.stages;
+        }
+        if (record) {
+            step.barrier = std::move(barrier);
+        }
+    }
+
+    Barrier final_barrier;
+    for (uint32_t i = 0; i < m_resources.size(); ++i) {
+        const Resource &resource = m_resources[i];
+        ImageState &state = states[i];
+        if (!resource.imported ||
+            resource.import.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED ||
+            resource.import.finalLayout == state.layout) {
+            continue;
+        }
+        final_barrier.images.push_back({i,
+                                        state.layout,
+                                        resource.import.finalLayout,
+                                        state.writeAccess,
+                                        0});
+        final_barrier.srcStages |= state.writeStages | state.readStages;
+        final_barrier.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        state = {};
+        state.layout = resource.import.finalLayout;
+        state.writeStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    }
+    if (record) {
+        m_finalBarrier = std::move(final_barrier);
+    }
+    return states;
+}
+
+void
+RenderGraph::CreateRenderPass(Step &step) const
+{
+    const uint32_t step_index = static_cast<uint32_t>(&step - m_steps.data());
+
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference> color_refs;
+    std::vector<VkAttachmentReference> resolve_refs;
+    VkAttachmentReference depth_ref{VK_ATTACHMENT_UNUSED,
+                                    VK_IMAGE_LAYOUT_UNDEFINED};
+    for (const RenderGraphUse &use : step.uses) {
+        const AccessInfo &info = get_access_info(use.access);
+        if (!info.attachment) {
+            continue;
+        }
+        const uint32_t resource = use.image.index;
+        const Resource &desc = m_resources[resource];
+
+        // Contents are only defined before the first use when something
+        // outside of the frame put them there.
+        const bool defined =
+            m_lifetimes[resource].firstStep != step_index ||
+            (desc.imported &&
+             desc.import.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+        // Stored when a later step reads them, or the frame is over for an
+        // image that outlives it.
+        bool read_later = false;
+        bool used_later = false;
+        for (size_t s = step_index + 1; s < m_steps.size() && !used_later;
+             ++s) {
+            for (const RenderGraphUse &other : m_steps[s].uses) {
+                if (other.image.index == resource) {
+                    used_later = true;
+                    read_later = get_access_info(other.access).reads;
+                    break;
+                }
+            }
+        }
+        const bool store = read_later || (!used_later && desc.imported);
+
+        VkAttachmentDescription attachment{};
+        attachment.format = desc.desc.format;
+        attachment.samples = desc.desc.samples;
+        if (use.access == RenderGraphAccess::ResolveAttachment) {
+            attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        }
+        else if (defined) {
+            attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        }
+        else {
+            attachment.loadOp = desc.desc.clear
+                                    ? VK_ATTACHMENT_LOAD_OP_CLEAR
+                                    : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        }
+        attachment.storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE
+                                   : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // The step's barrier moves the image to the layout of its use.
+        attachment.initialLayout = info.layout;
+        attachment.finalLayout = info.layout;
+
+        const VkAttachmentReference ref{
+            static_cast<uint32_t>(attachments.size()), info.layout};
+        switch (use.access) {
+        case RenderGraphAccess::ColorAttachment:
+            color_refs.push_back(ref);
+            break;
+        case RenderGraphAccess::DepthAttachment:
+            depth_ref = ref;
+            break;
+        default:
+            resolve_refs.push_back(ref);
+            break;
+        }
+        attachments.push_back(attachment);
+        step.clearValues.push_back(desc.desc.clearValue);
+    }
+    ASSERT(resolve_refs.empty() || resolve_refs.size() == color_refs.size(),
+           "Every color attachment needs a resolve attachment or none does");
+    ASSERT(!attachments.empty(), "Graphics passes need an attachment");
+    step.extent = m_resources[step.attachments.front()].desc.extent;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(color_refs.size());
+    subpass.pColorAttachments = color_refs.data();
+    subpass.pDepthStencilAttachment =
+        depth_ref.attachment != VK_ATTACHMENT_UNUSED ? &depth_ref : nullptr;
+    subpass.pResolveAttachments =
+        resolve_refs.empty() ? nullptr : resolve_refs.data();
+
+    VkRenderPassCreateInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount =
+        static_cast<uint32_t>(attachments.size());
+    render_pass_info.pAttachments = attachments.data();
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+
+    VKRESULT(vkCreateRenderPass(
+        m_device, &render_pass_info, nullptr, &step.renderPass));
+}
+
+VkFramebuffer
+RenderGraph::GetFramebuffer(Step &step)
+{
+    std::vector<VkImageView> views;
+    views.reserve(step.attachments.size());
+    for (uint32_t resource : step.attachments) {
+        views.push_back(GetView(resource));
+    }
+    for (const Framebuffer &framebuffer : step.framebuffers) {
+        if (framebuffer.views == views) {
+            return framebuffer.framebuffer;
+        }
+    }
+
+    VkFramebufferCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    create_info.renderPass = step.renderPass;
+    create_info.attachmentCount = static_cast<uint32_t>(views.size());
+    create_info.pAttachments = views.data();
+    create_info.width = step.extent.width;
+    create_info.height = step.extent.height;
+    create_info.layers = 1;
+
+    Framebuffer &framebuffer = step.framebuffers.emplace_back();
+    framebuffer.views = std::move(views);
+    VKRESULT(vkCreateFramebuffer(
+        m_device, &create_info, nullptr, &framebuffer.framebuffer));
+    return framebuffer.framebuffer;
+}
+
+void
+RenderGraph::RecordBarrier(VkCommandBuffer cb, const Barrier &barrier)
+{
+    if (!barrier.dstStages) {
+        return;
+    }
+
+    m_scratchBarriers.clear();
+    for (const ImageBarrier &image : barrier.images) {
+        VkImageMemoryBarrier &out = m_scratchBarriers.emplace_back();
+        out.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        out.srcAccessMask = image.srcAccess;
+        out.dstAccessMask = image.dstAccess;
+        out.oldLayout = image.oldLayout;
+        out.newLayout = image.newLayout;
+        out.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        out.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        out.image = GetImage(image.resource);
+        out.subresourceRange.aspectMask =
+            get_barrier_aspect(m_resources[image.resource].desc.format);
+        out.subresourceRange.baseMipLevel = 0;
+        out.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        out.subresourceRange.baseArrayLayer = 0;
+        out.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    }
+
+    VkMemoryBarrier memory_barrier{};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.srcAccessMask = barrier.srcAccess;
+    memory_barrier.dstAccessMask = barrier.dstAccess;
+    const bool memory = barrier.srcAccess != 0;
+    // Transitions of images nothing used before wait for nothing.
+    VkPipelineStageFlags src_stages = barrier.srcStages;
+    if (!src_stages) {
+        src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+
+    vkCmdPipelineBarrier(cb,
+                         src_stages,
+                         barrier.dstStages,
+                         0,
+                         memory ? 1 : 0,
+                         memory ? &memory_barrier : nullptr,
+                         0,
+                         nullptr,
+                         static_cast<uint32_t>(m_scratchBarriers.size()),
+                         m_scratchBarriers.data());
+}
+
+VkImage
+RenderGraph::GetImage(uint32_t resource) const
+{
+    const Resource &r = m_resources[resource];
+    return r.imported ? r.import.image : m_images[resource];
+}
+
+VkImageView
+RenderGraph::GetView(uint32_t resource) const
+{
+    const Resource &r = m_resources[resource];
+    return r.imported ? r.import.view : m_views[resource];
+}
+
+std::span<const RenderGraphUse>
+RenderGraph::GetUses(const Pass &pass) const
+{
+    return std::span<const RenderGraphUse>(m_uses).subspan(pass.firstUse,
+                                                           pass.useCount);
+}
+}  // namespace NEngine
@@ -0,0 +1,313 @@
+#include "scene_bvh.h"
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <utility>
+
+#include "job_system.h"
+#include "misc.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define NENGINE_BVH_SSE 1
+#endif
+
+namespace NEngine {
+
+static constexpr uint32_t ALL_PLANES = (1u << 6) - 1;
+
+// Below this many objects per thread the whole hierarchy is culled on the
+// calling thread; splitting it would cost more than the tests.
+static constexpr size_t MIN_OBJECTS_PER_JOB = 1 << 13;
+
+// Spreads the low 10 bits of `v` out to every third bit.
+static uint32_t
+spread_bits(uint32_t v)
+{
+    v = (v | v << 16) & 0x030000ffu;
+    v = (v | v << 8) & 0x0300f00fu;
+    v = (v | v << 4) & 0x030c30c3u;
+    v = (v | v << 2) & 0x09249249u;
+    return v;
+}
+
+// Position of `point` along a Z-order curve through `bounds`, at 10 bits
+// per axis.
+static uint32_t
+get_morton_code(const glm::vec3 &point, const MeshBounds &bounds)
+{
+    const glm::vec3 extent = glm::max(bounds.max - bounds.min, 1e-20f);
+    const glm::uvec3 cell =
+        glm::clamp((point - bounds.min) / extent * 1024.0f, 0.0f, 1023.0f);
+    return spread_bits(cell.x) << 2 | spread_bits(cell.y) << 1 |
+           spread_bits(cell.z);
+}
+
+// Splits the sorted `codes` where the highest bit in which they differ
+// changes, or in the middle when they are all the same, and returns the
+// size of the first part.
+static uint32_t
+split_codes(std::span<const uint32_t> codes)
+{
+    const uint32_t differing = codes.front() ^ codes.back();
+    if (differing == 0) {
+        return static_cast<uint32_t>(codes.size() / 2);
+    }
+    const uint32_t bit = std::bit_floor(differing);
+    return static_cast<uint32_t>(
+        std::partition_point(codes.begin(),
+                             codes.end(),
+                             [&](uint32_t code) { return (code & bit) == 0; }) -
+        codes.begin());
+}
+
+void
+SceneBvh::Build(std::span<const MeshBounds> boxes)
+{
+    ASSERT(boxes.size() < UINT32_MAX, "Too many objects for the hierarchy");
+
+    m_nodes.clear();
+    m_order.resize(boxes.size());
+    if (boxes.empty()) {
+        return;
+    }
+
+    // Objects are sorted along a Z-order curve through their centers, and
+    // nodes split their range where the curve crosses the largest cell
+    // boundary, so that nearby objects share subtrees without searching for
+    // splits.
+    std::vector<glm::vec3> centers(boxes.size());
+    MeshBounds center_bounds{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        centers[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        center_bounds.min = glm::min(center_bounds.min, centers[i]);
+        center_bounds.max = glm::max(center_bounds.max, centers[i]);
+    }
+    std::vector<uint64_t> keys(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        keys[i] = static_cast<uint64_t>(
+                      get_morton_code(centers[i], center_bounds))
+                      << 32 |
+                  i;
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<uint32_t> codes(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        codes[i] = static_cast<uint32_t>(keys[i] >> 32);
+        m_order[i] = static_cast<uint32_t>(keys[i]);
+    }
+
+    // Every node but the root has at least two objects under it, so there
+    // are fewer nodes than objects.
+    m_nodes.reserve(boxes.size());
+    MeshBounds bounds;
+    BuildNode(boxes, codes, 0, static_cast<uint32_t>(boxes.size()), bounds);
+}
+
+uint32_t
+SceneBvh::BuildNode(std::span<const MeshBounds> boxes,
+                    std::span<const uint32_t> codes,
+                    uint32_t first,
+                    uint32_t count,
+                    MeshBounds &bounds)
+{
+    const uint32_t index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    // Up to WIDTH objects become the children themselves. More are split in
+    // two, and halves of more than one object in two again.
+    Node node{};
+    if (count <= WIDTH) {
+        for (uint32_t c = 0; c < count; ++c) {
+            node.first[c] = first + c;
+            node.count[c] = 1;
+        }
+        node.childCount = count;
+    }
+    else {
+        const uint32_t half = split_codes(codes.subspan(first, count));
+        for (const auto &[begin, size] :
+             {std::pair(first, half), std::pair(first + half, count - half)}) {
+            const uint32_t quarter =
+                size > 1 ? split_codes(codes.subspan(begin, size)) : size;
+            node.first[node.childCount] = begin;
+            node.count[node.childCount++] = quarter;
+            if (quarter < size) {
+                node.first[node.childCount] = begin + quarter;
+                node.count[node.childCount++] = size - quarter;
+            }
+        }
+    }
+
+    for (uint32_t c = 0; c < node.childCount; ++c) {
+        MeshBounds child_bounds;
+        if (node.count[c] == 1) {
+            child_bounds = boxes[m_order[node.first[c]]];
+        }
+        else {
+            node.child[c] = BuildNode(
+                boxes, codes, node.first[c], node.count[c], child_bounds);
+        }
+        node.minX[c] = child_bounds.min.x;
+        node.minY[c] = child_bounds.min.y;
+        node.minZ[c] = child_bounds.min.z;
+        node.maxX[c] = child_bounds.max.x;
+        node.maxY[c] = child_bounds.max.y;
+        node.maxZ[c] = child_bounds.max.z;
+        if (c == 0) {
+            bounds = child_bounds;
+        }
+        else {
+            bounds.min = glm::min(bounds.min, child_bounds.min);
+            bounds.max = glm::max(bounds.max, child_bounds.max);
+        }
+    }
+    // Children were appended after the node, so it is written last.
+    m_nodes[index] = node;
+    return index;
+}
+
+void
+SceneBvh::Cull(const glm::vec4 (&planes)[6],
+               std::vector<uint32_t> &visible) const
+{
+    visible.clear();
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    // The top of the tree is tested level by level on this thread until
+    // there are enough subtrees to keep the job system's threads busy.
+    const size_t job_count = get_job_count(m_order.size(), MIN_OBJECTS_PER_JOB);
+    std::vector<Task> subtrees = {{0, ALL_PLANES}};
+    if (job_count > 1) {
+        std::vector<Task> next;
+        while (!subtrees.empty() &&
+               subtrees.size() < job_count * JOBS_PER_THREAD) {
+            next.clear();
+            for (const Task task : subtrees) {
+                CullNode(planes, task, visible, next);
+            }
+            subtrees.swap(next);
+        }
+    }
+
+    if (subtrees.size() == 1) {
+        CullSubtree(planes, subtrees[0], visible);
+        return;
+    }
+    std::vector<std::vector<uint32_t>> parts(subtrees.size());
+    run_parallel(subtrees.size(), [&](size_t i) {
+        CullSubtree(planes, subtrees[i], parts[i]);
+    });
+    for (const std::vector<uint32_t> &part : parts) {
+        visible.insert(visible.end(), part.begin(), part.end());
+    }
+}
+
+size_t
+SceneBvh::GetObjectCount() const
+{
+    return m_order.size();
+}
+
+void
+SceneBvh::CullSubtree(const glm::vec4 (&planes)[6],
+                      Task root,
+                      std::vector<uint32_t> &visible) const
+{
+    std::vector<Task> pending = {root};
+    while (!pending.empty()) {
+        const Task task = pending.back();
+        pending.pop_back();
+        CullNode(planes, task, visible, pending);
+    }
+}
+
+void
+SceneBvh::CullNode(const glm::vec4 (&planes)[6],
+                   Task task,
+                   std::vector<uint32_t> &visible,
+                   std::vector<Task> &pending) const
+{
+    const Node &node = m_nodes[task.node];
+
+    // Bit c of `outside` is set when child c is entirely behind one of the
+    // planes, and of inside[p] when it is entirely in front of plane p. The
+    // corner furthest along the plane's normal decides the former, the
+    // nearest the latter.
+    uint32_t outside = 0;
+    uint32_t inside[6] = {};
+    for (uint32_t p = 0; p < 6; ++p) {
+        if ((task.planeMask & (1u << p)) == 0) {
+            continue;
+        }
+        const glm::vec4 &plane = planes[p];
+        const float *far_x = plane.x >= 0.0f ? node.maxX : node.minX;
+        const float *far_y = plane.y >= 0.0f ? node.maxY : node.minY;
+        const float *far_z = plane.z >= 0.0f ? node.maxZ : node.minZ;
+        const float *near_x = plane.x >= 0.0f ? node.minX : node.maxX;
+        const float *near_y = plane.y >= 0.0f ? node.minY : node.maxY;
+        const float *near_z = plane.z >= 0.0f ? node.minZ : node.maxZ;
+#ifdef NENGINE_BVH_SSE
+        const __m128 a = _mm_set1_ps(plane.x);
+        const __m128 b = _mm_set1_ps(plane.y);
+        const __m128 c = _mm_set1_ps(plane.z);
+        const __m128 d = _mm_set1_ps(plane.w);
+        const auto distance = [&](const float *x,
+                                  const float *y,
+                                  const float *z) {
+            return _mm_add_ps(
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_load_ps(x)),
+                                      _mm_mul_ps(b, _mm_load_ps(y))),
+                           _mm_mul_ps(c, _mm_load_ps(z))),
+                d);
+        };
+        const __m128 zero = _mm_setzero_ps();
+        outside |= static_cast<uint32_t>(_mm_movemask_ps(
+            _mm_cmplt_ps(distance(far_x, far_y, far_z), zero)));
+        inside[p] = static_cast<uint32_t>(_mm_movemask_ps(
+            _mm_cmpge_ps(distance(near_x, near_y, near_z), zero)));
+#else
+        for (uint32_t c = 0; c < WIDTH; ++c) {
+            const float far = plane.x * far_x[c] + plane.y * far_y[c] +
+                              plane.z * far_z[c] + plane.w;
+            const float near = plane.x * near_x[c] + plane.y * near_y[c] +
+                               plane.z * near_z[c] + plane.w;
+            outside |= static_cast<uint32_t>(far < 0.0f) << c;
+            inside[p] |= static_cast<uint32_t>(near >= 0.0f) << c;
+        }
+#endif
+    }
+
+    for (uint32_t c = 0; c < node.childCount; ++c) {
+        if (outside & (1u << c)) {
+            continue;
+        }
+        uint32_t plane_mask = task.planeMask;
+        for (uint32_t p = 0; p < 6; ++p) {
+            if (inside[p] & (1u << c)) {
+                plane_mask &= ~(1u << p);
+            }
+        }
+        // A single object has passed every plane once it is not outside.
+        if (plane_mask == 0 || node.count[c] == 1) {
+            AppendObjects(node.first[c], node.count[c], visible);
+        }
+        else {
+            pending.push_back({node.child[c], plane_mask});
+        }
+    }
+}
+
+void
+SceneBvh::AppendObjects(uint32_t first,
+                        uint32_t count,
+                        std::vector<uint32_t> &visible) const
+{
+    visible.insert(visible.end(),
+                   m_order.begin() + first,
+                   m_order.begin() + first + count);
+}
+}  // namespace NEngine
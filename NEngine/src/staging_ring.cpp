@@ -0,0 +1,185 @@
+#include "staging_ring.h"
+
+#include <algorithm>
+
+#include "misc.h"
+
+namespace NEngine {
+
+static VkDeviceSize
+align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+StagingRing::StagingRing(VkDevice device,
+                         GpuAllocator &allocator,
+                         VkBuffer buffer,
+                         const GpuAllocation &memory,
+                         VkDeviceSize capacity)
+    : m_device(device),
+      m_allocator(&allocator),
+      m_buffer(buffer),
+      m_memory(memory),
+      m_capacity(capacity)
+{
+    ASSERT(m_memory.mapped, "Staging ring must live in host visible memory");
+}
+
+StagingRing::~StagingRing()
+{
+    Cleanup();
+}
+
+void
+StagingRing::Cleanup()
+{
+    if (!m_buffer) {
+        return;
+    }
+
+    for (const Submission &submission : m_inFlight) {
+        VKRESULT(vkWaitForFences(
+            m_device, 1, &submission.fence, VK_TRUE, UINT64_MAX));
+        vkDestroyFence(m_device, submission.fence, nullptr);
+    }
+    m_inFlight.clear();
+
+    for (VkFence fence : m_freeFences) {
+        vkDestroyFence(m_device, fence, nullptr);
+    }
+    m_freeFences.clear();
+
+    vkDestroyBuffer(m_device, m_buffer, nullptr);
+    m_allocator->Free(m_memory);
+    m_buffer = nullptr;
+    m_memory = {};
+}
+
+StagingRegion
+StagingRing::Acquire(VkDeviceSize size,
+                     VkDeviceSize alignment,
+                     VkDeviceSize granularity)
+{
+    StagingRegion region{};
+    while (!TryAcquire(size, alignment, granularity, region)) {
+        WaitOldest();
+    }
+
+    return region;
+}
+
+VkFence
+StagingRing::Submit()
+{
+    VkFence fence{};
+    if (m_freeFences.empty()) {
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VKRESULT(vkCreateFence(m_device, &fence_info, nullptr, &fence));
+    }
+    else {
+        fence = m_freeFences.back();
+        m_freeFences.pop_back();
+    }
+
+    m_inFlight.push_back({fence, m_head});
+    m_hasPending = false;
+
+    return fence;
+}
+
+void
+StagingRing::Reclaim()
+{
+    while (!m_inFlight.empty()) {
+        const Submission &oldest = m_inFlight.front();
+        if (vkGetFenceStatus(m_device, oldest.fence) != VK_SUCCESS) {
+            break;
+        }
+        VKRESULT(vkResetFences(m_device, 1, &oldest.fence));
+        m_freeFences.push_back(oldest.fence);
+        m_tail = oldest.end;
+        m_inFlight.pop_front();
+    }
+
+    // Once everything has retired start from the beginning again, which keeps
+    // large uploads from being split needlessly at the end of the buffer.
+    if (m_inFlight.empty() && !m_hasPending) {
+        m_head = 0;
+        m_tail = 0;
+    }
+}
+
+VkDeviceSize
+StagingRing::GetCapacity() const
+{
+    return m_capacity;
+}
+
+bool
+StagingRing::TryAcquire(VkDeviceSize size,
+                        VkDeviceSize alignment,
+                        VkDeviceSize granularity,
+                        StagingRegion &region)
+{
+    Reclaim();
+
+    const bool is_empty = m_inFlight.empty() && !m_hasPending;
+    // With head == tail the ring is either completely free or completely full.
+    if (!is_empty && m_head == m_tail) {
+        return false;
+    }
+
+    const auto fit = [&](VkDeviceSize begin, VkDeviceSize end) {
+        const VkDeviceSize offset = align_up(begin, alignment);
+        if (offset >= end) {
+            return false;
+        }
+        VkDeviceSize available = std::min(end - offset, size);
+        if (available < size) {
+            available -= available % granularity;
+        }
+        if (available == 0) {
+            return false;
+        }
+
+        region.buffer = m_buffer;
+        region.offset = offset;
+        region.size = available;
+        region.data = static_cast<char *>(m_memory.mapped) + offset;
+        m_head = offset + available;
+        m_hasPending = true;
+        return true;
+    };
+
+    if (m_head >= m_tail) {
+        if (fit(m_head, m_capacity)) {
+            return true;
+        }
+        // Not enough room before the end of the buffer, wrap around. The
+        // skipped tail bytes are released together with the submission that
+        // precedes the wrap.
+        if (m_tail == 0) {
+            return false;
+        }
+        m_head = 0;
+    }
+
+    // Keep one byte between head and tail so that head == tail keeps meaning
+    // "empty" only when nothing is in flight.
+    return fit(m_head, m_tail - 1);
+}
+
+void
+StagingRing::WaitOldest()
+{
+    if (m_inFlight.empty()) {
+        throw std::runtime_error(
+            "Staging ring is too small for a single unsubmitted batch");
+    }
+
+    VKRESULT(vkWaitForFences(
+        m_device, 1, &m_inFlight.front().fence, VK_TRUE, UINT64_MAX));
+}
+}  // namespace NEngine
@@ -0,0 +1,308 @@
+#include "texture_file.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace NEngine {
+
+static constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Identifier, header and index, followed by the level index.
+static constexpr size_t KTX2_HEADER_SIZE = 80;
+static constexpr size_t KTX2_LEVEL_INDEX_ENTRY_SIZE = 24;
+
+// Data format descriptor values from the Khronos Data Format specification.
+static constexpr uint8_t KHR_DF_MODEL_RGBSDA = 1;
+static constexpr uint8_t KHR_DF_MODEL_BC1A = 128;
+static constexpr uint8_t KHR_DF_MODEL_BC5 = 132;
+static constexpr uint8_t KHR_DF_MODEL_BC7 = 134;
+static constexpr uint8_t KHR_DF_PRIMARIES_BT709 = 1;
+static constexpr uint8_t KHR_DF_TRANSFER_LINEAR = 1;
+static constexpr uint8_t KHR_DF_TRANSFER_SRGB = 2;
+static constexpr uint8_t KHR_DF_CHANNEL_ALPHA = 15;
+static constexpr uint8_t KHR_DF_SAMPLE_DATATYPE_LINEAR = 0x10;
+
+struct DfdSample
+{
+    uint16_t bitOffset;
+    uint8_t bitLength;
+    uint8_t channel;
+    uint32_t upper;
+};
+
+TextureBlockInfo
+get_texture_block_info(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return {4, 1};
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            return {8, 4};
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return {16, 4};
+        default:
+            throw std::runtime_error("Unsupported cooked texture format");
+    }
+}
+
+static bool
+is_srgb(VkFormat format)
+{
+    return format == VK_FORMAT_R8G8B8A8_SRGB ||
+           format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ||
+           format == VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+static size_t
+get_level_size(VkFormat format, uint32_t width, uint32_t height)
+{
+    const TextureBlockInfo block = get_texture_block_info(format);
+    const size_t blocks_x = (width + block.extent - 1) / block.extent;
+    const size_t blocks_y = (height + block.extent - 1) / block.extent;
+    return blocks_x * blocks_y * block.size;
+}
+
+template <typename T>
+static void
+put(std::vector<uint8_t> &out, T value)
+{
+    const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static T
+get(const std::vector<uint8_t> &in, size_t offset)
+{
+    if (offset + sizeof(T) > in.size()) {
+        throw std::runtime_error("Truncated texture file");
+    }
+    T value;
+    memcpy(&value, in.data() + offset, sizeof(T));
+    return value;
+}
+
+// Builds the basic data format descriptor KTX2 requires, prefixed with its
+// total size.
+static std::vector<uint8_t>
+make_dfd(VkFormat format)
+{
+    const TextureBlockInfo block = get_texture_block_info(format);
+
+    uint8_t model = 0;
+    std::vector<DfdSample> samples;
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            model = KHR_DF_MODEL_RGBSDA;
+            samples = {{0, 8, 0, 255},
+                       {8, 8, 1, 255},
+                       {16, 8, 2, 255},
+                       {24,
+                        8,
+                        KHR_DF_CHANNEL_ALPHA | KHR_DF_SAMPLE_DATATYPE_LINEAR,
+                        255}};
+            break;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            model = KHR_DF_MODEL_BC1A;
+            samples = {{0, 64, 0, UINT32_MAX}};
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            model = KHR_DF_MODEL_BC5;
+            samples = {{0, 64, 0, UINT32_MAX}, {64, 64, 1, UINT32_MAX}};
+            break;
+        default:
+            model = KHR_DF_MODEL_BC7;
+            samples = {{0, 128, 0, UINT32_MAX}};
+            break;
+    }
+
+    const uint32_t block_size = 24 + 16 * static_cast<uint32_t>(samples.size());
+
+    std::vector<uint8_t> dfd;
+    put<uint32_t>(dfd, 4 + block_size);
+    // Khronos vendor, basic descriptor type, version 1.3.
+    put<uint32_t>(dfd, 0);
+    put<uint32_t>(dfd, 2 | (block_size << 16));
+    put<uint8_t>(dfd, model);
+    put<uint8_t>(dfd, KHR_DF_PRIMARIES_BT709);
+    put<uint8_t>(dfd,
+                 is_srgb(format) ? KHR_DF_TRANSFER_SRGB
+                                 : KHR_DF_TRANSFER_LINEAR);
+    put<uint8_t>(dfd, 0);
+    put<uint8_t>(dfd, static_cast<uint8_t>(block.extent - 1));
+    put<uint8_t>(dfd, static_cast<uint8_t>(block.extent - 1));
+    put<uint8_t>(dfd, 0);
+    put<uint8_t>(dfd, 0);
+    put<uint8_t>(dfd, static_cast<uint8_t>(block.size));
+    dfd.insert(dfd.end(), 7, 0);
+
+    for (const DfdSample &sample : samples) {
+        put<uint16_t>(dfd, sample.bitOffset);
+        put<uint8_t>(dfd, static_cast<uint8_t>(sample.bitLength - 1));
+        put<uint8_t>(dfd, sample.channel);
+        put<uint32_t>(dfd, 0);
+        put<uint32_t>(dfd, 0);
+        put<uint32_t>(dfd, sample.upper);
+    }
+
+    return dfd;
+}
+
+TextureFileLayout
+read_texture_layout(const FileReader &read,
+                    uint64_t fileSize,
+                    const std::string &name)
+{
+    if (fileSize < KTX2_HEADER_SIZE) {
+        throw std::runtime_error(name + " is not a KTX2 file");
+    }
+    std::vector<uint8_t> header(KTX2_HEADER_SIZE);
+    read(0, header);
+    if (!std::equal(
+            KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), header.begin())) {
+        throw std::runtime_error(name + " is not a KTX2 file");
+    }
+
+    TextureFileLayout layout;
+    layout.format = static_cast<VkFormat>(get<uint32_t>(header, 12));
+    layout.width = get<uint32_t>(header, 20);
+    layout.height = get<uint32_t>(header, 24);
+    const uint32_t depth = get<uint32_t>(header, 28);
+    const uint32_t layer_count = get<uint32_t>(header, 32);
+    const uint32_t face_count = get<uint32_t>(header, 36);
+    const uint32_t level_count = get<uint32_t>(header, 40);
+    const uint32_t supercompression = get<uint32_t>(header, 44);
+
+    if (depth > 1 || layer_count > 1 || face_count != 1 || level_count == 0 ||
+        level_count > 32 || supercompression != 0) {
+        throw std::runtime_error(
+            name + " is not an uncompressed 2D texture with stored mips");
+    }
+
+    const size_t index_size = size_t{level_count} * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+    if (fileSize - KTX2_HEADER_SIZE < index_size) {
+        throw std::runtime_error("Truncated texture file");
+    }
+    std::vector<uint8_t> index(index_size);
+    read(KTX2_HEADER_SIZE, index);
+
+    for (uint32_t level = 0; level < level_count; ++level) {
+        const size_t entry = level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        const uint64_t offset = get<uint64_t>(index, entry);
+        const uint64_t size = get<uint64_t>(index, entry + 8);
+
+        const size_t expected =
+            get_level_size(layout.format,
+                           std::max(layout.width >> level, 1u),
+                           std::max(layout.height >> level, 1u));
+        if (size != expected || offset > fileSize || fileSize - offset < size) {
+            throw std::runtime_error(name + " has a corrupt level index");
+        }
+        layout.levels.push_back({offset, size});
+    }
+
+    return layout;
+}
+
+TextureFile
+read_texture_file(const std::string &path)
+{
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open texture file " + path);
+    }
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(bytes.data()),
+              static_cast<std::streamsize>(bytes.size()));
+
+    const TextureFileLayout layout = read_texture_layout(
+        [&](uint64_t offset, std::span<uint8_t> out) {
+            memcpy(out.data(), bytes.data() + offset, out.size());
+        },
+        bytes.size(),
+        path);
+
+    TextureFile texture;
+    texture.format = layout.format;
+    texture.width = layout.width;
+    texture.height = layout.height;
+    for (const TextureFileLayout::Level &level : layout.levels) {
+        texture.levels.emplace_back(bytes.begin() + level.offset,
+                                    bytes.begin() + level.offset + level.size);
+    }
+
+    return texture;
+}
+
+void
+write_texture_file(const std::string &path, const TextureFile &texture)
+{
+    const TextureBlockInfo block = get_texture_block_info(texture.format);
+    const auto level_count = static_cast<uint32_t>(texture.levels.size());
+    const std::vector<uint8_t> dfd = make_dfd(texture.format);
+    const size_t dfd_offset =
+        KTX2_HEADER_SIZE + level_count * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+    // Level data is aligned to lcm(block size, 4), block sizes are powers of
+    // two.
+    const size_t alignment = std::max<size_t>(block.size, 4);
+
+    std::vector<uint8_t> out(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end());
+    put<uint32_t>(out, static_cast<uint32_t>(texture.format));
+    put<uint32_t>(out, 1);  // typeSize
+    put<uint32_t>(out, texture.width);
+    put<uint32_t>(out, texture.height);
+    put<uint32_t>(out, 0);  // pixelDepth
+    put<uint32_t>(out, 0);  // layerCount
+    put<uint32_t>(out, 1);  // faceCount
+    put<uint32_t>(out, level_count);
+    put<uint32_t>(out, 0);  // supercompressionScheme
+    put<uint32_t>(out, static_cast<uint32_t>(dfd_offset));
+    put<uint32_t>(out, static_cast<uint32_t>(dfd.size()));
+    put<uint32_t>(out, 0);  // kvdByteOffset
+    put<uint32_t>(out, 0);  // kvdByteLength
+    put<uint64_t>(out, 0);  // sgdByteOffset
+    put<uint64_t>(out, 0);  // sgdByteLength
+
+    // The level index lists level 0 first while the data is stored smallest
+    // level first, so compute the offsets before writing the index.
+    std::vector<size_t> offsets(level_count);
+    size_t offset = dfd_offset + dfd.size();
+    for (uint32_t level = level_count; level-- > 0;) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        offsets[level] = offset;
+        offset += texture.levels[level].size();
+    }
+
+    for (uint32_t level = 0; level < level_count; ++level) {
+        put<uint64_t>(out, offsets[level]);
+        put<uint64_t>(out, texture.levels[level].size());
+        put<uint64_t>(out, texture.levels[level].size());
+    }
+    out.insert(out.end(), dfd.begin(), dfd.end());
+
+    for (uint32_t level = level_count; level-- > 0;) {
+        out.resize(offsets[level], 0);
+        out.insert(
+            out.end(), texture.levels[level].begin(), texture.levels[level].end());
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to create texture file " + path);
+    }
+    file.write(reinterpret_cast<const char *>(out.data()),
+               static_cast<std::streamsize>(out.size()));
+}
+}  // namespace NEngine
@@ -0,0 +1,246 @@
+#include "texture_upload.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace NEngine {
+
+static int32_t
+mip_extent(uint32_t extent, uint32_t level)
+{
+    return static_cast<int32_t>(std::max(extent >> level, 1u));
+}
+
+static VkImageMemoryBarrier
+make_barrier(VkImage image,
+             uint32_t base_mip_level,
+             uint32_t level_count,
+             VkImageLayout old_layout,
+             VkImageLayout new_layout,
+             VkAccessFlags src_access,
+             VkAccessFlags dst_access)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = image;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = base_mip_level;
+    barrier.subresourceRange.levelCount = level_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+static void
+pipeline_barrier(VkCommandBuffer cb,
+                 VkPipelineStageFlags src_stage,
+                 VkPipelineStageFlags dst_stage,
+                 const std::vector<VkImageMemoryBarrier> &barriers)
+{
+    if (barriers.empty()) {
+        return;
+    }
+    vkCmdPipelineBarrier(cb,
+                         src_stage,
+                         dst_stage,
+                         0,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr,
+                         static_cast<uint32_t>(barriers.size()),
+                         barriers.data());
+}
+
+void
+record_texture_uploads(UploadService &uploads,
+                       const std::vector<TextureUpload> &textures,
+                       VkPhysicalDevice physical_device,
+                       MipGenerator *mipGenerator)
+{
+    std::vector<const Image *> compute_images;
+    std::vector<const Image *> blit_images;
+    std::vector<const Image *> complete_images;
+    std::vector<VkImageMemoryBarrier> barriers;
+
+    for (const TextureUpload &texture : textures) {
+        const Image &image = *texture.image;
+
+        if (texture.levels.empty() ||
+            texture.levels.size() > image.GetMipLevels()) {
+            throw std::runtime_error("Invalid number of texture mip levels");
+        }
+
+        if (texture.levels.size() == image.GetMipLevels()) {
+            complete_images.push_back(&image);
+        }
+        else if (mipGenerator &&
+                 (image.GetUsage() & MipGenerator::IMAGE_USAGE) ==
+                     MipGenerator::IMAGE_USAGE &&
+                 mipGenerator->Supports(image.GetFormat())) {
+            compute_images.push_back(&image);
+        }
+        else {
+            VkFormatProperties format_props;
+            vkGetPhysicalDeviceFormatProperties(
+                physical_device, image.GetFormat(), &format_props);
+
+            if (!(format_props.optimalTilingFeatures &
+                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+                throw std::runtime_error(
+                    "Texture image format does not support linear blitting");
+            }
+            blit_images.push_back(&image);
+        }
+
+        barriers.push_back(make_barrier(image.GetImage(),
+                                        0,
+                                        image.GetMipLevels(),
+                                        VK_IMAGE_LAYOUT_UNDEFINED,
+                                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                        0,
+                                        VK_ACCESS_TRANSFER_WRITE_BIT));
+    }
+
+    pipeline_barrier(uploads.GetCommandBuffer(),
+                     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     barriers);
+
+    for (const TextureUpload &texture : textures) {
+        const Image &image = *texture.image;
+        for (uint32_t level = 0; level < texture.levels.size(); ++level) {
+            uploads.CopyToImage(image.GetImage(),
+                                texture.levels[level],
+                                mip_extent(image.GetWidth(), level),
+                                mip_extent(image.GetHeight(), level),
+                                texture.texelSize,
+                                level,
+                                texture.blockExtent);
+        }
+    }
+
+    // CopyToImage may have flushed, so always ask for the current batch.
+    if (!compute_images.empty()) {
+        mipGenerator->Record(uploads, compute_images);
+    }
+    if (!blit_images.empty()) {
+        record_blit_mips(uploads.GetCommandBuffer(), blit_images);
+    }
+
+    barriers.clear();
+    for (const Image *image : complete_images) {
+        barriers.push_back(
+            make_barrier(image->GetImage(),
+                         0,
+                         image->GetMipLevels(),
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         VK_ACCESS_TRANSFER_WRITE_BIT,
+                         VK_ACCESS_SHADER_READ_BIT));
+    }
+    pipeline_barrier(uploads.GetCommandBuffer(),
+                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                     barriers);
+}
+
+void
+record_blit_mips(VkCommandBuffer cb, const std::vector<const Image *> &images)
+{
+    uint32_t max_mip_levels = 1;
+    for (const Image *image : images) {
+        max_mip_levels = std::max(max_mip_levels, image->GetMipLevels());
+    }
+
+    // Walk the mip chains of all images level by level so that each level
+    // costs two barrier calls in total instead of two per image.
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (uint32_t level = 1; level < max_mip_levels; ++level) {
+        barriers.clear();
+        for (const Image *image : images) {
+            if (level < image->GetMipLevels()) {
+                barriers.push_back(
+                    make_barrier(image->GetImage(),
+                                 level - 1,
+                                 1,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                 VK_ACCESS_TRANSFER_WRITE_BIT,
+                                 VK_ACCESS_TRANSFER_READ_BIT));
+            }
+        }
+        pipeline_barrier(cb,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         barriers);
+
+        for (const Image *image : images) {
+            if (level >= image->GetMipLevels()) {
+                continue;
+            }
+
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = {0, 0, 0};
+            blit.srcOffsets[1] = {mip_extent(image->GetWidth(), level - 1),
+                                  mip_extent(image->GetHeight(), level - 1),
+                                  1};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = level - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = 1;
+            blit.dstOffsets[0] = {0, 0, 0};
+            blit.dstOffsets[1] = {mip_extent(image->GetWidth(), level),
+                                  mip_extent(image->GetHeight(), level),
+                                  1};
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = 1;
+
+            vkCmdBlitImage(cb,
+                           image->GetImage(),
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           image->GetImage(),
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1,
+                           &blit,
+                           VK_FILTER_LINEAR);
+        }
+
+        for (VkImageMemoryBarrier &barrier : barriers) {
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+        pipeline_barrier(cb,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         barriers);
+    }
+
+    // The last level of every chain was only ever written to.
+    barriers.clear();
+    for (const Image *image : images) {
+        barriers.push_back(
+            make_barrier(image->GetImage(),
+                         image->GetMipLevels() - 1,
+                         1,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         VK_ACCESS_TRANSFER_WRITE_BIT,
+                         VK_ACCESS_SHADER_READ_BIT));
+    }
+    pipeline_barrier(cb,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                     barriers);
+}
+}  // namespace NEngine
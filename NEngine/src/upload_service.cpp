@@ -0,0 +1,374 @@
+#include "upload_service.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "misc.h"
+
+namespace NEngine {
+UploadService::UploadService(VkDevice device,
+                             VkQueue queue,
+                             uint32_t queueFamily,
+                             StagingRing &stagingRing)
+    : m_device(device),
+      m_queue(queue),
+      m_queueFamily(queueFamily),
+      m_stagingRing(&stagingRing)
+{
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                      VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queueFamily;
+    VKRESULT(vkCreateCommandPool(device, &pool_info, nullptr, &m_commandPool));
+
+    VkSemaphoreTypeCreateInfo type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+    VKRESULT(vkCreateSemaphore(device, &semaphore_info, nullptr, &m_timeline));
+}
+
+UploadService::~UploadService()
+{
+    Cleanup();
+}
+
+void
+UploadService::Cleanup()
+{
+    if (!m_commandPool) {
+        return;
+    }
+
+    Flush();
+    Wait(m_lastSubmittedValue);
+
+    // Destroying the pool frees every command buffer allocated from it.
+    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    vkDestroySemaphore(m_device, m_timeline, nullptr);
+    m_commandPool = nullptr;
+    m_timeline = nullptr;
+    m_inFlight.clear();
+    m_freeCommandBuffers.clear();
+}
+
+VkCommandBuffer
+UploadService::GetCommandBuffer()
+{
+    if (m_recording) {
+        return m_recording;
+    }
+
+    RecycleCompletedBatches();
+
+    if (m_freeCommandBuffers.empty()) {
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandPool = m_commandPool;
+        alloc_info.commandBufferCount = 1;
+        VKRESULT(vkAllocateCommandBuffers(m_device, &alloc_info, &m_recording));
+    }
+    else {
+        m_recording = m_freeCommandBuffers.back();
+        m_freeCommandBuffers.pop_back();
+    }
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VKRESULT(vkBeginCommandBuffer(m_recording, &begin_info));
+
+    return m_recording;
+}
+
+StagingWriter
+copy_from(const void *data)
+{
+    return [data](VkDeviceSize offset, std::span<uint8_t> out) {
+        memcpy(out.data(),
+               static_cast<const uint8_t *>(data) + offset,
+               out.size());
+    };
+}
+
+void
+UploadService::CopyToBuffer(VkBuffer dst,
+                            const void *data,
+                            VkDeviceSize size,
+                            VkDeviceSize dstOffset)
+{
+    CopyToBuffer(dst, copy_from(data), size, dstOffset);
+}
+
+void
+UploadService::CopyToBuffer(VkBuffer dst,
+                            const StagingWriter &write,
+                            VkDeviceSize size,
+                            VkDeviceSize dstOffset)
+{
+    for (VkDeviceSize done = 0; done < size;) {
+        const StagingRegion region = AcquireStaging(size - done, 16, 1);
+        write(done, {static_cast<uint8_t *>(region.data), region.size});
+
+        VkBufferCopy copy_region{};
+        copy_region.srcOffset = region.offset;
+        copy_region.dstOffset = dstOffset + done;
+        copy_region.size = region.size;
+        vkCmdCopyBuffer(GetCommandBuffer(), region.buffer, dst, 1, &copy_region);
+
+        done += region.size;
+    }
+}
+
+void
+UploadService::CopyToImage(VkImage image,
+                           const void *texels,
+                           uint32_t width,
+                           uint32_t height,
+                           uint32_t texelSize,
+                           uint32_t mipLevel,
+                           uint32_t blockExtent)
+{
+    CopyToImage(image,
+                copy_from(texels),
+                width,
+                height,
+                texelSize,
+                mipLevel,
+                blockExtent);
+}
+
+void
+UploadService::CopyToImage(VkImage image,
+                           const StagingWriter &write,
+                           uint32_t width,
+                           uint32_t height,
+                           uint32_t texelSize,
+                           uint32_t mipLevel,
+                           uint32_t blockExtent)
+{
+    const uint32_t block_columns = (width + blockExtent - 1) / blockExtent;
+    const uint32_t block_rows = (height + blockExtent - 1) / blockExtent;
+    const VkDeviceSize row_size =
+        static_cast<VkDeviceSize>(block_columns) * texelSize;
+    const VkDeviceSize image_size = row_size * block_rows;
+
+    // Whole rows of blocks at a time, so textures bigger than the free part
+    // of the staging ring are streamed through it in several copies.
+    for (VkDeviceSize done = 0; done < image_size;) {
+        const StagingRegion region =
+            AcquireStaging(image_size - done, 16, row_size);
+        write(done, {static_cast<uint8_t *>(region.data), region.size});
+
+        // Partial blocks at the bottom edge are copied with the real extent.
+        const uint32_t y = static_cast<uint32_t>(done / row_size) * blockExtent;
+        const uint32_t rows = static_cast<uint32_t>(region.size / row_size);
+
+        VkBufferImageCopy copy_region{};
+        copy_region.bufferOffset = region.offset;
+        copy_region.bufferRowLength = 0;
+        copy_region.bufferImageHeight = 0;
+        copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy_region.imageSubresource.mipLevel = mipLevel;
+        copy_region.imageSubresource.baseArrayLayer = 0;
+        copy_region.imageSubresource.layerCount = 1;
+        copy_region.imageOffset = {0, static_cast<int32_t>(y), 0};
+        copy_region.imageExtent = {
+            width, std::min(rows * blockExtent, height - y), 1};
+
+        vkCmdCopyBufferToImage(GetCommandBuffer(),
+                               region.buffer,
+                               image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               1,
+                               &copy_region);
+
+        done += region.size;
+    }
+}
+
+void
+UploadService::TransferOwnership(UploadService &dst,
+                                 VkBuffer buffer,
+                                 VkAccessFlags dstAccess,
+                                 VkPipelineStageFlags dstStage)
+{
+    if (m_queueFamily == dst.m_queueFamily) {
+        return;
+    }
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = m_queueFamily;
+    barrier.dstQueueFamilyIndex = dst.m_queueFamily;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    // Release: only the source access mask matters.
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(GetCommandBuffer(),
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0,
+                         nullptr,
+                         1,
+                         &barrier,
+                         0,
+                         nullptr);
+
+    // Acquire: only the destination access mask matters.
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(dst.GetCommandBuffer(),
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         dstStage,
+                         0,
+                         0,
+                         nullptr,
+                         1,
+                         &barrier,
+                         0,
+                         nullptr);
+}
+
+void
+UploadService::WaitFor(const UploadService &other, uint64_t value)
+{
+    if (other.IsComplete(value)) {
+        return;
+    }
+    m_waits.push_back({other.GetSemaphore(), value});
+}
+
+uint64_t
+UploadService::Flush()
+{
+    if (!m_recording && m_waits.empty()) {
+        return m_lastSubmittedValue;
+    }
+
+    const VkCommandBuffer cb = GetCommandBuffer();
+    VKRESULT(vkEndCommandBuffer(cb));
+
+    const uint64_t signal_value = m_lastSubmittedValue + 1;
+
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<uint64_t> wait_values;
+    const std::vector<VkPipelineStageFlags> wait_stages(
+        m_waits.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    for (const SemaphoreWait &wait : m_waits) {
+        wait_semaphores.push_back(wait.semaphore);
+        wait_values.push_back(wait.value);
+    }
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount =
+        static_cast<uint32_t>(wait_values.size());
+    timeline_info.pWaitSemaphoreValues = wait_values.data();
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &signal_value;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount =
+        static_cast<uint32_t>(wait_semaphores.size());
+    submit_info.pWaitSemaphores = wait_semaphores.data();
+    submit_info.pWaitDstStageMask = wait_stages.data();
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cb;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &m_timeline;
+
+    // The staging ring recycles the regions of this batch once its fence is
+    // signaled.
+    const VkFence fence =
+        m_usesStaging ? m_stagingRing->Submit() : VK_NULL_HANDLE;
+
+    VKRESULT(vkQueueSubmit(m_queue, 1, &submit_info, fence));
+
+    m_inFlight.push_back({cb, signal_value});
+    m_lastSubmittedValue = signal_value;
+    m_recording = nullptr;
+    m_usesStaging = false;
+    m_waits.clear();
+
+    return signal_value;
+}
+
+VkSemaphore
+UploadService::GetSemaphore() const
+{
+    return m_timeline;
+}
+
+uint64_t
+UploadService::GetLastSubmittedValue() const
+{
+    return m_lastSubmittedValue;
+}
+
+uint64_t
+UploadService::GetRecordingValue() const
+{
+    return m_lastSubmittedValue + 1;
+}
+
+bool
+UploadService::IsComplete(uint64_t value) const
+{
+    uint64_t completed = 0;
+    VKRESULT(vkGetSemaphoreCounterValue(m_device, m_timeline, &completed));
+    return completed >= value;
+}
+
+void
+UploadService::Wait(uint64_t value) const
+{
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &m_timeline;
+    wait_info.pValues = &value;
+    VKRESULT(vkWaitSemaphores(m_device, &wait_info, UINT64_MAX));
+}
+
+void
+UploadService::RecycleCompletedBatches()
+{
+    uint64_t completed = 0;
+    VKRESULT(vkGetSemaphoreCounterValue(m_device, m_timeline, &completed));
+
+    while (!m_inFlight.empty() && m_inFlight.front().value <= completed) {
+        VKRESULT(vkResetCommandBuffer(m_inFlight.front().commandBuffer, 0));
+        m_freeCommandBuffers.push_back(m_inFlight.front().commandBuffer);
+        m_inFlight.pop_front();
+    }
+}
+
+StagingRegion
+UploadService::AcquireStaging(VkDeviceSize size,
+                              VkDeviceSize alignment,
+                              VkDeviceSize granularity)
+{
+    StagingRegion region{};
+    if (!m_stagingRing->TryAcquire(size, alignment, granularity, region)) {
+        // The ring may be full of this very batch. Submit it so that its
+        // regions become reclaimable, then block until space frees up.
+        Flush();
+        region = m_stagingRing->Acquire(size, alignment, granularity);
+    }
+    m_usesStaging = true;
+    return region;
+}
+}  // namespace NEngine
@@ -0,0 +1,243 @@
+#include "vertex_format.h"
+
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <stdexcept>
+
+#include "mesh_file.h"
+
+namespace NEngine {
+
+uint32_t
+get_position_stride(PositionFormat format)
+{
+    switch (format) {
+        case PositionFormat::Float32:
+            return 12;
+        case PositionFormat::Float16:
+        case PositionFormat::Snorm16:
+            // Three component 16 bit formats are optional for vertex input,
+            // so the fourth component is padding.
+            return 8;
+    }
+    throw std::runtime_error("Unknown position format");
+}
+
+uint32_t
+get_attribute_stride(AttributeFormat format)
+{
+    switch (format) {
+        case AttributeFormat::Float32:
+            return 36;
+        case AttributeFormat::Packed:
+            return 12;
+    }
+    throw std::runtime_error("Unknown attribute format");
+}
+
+static VkFormat
+get_position_vk_format(PositionFormat format)
+{
+    switch (format) {
+        case PositionFormat::Float32:
+            return VK_FORMAT_R32G32B32_SFLOAT;
+        case PositionFormat::Float16:
+            return VK_FORMAT_R16G16B16A16_SFLOAT;
+        case PositionFormat::Snorm16:
+            return VK_FORMAT_R16G16B16A16_SNORM;
+    }
+    throw std::runtime_error("Unknown position format");
+}
+
+// Projects the unit normal onto an octahedron and unfolds the lower half,
+// giving two values in [-1, 1].
+static glm::vec2
+encode_octahedral(glm::vec3 n)
+{
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    glm::vec2 p(n.x, n.y);
+    if (n.z < 0.0f) {
+        p = (1.0f - glm::abs(glm::vec2(n.y, n.x))) *
+            glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return p;
+}
+
+template <typename T>
+static void
+put(std::vector<uint8_t> &out, size_t offset, T value)
+{
+    memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+VertexStreams
+encode_vertex_streams(std::span<const vertex> vertices,
+                      const MeshBounds &bounds,
+                      const VertexLayout &layout)
+{
+    VertexStreams streams;
+    streams.layout = layout;
+    streams.vertexCount = static_cast<uint32_t>(vertices.size());
+
+    // Quantized positions cover the bounds with the full [-1, 1] range on
+    // every axis.
+    if (layout.positions != PositionFormat::Float32) {
+        streams.positionOffset = (bounds.min + bounds.max) * 0.5f;
+        streams.positionScale =
+            glm::max((bounds.max - bounds.min) * 0.5f, glm::vec3(1e-20f));
+    }
+
+    const uint32_t position_stride = get_position_stride(layout.positions);
+    const uint32_t attribute_stride = get_attribute_stride(layout.attributes);
+    streams.positions.resize(vertices.size() * position_stride);
+    streams.attributes.resize(vertices.size() * attribute_stride);
+    if (layout.colors) {
+        streams.colors.resize(vertices.size() * COLOR_STRIDE);
+    }
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const vertex &v = vertices[i];
+
+        const size_t position_offset = i * position_stride;
+        const glm::vec4 p(
+            (v.pos - streams.positionOffset) / streams.positionScale, 0.0f);
+        switch (layout.positions) {
+            case PositionFormat::Float32:
+                put(streams.positions, position_offset, v.pos);
+                break;
+            case PositionFormat::Float16:
+                put(streams.positions, position_offset, glm::packHalf4x16(p));
+                break;
+            case PositionFormat::Snorm16:
+                put(streams.positions, position_offset, glm::packSnorm4x16(p));
+                break;
+        }
+
+        const size_t attribute_offset = i * attribute_stride;
+        const glm::vec3 normal = glm::length(v.normal) > 0.0f
+                                     ? glm::normalize(v.normal)
+                                     : glm::vec3(0.0f, 0.0f, 1.0f);
+        const glm::vec3 tangent =
+            glm::length(glm::vec3(v.tangent)) > 0.0f
+                ? glm::normalize(glm::vec3(v.tangent))
+                : glm::vec3(1.0f, 0.0f, 0.0f);
+        const float bitangent_sign = v.tangent.w < 0.0f ? -1.0f : 1.0f;
+        switch (layout.attributes) {
+            case AttributeFormat::Float32:
+                put(streams.attributes, attribute_offset, v.tex_coord);
+                put(streams.attributes, attribute_offset + 8, normal);
+                put(streams.attributes,
+                    attribute_offset + 20,
+                    glm::vec4(tangent, bitangent_sign));
+                break;
+            case AttributeFormat::Packed:
+                put(streams.attributes,
+                    attribute_offset,
+                    glm::packHalf2x16(v.tex_coord));
+                put(streams.attributes,
+                    attribute_offset + 4,
+                    glm::packSnorm2x16(encode_octahedral(normal)));
+                put(streams.attributes,
+                    attribute_offset + 8,
+                    glm::packSnorm4x8(glm::vec4(
+                        encode_octahedral(tangent), 0.0f, bitangent_sign)));
+                break;
+        }
+
+        if (layout.colors) {
+            put(streams.colors,
+                i * COLOR_STRIDE,
+                glm::packUnorm4x8(glm::vec4(v.color, 1.0f)));
+        }
+    }
+
+    return streams;
+}
+
+VertexStreamsView
+view_vertex_streams(const VertexStreams &streams)
+{
+    VertexStreamsView view;
+    view.layout = streams.layout;
+    view.vertexCount = streams.vertexCount;
+    view.positionScale = streams.positionScale;
+    view.positionOffset = streams.positionOffset;
+    view.positions = streams.positions;
+    view.attributes = streams.attributes;
+    view.colors = streams.colors;
+    return view;
+}
+
+VkVertexInputBindingDescription
+get_position_binding_description(const VertexLayout &layout)
+{
+    VkVertexInputBindingDescription description{};
+    description.binding = POSITION_BINDING;
+    description.stride = get_position_stride(layout.positions);
+    description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return description;
+}
+
+VkVertexInputAttributeDescription
+get_position_attribute_description(const VertexLayout &layout)
+{
+    VkVertexInputAttributeDescription description{};
+    description.location = 0;
+    description.binding = POSITION_BINDING;
+    description.format = get_position_vk_format(layout.positions);
+    description.offset = 0;
+    return description;
+}
+
+std::vector<VkVertexInputBindingDescription>
+get_binding_descriptions(const VertexLayout &layout)
+{
+    std::vector<VkVertexInputBindingDescription> descriptions(
+        VERTEX_BINDING_COUNT);
+    descriptions[0] = get_position_binding_description(layout);
+
+    descriptions[1].binding = ATTRIBUTE_BINDING;
+    descriptions[1].stride = get_attribute_stride(layout.attributes);
+    descriptions[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    // Without a colour stream every vertex reads the same white colour.
+    descriptions[2].binding = COLOR_BINDING;
+    descriptions[2].stride = layout.colors ? COLOR_STRIDE : 0;
+    descriptions[2].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return descriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription>
+get_attribute_descriptions(const VertexLayout &layout)
+{
+    std::vector<VkVertexInputAttributeDescription> descriptions(5);
+    descriptions[0] = get_position_attribute_description(layout);
+
+    descriptions[1].location = 1;
+    descriptions[1].binding = COLOR_BINDING;
+    descriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    descriptions[1].offset = 0;
+
+    const bool packed = layout.attributes == AttributeFormat::Packed;
+    descriptions[2].location = 2;
+    descriptions[2].binding = ATTRIBUTE_BINDING;
+    descriptions[2].format =
+        packed ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
+    descriptions[2].offset = 0;
+
+    descriptions[3].location = 3;
+    descriptions[3].binding = ATTRIBUTE_BINDING;
+    descriptions[3].format =
+        packed ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
+    descriptions[3].offset = packed ? 4 : 8;
+
+    descriptions[4].location = 4;
+    descriptions[4].binding = ATTRIBUTE_BINDING;
+    descriptions[4].format =
+        packed ? VK_FORMAT_R8G8B8A8_SNORM : VK_FORMAT_R32G32B32A32_SFLOAT;
+    descriptions[4].offset = packed ? 8 : 20;
+
+    return descriptions;
+}
+}  // namespace NEngine
@@ -0,0 +1,167 @@
+#include "virtual_file_system.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace NEngine {
+
+VirtualFile::VirtualFile(const std::string &path)
+    : m_loose(FileData::Map(path))
+{
+}
+
+VirtualFile::VirtualFile(FileData data) : m_loose(std::move(data))
+{
+}
+
+VirtualFile::VirtualFile(const AssetArchive &archive,
+                         const ArchiveEntry &entry)
+    : m_archive(&archive), m_entry(&entry)
+{
+}
+
+uint64_t
+VirtualFile::GetSize() const
+{
+    return m_entry ? m_entry->size : m_loose.GetData().size();
+}
+
+void
+VirtualFile::Read(uint64_t offset, std::span<uint8_t> out) const
+{
+    if (m_entry) {
+        m_archive->Read(*m_entry, offset, out);
+        return;
+    }
+
+    const std::span<const uint8_t> data = m_loose.GetData();
+    if (offset > data.size() || data.size() - offset < out.size()) {
+        throw std::runtime_error("Read past the end of a file");
+    }
+    memcpy(out.data(), data.data() + offset, out.size());
+}
+
+FileData
+VirtualFile::ReadAll() &&
+{
+    if (!m_entry) {
+        return std::move(m_loose);
+    }
+
+    const std::span<const uint8_t> mapped = m_archive->GetMappedData(*m_entry);
+    if (mapped.size() == m_entry->size) {
+        return FileData::Borrow(mapped);
+    }
+    std::vector<uint8_t> bytes(m_entry->size);
+    m_archive->Read(*m_entry, 0, bytes);
+    return FileData::Own(std::move(bytes));
+}
+
+void
+VirtualFileSystem::MountArchive(const std::string &path)
+{
+    m_mounts.push_back({std::make_unique<AssetArchive>(path), {}, {}});
+}
+
+void
+VirtualFileSystem::MountDirectory(const std::string &directory,
+                                  const std::string &prefix)
+{
+    m_mounts.push_back({nullptr, directory, prefix + "/"});
+}
+
+bool
+VirtualFileSystem::Exists(const std::string &path) const
+{
+    return Find(path).has_value();
+}
+
+VirtualFile
+VirtualFileSystem::Open(const std::string &path) const
+{
+    const std::optional<Location> location = Find(path);
+    if (!location) {
+        throw std::runtime_error("File not found: " + path);
+    }
+    if (location->entry) {
+        return VirtualFile(*location->archive, *location->entry);
+    }
+    return VirtualFile(location->file.string());
+}
+
+FileData
+VirtualFileSystem::Read(const std::string &path) const
+{
+    return Open(path).ReadAll();
+}
+
+std::vector<std::future<FileData>>
+VirtualFileSystem::ReadAsync(std::span<const std::string> paths,
+                             IoService &io) const
+{
+    std::vector<std::future<FileData>> futures;
+    std::vector<IoRequest> requests;
+    for (const std::string &path : paths) {
+        auto promise = std::make_shared<std::promise<FileData>>();
+        futures.push_back(promise->get_future());
+
+        const std::optional<Location> location = Find(path);
+        if (!location) {
+            promise->set_exception(std::make_exception_ptr(
+                std::runtime_error("File not found: " + path)));
+            continue;
+        }
+
+        IoRequest request;
+        const ArchiveEntry *entry = location->entry;
+        if (entry) {
+            request.path = location->archive->GetPath();
+            request.offset = entry->offset;
+            request.size = entry->storedSize;
+        }
+        else {
+            request.path = location->file.string();
+        }
+        request.onComplete = [promise, entry](std::vector<uint8_t> data,
+                                              std::exception_ptr error) {
+            try {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                if (entry &&
+                    (entry->compression != ArchiveCompression::None ||
+                     data.size() != entry->size)) {
+                    data = AssetArchive::Decode(*entry, data);
+                }
+                promise->set_value(FileData::Own(std::move(data)));
+            }
+            catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        };
+        requests.push_back(std::move(request));
+    }
+    io.Submit(std::move(requests));
+    return futures;
+}
+
+std::optional<VirtualFileSystem::Location>
+VirtualFileSystem::Find(const std::string &path) const
+{
+    for (auto mount = m_mounts.rbegin(); mount != m_mounts.rend(); ++mount) {
+        if (mount->archive) {
+            if (const ArchiveEntry *entry = mount->archive->Find(path)) {
+                return Location{mount->archive.get(), entry, {}};
+            }
+        }
+        else if (path.starts_with(mount->prefix)) {
+            std::filesystem::path file =
+                mount->directory / path.substr(mount->prefix.size());
+            if (std::filesystem::is_regular_file(file)) {
+                return Location{nullptr, nullptr, std::move(file)};
+            }
+        }
+    }
+    return std::nullopt;
+}
+}  // namespace NEngine
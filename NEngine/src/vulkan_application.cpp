@@ -5,13 +5,31 @@
 #include <imgui_impl_sdl2.h>
 #include <imgui_impl_vulkan.h>
 #include <stb_image.h>
-#include <tiny_obj_loader.h>
 
+#include <bit>
 #include <chrono>
+#include <filesystem>
 #include <fstream>
 
+#include "asset_cache.h"
+#include "cluster_culler.h"
+#include "frustum.h"
+#include "index_format.h"
+#include "job_system.h"
+#include "mesh_file.h"
+#include "mesh_lod.h"
+#include "mesh_normals.h"
+#include "mesh_optimizer.h"
 #include "misc.h"
+#include "mip_generator.h"
+#include "obj_import.h"
+#include "staging_ring.h"
+#include "texture_file.h"
+#include "texture_upload.h"
+#include "upload_service.h"
 #include "vertex.h"
+#include "vertex_format.h"
+#include "virtual_file_system.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -30,20 +48,37 @@ constexpr bool enable_validation_layers = true;
 #endif
 
 constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+// Textures and meshes stream through the transfer ring; the graphics ring
+// only carries culler and scene updates.
+constexpr VkDeviceSize TRANSFER_STAGING_SIZE = 32ull * 1024 * 1024;
+constexpr VkDeviceSize GRAPHICS_STAGING_SIZE = 8ull * 1024 * 1024;
 
 struct uniform_buffer_object
 {
-    alignas(16) glm::mat4 model;
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 proj;
+    alignas(16) glm::vec4 position_scale;
+    alignas(16) glm::vec4 position_offset;
 };
 
 struct uniform_buffer_object_ps
 {
     alignas(16) glm::vec3 light_pos;
     alignas(16) glm::vec3 cam_pos;
+    alignas(16) glm::vec4 material_colors[VulkanApplication::MATERIAL_COUNT];
 };
 
+// Tints of the materials, which all use the loaded texture.
+static constexpr glm::vec4
+    MATERIAL_COLORS[VulkanApplication::MATERIAL_COUNT] = {
+        {1.0f, 1.0f, 1.0f, 1.0f},
+        {1.0f, 0.45f, 0.4f, 1.0f},
+        {0.45f, 1.0f, 0.5f, 1.0f},
+        {0.45f, 0.6f, 1.0f, 1.0f}};
+
+// Instances the instance buffer of every frame starts out with room for.
+static constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 1024;
+
 struct queue_family_indices
 {
     std::optional<uint32_t> graphics_family;
@@ -56,14 +91,6 @@ struct queue_family_indices
         return graphics_family.has_value() && present_family.has_value() &&
                transfer_family.has_value();
     }
-
-	[[nodiscard]] VkSharingMode
-	get_sharing_mode() const
-	{
-		return graphics_family.value() == transfer_family.value()
-			? VK_SHARING_MODE_EXCLUSIVE
-			: VK_SHARING_MODE_CONCURRENT;
-	}
 };
 
 struct swap_chain_support_details
@@ -127,25 +154,6 @@ choose_swap_extent(SDL_Window *window,
     return actual_extent;
 }
 
-static std::vector<char>
-read_file(const std::string &filename)
-{
-    std::ifstream file(filename, std::ios_base::ate | std::ios_base::binary);
-
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file");
-    }
-
-    const size_t file_size = file.tellg();
-    std::vector<char> buffer(file_size);
-
-    file.seekg(0);
-    file.read(buffer.data(), static_cast<long long>(file_size));
-    file.close();
-
-    return buffer;
-}
-
 static VKAPI_ATTR VkBool32 VKAPI_CALL
 debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
                VkDebugUtilsMessageTypeFlagsEXT message_type,
@@ -241,28 +249,38 @@ find_queue_families(VkPhysicalDevice device, VkSurfaceKHR surface)
     vkGetPhysicalDeviceQueueFamilyProperties(
         device, &queue_family_count, queue_families.data());
 
-    int i = 0;
-    for (const auto &queue_family : queue_families) {
-        if (indices.is_complete()) {
-            break;
-        }
+    // Prefer a transfer-only family (the DMA engine on discrete GPUs), then
+    // any non-graphics family that can transfer. Graphics families support
+    // transfers implicitly and are the fallback.
+    bool is_transfer_only = false;
+
+    for (uint32_t i = 0; i < queue_family_count; ++i) {
+        const VkQueueFlags flags = queue_families[i].queueFlags;
 
-        if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        if ((flags & VK_QUEUE_GRAPHICS_BIT) &&
+            !indices.graphics_family.has_value()) {
             indices.graphics_family = i;
-	    // On some devices there might be no transfer queue
-	    indices.transfer_family = i;
         }
-        else if (queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) {
-            indices.transfer_family = i;
+
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+            const bool transfer_only = !(flags & VK_QUEUE_COMPUTE_BIT);
+            if (!indices.transfer_family.has_value() ||
+                (transfer_only && !is_transfer_only)) {
+                indices.transfer_family = i;
+                is_transfer_only = transfer_only;
+            }
         }
 
         VkBool32 present_support = false;
         vkGetPhysicalDeviceSurfaceSupportKHR(
             device, i, surface, &present_support);
-        if (present_support) {
+        if (present_support && !indices.present_family.has_value()) {
             indices.present_family = i;
         }
-        ++i;
+    }
+
+    if (!indices.transfer_family.has_value()) {
+        indices.transfer_family = indices.graphics_family;
     }
 
     return indices;
@@ -311,17 +329,13 @@ end_single_time_commands(VkCommandBuffer cb,
 static bool has_stencil_component(VkFormat format);
 
 static void
-transition_image_layout(VkImage image,
+transition_image_layout(VkCommandBuffer cb,
+                        VkImage image,
                         VkFormat format,
                         VkImageLayout old_layout,
                         VkImageLayout new_layout,
-                        VkDevice device,
-                        VkCommandPool pool,
-                        VkQueue queue,
                         uint32_t mip_levels)
 {
-    const VkCommandBuffer cb = begin_single_time_commands(device, pool);
-
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = old_layout;
@@ -380,38 +394,6 @@ transition_image_layout(VkImage image,
 
     vkCmdPipelineBarrier(
         cb, source_stage, dest_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    end_single_time_commands(cb, device, pool, queue);
-}
-
-static void
-copy_buffer_to_image(VkBuffer buffer,
-                     VkImage image,
-                     uint32_t width,
-                     uint32_t height,
-                     VkDevice device,
-                     VkCommandPool pool,
-                     VkQueue queue)
-{
-    const VkCommandBuffer cb = begin_single_time_commands(device, pool);
-
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {width, height, 1};
-
-    vkCmdCopyBufferToImage(
-        cb, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    end_single_time_commands(cb, device, pool, queue);
 }
 
 static VkFormat
@@ -455,138 +437,39 @@ has_stencil_component(VkFormat format)
            format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-static void
-generate_mipmaps(VkImage image,
-                 VkFormat image_format,
-                 uint32_t tex_width,
-                 uint32_t tex_height,
-                 uint32_t mip_levels,
-                 VkDevice device,
-                 VkCommandPool pool,
-                 VkQueue queue,
-                 VkPhysicalDevice physical_device)
-{
-    VkFormatProperties format_props;
-    vkGetPhysicalDeviceFormatProperties(
-        physical_device, image_format, &format_props);
-
-    if (!(format_props.optimalTilingFeatures &
-          VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-        throw std::runtime_error(
-            "Texture image format does not support linear blitting");
-    }
-
-    const VkCommandBuffer cb = begin_single_time_commands(device, pool);
-
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.image = image;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.subresourceRange.levelCount = 1;
-
-    int32_t mip_width = static_cast<int32_t>(tex_width);
-    int32_t mip_height = static_cast<int32_t>(tex_height);
-
-    for (uint32_t i = 1; i < mip_levels; ++i) {
-        barrier.subresourceRange.baseMipLevel = i - 1;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-        vkCmdPipelineBarrier(cb,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0,
-                             0,
-                             nullptr,
-                             0,
-                             nullptr,
-                             1,
-                             &barrier);
-
-        VkImageBlit blit{};
-        blit.srcOffsets[0] = {0, 0, 0};
-        blit.srcOffsets[1] = {mip_width, mip_height, 1};
-        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.srcSubresource.mipLevel = i - 1;
-        blit.srcSubresource.baseArrayLayer = 0;
-        blit.srcSubresource.layerCount = 1;
-        blit.dstOffsets[0] = {0, 0, 0};
-        blit.dstOffsets[1] = {mip_width > 1 ? mip_width / 2 : 1,
-                              mip_height > 1 ? mip_height / 2 : 1,
-                              1};
-        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.dstSubresource.mipLevel = i;
-        blit.dstSubresource.baseArrayLayer = 0;
-        blit.dstSubresource.layerCount = 1;
-
-        vkCmdBlitImage(cb,
-                       image,
-                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                       image,
-                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                       1,
-                       &blit,
-                       VK_FILTER_LINEAR);
-
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        vkCmdPipelineBarrier(cb,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                             0,
-                             0,
-                             nullptr,
-                             0,
-                             nullptr,
-                             1,
-                             &barrier);
-
-        if (mip_width > 1) {
-            mip_width /= 2;
-        }
-        if (mip_height > 1) {
-            mip_height /= 2;
-        }
-    }
-
-    barrier.subresourceRange.baseMipLevel = mip_levels - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier(cb,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                         0,
-                         0,
-                         nullptr,
-                         0,
-                         nullptr,
-                         1,
-                         &barrier);
-
-    end_single_time_commands(cb, device, pool, queue);
-}
-
+// Whether the device can draw with vkCmdDrawIndexedIndirectCount, which
+// the GPU cullers need.
+static bool
+supports_indirect_count(VkPhysicalDevice physical_device)
+{
+    VkPhysicalDeviceVulkan12Features vulkan12_features{};
+    vulkan12_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan12_features;
+    vkGetPhysicalDeviceFeatures2(physical_device, &features);
+    return features.features.multiDrawIndirect &&
+           vulkan12_features.drawIndirectCount;
+}
+
+// With indirect count draws the depth pyramid is built from the depth
+// buffer, so only sample counts compute shaders can sample the depth at are
+// considered, unless that leaves none but a single sample.
 static VkSampleCountFlagBits
 get_max_usable_sample_count(VkPhysicalDevice physical_device)
 {
     VkPhysicalDeviceProperties props{};
     vkGetPhysicalDeviceProperties(physical_device, &props);
 
-    const VkSampleCountFlags counts =
-        props.limits.framebufferColorSampleCounts &
-        props.limits.framebufferDepthSampleCounts;
+    VkSampleCountFlags counts = props.limits.framebufferColorSampleCounts &
+                                props.limits.framebufferDepthSampleCounts;
+    const VkSampleCountFlags sampled_counts =
+        counts & props.limits.sampledImageDepthSampleCounts;
+    if (supports_indirect_count(physical_device) &&
+        (sampled_counts & ~VkSampleCountFlags{VK_SAMPLE_COUNT_1_BIT})) {
+        counts = sampled_counts;
+    }
     if (counts & VK_SAMPLE_COUNT_64_BIT) {
         return VK_SAMPLE_COUNT_64_BIT;
     }
@@ -609,78 +492,115 @@ get_max_usable_sample_count(VkPhysicalDevice physical_device)
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
+// Whether compute shaders can read every sample of a depth buffer of
+// `format` with `samples` samples, as the depth pyramid does.
+static bool
+can_sample_depth(VkPhysicalDevice physical_device,
+                 VkFormat format,
+                 VkSampleCountFlagBits samples)
+{
+    if (samples == VK_SAMPLE_COUNT_1_BIT) {
+        return false;
+    }
+
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(physical_device, &props);
+    VkFormatProperties format_props{};
+    vkGetPhysicalDeviceFormatProperties(
+        physical_device, format, &format_props);
+    return (props.limits.sampledImageDepthSampleCounts & samples) &&
+           (format_props.optimalTilingFeatures &
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+}
+
 void
 VulkanApplication::CreateBuffer(VkDeviceSize size,
                                 VkBufferUsageFlags usage,
                                 VkMemoryPropertyFlags properties,
                                 VkBuffer &buffer,
-                                VkDeviceMemory &buffer_memory) const
+                                GpuAllocation &buffer_memory) const
 {
-    const queue_family_indices indices =
-        find_queue_families(physical_device_, surface_);
-    const std::set<uint32_t> unique_queue_indices = {indices.transfer_family.value(),
-                                      indices.graphics_family.value()};
-    std::vector<uint32_t> queue_indices(unique_queue_indices.size());
-    std::copy(unique_queue_indices.begin(), unique_queue_indices.end(), queue_indices.begin());
-
+    // Buffers written on the transfer queue are handed over to the graphics
+    // queue with explicit ownership transfers, see
+    // UploadService::TransferOwnership. Images never change queues: textures
+    // are uploaded on the graphics queue, see CreateTextureImage.
     VkBufferCreateInfo info{};
     info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     info.size = size;
     info.usage = usage;
-    info.sharingMode = indices.get_sharing_mode();
-    info.queueFamilyIndexCount = std::size(queue_indices);
-    info.pQueueFamilyIndices = queue_indices.data();
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VKRESULT(vkCreateBuffer(device_, &info, nullptr, &buffer));
 
     VkMemoryRequirements memory_requirements;
     vkGetBufferMemoryRequirements(device_, buffer, &memory_requirements);
 
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = memory_requirements.size;
-    alloc_info.memoryTypeIndex = find_memory_type(
-        physical_device_, memory_requirements.memoryTypeBits, properties);
-
-    VKRESULT(vkAllocateMemory(device_, &alloc_info, nullptr, &buffer_memory));
+    buffer_memory = allocator_->Allocate(memory_requirements, properties);
 
-    VKRESULT(vkBindBufferMemory(device_, buffer, buffer_memory, 0));
+    VKRESULT(vkBindBufferMemory(
+        device_, buffer, buffer_memory.memory, buffer_memory.offset));
 }
 
 void
-VulkanApplication::CopyBuffer(VkBuffer src_buffer,
-                              VkBuffer dst_buffer,
-                              VkDeviceSize size)
+VulkanApplication::FlushUploads()
 {
-    const VkCommandBuffer cb =
-        begin_single_time_commands(device_, transfer_command_pool_);
+    // Mip generation and layout transitions recorded on the graphics queue
+    // consume what the transfer queue copied, so they wait for it on the GPU.
+    const uint64_t transfer_value = transfer_uploads_->Flush();
+    graphics_uploads_->WaitFor(*transfer_uploads_, transfer_value);
+    graphics_uploads_->Flush();
+}
 
-    VkBufferCopy copy_region{};
-    copy_region.size = size;
-    vkCmdCopyBuffer(cb, src_buffer, dst_buffer, 1, &copy_region);
+std::unique_ptr<StagingRing>
+VulkanApplication::CreateStagingRing(VkDeviceSize size) const
+{
+    VkBuffer buffer;
+    GpuAllocation memory;
+    CreateBuffer(size,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 buffer,
+                 memory);
+    return std::make_unique<StagingRing>(
+        device_, *allocator_, buffer, memory, size);
+}
+
+void
+VulkanApplication::CreateUploadServices()
+{
+    // A ring retires its regions in submission order, so each service
+    // needs its own: one flushing first must not release regions the other
+    // has not submitted yet.
+    transfer_staging_ring_ = CreateStagingRing(TRANSFER_STAGING_SIZE);
+    graphics_staging_ring_ = CreateStagingRing(GRAPHICS_STAGING_SIZE);
 
-    end_single_time_commands(
-        cb, device_, transfer_command_pool_, transfer_queue_);
+    const queue_family_indices indices =
+        find_queue_families(physical_device_, surface_);
+    transfer_uploads_ =
+        std::make_unique<UploadService>(device_,
+                                        transfer_queue_,
+                                        indices.transfer_family.value(),
+                                        *transfer_staging_ring_);
+    graphics_uploads_ =
+        std::make_unique<UploadService>(device_,
+                                        queue_,
+                                        indices.graphics_family.value(),
+                                        *graphics_staging_ring_);
+
+    // Without the feature textures fall back to blitted mip chains.
+    if (storage_write_without_format_) {
+        mip_generator_ = std::make_unique<MipGenerator>(
+            device_,
+            physical_device_,
+            ReadShader("downsample_cs.spv"));
+    }
 }
 
 void
 VulkanApplication::CreateIndexBuffer()
 {
-    const VkDeviceSize buffer_size = sizeof(indices_[0]) * indices_.size();
-
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-    CreateBuffer(buffer_size,
-                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 staging_buffer,
-                 staging_buffer_memory);
-    void *data = nullptr;
-    VKRESULT(
-        vkMapMemory(device_, staging_buffer_memory, 0, buffer_size, 0, &data));
-    memcpy(data, indices_.data(), buffer_size);
-    vkUnmapMemory(device_, staging_buffer_memory);
+    const VkDeviceSize buffer_size = index_data_.size();
 
     CreateBuffer(
         buffer_size,
@@ -689,10 +609,55 @@ VulkanApplication::CreateIndexBuffer()
         index_buffer_,
         index_buffer_memory_);
 
-    CopyBuffer(staging_buffer, index_buffer_, buffer_size);
+    transfer_uploads_->CopyToBuffer(
+        index_buffer_, index_data_.data(), buffer_size);
+    transfer_uploads_->TransferOwnership(*graphics_uploads_,
+                                         index_buffer_,
+                                         VK_ACCESS_INDEX_READ_BIT,
+                                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+}
+
+void
+VulkanApplication::CreateClusterCuller()
+{
+    // Without indirect count draws, or for meshes cooked without meshlets,
+    // every submesh is drawn as a whole.
+    if (!draw_indirect_count_ || meshlets_.empty()) {
+        return;
+    }
+
+    cluster_culler_ = std::make_unique<ClusterCuller>(
+        device_,
+        *allocator_,
+        ReadShader("cluster_cull_cs.spv"),
+        static_cast<uint32_t>(meshlets_.size()));
+    cluster_culler_->Upload(*transfer_uploads_, *graphics_uploads_, meshlets_);
+}
+
+void
+VulkanApplication::CreateInstanceCuller()
+{
+    // Without indirect count draws the CPU culls the objects every frame and
+    // draws them instanced. Without a depth buffer to build the pyramid
+    // from, the GPU culls them against the frustum only.
+    if (!draw_indirect_count_) {
+        return;
+    }
 
-    vkDestroyBuffer(device_, staging_buffer, nullptr);
-    vkFreeMemory(device_, staging_buffer_memory, nullptr);
+    if (occlusion_culling_) {
+        depth_pyramid_ = std::make_unique<DepthPyramid>(
+            device_, *allocator_, ReadShader("depth_pyramid_cs.spv"));
+        depth_pyramid_->Resize(
+            *graphics_uploads_, swap_chain_extent_, msaa_samples_);
+    }
+    instance_culler_ =
+        std::make_unique<InstanceCuller>(device_,
+                                         *allocator_,
+                                         ReadShader("instance_cull_cs.spv"),
+                                         depth_pyramid_.get());
+    instance_culler_->SetMesh(
+        *graphics_uploads_, lods_, submeshes_, mesh_bounds_);
+    instance_culler_->SetObjects(*graphics_uploads_, {});
 }
 
 void
@@ -720,8 +685,18 @@ VulkanApplication::CreateDescriptorSetLayout()
     ubo_ps_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     ubo_ps_layout_binding.pImmutableSamplers = nullptr;
 
-    const std::array<VkDescriptorSetLayoutBinding, 3> bindings = {
-        ubo_layout_binding, sampler_layout_binding, ubo_ps_layout_binding};
+    VkDescriptorSetLayoutBinding instance_layout_binding{};
+    instance_layout_binding.binding = 3;
+    instance_layout_binding.descriptorCount = 1;
+    instance_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instance_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    instance_layout_binding.pImmutableSamplers = nullptr;
+
+    const std::array<VkDescriptorSetLayoutBinding, 4> bindings = {
+        ubo_layout_binding,
+        sampler_layout_binding,
+        ubo_ps_layout_binding,
+        instance_layout_binding};
 
     VkDescriptorSetLayoutCreateInfo info{};
     info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -750,12 +725,7 @@ VulkanApplication::CreateUniformBuffers()
                          uniform_buffers_[i],
                          uniform_buffers_memory_[i]);
 
-            vkMapMemory(device_,
-                        uniform_buffers_memory_[i],
-                        0,
-                        buffer_size,
-                        0,
-                        &uniform_buffers_mapped_[i]);
+            uniform_buffers_mapped_[i] = uniform_buffers_memory_[i].mapped;
         }
     }
 
@@ -774,18 +744,73 @@ VulkanApplication::CreateUniformBuffers()
                          uniform_buffers_ps_[i],
                          uniform_buffers_memory_ps_[i]);
 
-            vkMapMemory(device_,
-                        uniform_buffers_memory_ps_[i],
-                        0,
-                        buffer_size,
-                        0,
-                        &uniform_buffers_mapped_ps_[i]);
+            uniform_buffers_mapped_ps_[i] =
+                uniform_buffers_memory_ps_[i].mapped;
         }
     }
+
+    // The instance culler keeps the instances of all frames on the GPU.
+    if (instance_culler_) {
+        return;
+    }
+    instance_buffers_.resize(MAX_FRAMES_IN_FLIGHT);
+    instance_buffers_memory_.resize(MAX_FRAMES_IN_FLIGHT);
+    instance_buffer_capacities_.resize(MAX_FRAMES_IN_FLIGHT);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        CreateInstanceBuffer(i, INITIAL_INSTANCE_CAPACITY);
+    }
 }
 
 void
-VulkanApplication::UpdateUniformBuffer() const
+VulkanApplication::CreateInstanceBuffer(uint32_t frame, uint32_t capacity)
+{
+    CreateBuffer(capacity * sizeof(InstanceData),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 instance_buffers_[frame],
+                 instance_buffers_memory_[frame]);
+    instance_buffer_capacities_[frame] = capacity;
+}
+
+void
+VulkanApplication::WriteInstanceDescriptor(uint32_t frame) const
+{
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.offset = 0;
+    buffer_info.buffer = instance_culler_
+                             ? instance_culler_->GetInstanceBuffer()
+                             : instance_buffers_[frame];
+    buffer_info.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = descriptor_sets_[frame];
+    descriptor_write.dstBinding = 3;
+    descriptor_write.dstArrayElement = 0;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pBufferInfo = &buffer_info;
+
+    vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
+}
+
+static glm::mat4
+get_projection(VkExtent2D extent)
+{
+    glm::mat4 proj = glm::perspective(
+        glm::radians(45.0f),
+        extent.width / static_cast<float>(extent.height),
+        0.1f,
+        10.0f);
+
+    proj[1][1] *= -1;  // flip Y
+
+    return proj;
+}
+
+void
+VulkanApplication::UpdateUniformBuffer(const FramePacket &frame) const
 {
     static const auto start_time = std::chrono::high_resolution_clock::now();
 
@@ -798,41 +823,143 @@ VulkanApplication::UpdateUniformBuffer() const
 
     {
         uniform_buffer_object ubo{};
-        ubo.model = glm::mat4(1.0f);
-
-        ubo.view = camera_->view;
+        ubo.view = frame.camera.view;
 
-        ubo.proj =
-            glm::perspective(glm::radians(45.0f),
-                             swap_chain_extent_.width /
-                                 static_cast<float>(swap_chain_extent_.height),
-                             0.1f,
-                             10.0f);
+        ubo.proj = get_projection(swap_chain_extent_);
 
-        ubo.proj[1][1] *= -1;  // flip Y
+        ubo.position_scale = glm::vec4(vertex_streams_.positionScale, 0.0f);
+        ubo.position_offset = glm::vec4(vertex_streams_.positionOffset, 0.0f);
 
         memcpy(uniform_buffers_mapped_[current_frame_], &ubo, sizeof(ubo));
     }
 
     {
         uniform_buffer_object_ps ubo{};
-        ubo.cam_pos = camera_->cam_pos;
+        ubo.cam_pos = frame.camera.position;
         ubo.light_pos = glm::vec3(2.0f);
+        std::copy(std::begin(MATERIAL_COLORS),
+                  std::end(MATERIAL_COLORS),
+                  ubo.material_colors);
 
         memcpy(uniform_buffers_mapped_ps_[current_frame_], &ubo, sizeof(ubo));
     }
 }
 
+// Only one mesh is loaded so far.
+static void
+check_draw_item([[maybe_unused]] const DrawItem &item)
+{
+    ASSERT(item.mesh == 0, "Draw item references an unknown mesh");
+    ASSERT(item.material < VulkanApplication::MATERIAL_COUNT,
+           "Draw item references an unknown material");
+}
+
+void
+VulkanApplication::BuildDrawList(const FramePacket &frame)
+{
+    // Items get their levels of detail picked on the job system once there
+    // are enough of them to split.
+    static constexpr size_t MIN_ITEMS_PER_JOB = 256;
+
+    const std::span<const DrawItem> items = *frame.drawList;
+    if (frame.drawList != scene_) {
+        std::vector<MeshBounds> boxes(items.size());
+        parallel_for(
+            items.size(), MIN_ITEMS_PER_JOB, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    check_draw_item(items[i]);
+                    boxes[i] = transform_bounds(items[i].model, mesh_bounds_);
+                }
+            });
+        scene_bvh_.Build(boxes);
+        scene_ = frame.drawList;
+    }
+
+    const glm::mat4 &view = frame.camera.view;
+    const glm::mat4 proj = get_projection(swap_chain_extent_);
+    glm::vec4 frustum[6];
+    extract_frustum_planes(proj * view, frustum);
+    scene_bvh_.Cull(frustum, visible_items_);
+
+    std::vector<uint32_t> item_lods(visible_items_.size());
+    const auto select_lods = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            // Picked so that the simplification error stays below a pixel.
+            item_lods[i] =
+                select_lod(lods_,
+                           mesh_bounds_,
+                           view * items[visible_items_[i]].model,
+                           proj,
+                           static_cast<float>(swap_chain_extent_.height));
+        }
+    };
+    parallel_for(visible_items_.size(), MIN_ITEMS_PER_JOB, select_lods);
+
+    draw_list_.Clear();
+    for (size_t i = 0; i < visible_items_.size(); ++i) {
+        const DrawItem &item = items[visible_items_[i]];
+        draw_list_.Add(item.mesh, item_lods[i], item.material, item.model);
+    }
+    draw_list_.Build();
+}
+
+void
+VulkanApplication::UpdateScene(const FramePacket &frame)
+{
+    if (frame.drawList == scene_) {
+        return;
+    }
+
+    // Scenes change rarely, so rather than keeping the old buffers alive
+    // until the frames in flight are done with them, the GPU is drained.
+    VKRESULT(vkDeviceWaitIdle(device_));
+    std::vector<InstanceData> objects;
+    objects.reserve(frame.drawList->size());
+    for (const DrawItem &item : *frame.drawList) {
+        check_draw_item(item);
+        objects.push_back({item.model, item.material});
+    }
+    instance_culler_->SetObjects(*graphics_uploads_, objects);
+    graphics_uploads_->Flush();
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        WriteInstanceDescriptor(i);
+    }
+    scene_ = frame.drawList;
+}
+
+void
+VulkanApplication::UpdateInstanceBuffer()
+{
+    const std::span<const InstanceData> instances = draw_list_.GetInstances();
+    if (instances.size() > instance_buffer_capacities_[current_frame_]) {
+        // The frame's fence was waited for, so the GPU is done with the old
+        // buffer and with the descriptor set that points to it.
+        vkDestroyBuffer(device_, instance_buffers_[current_frame_], nullptr);
+        allocator_->Free(instance_buffers_memory_[current_frame_]);
+        CreateInstanceBuffer(
+            current_frame_,
+            std::bit_ceil(static_cast<uint32_t>(instances.size())));
+        WriteInstanceDescriptor(current_frame_);
+    }
+    if (!instances.empty()) {
+        memcpy(instance_buffers_memory_[current_frame_].mapped,
+               instances.data(),
+               instances.size_bytes());
+    }
+}
+
 void
 VulkanApplication::CreateDescriptorPool()
 {
-    std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+    std::array<VkDescriptorPoolSize, 4> pool_sizes{};
     pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     pool_sizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     pool_sizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     pool_sizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     pool_sizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    pool_sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[3].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
     VkDescriptorPoolCreateInfo pool_info{};
     pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -907,51 +1034,46 @@ VulkanApplication::CreateDescriptorSets()
                                descriptor_writes.data(),
                                0,
                                nullptr);
+        WriteInstanceDescriptor(i);
     }
 }
 
 void
-VulkanApplication::CreateTextureImage(const std::string &texture_path)
-{
-    int tex_width = 0;
-    int tex_height = 0;
-    int tex_channels = 0;
-    stbi_uc *pixels = stbi_load(texture_path.c_str(),
-                                &tex_width,
-                                &tex_height,
-                                &tex_channels,
-                                STBI_rgb_alpha);
+VulkanApplication::CreateTextureImage(const VirtualFile &file,
+                                      const std::string &name)
+{
+    const TextureFileLayout layout = read_texture_layout(
+        [&](uint64_t offset, std::span<uint8_t> out) {
+            file.Read(offset, out);
+        },
+        file.GetSize(),
+        name);
+
+    // Textures from the cache hold level 0 only; their mips are generated on
+    // the GPU like those of a decoded source image.
+    if (layout.levels.size() == 1 &&
+        layout.format == VK_FORMAT_R8G8B8A8_SRGB) {
+        std::vector<uint8_t> pixels(layout.levels[0].size);
+        file.Read(layout.levels[0].offset, pixels);
+        CreateTextureImage(pixels.data(), layout.width, layout.height);
+    }
+    else {
+        CreateCookedTextureImage(file, layout);
+    }
+}
 
+void
+VulkanApplication::CreateTextureImage(const uint8_t *pixels,
+                                      uint32_t width,
+                                      uint32_t height)
+{
     mip_levels_ = static_cast<uint32_t>(
-                      std::floor(std::log2(std::max(tex_width, tex_height)))) +
+                      std::floor(std::log2(std::max(width, height)))) +
                   1;
 
-    const VkDeviceSize image_size = tex_width * tex_height * 4;
-
-    if (!pixels) {
-        throw std::runtime_error("Failed to load texture image");
-    }
-
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-    CreateBuffer(image_size,
-                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 staging_buffer,
-                 staging_buffer_memory);
-
-    void *data = nullptr;
-    VKRESULT(
-        vkMapMemory(device_, staging_buffer_memory, 0, image_size, 0, &data));
-    memcpy(data, pixels, image_size);
-    vkUnmapMemory(device_, staging_buffer_memory);
-
-    stbi_image_free(pixels);
-
     ImageCreateInfo createInfo = {};
-    createInfo.width = tex_width;
-    createInfo.height = tex_height;
+    createInfo.width = width;
+    createInfo.height = height;
     createInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
     createInfo.mipLevels = mip_levels_;
     createInfo.numSamples = VK_SAMPLE_COUNT_1_BIT;
@@ -960,83 +1082,56 @@ VulkanApplication::CreateTextureImage(const std::string &texture_path)
                        VK_IMAGE_USAGE_SAMPLED_BIT |
                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     createInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    m_textureImage =
-        std::make_unique<Image>(createInfo, device_, physical_device_);
-
-    transition_image_layout(m_textureImage->GetImage(),
-                            VK_FORMAT_R8G8B8A8_SRGB,
-                            VK_IMAGE_LAYOUT_UNDEFINED,
-                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                            device_,
-                            command_pool_,
-                            queue_,
-                            mip_levels_);
-
-    copy_buffer_to_image(staging_buffer,
-                         m_textureImage->GetImage(),
-                         tex_width,
-                         tex_height,
-                         device_,
-                         transfer_command_pool_,
-                         transfer_queue_);
-
-    generate_mipmaps(m_textureImage->GetImage(),
-                     VK_FORMAT_R8G8B8A8_SRGB,
-                     tex_width,
-                     tex_height,
-                     mip_levels_,
-                     device_,
-                     command_pool_,
-                     queue_,
-                     physical_device_);
-
-    vkDestroyBuffer(device_, staging_buffer, nullptr);
-    vkFreeMemory(device_, staging_buffer_memory, nullptr);
+    if (mip_generator_ && mip_generator_->Supports(createInfo.format)) {
+        createInfo.usage |= MipGenerator::IMAGE_USAGE;
+        createInfo.flags = MipGenerator::GetImageFlags(createInfo.format);
+    }
+    m_textureImage = std::make_unique<Image>(createInfo, device_, *allocator_);
+
+    // Blits and the mip compute shader need a graphics queue, so the
+    // transition, copy and mip chain are all recorded into the graphics batch
+    // and go out in one submission without an ownership transfer.
+    record_texture_uploads(*graphics_uploads_,
+                           {{m_textureImage.get(), {copy_from(pixels)}, 4}},
+                           physical_device_,
+                           mip_generator_.get());
 }
 
 void
-VulkanApplication::CreateImage(uint32_t width,
-                               uint32_t height,
-                               VkFormat format,
-                               uint32_t mip_levels,
-                               VkSampleCountFlagBits num_samples,
-                               VkImageTiling tiling,
-                               VkImageUsageFlags usage,
-                               VkMemoryPropertyFlags properties,
-                               VkImage &image,
-                               VkDeviceMemory &image_memory) const
-{
-    VkImageCreateInfo image_info{};
-    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    image_info.imageType = VK_IMAGE_TYPE_2D;
-    image_info.extent.width = width;
-    image_info.extent.height = height;
-    image_info.extent.depth = 1;
-    image_info.mipLevels = mip_levels;
-    image_info.arrayLayers = 1;
-    image_info.format = format;
-    image_info.tiling = tiling;
-    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    image_info.usage = usage;
-    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    image_info.samples = num_samples;
-
-    VKRESULT(vkCreateImage(device_, &image_info, nullptr, &image));
-
-    VkMemoryRequirements memory_requirements;
-    vkGetImageMemoryRequirements(device_, image, &memory_requirements);
+VulkanApplication::CreateCookedTextureImage(const VirtualFile &file,
+                                            const TextureFileLayout &layout)
+{
+    // Cooked textures carry their whole mip chain, so they are copied as is
+    // and need neither transfer-src usage nor a mip pass.
+    const TextureBlockInfo block = get_texture_block_info(layout.format);
 
-    VkMemoryAllocateInfo allocate_info{};
-    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocate_info.allocationSize = memory_requirements.size;
-    allocate_info.memoryTypeIndex =
-        find_memory_type(physical_device_,
-                         memory_requirements.memoryTypeBits,
-                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    mip_levels_ = static_cast<uint32_t>(layout.levels.size());
 
-    VKRESULT(vkAllocateMemory(device_, &allocate_info, nullptr, &image_memory));
+    ImageCreateInfo createInfo = {};
+    createInfo.width = layout.width;
+    createInfo.height = layout.height;
+    createInfo.format = layout.format;
+    createInfo.mipLevels = mip_levels_;
+    createInfo.numSamples = VK_SAMPLE_COUNT_1_BIT;
+    createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    createInfo.usage =
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    createInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    m_textureImage = std::make_unique<Image>(createInfo, device_, *allocator_);
 
-    VKRESULT(vkBindImageMemory(device_, image, image_memory, 0));
+    // Levels are read, or decompressed when archived, straight into the
+    // staging ring.
+    std::vector<StagingWriter> levels;
+    for (const TextureFileLayout::Level &level : layout.levels) {
+        levels.push_back(
+            [&file, level](VkDeviceSize offset, std::span<uint8_t> out) {
+                file.Read(level.offset + offset, out);
+            });
+    }
+    record_texture_uploads(
+        *graphics_uploads_,
+        {{m_textureImage.get(), levels, block.size, block.extent}},
+        physical_device_);
 }
 
 void
@@ -1100,54 +1195,6 @@ VulkanApplication::CreateTextureSampler()
         vkCreateSampler(device_, &sampler_info, nullptr, &texture_sampler_));
 }
 
-void
-VulkanApplication::CreateDepthResources()
-{
-    const VkFormat depth_format = find_depth_format(physical_device_);
-
-    ImageCreateInfo createInfo = {};
-    createInfo.format = depth_format;
-    createInfo.height = swap_chain_extent_.height;
-    createInfo.width = swap_chain_extent_.width;
-    createInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    createInfo.numSamples = msaa_samples_;
-    createInfo.mipLevels = 1;
-    createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    createInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-
-    m_depthImage =
-        std::make_unique<Image>(createInfo, device_, physical_device_);
-    m_depthImage->CreateImageView(VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-
-    transition_image_layout(m_depthImage->GetImage(),
-                            depth_format,
-                            VK_IMAGE_LAYOUT_UNDEFINED,
-                            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-                            device_,
-                            command_pool_,
-                            queue_,
-                            1);
-}
-
-void
-VulkanApplication::CreateColorResources()
-{
-    const VkFormat color_format = swap_chain_image_format_;
-    CreateImage(swap_chain_extent_.width,
-                swap_chain_extent_.height,
-                color_format,
-                1,
-                msaa_samples_,
-                VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
-                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                color_image_,
-                color_image_memory_);
-    color_image_view_ = CreateImageView(
-        color_image_, color_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-}
-
 void
 VulkanApplication::InitImGui()
 {
@@ -1218,14 +1265,14 @@ VulkanApplication::VulkanApplication(SDL_Window *window)
     : window_(window)
 {
     InitVulkan();
-    camera_ = std::make_unique<Camera>(
-        swap_chain_extent_.width, swap_chain_extent_.height, 10);
 }
 
 void
-VulkanApplication::DrawFrame()
+VulkanApplication::DrawFrame(const FramePacket &frame)
 {
-    ImGui::Render();
+    if (frame.windowResized) {
+        is_framebuffer_resized = true;
+    }
 
     VKRESULT(vkWaitForFences(
         device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX));
@@ -1247,27 +1294,57 @@ VulkanApplication::DrawFrame()
         throw std::runtime_error("Failed to acquire swap chain image");
     }
 
-    camera_->Update();
-
-    UpdateUniformBuffer();
+    if (instance_culler_) {
+        UpdateScene(frame);
+    }
+    else {
+        BuildDrawList(frame);
+        UpdateInstanceBuffer();
+    }
+    UpdateUniformBuffer(frame);
 
     VKRESULT(vkResetFences(device_, 1, &in_flight_fences_[current_frame_]));
 
     VKRESULT(vkResetCommandBuffer(command_buffers_[current_frame_], 0));
 
-    RecordCommandBuffer(command_buffers_[current_frame_], image_idx);
+    RecordCommandBuffer(command_buffers_[current_frame_], image_idx, frame);
 
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    const VkSemaphore wait_semaphores[] = {
+    std::vector<VkSemaphore> wait_semaphores = {
         image_available_semaphores_[current_frame_]};
-    const VkPipelineStageFlags wait_stages[] = {
+    std::vector<VkPipelineStageFlags> wait_stages = {
         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    // Binary semaphores ignore their entry in the value array.
+    std::vector<uint64_t> wait_values = {0};
+
+    // Only wait for uploads that the GPU has not finished yet; once they are
+    // done the frame is submitted without any extra dependency.
+    for (const UploadService *uploads :
+         {transfer_uploads_.get(), graphics_uploads_.get()}) {
+        const uint64_t value = uploads->GetLastSubmittedValue();
+        if (!uploads->IsComplete(value)) {
+            wait_semaphores.push_back(uploads->GetSemaphore());
+            wait_stages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                  VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+            wait_values.push_back(value);
+        }
+    }
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount =
+        static_cast<uint32_t>(wait_values.size());
+    timeline_info.pWaitSemaphoreValues = wait_values.data();
 
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = wait_stages;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount =
+        static_cast<uint32_t>(wait_semaphores.size());
+    submit_info.pWaitSemaphores = wait_semaphores.data();
+    submit_info.pWaitDstStageMask = wait_stages.data();
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &command_buffers_[current_frame_];
 
@@ -1304,12 +1381,6 @@ VulkanApplication::DrawFrame()
     current_frame_ = (current_frame_ + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
-void
-VulkanApplication::OnWindowResized()
-{
-    is_framebuffer_resized = true;
-}
-
 VulkanApplication::~VulkanApplication()
 {
     VKRESULT(vkDeviceWaitIdle(device_));
@@ -1317,9 +1388,6 @@ VulkanApplication::~VulkanApplication()
     Cleanup();
 }
 
-static void generate_normals(std::vector<vertex> &vertices,
-                             const std::vector<uint32_t> &indices);
-
 static std::string
 resolve_resource_path(const char *resource_path)
 {
@@ -1328,6 +1396,51 @@ resolve_resource_path(const char *resource_path)
     return out.str();
 }
 
+// Bump when a change to the importers alters what they cook, so that stale
+// cache entries are no longer found.
+static constexpr uint32_t MESH_COOK_VERSION = 1;
+static constexpr uint32_t TEXTURE_COOK_VERSION = 1;
+
+static constexpr const char *COOKED_MESH_PATH = "cooked/models/teapot.nmesh";
+static constexpr const char *COOKED_TEXTURE_PATH =
+    "cooked/textures/viking_room.ktx2";
+
+// Decodes the image at `source_path` into a single level RGBA8 texture.
+static void
+cook_texture(const std::string &source_path, const std::string &path)
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    stbi_uc *pixels = stbi_load(
+        source_path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("Failed to load texture image");
+    }
+
+    TextureFile texture;
+    texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+    texture.width = static_cast<uint32_t>(width);
+    texture.height = static_cast<uint32_t>(height);
+    texture.levels.emplace_back(pixels, pixels + size_t{texture.width} *
+                                                     texture.height * 4);
+    stbi_image_free(pixels);
+
+    write_texture_file(path, texture);
+}
+
+// Runs the OBJ file at `source_path` through the same steps as meshcook.
+static void
+cook_mesh(const std::string &source_path,
+          const std::string &path,
+          const VertexLayout &layout)
+{
+    MeshData mesh = import_obj(source_path);
+    generate_tangents(mesh);
+    optimize_mesh(mesh);
+    write_mesh_file(path, mesh, layout);
+}
+
 void
 VulkanApplication::LoadModel(const std::string &path)
 {
@@ -1338,64 +1451,280 @@ VulkanApplication::LoadModel(const std::string &path)
     const std::string TEXTURE_PATH =
         resolve_resource_path("textures/viking_room.png");
 
-    CreateTextureImage(TEXTURE_PATH);
+    // Source assets that the build did not cook are cooked once into the
+    // cache, keyed by their contents, and loaded from there afterwards.
+    if (!asset_cache_) {
+        asset_cache_ = std::make_unique<AssetCache>(COOKED_HOME_DIR "/cache");
+    }
+
+    // Prefer the texture cooked at build time and fall back to the source
+    // image when it is missing or the device cannot sample BC. Cooked meshes
+    // are read ahead, decompressed when archived, and copied to the GPU as
+    // they are.
+    const bool cooked_texture =
+        texture_compression_bc_ && file_system_->Exists(COOKED_TEXTURE_PATH);
+    const bool cooked_mesh = file_system_->Exists(COOKED_MESH_PATH);
+
+    // Assets that need the cache are prepared on the job system, so that
+    // decoding the image overlaps importing the model and waiting for the
+    // prefetched files. Creating the GPU resources stays on this thread.
+    JobSystem &jobs = get_job_system();
+    JobCounter prepared;
+    std::optional<VirtualFile> texture;
+    std::string texture_name = COOKED_TEXTURE_PATH;
+    if (!cooked_texture) {
+        jobs.Run(
+            [&] {
+                const uint64_t key = get_asset_key(
+                    TEXTURE_PATH, TEXTURE_COOK_VERSION, "rgba8 srgb");
+                texture_name = asset_cache_->Get(
+                    key, ".ktx2", [&](const std::string &out) {
+                        cook_texture(TEXTURE_PATH, out);
+                    });
+                texture.emplace(texture_name);
+            },
+            &prepared);
+    }
+    if (!cooked_mesh) {
+        jobs.Run(
+            [&] {
+                const VertexLayout layout{};
+                std::ostringstream settings;
+                settings << "mesh " << MeshFile::VERSION << " positions "
+                         << static_cast<uint32_t>(layout.positions)
+                         << " attributes "
+                         << static_cast<uint32_t>(layout.attributes)
+                         << " colors " << layout.colors;
+                const uint64_t key = get_asset_key(
+                    MODEL_PATH, MESH_COOK_VERSION, settings.str());
+                mesh_file_ = std::make_unique<MeshFile>(asset_cache_->Get(
+                    key, ".nmesh", [&](const std::string &out) {
+                        cook_mesh(MODEL_PATH, out, layout);
+                    }));
+            },
+            &prepared);
+    }
+    // The jobs refer to locals, so they are waited for even when
+    // opening a cooked file fails.
+    std::exception_ptr error;
+    try {
+        if (cooked_texture) {
+            texture.emplace(OpenFile(COOKED_TEXTURE_PATH));
+        }
+        if (cooked_mesh) {
+            mesh_file_ = std::make_unique<MeshFile>(
+                OpenFile(COOKED_MESH_PATH).ReadAll(), COOKED_MESH_PATH);
+        }
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+    jobs.Wait(prepared);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    CreateTextureImage(*texture, texture_name);
     CreateTextureImageView();
     CreateTextureSampler();
 
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn;
-    std::string err;
+    vertex_streams_ = mesh_file_->GetVertexStreams();
+    index_type_ = mesh_file_->GetIndexType();
+    index_data_ = mesh_file_->GetIndexData();
+    submeshes_ = mesh_file_->GetSubmeshes();
+    meshlets_ = mesh_file_->GetMeshlets();
+    lods_ = mesh_file_->GetLods();
+    mesh_bounds_ = mesh_file_->GetBounds();
+}
 
-    if (!tinyobj::LoadObj(
-            &attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-        throw std::runtime_error("Failed to load model. " + warn + err);
+void
+VulkanApplication::CreateFileSystem()
+{
+    // Loose files are found under the same names as in the archive, which
+    // takes precedence when the build packed one.
+    file_system_ = std::make_unique<VirtualFileSystem>();
+    file_system_->MountDirectory(SHADERS_HOME_DIR, "shaders");
+    file_system_->MountDirectory(COOKED_HOME_DIR, "cooked");
+    if (std::filesystem::exists(ARCHIVE_PATH)) {
+        file_system_->MountArchive(ARCHIVE_PATH);
     }
+}
 
-    std::unordered_map<vertex, uint32_t> unique_vertices{};
+void
+VulkanApplication::PrefetchFiles()
+{
+    // The cooked texture is read even though the device, created meanwhile,
+    // may turn out unable to sample it; its bytes are then dropped.
+    static constexpr const char *FILES[] = {
+        "shaders/phong_vs.spv",
+        "shaders/phong_fs.spv",
+        "shaders/downsample_cs.spv",
+        "shaders/cluster_cull_cs.spv",
+        "shaders/instance_cull_cs.spv",
+        "shaders/depth_pyramid_cs.spv",
+        COOKED_TEXTURE_PATH,
+        COOKED_MESH_PATH,
+    };
+
+    io_service_ = std::make_unique<IoService>();
+    std::vector<std::string> paths;
+    for (const char *path : FILES) {
+        if (file_system_->Exists(path)) {
+            paths.emplace_back(path);
+        }
+    }
+    std::vector<std::future<FileData>> files =
+        file_system_->ReadAsync(paths, *io_service_);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        prefetched_files_.emplace(paths[i], std::move(files[i]));
+    }
+}
 
-    for (const auto &shape : shapes) {
-        for (const auto &index : shape.mesh.indices) {
-            vertex v{};
+VirtualFile
+VulkanApplication::OpenFile(const std::string &path)
+{
+    const auto it = prefetched_files_.find(path);
+    if (it == prefetched_files_.end()) {
+        return file_system_->Open(path);
+    }
+    std::future<FileData> data = std::move(it->second);
+    prefetched_files_.erase(it);
+    return VirtualFile(data.get());
+}
 
-            v.pos = {attrib.vertices[3 * index.vertex_index + 0],
-                     attrib.vertices[3 * index.vertex_index + 1],
-                     attrib.vertices[3 * index.vertex_index + 2]};
+std::vector<char>
+VulkanApplication::ReadShader(const char *name)
+{
+    const FileData code = OpenFile(std::string("shaders/") + name).ReadAll();
+    return {code.GetData().begin(), code.GetData().end()};
+}
 
-            if (!attrib.texcoords.empty()) {
-                v.tex_coord = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
-            }
+GpuAllocatorStats
+VulkanApplication::GetMemoryStats() const
+{
+    return allocator_->GetStats();
+}
 
-            if (!attrib.normals.empty()) {
-                v.normal = {attrib.normals[3 * index.normal_index + 0],
-                            attrib.normals[3 * index.normal_index + 1],
-                            attrib.normals[3 * index.normal_index + 2]};
-            }
+AssetCacheStats
+VulkanApplication::GetAssetCacheStats() const
+{
+    return asset_cache_ ? asset_cache_->GetStats() : AssetCacheStats{};
+}
 
-            v.color = {1.0f, 1.0f, 1.0f};
+MipBenchmarkResult
+VulkanApplication::BenchmarkMipGeneration(uint32_t width,
+                                          uint32_t height,
+                                          uint32_t iterations)
+{
+    const queue_family_indices indices =
+        find_queue_families(physical_device_, surface_);
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        physical_device_, &family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        physical_device_, &family_count, families.data());
+    if (families[indices.graphics_family.value()].timestampValidBits == 0) {
+        throw std::runtime_error("Graphics queue does not support timestamps");
+    }
 
-            if (!unique_vertices.contains(v)) {
-                unique_vertices.insert(
-                    std::make_pair(v, static_cast<uint32_t>(vertices_.size())));
-                vertices_.push_back(v);
-            }
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(physical_device_, &props);
 
-            indices_.push_back(unique_vertices[v]);
+    VkQueryPoolCreateInfo query_pool_info{};
+    query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = 2;
+    VkQueryPool query_pool{};
+    VKRESULT(
+        vkCreateQueryPool(device_, &query_pool_info, nullptr, &query_pool));
+
+    ImageCreateInfo createInfo = {};
+    createInfo.width = width;
+    createInfo.height = height;
+    createInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+    createInfo.mipLevels =
+        static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) +
+        1;
+    createInfo.numSamples = VK_SAMPLE_COUNT_1_BIT;
+    createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    createInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_SAMPLED_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    createInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    const bool has_compute =
+        mip_generator_ && mip_generator_->Supports(createInfo.format);
+    if (has_compute) {
+        createInfo.usage |= MipGenerator::IMAGE_USAGE;
+        createInfo.flags = MipGenerator::GetImageFlags(createInfo.format);
+    }
+    Image image(createInfo, device_, *allocator_);
+
+    // Returns the average GPU time in milliseconds of the mip chain recorded
+    // by `record`. Level 0 is cleared first so every run reads defined data.
+    const auto measure = [&](const auto &record) {
+        double total_ms = 0.0;
+        for (uint32_t i = 0; i < iterations; ++i) {
+            const VkCommandBuffer cb = graphics_uploads_->GetCommandBuffer();
+            transition_image_layout(cb,
+                                    image.GetImage(),
+                                    createInfo.format,
+                                    VK_IMAGE_LAYOUT_UNDEFINED,
+                                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                    createInfo.mipLevels);
+
+            const VkClearColorValue clear_color = {{0.5f, 0.25f, 0.75f, 1.0f}};
+            VkImageSubresourceRange range{};
+            range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            range.levelCount = 1;
+            range.layerCount = 1;
+            vkCmdClearColorImage(cb,
+                                 image.GetImage(),
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 &clear_color,
+                                 1,
+                                 &range);
+
+            vkCmdResetQueryPool(cb, query_pool, 0, 2);
+            vkCmdWriteTimestamp(
+                cb, VK_PIPELINE_STAGE_TRANSFER_BIT, query_pool, 0);
+            record();
+            vkCmdWriteTimestamp(
+                cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 1);
+            graphics_uploads_->Wait(graphics_uploads_->Flush());
+
+            std::array<uint64_t, 2> timestamps{};
+            VKRESULT(vkGetQueryPoolResults(
+                device_,
+                query_pool,
+                0,
+                2,
+                sizeof(timestamps),
+                timestamps.data(),
+                sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+            total_ms += static_cast<double>(timestamps[1] - timestamps[0]) *
+                        props.limits.timestampPeriod / 1e6;
         }
-    }
+        return total_ms / iterations;
+    };
 
-    if (attrib.normals.empty()) {
-        generate_normals(vertices_, indices_);
+    MipBenchmarkResult result{};
+    result.mipLevels = createInfo.mipLevels;
+    result.blitMs = measure([&] {
+        record_blit_mips(graphics_uploads_->GetCommandBuffer(), {&image});
+    });
+    if (has_compute) {
+        result.computeMs = measure(
+            [&] { mip_generator_->Record(*graphics_uploads_, {&image}); });
+        // Every run was waited for, so this drops all the views of `image`
+        // before it is destroyed.
+        mip_generator_->ReleaseCompleted();
     }
-}
 
-void
-VulkanApplication::OnMouseMove(uint32_t mouse_state, int x, int y)
-{
-    camera_->UpdateMousePos(mouse_state, glm::vec2(x, y));
+    vkDestroyQueryPool(device_, query_pool, nullptr);
+
+    return result;
 }
 
 void
@@ -1411,16 +1740,13 @@ VulkanApplication::CreateCommandPool()
 
     VKRESULT(
         vkCreateCommandPool(device_, &create_info, nullptr, &command_pool_));
-
-    create_info.queueFamilyIndex = indices.transfer_family.value();
-    create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-    VKRESULT(vkCreateCommandPool(
-        device_, &create_info, nullptr, &transfer_command_pool_));
 }
 
 void
 VulkanApplication::InitVulkan()
 {
+    CreateFileSystem();
+    PrefetchFiles();
     CreateInstance();
     SetupDebugMessenger();
     CreateSurface();
@@ -1430,19 +1756,23 @@ VulkanApplication::InitVulkan()
     CreateImageView();
     CreateRenderPass();
     CreateDescriptorSetLayout();
-    CreateGraphicsPipeline();
     CreateCommandPool();
-    CreateColorResources();
-    CreateDepthResources();
-    CreateFramebuffers();
+    CreateUploadServices();
+    // The pipeline's vertex input depends on the layout of the loaded mesh.
     LoadModel("");
+    CreateGraphicsPipeline();
+    render_graph_ = std::make_unique<RenderGraph>(device_, *allocator_);
     CreateVertexBuffer();
     CreateIndexBuffer();
+    CreateClusterCuller();
+    CreateInstanceCuller();
+    FlushUploads();
     CreateUniformBuffers();
     CreateDescriptorPool();
     CreateDescriptorSets();
     CreateCommandBuffers();
     CreateSyncObjects();
+    prefetched_files_.clear();
 
     InitImGui();
 }
@@ -1460,10 +1790,14 @@ VulkanApplication::Cleanup() const
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
         vkDestroyBuffer(device_, uniform_buffers_[i], nullptr);
-        vkFreeMemory(device_, uniform_buffers_memory_[i], nullptr);
+        allocator_->Free(uniform_buffers_memory_[i]);
         // TODO: Move to helper structure to handle this automatically
         vkDestroyBuffer(device_, uniform_buffers_ps_[i], nullptr);
-        vkFreeMemory(device_, uniform_buffers_memory_ps_[i], nullptr);
+        allocator_->Free(uniform_buffers_memory_ps_[i]);
+    }
+    for (size_t i = 0; i < instance_buffers_.size(); ++i) {
+        vkDestroyBuffer(device_, instance_buffers_[i], nullptr);
+        allocator_->Free(instance_buffers_memory_[i]);
     }
 
     vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
@@ -1471,10 +1805,10 @@ VulkanApplication::Cleanup() const
     vkDestroyDescriptorSetLayout(device_, descriptor_set_layout_, nullptr);
 
     vkDestroyBuffer(device_, vertex_buffer_, nullptr);
-    vkFreeMemory(device_, vertex_buffer_memory_, nullptr);
+    allocator_->Free(vertex_buffer_memory_);
 
     vkDestroyBuffer(device_, index_buffer_, nullptr);
-    vkFreeMemory(device_, index_buffer_memory_, nullptr);
+    allocator_->Free(index_buffer_memory_);
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
         vkDestroySemaphore(device_, image_available_semaphores_[i], nullptr);
@@ -1483,12 +1817,30 @@ VulkanApplication::Cleanup() const
     }
 
     vkDestroyCommandPool(device_, command_pool_, nullptr);
-    vkDestroyCommandPool(device_, transfer_command_pool_, nullptr);
 
     vkDestroyPipeline(device_, graphics_pipeline_, nullptr);
     vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
     vkDestroyRenderPass(device_, render_pass_, nullptr);
 
+    transfer_uploads_->Cleanup();
+    graphics_uploads_->Cleanup();
+    render_graph_->Cleanup();
+    if (mip_generator_) {
+        mip_generator_->Cleanup();
+    }
+    if (cluster_culler_) {
+        cluster_culler_->Cleanup();
+    }
+    if (instance_culler_) {
+        instance_culler_->Cleanup();
+    }
+    if (depth_pyramid_) {
+        depth_pyramid_->Cleanup();
+    }
+    transfer_staging_ring_->Cleanup();
+    graphics_staging_ring_->Cleanup();
+    allocator_->Cleanup();
+
     vkDestroyDevice(device_, nullptr);
     if constexpr (enable_validation_layers) {
         destroy_debug_utils_messenger_ext(
@@ -1738,7 +2090,7 @@ VulkanApplication::CreateRenderPass()
     color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentDescription depth_attachment{};
-    depth_attachment.format = find_depth_format(physical_device_);
+    depth_attachment.format = depth_format_;
     depth_attachment.samples = msaa_samples_;
     depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -1775,17 +2127,6 @@ VulkanApplication::CreateRenderPass()
     subpass.pDepthStencilAttachment = &depth_attachment_ref;
     subpass.pResolveAttachments = &color_attachment_resolve_ref;
 
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                              VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                              VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
-                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
     const std::array<VkAttachmentDescription, 3> attachments = {
         color_attachment, depth_attachment, color_attachment_resolve};
     VkRenderPassCreateInfo render_pass_info{};
@@ -1795,37 +2136,11 @@ VulkanApplication::CreateRenderPass()
     render_pass_info.pAttachments = attachments.data();
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
 
     VKRESULT(
         vkCreateRenderPass(device_, &render_pass_info, nullptr, &render_pass_));
 }
 
-void
-VulkanApplication::CreateFramebuffers()
-{
-    swap_chain_framebuffers_.resize(swap_chain_image_views_.size());
-
-    for (size_t i = 0; i < swap_chain_image_views_.size(); ++i) {
-        std::array<VkImageView, 3> attachments = {color_image_view_,
-                                                  m_depthImage->GetImageView(),
-                                                  swap_chain_image_views_[i]};
-
-        VkFramebufferCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        create_info.renderPass = render_pass_;
-        create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
-        create_info.pAttachments = attachments.data();
-        create_info.width = swap_chain_extent_.width;
-        create_info.height = swap_chain_extent_.height;
-        create_info.layers = 1;
-
-        VKRESULT(vkCreateFramebuffer(
-            device_, &create_info, nullptr, &swap_chain_framebuffers_[i]));
-    }
-}
-
 void
 VulkanApplication::CreateCommandBuffers()
 {
@@ -1844,7 +2159,8 @@ VulkanApplication::CreateCommandBuffers()
 
 void
 VulkanApplication::RecordCommandBuffer(VkCommandBuffer cb,
-                                       uint32_t image_idx) const
+                                       uint32_t image_idx,
+                                       const FramePacket &frame) const
 {
     VkCommandBufferBeginInfo begin_info{};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1853,30 +2169,153 @@ VulkanApplication::RecordCommandBuffer(VkCommandBuffer cb,
 
     VKRESULT(vkBeginCommandBuffer(cb, &begin_info));
 
-    VkRenderPassBeginInfo render_pass_info{};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass = render_pass_;
-    render_pass_info.framebuffer = swap_chain_framebuffers_[image_idx];
-    render_pass_info.renderArea.offset = {0, 0};
-    render_pass_info.renderArea.extent = swap_chain_extent_;
+    // The scene is drawn into multisampled color and depth buffers that
+    // resolve to the swap chain image, in as many render passes as the
+    // culling splits it into.
+    render_graph_->Reset();
+    RenderGraphImageDesc color_desc{};
+    color_desc.format = swap_chain_image_format_;
+    color_desc.extent = swap_chain_extent_;
+    color_desc.samples = msaa_samples_;
+    color_desc.clear = true;
+    color_desc.clearValue.color = {{0, 0, 0, 1}};
+    const RenderGraphImage color = render_graph_->CreateImage(color_desc);
+
+    RenderGraphImageDesc depth_desc = color_desc;
+    depth_desc.format = depth_format_;
+    depth_desc.clearValue.depthStencil = {1.0f, 0};
+    const RenderGraphImage depth = render_graph_->CreateImage(depth_desc);
+
+    RenderGraphImageDesc backbuffer_desc{};
+    backbuffer_desc.format = swap_chain_image_format_;
+    backbuffer_desc.extent = swap_chain_extent_;
+    RenderGraphImport backbuffer_import{};
+    backbuffer_import.image = swap_chain_images_[image_idx];
+    backbuffer_import.view = swap_chain_image_views_[image_idx];
+    backbuffer_import.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    backbuffer_import.output = true;
+    const RenderGraphImage backbuffer =
+        render_graph_->ImportImage(backbuffer_desc, backbuffer_import);
+
+    const std::array<RenderGraphUse, 3> targets = {{
+        {color, RenderGraphAccess::ColorAttachment},
+        {depth, RenderGraphAccess::DepthAttachment},
+        {backbuffer, RenderGraphAccess::ResolveAttachment},
+    }};
+
+    // Meshlets are culled for a single model matrix, so the cluster culler
+    // only takes over while the scene holds one object, which is the first
+    // of the instance culler's. The level of detail is picked so that its
+    // simplification error stays below a pixel.
+    const glm::mat4 &view = frame.camera.view;
+    const glm::mat4 proj = get_projection(swap_chain_extent_);
+    const float viewport_height = static_cast<float>(swap_chain_extent_.height);
+    const bool cull_clusters =
+        cluster_culler_ && instance_culler_ && frame.drawList->size() == 1;
+    if (cull_clusters) {
+        const glm::mat4 &model = frame.drawList->front().model;
+        const MeshLod &lod = lods_[select_lod(
+            lods_, mesh_bounds_, view * model, proj, viewport_height)];
+        render_graph_->AddComputePass({}, [&](VkCommandBuffer cb) {
+            cluster_culler_->Record(cb,
+                                    lod.firstMeshlet,
+                                    lod.meshletCount,
+                                    model,
+                                    view,
+                                    proj,
+                                    true);
+        });
+        render_graph_->AddGraphicsPass(targets, [&](VkCommandBuffer cb) {
+            BindDrawState(cb);
+            cluster_culler_->Draw(cb);
+        });
+    }
+    else if (instance_culler_ && !depth_pyramid_) {
+        // Without a depth pyramid the early phase is the only one, and it
+        // draws every object in the frustum.
+        render_graph_->AddComputePass({}, [&](VkCommandBuffer cb) {
+            instance_culler_->Record(
+                cb, CullPhase::Early, view, proj, viewport_height);
+        });
+        render_graph_->AddGraphicsPass(targets, [&](VkCommandBuffer cb) {
+            BindDrawState(cb);
+            instance_culler_->Draw(cb, CullPhase::Early);
+        });
+    }
+    else if (instance_culler_) {
+        // Objects visible last frame are drawn first and the depth they
+        // leave is reduced to the pyramid, against which the rest are
+        // tested.
+        render_graph_->AddComputePass({}, [&](VkCommandBuffer cb) {
+            instance_culler_->Record(
+                cb, CullPhase::Early, view, proj, viewport_height);
+        });
+        render_graph_->AddGraphicsPass(targets, [&](VkCommandBuffer cb) {
+            BindDrawState(cb);
+            instance_culler_->Draw(cb, CullPhase::Early);
+        });
+
+        const RenderGraphImage pyramid =
+            depth_pyramid_->AddPass(*render_graph_, depth);
+        const RenderGraphUse late_uses[] = {
+            {pyramid, RenderGraphAccess::ComputeRead}};
+        render_graph_->AddComputePass(late_uses, [&](VkCommandBuffer cb) {
+            instance_culler_->Record(
+                cb, CullPhase::Late, view, proj, viewport_height);
+        });
+        render_graph_->AddGraphicsPass(targets, [&](VkCommandBuffer cb) {
+            BindDrawState(cb);
+            instance_culler_->Draw(cb, CullPhase::Late);
+        });
+    }
+    else {
+        render_graph_->AddGraphicsPass(targets, [&](VkCommandBuffer cb) {
+            BindDrawState(cb);
+            // One instanced draw per submesh of every group. Submeshes
+            // addressed with 16 bit indices start at their own vertex.
+            for (const DrawGroup &group : draw_list_.GetGroups()) {
+                const MeshLod &lod = lods_[group.lod];
+                for (const Submesh &submesh : submeshes_.subspan(
+                         lod.firstSubmesh, lod.submeshCount)) {
+                    vkCmdDrawIndexed(
+                        cb,
+                        submesh.indexCount,
+                        group.instanceCount,
+                        submesh.firstIndex,
+                        static_cast<int32_t>(submesh.vertexOffset),
+                        group.firstInstance);
+                }
+            }
+        });
+    }
 
-    std::array<VkClearValue, 2> clear_values{};
-    clear_values[0].color = {{0, 0, 0, 1}};
-    clear_values[1].depthStencil = {1.0f, 0};
+    // Uses the same attachments as the scene, so it is merged into the
+    // scene's last render pass.
+    if (ImDrawData *ui = frame.ui.Get()) {
+        render_graph_->AddGraphicsPass(targets, [ui](VkCommandBuffer cb) {
+            ImGui_ImplVulkan_RenderDrawData(ui, cb);
+        });
+    }
 
-    render_pass_info.clearValueCount =
-        static_cast<uint32_t>(clear_values.size());
-    render_pass_info.pClearValues = clear_values.data();
+    render_graph_->Execute(cb);
 
-    vkCmdBeginRenderPass(cb, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+    VKRESULT(vkEndCommandBuffer(cb));
+}
 
+void
+VulkanApplication::BindDrawState(VkCommandBuffer cb) const
+{
     vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
 
-    const VkBuffer vertex_buffers[] = {vertex_buffer_};
-    const VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(cb, 0, 1, vertex_buffers, offsets);
+    const VkBuffer vertex_buffers[] = {
+        vertex_buffer_, vertex_buffer_, vertex_buffer_};
+    vkCmdBindVertexBuffers(cb,
+                           0,
+                           VERTEX_BINDING_COUNT,
+                           vertex_buffers,
+                           vertex_stream_offsets_.data());
 
-    vkCmdBindIndexBuffer(cb, index_buffer_, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindIndexBuffer(cb, index_buffer_, 0, index_type_);
 
     VkViewport viewport{};
     viewport.x = 0.0f;
@@ -1900,14 +2339,6 @@ VulkanApplication::RecordCommandBuffer(VkCommandBuffer cb,
                             &descriptor_sets_[current_frame_],
                             0,
                             nullptr);
-
-    vkCmdDrawIndexed(cb, static_cast<uint32_t>(indices_.size()), 1, 0, 0, 0);
-
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cb);
-
-    vkCmdEndRenderPass(cb);
-
-    VKRESULT(vkEndCommandBuffer(cb));
 }
 
 void
@@ -1947,23 +2378,20 @@ VulkanApplication::RecreateSwapChain()
 
     CreateSwapchain();
     CreateImageView();
-    CreateColorResources();
-    CreateDepthResources();
-    CreateFramebuffers();
+    if (depth_pyramid_) {
+        depth_pyramid_->Resize(
+            *graphics_uploads_, swap_chain_extent_, msaa_samples_);
+        instance_culler_->UpdateDepthPyramid();
+    }
+    FlushUploads();
 }
 
 void
 VulkanApplication::CleanupSwapChain() const
 {
-    vkDestroyImageView(device_, color_image_view_, nullptr);
-    vkDestroyImage(device_, color_image_, nullptr);
-    vkFreeMemory(device_, color_image_memory_, nullptr);
+    // Its framebuffers view the swap chain images.
+    render_graph_->Invalidate();
 
-    m_depthImage->Cleanup();
-
-    for (auto framebuffer : swap_chain_framebuffers_) {
-        vkDestroyFramebuffer(device_, framebuffer, nullptr);
-    }
     for (auto image_view : swap_chain_image_views_) {
         vkDestroyImageView(device_, image_view, nullptr);
     }
@@ -1974,23 +2402,21 @@ VulkanApplication::CleanupSwapChain() const
 void
 VulkanApplication::CreateVertexBuffer()
 {
-    const VkDeviceSize buffer_size = sizeof(vertices_[0]) * vertices_.size();
-
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-    CreateBuffer(buffer_size,
-                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 staging_buffer,
-                 staging_buffer_memory);
-
-    void *data = nullptr;
-    VKRESULT(
-        vkMapMemory(device_, staging_buffer_memory, 0, buffer_size, 0, &data));
+    // All streams share one buffer and are bound at their own offsets. A
+    // mesh without colours gets a single white colour read with zero stride.
+    static constexpr uint8_t WHITE[COLOR_STRIDE] = {255, 255, 255, 255};
+    const std::span<const uint8_t> colors =
+        vertex_streams_.layout.colors ? vertex_streams_.colors
+                                      : std::span<const uint8_t>(WHITE);
+    const std::span<const uint8_t> streams[VERTEX_BINDING_COUNT] = {
+        vertex_streams_.positions, vertex_streams_.attributes, colors};
 
-    memcpy(data, vertices_.data(), buffer_size);
-    vkUnmapMemory(device_, staging_buffer_memory);
+    VkDeviceSize buffer_size = 0;
+    for (uint32_t i = 0; i < VERTEX_BINDING_COUNT; ++i) {
+        vertex_stream_offsets_[i] = buffer_size;
+        buffer_size =
+            (buffer_size + streams[i].size() + 15) & ~VkDeviceSize{15};
+    }
 
     CreateBuffer(
         buffer_size,
@@ -1999,36 +2425,46 @@ VulkanApplication::CreateVertexBuffer()
         vertex_buffer_,
         vertex_buffer_memory_);
 
-    CopyBuffer(staging_buffer, vertex_buffer_, buffer_size);
-
-    vkDestroyBuffer(device_, staging_buffer, nullptr);
-    vkFreeMemory(device_, staging_buffer_memory, nullptr);
-}
-
-static std::string
-resolve_shader_path(const char *path)
-{
-    std::ostringstream out;
-    out << SHADERS_HOME_DIR << "/" << path;
-    return out.str();
+    for (uint32_t i = 0; i < VERTEX_BINDING_COUNT; ++i) {
+        transfer_uploads_->CopyToBuffer(vertex_buffer_,
+                                        streams[i].data(),
+                                        streams[i].size(),
+                                        vertex_stream_offsets_[i]);
+    }
+    transfer_uploads_->TransferOwnership(*graphics_uploads_,
+                                         vertex_buffer_,
+                                         VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 }
 
 void
 VulkanApplication::CreateGraphicsPipeline()
 {
-    const std::vector<char> vs_code =
-        read_file(resolve_shader_path("phong_vs.spv"));
-    const std::vector<char> ps_code =
-        read_file(resolve_shader_path("phong_fs.spv"));
+    const std::vector<char> vs_code = ReadShader("phong_vs.spv");
+    const std::vector<char> ps_code = ReadShader("phong_fs.spv");
 
     const VkShaderModule vsm = CreateShaderModule(vs_code);
     const VkShaderModule psm = CreateShaderModule(ps_code);
 
+    const VertexLayout &layout = vertex_streams_.layout;
+    const VkBool32 octahedral_normals =
+        layout.attributes == AttributeFormat::Packed;
+    VkSpecializationMapEntry specialization_entry{};
+    specialization_entry.constantID = 0;
+    specialization_entry.offset = 0;
+    specialization_entry.size = sizeof(octahedral_normals);
+    VkSpecializationInfo specialization_info{};
+    specialization_info.mapEntryCount = 1;
+    specialization_info.pMapEntries = &specialization_entry;
+    specialization_info.dataSize = sizeof(octahedral_normals);
+    specialization_info.pData = &octahedral_normals;
+
     VkPipelineShaderStageCreateInfo vs_stage_info{};
     vs_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vs_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
     vs_stage_info.module = vsm;
     vs_stage_info.pName = "main";
+    vs_stage_info.pSpecializationInfo = &specialization_info;
 
     VkPipelineShaderStageCreateInfo ps_stage_info{};
     ps_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -2039,14 +2475,14 @@ VulkanApplication::CreateGraphicsPipeline()
     const VkPipelineShaderStageCreateInfo shader_stages[] = {vs_stage_info,
                                                              ps_stage_info};
 
-    const auto binding_desc = vertex::get_binding_description();
-    const auto attribute_desc = vertex::get_attribute_descriptions();
+    const auto binding_desc = get_binding_descriptions(layout);
+    const auto attribute_desc = get_attribute_descriptions(layout);
 
     VkPipelineVertexInputStateCreateInfo vertex_input_info{};
     vertex_input_info.sType =
         VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_info.vertexBindingDescriptionCount = 1;
-    vertex_input_info.pVertexBindingDescriptions = &binding_desc;
+    vertex_input_info.vertexBindingDescriptionCount = binding_desc.size();
+    vertex_input_info.pVertexBindingDescriptions = binding_desc.data();
     vertex_input_info.vertexAttributeDescriptionCount = attribute_desc.size();
     vertex_input_info.pVertexAttributeDescriptions = attribute_desc.data();
 
@@ -2191,6 +2627,14 @@ VulkanApplication::IsDeviceSuitable(VkPhysicalDevice device) const
     VkPhysicalDeviceFeatures device_features;
     vkGetPhysicalDeviceFeatures(device, &device_features);
 
+    VkPhysicalDeviceVulkan12Features vulkan12_features{};
+    vulkan12_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &vulkan12_features;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+
     // return device_properties.deviceType ==
     //            VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
     //        device_features.geometryShader;
@@ -2207,7 +2651,8 @@ VulkanApplication::IsDeviceSuitable(VkPhysicalDevice device) const
     }
 
     return indices.is_complete() && extensions_supported &&
-           is_swap_chain_valid && device_features.samplerAnisotropy;
+           is_swap_chain_valid && device_features.samplerAnisotropy &&
+           vulkan12_features.timelineSemaphore;
 }
 
 void
@@ -2230,6 +2675,7 @@ VulkanApplication::PickPhysicalDevice()
         if (IsDeviceSuitable(device)) {
             physical_device_ = device;
             msaa_samples_ = get_max_usable_sample_count(device);
+            depth_format_ = find_depth_format(device);
             break;
         }
     }
@@ -2261,12 +2707,38 @@ VulkanApplication::CreateLogicalDevice()
         queue_create_infos.push_back(queue_create_info);
     }
 
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(physical_device_, &supported_features);
+
     VkPhysicalDeviceFeatures device_features{};
     device_features.samplerAnisotropy = VK_TRUE;
     device_features.sampleRateShading = VK_TRUE;
+    // Optional, enables the compute mip generator.
+    device_features.shaderStorageImageWriteWithoutFormat =
+        supported_features.shaderStorageImageWriteWithoutFormat;
+    storage_write_without_format_ =
+        supported_features.shaderStorageImageWriteWithoutFormat;
+    // Optional, allows loading cooked BC textures.
+    device_features.textureCompressionBC =
+        supported_features.textureCompressionBC;
+    texture_compression_bc_ = supported_features.textureCompressionBC;
+
+    // Optional, enables GPU meshlet and object culling.
+    draw_indirect_count_ = supports_indirect_count(physical_device_);
+    device_features.multiDrawIndirect = draw_indirect_count_;
+
+    VkPhysicalDeviceVulkan12Features vulkan12_features{};
+    vulkan12_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12_features.timelineSemaphore = VK_TRUE;
+    vulkan12_features.drawIndirectCount = draw_indirect_count_;
+    occlusion_culling_ =
+        draw_indirect_count_ &&
+        can_sample_depth(physical_device_, depth_format_, msaa_samples_);
 
     VkDeviceCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.pNext = &vulkan12_features;
 
     create_info.pQueueCreateInfos = queue_create_infos.data();
     create_info.queueCreateInfoCount =
@@ -2292,6 +2764,8 @@ VulkanApplication::CreateLogicalDevice()
         device_, indices.present_family.value(), 0, &present_queue_);
     vkGetDeviceQueue(
         device_, indices.transfer_family.value(), 0, &transfer_queue_);
+
+    allocator_ = std::make_unique<GpuAllocator>(device_, physical_device_);
 }
 
 void
@@ -2301,28 +2775,4 @@ VulkanApplication::CreateSurface()
         throw std::runtime_error("Failed to create surface");
     }
 }
-
-static void
-generate_normals(std::vector<vertex> &vertices,
-                 const std::vector<uint32_t> &indices)
-{
-    for (uint32_t i = 0u; i < indices.size(); i += 3u) {
-        auto &v0 = vertices.at(indices.at(i));
-        auto &v1 = vertices.at(indices.at(i + 1));
-        auto &v2 = vertices.at(indices.at(i + 2));
-
-        const auto e0 = v1.pos - v0.pos;
-        const auto e1 = v2.pos - v1.pos;
-
-        const auto n0 = glm::cross(e0, e1);
-
-        v0.normal += n0;
-        v1.normal += n0;
-        v2.normal += n0;
-    }
-
-    for (vertex &v : vertices) {
-        v.normal = glm::normalize(v.normal);
-    }
-}
 }  // namespace NEngine
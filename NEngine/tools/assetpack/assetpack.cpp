@@ -0,0 +1,71 @@
+// Asset packer. Stores files found below a root directory in one archive
+// that the engine maps at startup, each under its path relative to the root.
+//
+// Usage: assetpack [--lz4] <root> <output.npak> <file>...
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "asset_archive.h"
+
+using namespace NEngine;
+
+static void
+print_usage()
+{
+    std::cerr << "Usage: assetpack [--lz4] <root> <output.npak> <file>..."
+              << std::endl;
+}
+
+int
+main(int argc, char **argv)
+{
+    ArchiveCompression compression = ArchiveCompression::None;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--lz4") {
+            compression = ArchiveCompression::LZ4;
+        }
+        else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() < 3) {
+        print_usage();
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::filesystem::path root = args[0];
+    const std::string output = args[1];
+
+    try {
+        std::vector<ArchiveSource> sources;
+        uint64_t input_size = 0;
+        for (size_t i = 2; i < args.size(); ++i) {
+            const std::filesystem::path file = root / args[i];
+            sources.push_back({std::filesystem::path(args[i]).generic_string(),
+                               file.string(),
+                               compression});
+            input_size += std::filesystem::file_size(file);
+        }
+        write_asset_archive(output, sources);
+
+        const auto elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start);
+        std::cout << output << ": " << sources.size() << " files, "
+                  << input_size / 1024 << " KiB -> "
+                  << std::filesystem::file_size(output) / 1024 << " KiB in "
+                  << elapsed.count() << " ms" << std::endl;
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
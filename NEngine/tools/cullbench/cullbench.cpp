@@ -0,0 +1,152 @@
+// Times frustum culling of a scene of randomly placed, rotated and scaled
+// boxes: the per object test the renderer used before, the same test over
+// world space boxes, and SceneBvh. The camera looks from the edge of the
+// scene towards its center, so about a third of the objects are visible.
+//
+// Usage: cullbench [objects] [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.h"
+#include "job_system.h"
+#include "scene_bvh.h"
+
+using namespace NEngine;
+
+static double
+best_time(int iterations, const std::function<void()> &run)
+{
+    double best = 0.0;
+    for (int i = 0; i < iterations; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const double ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+        best = i == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+int
+main(int argc, char **argv)
+{
+    const size_t object_count =
+        argc > 1 ? std::max(std::stoul(argv[1]), 1ul) : 100000;
+    const int iterations = argc > 2 ? std::max(std::stoi(argv[2]), 1) : 20;
+
+    try {
+        // Objects fill a cube whose side grows with their count, so that
+        // their density stays the same.
+        const float side = 4.0f * std::cbrt(static_cast<float>(object_count));
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> coordinate(-side / 2,
+                                                         side / 2);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+        const MeshBounds mesh_bounds{glm::vec3(-0.5f), glm::vec3(0.5f)};
+        std::vector<glm::mat4> models(object_count);
+        for (glm::mat4 &model : models) {
+            glm::vec3 axis(unit(random), unit(random), unit(random));
+            if (glm::dot(axis, axis) < 1e-6f) {
+                axis = glm::vec3(0.0f, 1.0f, 0.0f);
+            }
+            model = glm::translate(glm::mat4(1.0f),
+                                   glm::vec3(coordinate(random),
+                                             coordinate(random),
+                                             coordinate(random)));
+            model = glm::rotate(model, 3.14159f * unit(random), axis);
+            model = glm::scale(model, glm::vec3(scale(random)));
+        }
+
+        const glm::mat4 view =
+            glm::lookAt(glm::vec3(0.0f, 0.0f, side / 2),
+                        glm::vec3(0.0f),
+                        glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 proj =
+            glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, side);
+        proj[1][1] *= -1;
+        const glm::mat4 view_proj = proj * view;
+        glm::vec4 planes[6];
+        extract_frustum_planes(view_proj, planes);
+
+        // Warm up the job system so that starting its threads is not timed.
+        get_job_system();
+
+        std::vector<uint8_t> per_object(object_count);
+        const double per_object_ms = best_time(iterations, [&] {
+            parallel_for(object_count, 256, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    glm::vec4 local[6];
+                    extract_frustum_planes(view_proj * models[i], local);
+                    per_object[i] = is_box_visible(local, mesh_bounds);
+                }
+            });
+        });
+
+        std::vector<MeshBounds> boxes(object_count);
+        const double bounds_ms = best_time(iterations, [&] {
+            for (size_t i = 0; i < object_count; ++i) {
+                boxes[i] = transform_bounds(models[i], mesh_bounds);
+            }
+        });
+
+        std::vector<uint32_t> brute_force;
+        const double brute_force_ms = best_time(iterations, [&] {
+            brute_force.clear();
+            for (size_t i = 0; i < object_count; ++i) {
+                if (is_box_visible(planes, boxes[i])) {
+                    brute_force.push_back(static_cast<uint32_t>(i));
+                }
+            }
+        });
+
+        SceneBvh bvh;
+        const double build_ms = best_time(iterations, [&] {
+            bvh.Build(boxes);
+        });
+        std::vector<uint32_t> visible;
+        const double cull_ms = best_time(iterations, [&] {
+            bvh.Cull(planes, visible);
+        });
+
+        std::sort(visible.begin(), visible.end());
+        const bool same = visible == brute_force;
+        const size_t per_object_visible =
+            std::count(per_object.begin(), per_object.end(), 1);
+
+        std::cout << object_count << " objects, "
+                  << get_job_system().GetThreadCount() << " threads"
+                  << std::endl;
+        std::cout << "per object planes, parallel: " << per_object_ms
+                  << " ms, " << per_object_visible << " visible" << std::endl;
+        std::cout << "world boxes:                 " << bounds_ms << " ms"
+                  << std::endl;
+        std::cout << "brute force over boxes:      " << brute_force_ms
+                  << " ms, " << brute_force.size() << " visible" << std::endl;
+        std::cout << "SceneBvh::Build:             " << build_ms << " ms"
+                  << std::endl;
+        std::cout << "SceneBvh::Cull:              " << cull_ms << " ms, "
+                  << visible.size() << " visible, "
+                  << (same ? "same as" : "DIFFERENT FROM")
+                  << " brute force" << std::endl;
+        if (!same) {
+            return 1;
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
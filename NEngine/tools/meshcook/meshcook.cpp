@@ -0,0 +1,164 @@
+// Offline mesh cooker. Imports an OBJ file, generates MikkTSpace tangents,
+// optimizes it for the vertex cache, overdraw and vertex fetch, and writes
+// the vertex streams and indices in the binary mesh format that the engine
+// maps directly, together with the meshlets the renderer culls on the GPU
+// and a chain of simplified levels of detail it picks from by screen-space
+// error. Meshes too large for 16 bit indices can be split into submeshes
+// that fit them.
+//
+// Usage: meshcook [--positions float32|float16|snorm16]
+//                 [--attributes float32|packed] [--colors] [--split-16bit]
+//                 <input.obj> <output.nmesh>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "index_format.h"
+#include "mesh_file.h"
+#include "mesh_normals.h"
+#include "mesh_optimizer.h"
+#include "obj_import.h"
+#include "vertex_format.h"
+
+using namespace NEngine;
+
+struct CookOptions
+{
+    VertexLayout layout;
+    bool split16Bit = false;
+    std::string input;
+    std::string output;
+};
+
+static void
+print_usage()
+{
+    std::cerr << "Usage: meshcook [--positions float32|float16|snorm16] "
+                 "[--attributes float32|packed] [--colors] [--split-16bit] "
+                 "<input.obj> <output.nmesh>"
+              << std::endl;
+}
+
+static bool
+parse_options(int argc, char **argv, CookOptions &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--positions" && i + 1 < argc) {
+            const std::string format = argv[++i];
+            if (format == "float32") {
+                options.layout.positions = PositionFormat::Float32;
+            }
+            else if (format == "float16") {
+                options.layout.positions = PositionFormat::Float16;
+            }
+            else if (format == "snorm16") {
+                options.layout.positions = PositionFormat::Snorm16;
+            }
+            else {
+                return false;
+            }
+        }
+        else if (arg == "--attributes" && i + 1 < argc) {
+            const std::string format = argv[++i];
+            if (format == "float32") {
+                options.layout.attributes = AttributeFormat::Float32;
+            }
+            else if (format == "packed") {
+                options.layout.attributes = AttributeFormat::Packed;
+            }
+            else {
+                return false;
+            }
+        }
+        else if (arg == "--colors") {
+            options.layout.colors = true;
+        }
+        else if (arg == "--split-16bit") {
+            options.split16Bit = true;
+        }
+        else if (options.input.empty()) {
+            options.input = arg;
+        }
+        else if (options.output.empty()) {
+            options.output = arg;
+        }
+        else {
+            return false;
+        }
+    }
+
+    return !options.input.empty() && !options.output.empty();
+}
+
+int
+main(int argc, char **argv)
+{
+    CookOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    try {
+        MeshData mesh = import_obj(options.input);
+        generate_tangents(mesh);
+
+        const uint32_t vertex_count =
+            static_cast<uint32_t>(mesh.vertices.size());
+        const VertexCacheStats before =
+            analyze_vertex_cache(mesh.indices, vertex_count);
+        optimize_mesh(mesh);
+        // Level 0 is the imported mesh; the generated levels follow it in
+        // the index buffer and are left out of the comparison.
+        size_t lod0_index_count = 0;
+        for (uint32_t s = 0; s < mesh.lods[0].submeshCount; ++s) {
+            lod0_index_count += mesh.submeshes[s].indexCount;
+        }
+        const VertexCacheStats after = analyze_vertex_cache(
+            std::span(mesh.indices).first(lod0_index_count), vertex_count);
+        if (options.split16Bit) {
+            split_for_16bit_indices(mesh);
+        }
+
+        write_mesh_file(options.output, mesh, options.layout);
+        const uint32_t index_size =
+            get_index_size(encode_index_buffer(mesh).indexType);
+
+        const uint32_t vertex_size =
+            get_position_stride(options.layout.positions) +
+            get_attribute_stride(options.layout.attributes) +
+            (options.layout.colors ? COLOR_STRIDE : 0);
+        const auto elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start);
+        std::cout << options.input << " -> " << options.output << ": "
+                  << mesh.vertices.size() << " vertices of " << vertex_size
+                  << " bytes, " << mesh.indices.size() / 3
+                  << " triangles with " << index_size * 8 << " bit indices, "
+                  << mesh.submeshes.size() << " submeshes, "
+                  << mesh.meshlets.size() << " meshlets in "
+                  << elapsed.count() << " ms" << std::endl;
+        std::cout << "ACMR " << before.acmr << " -> " << after.acmr
+                  << ", ATVR " << before.atvr << " -> " << after.atvr
+                  << std::endl;
+        for (size_t l = 0; l < mesh.lods.size(); ++l) {
+            const MeshLod &lod = mesh.lods[l];
+            size_t index_count = 0;
+            for (uint32_t s = 0; s < lod.submeshCount; ++s) {
+                index_count += mesh.submeshes[lod.firstSubmesh + s].indexCount;
+            }
+            std::cout << "LOD " << l << ": " << index_count / 3
+                      << " triangles, " << lod.meshletCount
+                      << " meshlets, error " << lod.error << std::endl;
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
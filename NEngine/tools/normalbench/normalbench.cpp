@@ -0,0 +1,167 @@
+// Compares generate_normals with the scalar loop it replaced and times
+// generate_tangents with and without submeshes to spread over threads.
+// Without an input file a tessellated sphere of about two million triangles
+// in 16 submeshes is generated in memory.
+//
+// Usage: normalbench [input.obj] [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "mesh_normals.h"
+#include "obj_import.h"
+
+using namespace NEngine;
+
+// The importer's normal generation before it moved to mesh_normals.
+static void
+generate_normals_reference(std::vector<vertex> &vertices,
+                           const std::vector<uint32_t> &indices)
+{
+    for (uint32_t i = 0u; i < indices.size(); i += 3u) {
+        auto &v0 = vertices.at(indices.at(i));
+        auto &v1 = vertices.at(indices.at(i + 1));
+        auto &v2 = vertices.at(indices.at(i + 2));
+
+        const auto e0 = v1.pos - v0.pos;
+        const auto e1 = v2.pos - v1.pos;
+
+        const auto n0 = glm::cross(e0, e1);
+
+        v0.normal += n0;
+        v1.normal += n0;
+        v2.normal += n0;
+    }
+
+    for (vertex &v : vertices) {
+        v.normal = glm::normalize(v.normal);
+    }
+}
+
+// UV sphere with one submesh per band of rings.
+static MeshData
+make_sphere(uint32_t rings, uint32_t segments, uint32_t bands)
+{
+    const float pi = 3.14159265358979f;
+    MeshData mesh;
+    for (uint32_t r = 0; r <= rings; ++r) {
+        const float theta = pi * static_cast<float>(r) / rings;
+        for (uint32_t s = 0; s <= segments; ++s) {
+            const float phi = 2.0f * pi * static_cast<float>(s) / segments;
+            vertex v{};
+            v.pos = {std::sin(theta) * std::cos(phi),
+                     std::cos(theta),
+                     std::sin(theta) * std::sin(phi)};
+            v.color = {1.0f, 1.0f, 1.0f};
+            v.tex_coord = {static_cast<float>(s) / segments,
+                           static_cast<float>(r) / rings};
+            mesh.vertices.push_back(v);
+        }
+    }
+
+    for (uint32_t r = 0; r < rings; ++r) {
+        if (r % (rings / bands) == 0) {
+            mesh.submeshes.push_back(
+                {static_cast<uint32_t>(mesh.indices.size()), 0, 0, {}});
+        }
+        for (uint32_t s = 0; s < segments; ++s) {
+            const uint32_t a = r * (segments + 1) + s;
+            const uint32_t b = a + segments + 1;
+            mesh.indices.insert(mesh.indices.end(), {a, b, b + 1});
+            mesh.indices.insert(mesh.indices.end(), {a, b + 1, a + 1});
+            mesh.submeshes.back().indexCount += 6;
+        }
+    }
+    mesh.bounds = compute_bounds(mesh.vertices, mesh.indices);
+    return mesh;
+}
+
+static double
+best_time(int iterations, const std::function<void()> &run)
+{
+    double best = 0.0;
+    for (int i = 0; i < iterations; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const double ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+        best = i == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+int
+main(int argc, char **argv)
+{
+    const int iterations = argc > 2 ? std::max(std::stoi(argv[2]), 1) : 3;
+
+    try {
+        const MeshData source =
+            argc > 1 ? import_obj(argv[1]) : make_sphere(1024, 1024, 16);
+
+        MeshData reference;
+        const double reference_ms = best_time(iterations, [&] {
+            reference = source;
+            generate_normals_reference(reference.vertices, reference.indices);
+        });
+        MeshData mesh;
+        const double normals_ms = best_time(iterations, [&] {
+            mesh = source;
+            generate_normals(mesh.vertices, mesh.indices);
+        });
+
+        // Both include the copy of the source mesh; time it on its own.
+        MeshData copy;
+        const double copy_ms = best_time(iterations, [&] { copy = source; });
+
+        float max_angle = 0.0f;
+        for (size_t v = 0; v < mesh.vertices.size(); ++v) {
+            const float cosine = glm::dot(mesh.vertices[v].normal,
+                                          reference.vertices[v].normal);
+            if (!std::isnan(cosine)) {
+                max_angle = std::max(
+                    max_angle, std::acos(std::clamp(cosine, -1.0f, 1.0f)));
+            }
+        }
+
+        MeshData single = mesh;
+        single.submeshes.clear();
+        MeshData tangents;
+        const double single_ms = best_time(iterations, [&] {
+            tangents = single;
+            generate_tangents(tangents);
+        });
+        const double tangents_ms = best_time(iterations, [&] {
+            tangents = mesh;
+            generate_tangents(tangents);
+        });
+
+        std::cout << mesh.indices.size() / 3 << " triangles, "
+                  << mesh.vertices.size() << " vertices, "
+                  << mesh.submeshes.size() << " submeshes" << std::endl;
+        std::cout << "scalar normals:   " << reference_ms - copy_ms << " ms"
+                  << std::endl;
+        std::cout << "generate_normals: " << normals_ms - copy_ms
+                  << " ms, max difference " << glm::degrees(max_angle)
+                  << " degrees" << std::endl;
+        std::cout << "speedup: "
+                  << (reference_ms - copy_ms) / (normals_ms - copy_ms) << "x"
+                  << std::endl;
+        std::cout << "tangents, one submesh: " << single_ms - copy_ms
+                  << " ms" << std::endl;
+        std::cout << "tangents, per submesh: " << tangents_ms - copy_ms
+                  << " ms, " << tangents.vertices.size() << " vertices"
+                  << std::endl;
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
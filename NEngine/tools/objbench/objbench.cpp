@@ -0,0 +1,162 @@
+// Compares import_obj with the tinyobjloader and std::unordered_map path it
+// replaced. Without an input file a tessellated sphere of a little over a
+// million triangles is generated first.
+//
+// Usage: objbench [input.obj] [iterations]
+
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "obj_import.h"
+
+using namespace NEngine;
+
+static MeshData
+import_obj_reference(const std::string &path)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn;
+    std::string err;
+
+    if (!tinyobj::LoadObj(
+            &attrib, &shapes, &materials, &warn, &err, path.c_str())) {
+        throw std::runtime_error("Failed to load model. " + warn + err);
+    }
+
+    MeshData mesh;
+    std::unordered_map<vertex, uint32_t> unique_vertices{};
+    for (const auto &shape : shapes) {
+        for (const auto &index : shape.mesh.indices) {
+            vertex v{};
+            v.pos = {attrib.vertices[3 * index.vertex_index + 0],
+                     attrib.vertices[3 * index.vertex_index + 1],
+                     attrib.vertices[3 * index.vertex_index + 2]};
+            if (index.texcoord_index >= 0) {
+                v.tex_coord = {
+                    attrib.texcoords[2 * index.texcoord_index + 0],
+                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+            }
+            if (index.normal_index >= 0) {
+                v.normal = {attrib.normals[3 * index.normal_index + 0],
+                            attrib.normals[3 * index.normal_index + 1],
+                            attrib.normals[3 * index.normal_index + 2]};
+            }
+            v.color = {1.0f, 1.0f, 1.0f};
+
+            const auto [it, inserted] = unique_vertices.try_emplace(
+                v, static_cast<uint32_t>(mesh.vertices.size()));
+            if (inserted) {
+                mesh.vertices.push_back(v);
+            }
+            mesh.indices.push_back(it->second);
+        }
+    }
+    return mesh;
+}
+
+// UV sphere written as quads, so the importer also has to triangulate.
+static void
+write_sphere(const std::string &path, uint32_t rings, uint32_t segments)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    const float pi = 3.14159265358979f;
+    for (uint32_t r = 0; r <= rings; ++r) {
+        const float theta = pi * static_cast<float>(r) / rings;
+        for (uint32_t s = 0; s <= segments; ++s) {
+            const float phi = 2.0f * pi * static_cast<float>(s) / segments;
+            const float x = std::sin(theta) * std::cos(phi);
+            const float y = std::cos(theta);
+            const float z = std::sin(theta) * std::sin(phi);
+            fprintf(file, "v %f %f %f\n", x, y, z);
+            fprintf(file, "vt %f %f\n",
+                    static_cast<float>(s) / segments,
+                    static_cast<float>(r) / rings);
+            fprintf(file, "vn %f %f %f\n", x, y, z);
+        }
+    }
+
+    for (uint32_t r = 0; r < rings; ++r) {
+        for (uint32_t s = 0; s < segments; ++s) {
+            const uint32_t a = r * (segments + 1) + s + 1;
+            const uint32_t b = a + segments + 1;
+            fprintf(file,
+                    "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                    a, a, a, b, b, b, b + 1, b + 1, b + 1, a + 1, a + 1,
+                    a + 1);
+        }
+    }
+
+    fclose(file);
+}
+
+static double
+best_time(int iterations,
+          const std::function<MeshData()> &import,
+          MeshData &mesh)
+{
+    double best = 0.0;
+    for (int i = 0; i < iterations; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        mesh = import();
+        const double ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+        best = i == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+int
+main(int argc, char **argv)
+{
+    std::string path;
+    if (argc > 1) {
+        path = argv[1];
+    }
+    else {
+        path = (std::filesystem::temp_directory_path() / "objbench_sphere.obj")
+                   .string();
+        write_sphere(path, 512, 1024);
+    }
+    const int iterations = argc > 2 ? std::max(std::stoi(argv[2]), 1) : 3;
+
+    try {
+        MeshData mesh;
+        MeshData reference;
+        const double fast_ms =
+            best_time(iterations, [&] { return import_obj(path); }, mesh);
+        const double reference_ms = best_time(
+            iterations, [&] { return import_obj_reference(path); }, reference);
+
+        std::cout << path << ": "
+                  << std::filesystem::file_size(path) / (1024 * 1024)
+                  << " MiB, " << mesh.indices.size() / 3 << " triangles"
+                  << std::endl;
+        std::cout << "import_obj:             " << fast_ms << " ms, "
+                  << mesh.vertices.size() << " vertices" << std::endl;
+        std::cout << "tinyobj + unordered_map: " << reference_ms << " ms, "
+                  << reference.vertices.size() << " vertices" << std::endl;
+        std::cout << "speedup: " << reference_ms / fast_ms << "x" << std::endl;
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,433 @@
+#include "bc_encoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace NEngine {
+
+// Weights of the 4-bit BC7 index precision, in 1/64ths.
+static constexpr uint8_t BC7_WEIGHTS[16] =
+    {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Finds the mean and the direction of largest variance of `N` channel
+// points. Colors in a block tend to lie close to a line, and its extent
+// along that direction gives good initial endpoints.
+template <int N>
+static void
+principal_axis(const float (&points)[16][N], float (&mean)[N], float (&axis)[N])
+{
+    for (int c = 0; c < N; ++c) {
+        mean[c] = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            mean[c] += points[i][c];
+        }
+        mean[c] /= 16.0f;
+    }
+
+    float covariance[N][N] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int a = 0; a < N; ++a) {
+            for (int b = 0; b < N; ++b) {
+                covariance[a][b] +=
+                    (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // Power iteration converges quickly for the small matrices here.
+    for (int c = 0; c < N; ++c) {
+        axis[c] = 1.0f;
+    }
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[N] = {};
+        for (int a = 0; a < N; ++a) {
+            for (int b = 0; b < N; ++b) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+        }
+        float length = 0.0f;
+        for (int c = 0; c < N; ++c) {
+            length += next[c] * next[c];
+        }
+        if (length < 1e-12f) {
+            break;
+        }
+        length = std::sqrt(length);
+        for (int c = 0; c < N; ++c) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float length = 0.0f;
+    for (int c = 0; c < N; ++c) {
+        length += axis[c] * axis[c];
+    }
+    length = std::sqrt(length);
+    for (int c = 0; c < N; ++c) {
+        axis[c] /= length;
+    }
+}
+
+// Endpoints at the extremes of the projection of the points onto `axis`.
+template <int N>
+static void
+find_endpoints(const float (&points)[16][N], float (&lo)[N], float (&hi)[N])
+{
+    float mean[N];
+    float axis[N];
+    principal_axis(points, mean, axis);
+
+    float min_t = 0.0f;
+    float max_t = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < N; ++c) {
+            t += (points[i][c] - mean[c]) * axis[c];
+        }
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+
+    for (int c = 0; c < N; ++c) {
+        lo[c] = std::clamp(mean[c] + axis[c] * min_t, 0.0f, 255.0f);
+        hi[c] = std::clamp(mean[c] + axis[c] * max_t, 0.0f, 255.0f);
+    }
+}
+
+template <int N>
+static float
+distance_squared(const float *a, const float *b)
+{
+    float distance = 0.0f;
+    for (int c = 0; c < N; ++c) {
+        distance += (a[c] - b[c]) * (a[c] - b[c]);
+    }
+    return distance;
+}
+
+static uint16_t
+to_565(const float *color)
+{
+    const auto quantize = [](float value, float max) {
+        return static_cast<uint16_t>(
+            std::clamp(std::lround(value * max / 255.0f), 0l, lround(max)));
+    };
+    return static_cast<uint16_t>(quantize(color[0], 31.0f) << 11 |
+                                 quantize(color[1], 63.0f) << 5 |
+                                 quantize(color[2], 31.0f));
+}
+
+static void
+from_565(uint16_t value, float *color)
+{
+    const uint32_t r = value >> 11 & 31;
+    const uint32_t g = value >> 5 & 63;
+    const uint32_t b = value & 31;
+    color[0] = static_cast<float>(r << 3 | r >> 2);
+    color[1] = static_cast<float>(g << 2 | g >> 4);
+    color[2] = static_cast<float>(b << 3 | b >> 2);
+}
+
+// Picks the closest palette entry for every texel. Returns the total squared
+// error. Endpoints are swapped if necessary to stay in four color mode.
+static float
+fit_bc1(const float (&points)[16][3],
+        uint16_t &c0,
+        uint16_t &c1,
+        uint32_t &indices)
+{
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    indices = 0;
+    float palette[4][3];
+    from_565(c0, palette[0]);
+    from_565(c1, palette[1]);
+    if (c0 == c1) {
+        // Three color mode, index 0 is the only safe choice.
+        float error = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            error += distance_squared<3>(points[i], palette[0]);
+        }
+        return error;
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    float error = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        uint32_t best = 0;
+        float best_distance = distance_squared<3>(points[i], palette[0]);
+        for (uint32_t j = 1; j < 4; ++j) {
+            const float distance = distance_squared<3>(points[i], palette[j]);
+            if (distance < best_distance) {
+                best = j;
+                best_distance = distance;
+            }
+        }
+        indices |= best << (2 * i);
+        error += best_distance;
+    }
+
+    return error;
+}
+
+void
+encode_bc1_block(const uint8_t *texels, uint8_t *out)
+{
+    float points[16][3];
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            points[i][c] = texels[4 * i + c];
+        }
+    }
+
+    float lo[3];
+    float hi[3];
+    find_endpoints(points, lo, hi);
+
+    uint16_t c0 = to_565(hi);
+    uint16_t c1 = to_565(lo);
+    uint32_t indices = 0;
+    float error = fit_bc1(points, c0, c1, indices);
+
+    // One least squares pass: with the indices fixed, solve for the
+    // endpoints that minimize the error and keep them if they do.
+    static constexpr float WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float alpha2 = 0.0f;
+    float beta2 = 0.0f;
+    float alphabeta = 0.0f;
+    float alphax[3] = {};
+    float betax[3] = {};
+    for (int i = 0; i < 16; ++i) {
+        const float a = WEIGHTS[indices >> (2 * i) & 3];
+        const float b = 1.0f - a;
+        alpha2 += a * a;
+        beta2 += b * b;
+        alphabeta += a * b;
+        for (int c = 0; c < 3; ++c) {
+            alphax[c] += a * points[i][c];
+            betax[c] += b * points[i][c];
+        }
+    }
+
+    const float determinant = alpha2 * beta2 - alphabeta * alphabeta;
+    if (std::abs(determinant) > 1e-6f) {
+        float e0[3];
+        float e1[3];
+        for (int c = 0; c < 3; ++c) {
+            e0[c] = std::clamp(
+                (alphax[c] * beta2 - betax[c] * alphabeta) / determinant,
+                0.0f,
+                255.0f);
+            e1[c] = std::clamp(
+                (betax[c] * alpha2 - alphax[c] * alphabeta) / determinant,
+                0.0f,
+                255.0f);
+        }
+
+        uint16_t refined_c0 = to_565(e0);
+        uint16_t refined_c1 = to_565(e1);
+        uint32_t refined_indices = 0;
+        const float refined_error =
+            fit_bc1(points, refined_c0, refined_c1, refined_indices);
+        if (refined_error < error) {
+            c0 = refined_c0;
+            c1 = refined_c1;
+            indices = refined_indices;
+        }
+    }
+
+    memcpy(out, &c0, 2);
+    memcpy(out + 2, &c1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+static void
+encode_bc4_block(const uint8_t *values, uint8_t *out)
+{
+    const auto [min_it, max_it] = std::minmax_element(values, values + 16);
+    const int lo = *min_it;
+    const int hi = *max_it;
+
+    // red0 > red1 selects the eight value mode: index 0 is red0, index 1 is
+    // red1 and indices 2 to 7 interpolate from red0 towards red1.
+    out[0] = static_cast<uint8_t>(hi);
+    out[1] = static_cast<uint8_t>(lo);
+
+    uint64_t indices = 0;
+    if (hi > lo) {
+        for (int i = 0; i < 16; ++i) {
+            const int step = (2 * 7 * (values[i] - lo) + (hi - lo)) /
+                             (2 * (hi - lo));
+            const uint64_t index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+            indices |= index << (3 * i);
+        }
+    }
+
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+void
+encode_bc5_block(const uint8_t *texels, uint8_t *out)
+{
+    uint8_t red[16];
+    uint8_t green[16];
+    for (int i = 0; i < 16; ++i) {
+        red[i] = texels[4 * i];
+        green[i] = texels[4 * i + 1];
+    }
+
+    encode_bc4_block(red, out);
+    encode_bc4_block(green, out + 8);
+}
+
+struct BitWriter
+{
+    uint64_t bits[2] = {};
+    uint32_t position = 0;
+
+    void
+    Write(uint32_t value, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; ++i, ++position) {
+            bits[position / 64] |= static_cast<uint64_t>(value >> i & 1)
+                                   << (position % 64);
+        }
+    }
+};
+
+void
+encode_bc7_block(const uint8_t *texels, uint8_t *out)
+{
+    float points[16][4];
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            points[i][c] = texels[4 * i + c];
+        }
+    }
+
+    float endpoints[2][4];
+    find_endpoints(points, endpoints[0], endpoints[1]);
+
+    // Mode 6 stores 7 bits per channel plus one shared low bit per endpoint.
+    // Pick the low bit that brings each endpoint closest to its ideal value.
+    uint32_t quantized[2][4];
+    uint32_t p_bits[2];
+    for (int e = 0; e < 2; ++e) {
+        float best_error = INFINITY;
+        for (uint32_t p = 0; p < 2; ++p) {
+            uint32_t candidate[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c) {
+                candidate[c] = static_cast<uint32_t>(std::clamp(
+                    std::lround((endpoints[e][c] - p) / 2.0f), 0l, 127l));
+                const float value = static_cast<float>(candidate[c] << 1 | p);
+                error += (value - endpoints[e][c]) * (value - endpoints[e][c]);
+            }
+            if (error < best_error) {
+                best_error = error;
+                p_bits[e] = p;
+                std::copy(candidate, candidate + 4, quantized[e]);
+            }
+        }
+    }
+
+    float palette[16][4];
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            const uint32_t e0 = quantized[0][c] << 1 | p_bits[0];
+            const uint32_t e1 = quantized[1][c] << 1 | p_bits[1];
+            palette[i][c] = static_cast<float>(
+                ((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6);
+        }
+    }
+
+    uint32_t indices[16];
+    for (int i = 0; i < 16; ++i) {
+        indices[i] = 0;
+        float best_distance = distance_squared<4>(points[i], palette[0]);
+        for (uint32_t j = 1; j < 16; ++j) {
+            const float distance = distance_squared<4>(points[i], palette[j]);
+            if (distance < best_distance) {
+                indices[i] = j;
+                best_distance = distance;
+            }
+        }
+    }
+
+    // The most significant bit of the first index is implicitly zero.
+    if (indices[0] & 8) {
+        std::swap(quantized[0], quantized[1]);
+        std::swap(p_bits[0], p_bits[1]);
+        for (uint32_t &index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    BitWriter writer;
+    writer.Write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        writer.Write(quantized[0][c], 7);
+        writer.Write(quantized[1][c], 7);
+    }
+    writer.Write(p_bits[0], 1);
+    writer.Write(p_bits[1], 1);
+    writer.Write(indices[0], 3);
+    for (int i = 1; i < 16; ++i) {
+        writer.Write(indices[i], 4);
+    }
+
+    memcpy(out, writer.bits, 16);
+}
+
+std::vector<uint8_t>
+compress_image(const uint8_t *rgba,
+               uint32_t width,
+               uint32_t height,
+               BlockFormat format)
+{
+    const uint32_t block_size = format == BlockFormat::BC1 ? 8 : 16;
+    const uint32_t blocks_x = (width + 3) / 4;
+    const uint32_t blocks_y = (height + 3) / 4;
+    std::vector<uint8_t> out(static_cast<size_t>(blocks_x) * blocks_y *
+                             block_size);
+
+    uint8_t texels[64];
+    uint8_t *block = out.data();
+    for (uint32_t by = 0; by < blocks_y; ++by) {
+        for (uint32_t bx = 0; bx < blocks_x; ++bx, block += block_size) {
+            for (uint32_t y = 0; y < 4; ++y) {
+                for (uint32_t x = 0; x < 4; ++x) {
+                    const uint32_t sx = std::min(bx * 4 + x, width - 1);
+                    const uint32_t sy = std::min(by * 4 + y, height - 1);
+                    memcpy(texels + 4 * (y * 4 + x),
+                           rgba + 4 * (static_cast<size_t>(sy) * width + sx),
+                           4);
+                }
+            }
+
+            switch (format) {
+                case BlockFormat::BC1:
+                    encode_bc1_block(texels, block);
+                    break;
+                case BlockFormat::BC5:
+                    encode_bc5_block(texels, block);
+                    break;
+                case BlockFormat::BC7:
+                    encode_bc7_block(texels, block);
+                    break;
+            }
+        }
+    }
+
+    return out;
+}
+}  // namespace NEngine
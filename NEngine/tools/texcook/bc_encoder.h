@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace NEngine {
+
+enum class BlockFormat
+{
+    BC1,
+    BC5,
+    BC7,
+};
+
+// Encoders for a single 4x4 block of RGBA8 texels stored row by row.
+// BC1 always uses the opaque four color mode, BC5 encodes the red and green
+// channels and BC7 uses mode 6, which covers RGBA with one subset.
+void encode_bc1_block(const uint8_t *texels, uint8_t *out);
+void encode_bc5_block(const uint8_t *texels, uint8_t *out);
+void encode_bc7_block(const uint8_t *texels, uint8_t *out);
+
+// Compresses a whole RGBA8 image. Partial blocks at the right and bottom
+// edges repeat the last row and column.
+std::vector<uint8_t> compress_image(const uint8_t *rgba,
+                                    uint32_t width,
+                                    uint32_t height,
+                                    BlockFormat format);
+}  // namespace NEngine
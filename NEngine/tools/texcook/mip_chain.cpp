@@ -0,0 +1,145 @@
+#include "mip_chain.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define NENGINE_TEXCOOK_SSE 1
+#endif
+
+namespace NEngine {
+
+static float
+srgb_to_linear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f
+                             : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float
+linear_to_srgb(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f
+                               : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+FloatImage
+decode_rgba8(const uint8_t *rgba, uint32_t width, uint32_t height, bool srgb)
+{
+    std::array<float, 256> color_table;
+    std::array<float, 256> alpha_table;
+    for (uint32_t i = 0; i < 256; ++i) {
+        alpha_table[i] = static_cast<float>(i) / 255.0f;
+        color_table[i] = srgb ? srgb_to_linear(alpha_table[i]) : alpha_table[i];
+    }
+
+    FloatImage image;
+    image.width = width;
+    image.height = height;
+    image.texels.resize(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < image.texels.size(); i += 4) {
+        image.texels[i] = color_table[rgba[i]];
+        image.texels[i + 1] = color_table[rgba[i + 1]];
+        image.texels[i + 2] = color_table[rgba[i + 2]];
+        image.texels[i + 3] = alpha_table[rgba[i + 3]];
+    }
+
+    return image;
+}
+
+std::vector<uint8_t>
+encode_rgba8(const FloatImage &image, bool srgb)
+{
+    const auto quantize = [](float value) {
+        return static_cast<uint8_t>(
+            std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    };
+
+    std::vector<uint8_t> rgba(image.texels.size());
+    for (size_t i = 0; i < rgba.size(); ++i) {
+        const float value = image.texels[i];
+        rgba[i] = quantize(srgb && i % 4 != 3 ? linear_to_srgb(value) : value);
+    }
+
+    return rgba;
+}
+
+static void
+renormalize(FloatImage &image)
+{
+    for (size_t i = 0; i < image.texels.size(); i += 4) {
+        float *texel = &image.texels[i];
+        const float x = texel[0] * 2.0f - 1.0f;
+        const float y = texel[1] * 2.0f - 1.0f;
+        const float z = texel[2] * 2.0f - 1.0f;
+        const float length = std::sqrt(x * x + y * y + z * z);
+        if (length > 1e-6f) {
+            texel[0] = x / length * 0.5f + 0.5f;
+            texel[1] = y / length * 0.5f + 0.5f;
+            texel[2] = z / length * 0.5f + 0.5f;
+        }
+    }
+}
+
+FloatImage
+downsample(const FloatImage &image, bool normalMap)
+{
+    FloatImage result;
+    result.width = std::max(image.width / 2, 1u);
+    result.height = std::max(image.height / 2, 1u);
+    result.texels.resize(static_cast<size_t>(result.width) * result.height *
+                         4);
+
+    const uint32_t last_x = image.width - 1;
+    const uint32_t last_y = image.height - 1;
+
+    for (uint32_t y = 0; y < result.height; ++y) {
+        const float *row0 =
+            &image.texels[static_cast<size_t>(std::min(2 * y, last_y)) *
+                          image.width * 4];
+        const float *row1 =
+            &image.texels[static_cast<size_t>(std::min(2 * y + 1, last_y)) *
+                          image.width * 4];
+        float *out = &result.texels[static_cast<size_t>(y) * result.width * 4];
+
+        for (uint32_t x = 0; x < result.width; ++x, out += 4) {
+            const size_t x0 = static_cast<size_t>(std::min(2 * x, last_x)) * 4;
+            const size_t x1 =
+                static_cast<size_t>(std::min(2 * x + 1, last_x)) * 4;
+#ifdef NENGINE_TEXCOOK_SSE
+            // One texel is exactly one SSE register.
+            const __m128 sum =
+                _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0),
+                                      _mm_loadu_ps(row0 + x1)),
+                           _mm_add_ps(_mm_loadu_ps(row1 + x0),
+                                      _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for (int c = 0; c < 4; ++c) {
+                out[c] = 0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] +
+                                  row1[x1 + c]);
+            }
+#endif
+        }
+    }
+
+    if (normalMap) {
+        renormalize(result);
+    }
+
+    return result;
+}
+
+std::vector<FloatImage>
+build_mip_chain(FloatImage image, bool normalMap)
+{
+    std::vector<FloatImage> levels;
+    levels.push_back(std::move(image));
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        levels.push_back(downsample(levels.back(), normalMap));
+    }
+    return levels;
+}
+}  // namespace NEngine
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace NEngine {
+
+// Linear RGBA image with four floats per texel.
+struct FloatImage
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<float> texels;
+};
+
+FloatImage decode_rgba8(const uint8_t *rgba,
+                        uint32_t width,
+                        uint32_t height,
+                        bool srgb);
+std::vector<uint8_t> encode_rgba8(const FloatImage &image, bool srgb);
+
+// Halves the image with a 2x2 box filter in linear space. Sizes follow the
+// Vulkan rule max(1, size / 2) and reads past the edge are clamped, like the
+// GPU mip paths. Normal maps are renormalized after filtering.
+FloatImage downsample(const FloatImage &image, bool normalMap);
+
+// Level 0 followed by every level down to 1x1.
+std::vector<FloatImage> build_mip_chain(FloatImage image, bool normalMap);
+}  // namespace NEngine
@@ -0,0 +1,188 @@
+// Offline texture cooker. Decodes an image, builds its mip chain on the CPU,
+// block-compresses every level and writes a KTX2 file that the engine can
+// copy straight into an image.
+//
+// Usage: texcook [--format bc1|bc5|bc7|rgba8] [--linear] [--normal-map]
+//                <input> <output.ktx2>
+
+#include <stb_image.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "bc_encoder.h"
+#include "mip_chain.h"
+#include "texture_file.h"
+
+using namespace NEngine;
+
+enum class CookFormat
+{
+    BC1,
+    BC5,
+    BC7,
+    RGBA8,
+};
+
+struct CookOptions
+{
+    CookFormat format = CookFormat::BC7;
+    bool srgb = true;
+    bool normalMap = false;
+    std::string input;
+    std::string output;
+};
+
+static void
+print_usage()
+{
+    std::cerr << "Usage: texcook [--format bc1|bc5|bc7|rgba8] [--linear] "
+                 "[--normal-map] <input> <output.ktx2>"
+              << std::endl;
+}
+
+static bool
+parse_options(int argc, char **argv, CookOptions &options)
+{
+    bool has_format = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) {
+            const std::string format = argv[++i];
+            has_format = true;
+            if (format == "bc1") {
+                options.format = CookFormat::BC1;
+            }
+            else if (format == "bc5") {
+                options.format = CookFormat::BC5;
+            }
+            else if (format == "bc7") {
+                options.format = CookFormat::BC7;
+            }
+            else if (format == "rgba8") {
+                options.format = CookFormat::RGBA8;
+            }
+            else {
+                return false;
+            }
+        }
+        else if (arg == "--linear") {
+            options.srgb = false;
+        }
+        else if (arg == "--normal-map") {
+            options.normalMap = true;
+            options.srgb = false;
+        }
+        else if (options.input.empty()) {
+            options.input = arg;
+        }
+        else if (options.output.empty()) {
+            options.output = arg;
+        }
+        else {
+            return false;
+        }
+    }
+
+    if (options.normalMap && !has_format) {
+        options.format = CookFormat::BC5;
+    }
+    // BC5 has no sRGB variant.
+    if (options.format == CookFormat::BC5) {
+        options.srgb = false;
+    }
+
+    return !options.input.empty() && !options.output.empty();
+}
+
+static VkFormat
+get_vk_format(const CookOptions &options)
+{
+    switch (options.format) {
+        case CookFormat::BC1:
+            return options.srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK
+                                : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case CookFormat::BC5:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+        case CookFormat::BC7:
+            return options.srgb ? VK_FORMAT_BC7_SRGB_BLOCK
+                                : VK_FORMAT_BC7_UNORM_BLOCK;
+        default:
+            return options.srgb ? VK_FORMAT_R8G8B8A8_SRGB
+                                : VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    CookOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    stbi_uc *pixels = stbi_load(
+        options.input.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        std::cerr << "Failed to load " << options.input << ": "
+                  << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+
+    std::vector<FloatImage> mips = build_mip_chain(
+        decode_rgba8(pixels, width, height, options.srgb), options.normalMap);
+    stbi_image_free(pixels);
+
+    TextureFile texture;
+    texture.format = get_vk_format(options);
+    texture.width = static_cast<uint32_t>(width);
+    texture.height = static_cast<uint32_t>(height);
+    for (const FloatImage &mip : mips) {
+        const std::vector<uint8_t> rgba = encode_rgba8(mip, options.srgb);
+        switch (options.format) {
+            case CookFormat::BC1:
+                texture.levels.push_back(compress_image(
+                    rgba.data(), mip.width, mip.height, BlockFormat::BC1));
+                break;
+            case CookFormat::BC5:
+                texture.levels.push_back(compress_image(
+                    rgba.data(), mip.width, mip.height, BlockFormat::BC5));
+                break;
+            case CookFormat::BC7:
+                texture.levels.push_back(compress_image(
+                    rgba.data(), mip.width, mip.height, BlockFormat::BC7));
+                break;
+            case CookFormat::RGBA8:
+                texture.levels.push_back(rgba);
+                break;
+        }
+    }
+
+    try {
+        write_texture_file(options.output, texture);
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    size_t cooked_size = 0;
+    for (const std::vector<uint8_t> &level : texture.levels) {
+        cooked_size += level.size();
+    }
+    const auto elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << options.input << " -> " << options.output << ": " << width
+              << "x" << height << ", " << texture.levels.size() << " levels, "
+              << cooked_size / 1024 << " KiB in " << elapsed.count() << " ms"
+              << std::endl;
+
+    return 0;
+}